@@ -1,6 +1,16 @@
 #include "main.hpp"
 
 #include "logger/logger.hpp"
+#include "network/disk_cache.hpp"
+#include "network/download_queue.hpp"
+#include "player/audio_mixer.hpp"
+#include "player/faststart.hpp"
+#include "player/media_player.hpp"
+#include "player/player_arena.hpp"
+#include "player/poster_frames.hpp"
+#include "player/preopen.hpp"
+#include "player/video_preview.hpp"
+#include "settings/settings.hpp"
 #include "ui/menu.hpp"
 #include "utils/display.hpp"
 #include "utils/power_manager.hpp"
@@ -10,6 +20,7 @@
 #endif
 
 #include <sndcore2/core.h>
+#include <sys/stat.h>
 #include <whb/gfx.h>
 #include <whb/proc.h>
 
@@ -22,13 +33,33 @@ int main(void) {
     AXQuit();
 
     log_message(LOG_OK, "Main", "========================Application Start========================");
-    
+
+    // Reserve the player's memory before anything else can fragment MEM2.
+    if (player_arena_init(PLAYER_ARENA_SIZE)) {
+        player_arena_set_budget(ARENA_VIDEO_FRAMES, PLAYER_ARENA_VIDEO_BUDGET);
+        player_arena_set_budget(ARENA_PACKETS, PLAYER_ARENA_PACKET_BUDGET);
+    }
+
 #ifndef PLATFORM_WIIU_LEGACY
     usb_init();
     usb_mount();
 #endif
 
+    settings_load();
+    disk_cache_init();
+#ifndef PLATFORM_WIIU_LEGACY
+    if (usb_active_drive()) {
+        mkdir(MEDIA_PATH_USB "cafemp", 0777);
+        download_queue_init(DOWNLOADS_PATH_USB);
+    } else {
+        download_queue_init(DOWNLOADS_PATH);
+    }
+#else
+    download_queue_init(DOWNLOADS_PATH);
+#endif
+    faststart_init();
     display_init();
+    audio_mixer_init();
     ui_init();
 
     while (WHBProcIsRunning()) {
@@ -36,6 +67,15 @@ int main(void) {
     }
 
     ui_shutdown();
+    player_context_shutdown();
+    audio_mixer_shutdown();
+    faststart_shutdown();
+    video_preview_shutdown();
+    poster_frames_shutdown();
+    preopen_shutdown();
+    download_queue_shutdown();
+    disk_cache_shutdown();
+    player_arena_shutdown();
 
 #ifndef PLATFORM_WIIU_LEGACY
     usb_unmount();
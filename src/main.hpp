@@ -25,7 +25,10 @@
 #define MEDIA_PATH_VIDEO "video:/"
 #define MEDIA_PATH_USB "usb:/"
 
-#define SETTINGS_PATH "settings:/settings.json"
+#define SETTINGS_PATH BASE_PATH_RAW "settings.json"
+#define CACHE_PATH BASE_PATH_RAW "cache/"
+#define DOWNLOADS_PATH BASE_PATH_RAW "Downloads/"
+#define DOWNLOADS_PATH_USB MEDIA_PATH_USB "cafemp/Downloads/"
 
 #endif
 
@@ -43,6 +46,8 @@
 #define MEDIA_PATH_PDF BASE_PATH "Library/"
 
 #define SETTINGS_PATH BASE_PATH "settings.json"
+#define CACHE_PATH BASE_PATH "cache/"
+#define DOWNLOADS_PATH BASE_PATH "Downloads/"
 
 #endif
 #define VERSION_STRING_NUMBER "v0.6.0.this.is.pain"
@@ -57,4 +62,11 @@
 
 #define TOOLTIP_BAR_HEIGHT 48
 
+// Reserved at start-up for the player; see player/player_arena.hpp.
+#define PLAYER_ARENA_SIZE (160 * 1024 * 1024)
+#define PLAYER_ARENA_VIDEO_BUDGET (128 * 1024 * 1024)
+#define PLAYER_ARENA_PACKET_BUDGET (32 * 1024 * 1024)
+
+#define PDF_STORE_BUDGET (32 * 1024 * 1024)
+
 #endif
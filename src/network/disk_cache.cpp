@@ -0,0 +1,373 @@
+#include "network/disk_cache.hpp"
+
+#include "logger/logger.hpp"
+#include "main.hpp"
+#include "utils/byte_stream.hpp"
+#include "utils/hash.hpp"
+#ifndef PLATFORM_WIIU_LEGACY
+#include "utils/usb.hpp"
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <strings.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+
+#define DC "DiskCache"
+
+#define DISK_CACHE_SD_DIR CACHE_PATH "net/"
+#define DISK_CACHE_USB_DIR MEDIA_PATH_USB "cafemp/"
+#define DISK_CACHE_SLAB "netcache.bin"
+#define DISK_CACHE_INDEX "netcache.idx"
+#define DISK_CACHE_MAGIC 0x3143434Eu // "NCC1"
+#define DISK_CACHE_INDEX_EVERY 32    // stores between index saves
+
+enum class SlotState : uint8_t { Free, Writing, Valid };
+
+struct Slot {
+    uint64_t resource = 0;
+    int32_t block = -1;
+    uint32_t len = 0;
+    uint32_t last_use = 0;
+    uint32_t generation = 0; // bumped whenever the slot is reassigned
+    SlotState state = SlotState::Free;
+};
+
+struct PendingWrite {
+    uint32_t slot;
+    uint32_t generation;
+    std::vector<uint8_t> data;
+};
+
+static std::mutex mtx; // index, queue and stats
+static std::condition_variable cv;
+static Slot slots[DISK_CACHE_SLOTS];
+static std::unordered_map<uint64_t, uint32_t> index_map;
+static uint32_t use_clock = 0;
+static std::deque<PendingWrite> pending;
+static size_t pending_bytes = 0;
+static bool ready = false;
+static bool quit = false;
+static DiskCacheStats stats = {};
+static bool evicted_since_index = false; // a slot the saved index lists has been reassigned
+
+static std::mutex file_mtx; // slab file position
+static FILE *slab = nullptr;
+static std::string slab_path, index_path;
+static std::thread writer;
+
+static uint64_t slot_key(uint64_t resource, int64_t block) { return resource ^ ((uint64_t)block * 0x9E3779B97F4A7C15ull); }
+
+static const char *volatile_params[] = {"api_key", "ApiKey", "PlaySessionId", "DeviceId"};
+
+uint64_t disk_cache_resource_id(const std::string &url, int64_t size) {
+    // Session tokens change on every request for the same file.
+    std::string stable;
+    size_t q = url.find('?');
+    stable.assign(url, 0, q == std::string::npos ? url.size() : q);
+    char sep = '?';
+    size_t pos = q;
+    while (pos != std::string::npos && pos < url.size()) {
+        size_t end = url.find('&', pos + 1);
+        std::string param = url.substr(pos + 1, (end == std::string::npos ? url.size() : end) - pos - 1);
+        bool skip = false;
+        for (const char *v : volatile_params)
+            if (!strncasecmp(param.c_str(), v, strlen(v)) && param[strlen(v)] == '=') skip = true;
+        if (!skip && !param.empty()) {
+            stable += sep;
+            stable += param;
+            sep = '&';
+        }
+        pos = end;
+    }
+    return hash_fnv1a64(&size, sizeof(size), hash_fnv1a64(stable.data(), stable.size()));
+}
+
+// Caller holds mtx.
+static void forget_slot(uint32_t i) {
+    Slot &s = slots[i];
+    if (s.state != SlotState::Free) {
+        auto it = index_map.find(slot_key(s.resource, s.block));
+        if (it != index_map.end() && it->second == i) index_map.erase(it);
+        if (s.state == SlotState::Valid) {
+            stats.used_slots--;
+            evicted_since_index = true;
+        }
+    }
+    s = Slot{0, -1, 0, 0, s.generation + 1, SlotState::Free};
+}
+
+// Least recently used slot that is not being written. Caller holds mtx.
+static int pick_victim() {
+    int victim = -1;
+    for (uint32_t i = 0; i < DISK_CACHE_SLOTS; ++i) {
+        if (slots[i].state == SlotState::Free) return (int)i;
+        if (slots[i].state == SlotState::Writing) continue;
+        if (victim < 0 || slots[i].last_use < slots[victim].last_use) victim = (int)i;
+    }
+    return victim;
+}
+
+static void save_index() {
+    ByteWriter w;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        w.u32(DISK_CACHE_MAGIC);
+        w.u32(DISK_CACHE_SLOT_SIZE);
+        w.u32(DISK_CACHE_SLOTS);
+        w.u32(use_clock);
+        w.u32(stats.used_slots);
+        evicted_since_index = false;
+        for (uint32_t i = 0; i < DISK_CACHE_SLOTS; ++i) {
+            const Slot &s = slots[i];
+            if (s.state != SlotState::Valid) continue;
+            w.u32(i);
+            w.u64(s.resource);
+            w.i32(s.block);
+            w.u32(s.len);
+            w.u32(s.last_use);
+        }
+    }
+    if (!byte_stream_write_file(index_path.c_str(), w.buf)) log_message(LOG_WARNING, DC, "Failed to write %s", index_path.c_str());
+}
+
+static void load_index() {
+    std::vector<uint8_t> data;
+    if (!byte_stream_read_file(index_path.c_str(), data, 64 + (size_t)DISK_CACHE_SLOTS * 24)) return;
+
+    ByteReader r(data.data(), data.size());
+    if (r.u32() != DISK_CACHE_MAGIC || r.u32() != DISK_CACHE_SLOT_SIZE || r.u32() != DISK_CACHE_SLOTS) return;
+
+    std::lock_guard<std::mutex> lk(mtx);
+    use_clock = r.u32();
+    uint32_t n = r.u32();
+    for (uint32_t k = 0; k < n && r.ok; ++k) {
+        uint32_t i = r.u32();
+        Slot s;
+        s.resource = r.u64();
+        s.block = r.i32();
+        s.len = r.u32();
+        s.last_use = r.u32();
+        if (!r.ok || i >= DISK_CACHE_SLOTS || s.len > DISK_CACHE_SLOT_SIZE) break;
+        s.state = SlotState::Valid;
+        slots[i] = s;
+        index_map[slot_key(s.resource, s.block)] = i;
+        stats.used_slots++;
+    }
+}
+
+static bool open_slab() {
+    const long size = (long)DISK_CACHE_SLOTS * DISK_CACHE_SLOT_SIZE;
+
+    slab = fopen(slab_path.c_str(), "r+b");
+    if (slab) {
+        fseek(slab, 0, SEEK_END);
+        if (ftell(slab) == size) {
+            setvbuf(slab, nullptr, _IONBF, 0);
+            return true;
+        }
+        fclose(slab);
+        slab = nullptr;
+    }
+
+    // New slab: whatever the old index described is gone.
+    remove(index_path.c_str());
+    log_message(LOG_DEBUG, DC, "Allocating %ld MiB slab at %s", size >> 20, slab_path.c_str());
+
+    bool allocated = false;
+#ifndef PLATFORM_WIIU_LEGACY
+    // FatFs can hand out one contiguous cluster run without writing it.
+    if (!strncmp(slab_path.c_str(), MEDIA_PATH_USB, strlen(MEDIA_PATH_USB))) allocated = usb_preallocate(slab_path.c_str(), (uint64_t)size);
+#endif
+    if (!allocated) {
+        FILE *f = fopen(slab_path.c_str(), "wb");
+        if (!f) return false;
+        allocated = fseek(f, size - 1, SEEK_SET) == 0 && fputc(0, f) != EOF;
+        allocated = fclose(f) == 0 && allocated;
+        if (!allocated) {
+            remove(slab_path.c_str());
+            return false;
+        }
+    }
+
+    slab = fopen(slab_path.c_str(), "r+b");
+    if (slab) setvbuf(slab, nullptr, _IONBF, 0);
+    return slab != nullptr;
+}
+
+static void writer_thread() {
+    if (!open_slab()) {
+        log_message(LOG_ERROR, DC, "No slab at %s, disk cache disabled", slab_path.c_str());
+        return;
+    }
+    load_index();
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        ready = true;
+    }
+    log_message(LOG_OK, DC, "Ready: %u/%u slots in use", stats.used_slots, DISK_CACHE_SLOTS);
+
+    int since_index = 0;
+    for (;;) {
+        std::deque<PendingWrite> batch;
+        bool evicted;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [] { return quit || !pending.empty(); });
+            if (quit && pending.empty()) break;
+            batch.swap(pending);
+            pending_bytes = 0;
+            evicted = evicted_since_index;
+        }
+
+        // The saved index must stop pointing at a slot before its bytes are
+        // overwritten, or a crash would leave it serving another block.
+        if (evicted) {
+            save_index();
+            since_index = 0;
+        }
+
+        // Slot order keeps the card writing forward through the slab.
+        std::sort(batch.begin(), batch.end(), [](const PendingWrite &a, const PendingWrite &b) { return a.slot < b.slot; });
+        for (PendingWrite &w : batch) {
+            bool ok;
+            {
+                std::lock_guard<std::mutex> lk(file_mtx);
+                ok = fseek(slab, (long)w.slot * DISK_CACHE_SLOT_SIZE, SEEK_SET) == 0 && fwrite(w.data.data(), 1, w.data.size(), slab) == w.data.size();
+            }
+
+            std::lock_guard<std::mutex> lk(mtx);
+            Slot &s = slots[w.slot];
+            if (s.generation != w.generation || s.state != SlotState::Writing) continue;
+            if (ok) {
+                s.state = SlotState::Valid;
+                stats.stored++;
+                stats.used_slots++;
+            } else {
+                forget_slot(w.slot);
+            }
+        }
+
+        since_index += (int)batch.size();
+        if (since_index >= DISK_CACHE_INDEX_EVERY) {
+            save_index();
+            since_index = 0;
+        }
+    }
+
+    save_index();
+}
+
+void disk_cache_init() {
+    if (writer.joinable()) return;
+
+    std::string dir = DISK_CACHE_SD_DIR;
+#ifndef PLATFORM_WIIU_LEGACY
+    if (usb_active_drive()) dir = DISK_CACHE_USB_DIR;
+#endif
+    mkdir(CACHE_PATH, 0777);
+    mkdir(dir.c_str(), 0777);
+    slab_path = dir + DISK_CACHE_SLAB;
+    index_path = dir + DISK_CACHE_INDEX;
+
+    quit = false;
+    writer = std::thread(writer_thread);
+}
+
+void disk_cache_shutdown() {
+    if (!writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = true;
+    }
+    cv.notify_all();
+    writer.join();
+
+    std::lock_guard<std::mutex> lk(mtx);
+    log_message(LOG_DEBUG, DC, "Shutdown: %u hits, %u misses, %u stored, %u dropped", stats.hits, stats.misses, stats.stored, stats.dropped);
+    ready = false;
+    if (slab) fclose(slab);
+    slab = nullptr;
+    pending.clear();
+    pending_bytes = 0;
+    index_map.clear();
+    for (Slot &s : slots) s = Slot{};
+    stats = {};
+    evicted_since_index = false;
+}
+
+bool disk_cache_read(uint64_t resource, int64_t block, std::vector<uint8_t> *out) {
+    uint32_t i, generation, len;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (!ready) return false;
+        auto it = index_map.find(slot_key(resource, block));
+        if (it == index_map.end() || slots[it->second].state != SlotState::Valid || slots[it->second].resource != resource || slots[it->second].block != (int32_t)block) {
+            stats.misses++;
+            return false;
+        }
+        i = it->second;
+        slots[i].last_use = ++use_clock;
+        generation = slots[i].generation;
+        len = slots[i].len;
+    }
+
+    out->resize(len);
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lk(file_mtx);
+        ok = fseek(slab, (long)i * DISK_CACHE_SLOT_SIZE, SEEK_SET) == 0 && fread(out->data(), 1, len, slab) == len;
+    }
+
+    // The slot may have been handed to another block while we were reading.
+    std::lock_guard<std::mutex> lk(mtx);
+    if (!ok || slots[i].generation != generation) {
+        stats.misses++;
+        return false;
+    }
+    stats.hits++;
+    return true;
+}
+
+void disk_cache_store(uint64_t resource, int64_t block, const uint8_t *data, size_t len) {
+    if (len == 0 || len > DISK_CACHE_SLOT_SIZE) return;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (!ready || quit) return;
+        if (index_map.count(slot_key(resource, block))) return;
+        if (pending_bytes + len > DISK_CACHE_MAX_PENDING) {
+            stats.dropped++;
+            return;
+        }
+
+        int victim = pick_victim();
+        if (victim < 0) {
+            stats.dropped++;
+            return;
+        }
+        forget_slot((uint32_t)victim);
+
+        Slot &s = slots[victim];
+        s.resource = resource;
+        s.block = (int32_t)block;
+        s.len = (uint32_t)len;
+        s.last_use = ++use_clock;
+        s.state = SlotState::Writing;
+        index_map[slot_key(resource, block)] = (uint32_t)victim;
+
+        pending.push_back({(uint32_t)victim, s.generation, std::vector<uint8_t>(data, data + len)});
+        pending_bytes += len;
+    }
+    cv.notify_one();
+}
+
+void disk_cache_get_stats(DiskCacheStats *out) {
+    std::lock_guard<std::mutex> lk(mtx);
+    *out = stats;
+}
@@ -0,0 +1,42 @@
+#ifndef DISK_CACHE_HPP
+#define DISK_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk LRU cache of fetched network blocks. One preallocated slab file is
+// split into fixed slots; a compact index maps (resource, block) to a slot.
+// Lookups read synchronously, stores are queued and written in batches by a
+// background thread, so fetches never wait on the card.
+#define DISK_CACHE_SLOT_SIZE (256 * 1024)
+#define DISK_CACHE_SLOTS 1024 // 256 MiB
+#define DISK_CACHE_MAX_PENDING (8 * 1024 * 1024)
+
+struct DiskCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t stored;
+    uint32_t dropped; // stores skipped because the write queue was full
+    uint32_t used_slots;
+};
+
+// Places the slab on the USB drive when one is mounted, else on the SD card.
+// Creating the slab happens on the writer thread; until then every lookup misses.
+void disk_cache_init();
+void disk_cache_shutdown();
+
+// Identifies a resource by URL (minus per-session query parameters) and size,
+// so a changed file never hits stale blocks.
+uint64_t disk_cache_resource_id(const std::string &url, int64_t size);
+
+// Fills out with the cached block; false on a miss.
+bool disk_cache_read(uint64_t resource, int64_t block, std::vector<uint8_t> *out);
+
+// Copies data into the write queue. Blocks larger than a slot are ignored.
+void disk_cache_store(uint64_t resource, int64_t block, const uint8_t *data, size_t len);
+
+void disk_cache_get_stats(DiskCacheStats *stats);
+
+#endif
@@ -0,0 +1,470 @@
+#include "network/download_queue.hpp"
+
+#include "logger/logger.hpp"
+#include "main.hpp"
+#include "network/http_client.hpp"
+#include "utils/byte_stream.hpp"
+#ifndef PLATFORM_WIIU_LEGACY
+#include "utils/usb.hpp"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+
+#define DQ "Downloads"
+
+#define DOWNLOAD_INDEX "queue.idx"
+#define DOWNLOAD_MAGIC 0x31514C44u // "DLQ1"
+#define DOWNLOAD_PART_SUFFIX ".part"
+#define DOWNLOAD_READ_SIZE (64 * 1024)
+#define DOWNLOAD_MAX_NAME 160
+
+struct Item {
+    DownloadInfo info;
+    std::string validator; // ETag or Last-Modified of the partial file
+    int attempts = 0;
+};
+
+enum class Transfer { Done, Stopped, Retry, Failed };
+
+static std::mutex mtx;
+static std::condition_variable cv;
+static std::vector<Item> items;
+static uint32_t next_id = 1;
+static std::string dir;
+static std::thread worker;
+static bool running = false;
+static bool quit = false;
+
+static std::atomic<bool> stop_transfer{false}; // pause, remove or shutdown of the active item
+static std::atomic<bool> throttled{false};
+
+static std::string part_path(const std::string &name) { return dir + name + DOWNLOAD_PART_SUFFIX; }
+
+static bool file_exists(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// Caller holds mtx.
+static Item *find_item(uint32_t id) {
+    for (Item &it : items)
+        if (it.info.id == id) return &it;
+    return nullptr;
+}
+
+static void save_queue() {
+    ByteWriter w;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        w.u32(DOWNLOAD_MAGIC);
+        w.u32(next_id);
+        w.u32((uint32_t)items.size());
+        for (const Item &it : items) {
+            w.u32(it.info.id);
+            w.str(it.info.name);
+            w.str(it.info.url);
+            w.i64(it.info.size);
+            w.i64(it.info.done);
+            w.u8((uint8_t)it.info.state);
+            w.str(it.validator);
+        }
+    }
+    if (!byte_stream_write_file((dir + DOWNLOAD_INDEX).c_str(), w.buf)) log_message(LOG_WARNING, DQ, "Failed to save the queue");
+}
+
+static void load_queue() {
+    std::vector<uint8_t> data;
+    if (!byte_stream_read_file((dir + DOWNLOAD_INDEX).c_str(), data, 4 * 1024 * 1024)) return;
+
+    ByteReader r(data.data(), data.size());
+    if (r.u32() != DOWNLOAD_MAGIC) return;
+    next_id = std::max(1u, r.u32());
+    uint32_t n = r.u32();
+    for (uint32_t i = 0; i < n && r.ok; ++i) {
+        Item it;
+        it.info.id = r.u32();
+        r.str(it.info.name, 1024);
+        r.str(it.info.url, 8192);
+        it.info.size = r.i64();
+        it.info.done = r.i64();
+        uint8_t state = r.u8();
+        r.str(it.validator, 1024);
+        if (!r.ok || state > (uint8_t)DownloadState::Failed) break;
+        it.info.state = (DownloadState)state;
+        // Interrupted by the last exit: pick it up again from the saved chunk.
+        if (it.info.state == DownloadState::Active) it.info.state = DownloadState::Queued;
+        items.push_back(std::move(it));
+    }
+}
+
+static void set_progress(uint32_t id, int64_t size, int64_t done, double bps) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (Item *it = find_item(id)) {
+        it->info.size = size;
+        it->info.done = done;
+        it->info.bps = bps;
+    }
+}
+
+// Whole chunks at chunk-aligned offsets: FatFs writes full clusters straight
+// from the buffer without reading anything back.
+static bool write_chunk(FILE *f, const uint8_t *data, size_t len) { return fwrite(data, 1, len, f) == len; }
+
+static FILE *open_part(const std::string &path, int64_t offset, int64_t size) {
+    if (offset == 0) {
+        remove(path.c_str());
+        bool allocated = false;
+#ifndef PLATFORM_WIIU_LEGACY
+        // Reserve one contiguous cluster run up front so the drive never has
+        // to search the FAT mid-download.
+        if (size > 0 && !strncmp(path.c_str(), MEDIA_PATH_USB, strlen(MEDIA_PATH_USB))) allocated = usb_preallocate(path.c_str(), (uint64_t)size);
+#endif
+        if (!allocated) {
+            FILE *f = fopen(path.c_str(), "wb");
+            if (!f) return nullptr;
+            fclose(f);
+        }
+    }
+
+    FILE *f = fopen(path.c_str(), "r+b");
+    if (!f) return nullptr;
+    setvbuf(f, nullptr, _IONBF, 0);
+    if (fseek(f, (long)offset, SEEK_SET) != 0) {
+        fclose(f);
+        return nullptr;
+    }
+    return f;
+}
+
+// Sends the ranged GET, following redirects. Returns the connection with the
+// response head read, or nullptr.
+static HttpConnection *request_from(const std::string &url_str, int64_t offset, const std::string &validator, HttpResponse *resp) {
+    HttpUrl url;
+    if (!http_parse_url(url_str, &url)) return nullptr;
+
+    std::vector<std::string> headers;
+    char range[64];
+    snprintf(range, sizeof(range), "Range: bytes=%lld-", (long long)offset);
+    headers.push_back(range);
+    // A changed file answers If-Range with 200 and the whole body.
+    if (offset > 0 && !validator.empty()) headers.push_back("If-Range: " + validator);
+
+    for (int redirects = 0; redirects <= HTTP_MAX_REDIRECTS; ++redirects) {
+        HttpConnection *c = http_connect(url);
+        if (!c) return nullptr;
+        http_set_abort_flag(c, &stop_transfer);
+        if (!http_send_request(c, "GET", url, headers, resp)) {
+            http_close(c);
+            return nullptr;
+        }
+        if (resp->status < 300 || resp->status >= 400 || resp->location.empty()) return c;
+
+        http_close(c);
+        HttpUrl next;
+        if (resp->location[0] == '/') {
+            url.path = resp->location;
+        } else if (http_parse_url(resp->location, &next)) {
+            url = next;
+        } else {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+static Transfer transfer(Item &it) {
+    const uint32_t id = it.info.id;
+    std::string part = part_path(it.info.name);
+
+    // Resume only at a chunk boundary that is known to be on disk.
+    int64_t offset = it.info.done - it.info.done % DOWNLOAD_CHUNK_SIZE;
+    if (offset > 0 && !file_exists(part)) offset = 0;
+
+    HttpResponse resp;
+    HttpConnection *c = request_from(it.info.url, offset, it.validator, &resp);
+    if (!c) return stop_transfer.load() ? Transfer::Stopped : Transfer::Retry;
+
+    if (resp.status == 416 && it.info.size >= 0 && offset >= it.info.size) {
+        http_close(c);
+        return Transfer::Done;
+    }
+    if (resp.status == 200) {
+        if (offset > 0) log_message(LOG_WARNING, DQ, "'%s' changed on the server or cannot resume, restarting", it.info.name.c_str());
+        offset = 0;
+        it.info.size = resp.content_length;
+    } else if (resp.status == 206 && resp.range_start == offset) {
+        it.info.size = resp.total_size;
+    } else {
+        log_message(LOG_ERROR, DQ, "'%s' answered with %d", it.info.name.c_str(), resp.status);
+        http_close(c);
+        return resp.status >= 500 ? Transfer::Retry : Transfer::Failed;
+    }
+    it.validator = !resp.etag.empty() ? resp.etag : resp.last_modified;
+    it.info.done = offset;
+
+    FILE *f = open_part(part, offset, it.info.size);
+    if (!f) {
+        log_message(LOG_ERROR, DQ, "Cannot write %s", part.c_str());
+        http_close(c);
+        return Transfer::Failed;
+    }
+    log_message(LOG_DEBUG, DQ, "'%s' from %lld of %lld bytes", it.info.name.c_str(), (long long)offset, (long long)it.info.size);
+
+    std::vector<uint8_t> chunk(DOWNLOAD_CHUNK_SIZE);
+    size_t fill = 0;
+    int chunks_since_save = 0;
+    int64_t window_bytes = 0;
+    auto window_start = std::chrono::steady_clock::now();
+    double bps = 0.0;
+    Transfer result = Transfer::Done;
+
+    for (;;) {
+        if (stop_transfer.load()) {
+            result = Transfer::Stopped;
+            break;
+        }
+
+        int n = http_read_body(c, chunk.data() + fill, (int)std::min<size_t>(DOWNLOAD_READ_SIZE, chunk.size() - fill));
+        if (n < 0) {
+            result = stop_transfer.load() ? Transfer::Stopped : Transfer::Retry;
+            break;
+        }
+        fill += (size_t)n;
+        window_bytes += n;
+
+        if (n == 0 || fill == chunk.size()) {
+            if (fill && !write_chunk(f, chunk.data(), fill)) {
+                log_message(LOG_ERROR, DQ, "Write failed at %lld", (long long)it.info.done);
+                result = Transfer::Failed;
+                break;
+            }
+            it.info.done += (int64_t)fill;
+            fill = 0;
+            set_progress(id, it.info.size, it.info.done, bps);
+            if (++chunks_since_save >= DOWNLOAD_SAVE_EVERY) {
+                save_queue();
+                chunks_since_save = 0;
+            }
+        }
+        if (n == 0) break;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - window_start).count();
+        // Pace reads (and so the card writes) to the throttled rate while
+        // something is playing; the socket buffer absorbs the pauses.
+        while (throttled.load() && !stop_transfer.load() && window_bytes > elapsed * DOWNLOAD_THROTTLED_BPS) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - window_start).count();
+        }
+        if (elapsed >= 1.0) {
+            bps = window_bytes / elapsed;
+            window_bytes = 0;
+            window_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    http_close(c);
+    fclose(f);
+
+    // The unwritten tail of a partial chunk is dropped; done stays aligned.
+    if (result == Transfer::Done && it.info.size >= 0 && it.info.done != it.info.size) result = Transfer::Retry;
+    if (result == Transfer::Done && it.info.size < 0) it.info.size = it.info.done;
+    set_progress(id, it.info.size, it.info.done, 0.0);
+    return result;
+}
+
+static void finish(Item &it) {
+    std::string part = part_path(it.info.name);
+    std::string final_path = dir + it.info.name;
+    remove(final_path.c_str());
+    if (rename(part.c_str(), final_path.c_str()) != 0) log_message(LOG_ERROR, DQ, "Cannot rename %s", part.c_str());
+    log_message(LOG_OK, DQ, "Finished '%s' (%lld bytes)", it.info.name.c_str(), (long long)it.info.size);
+}
+
+static void worker_thread() {
+    for (;;) {
+        Item job;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            auto next = [] { return std::find_if(items.begin(), items.end(), [](const Item &it) { return it.info.state == DownloadState::Queued; }); };
+            cv.wait(lk, [&] { return quit || next() != items.end(); });
+            if (quit) break;
+            auto it = next();
+            it->info.state = DownloadState::Active;
+            stop_transfer = false;
+            job = *it;
+        }
+
+        int64_t start_done = job.info.done;
+        Transfer result = transfer(job);
+        if (result == Transfer::Done) finish(job);
+
+        int backoff = 0;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            Item *it = find_item(job.info.id);
+            if (!it) {
+                // Removed while it was downloading.
+                remove(part_path(job.info.name).c_str());
+                continue;
+            }
+            it->validator = job.validator;
+            it->info.bps = 0.0;
+            if (result == Transfer::Done) {
+                it->info.state = DownloadState::Done;
+            } else if (result == Transfer::Failed) {
+                it->info.state = DownloadState::Failed;
+            } else if (result == Transfer::Retry) {
+                // Only consecutive failures without progress count.
+                it->attempts = job.info.done > start_done ? 1 : it->attempts + 1;
+                it->info.state = it->attempts >= DOWNLOAD_MAX_ATTEMPTS ? DownloadState::Failed : DownloadState::Queued;
+                backoff = 1 << std::min(it->attempts, 5);
+            } else if (it->info.state == DownloadState::Active) {
+                it->info.state = DownloadState::Queued;
+            }
+            if (result == Transfer::Done) it->attempts = 0;
+        }
+        save_queue();
+
+        if (backoff) {
+            log_message(LOG_WARNING, DQ, "'%s' interrupted, retrying in %d s", job.info.name.c_str(), backoff);
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait_for(lk, std::chrono::seconds(backoff), [] { return quit; });
+        }
+    }
+}
+
+static std::string sanitize_name(const std::string &name) {
+    std::string out;
+    for (char ch : name) {
+        if ((unsigned char)ch < 0x20 || strchr("\\/:*?\"<>|", ch)) ch = '_';
+        out += ch;
+    }
+    while (!out.empty() && (out.back() == ' ' || out.back() == '.')) out.pop_back();
+    while (!out.empty() && out[0] == ' ') out.erase(0, 1);
+    if (out.size() > DOWNLOAD_MAX_NAME) out.resize(DOWNLOAD_MAX_NAME);
+    return out.empty() ? "download" : out;
+}
+
+static std::string name_from_url(const std::string &url) {
+    size_t end = url.find_first_of("?#");
+    if (end == std::string::npos) end = url.size();
+    size_t start = url.rfind('/', end ? end - 1 : 0);
+    start = start == std::string::npos ? 0 : start + 1;
+    return url.substr(start, end - start);
+}
+
+// Caller holds mtx.
+static std::string unique_name(const std::string &wanted) {
+    size_t dot = wanted.rfind('.');
+    std::string stem = dot == std::string::npos || dot == 0 ? wanted : wanted.substr(0, dot);
+    std::string ext = dot == std::string::npos || dot == 0 ? "" : wanted.substr(dot);
+
+    std::string name = wanted;
+    for (int n = 2;; ++n) {
+        bool taken = file_exists(dir + name) || file_exists(part_path(name));
+        for (const Item &it : items) taken |= it.info.name == name;
+        if (!taken) return name;
+        name = stem + " (" + std::to_string(n) + ")" + ext;
+    }
+}
+
+void download_queue_init(const std::string &directory) {
+    if (running) return;
+    dir = directory;
+    mkdir(dir.c_str(), 0777);
+
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        items.clear();
+        next_id = 1;
+        load_queue();
+        quit = false;
+        running = true;
+    }
+    worker = std::thread(worker_thread);
+
+    int pending = 0;
+    for (const Item &it : items) pending += it.info.state == DownloadState::Queued;
+    log_message(LOG_OK, DQ, "Queue in %s: %d pending", dir.c_str(), pending);
+}
+
+void download_queue_shutdown() {
+    if (!running) return;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = true;
+        stop_transfer = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+    save_queue();
+
+    std::lock_guard<std::mutex> lk(mtx);
+    items.clear();
+    running = false;
+}
+
+uint32_t download_queue_add(const std::string &url, const std::string &name) {
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (!running) return 0;
+        Item it;
+        it.info.id = id = next_id++;
+        it.info.url = url;
+        it.info.name = unique_name(sanitize_name(name.empty() ? name_from_url(url) : name));
+        log_message(LOG_OK, DQ, "Queued '%s'", it.info.name.c_str());
+        items.push_back(std::move(it));
+    }
+    cv.notify_all();
+    save_queue();
+    return id;
+}
+
+void download_queue_pause(uint32_t id, bool paused) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        Item *it = find_item(id);
+        if (!it) return;
+        if (paused) {
+            if (it->info.state == DownloadState::Active) stop_transfer = true;
+            if (it->info.state == DownloadState::Active || it->info.state == DownloadState::Queued) it->info.state = DownloadState::Paused;
+        } else if (it->info.state == DownloadState::Paused || it->info.state == DownloadState::Failed) {
+            it->info.state = DownloadState::Queued;
+            it->attempts = 0;
+        }
+    }
+    cv.notify_all();
+    save_queue();
+}
+
+void download_queue_remove(uint32_t id) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = std::find_if(items.begin(), items.end(), [id](const Item &i) { return i.info.id == id; });
+        if (it == items.end()) return;
+        // The worker deletes the partial file of the active item once it lets go.
+        if (it->info.state == DownloadState::Active) stop_transfer = true;
+        else if (it->info.state != DownloadState::Done) remove(part_path(it->info.name).c_str());
+        items.erase(it);
+    }
+    save_queue();
+}
+
+void download_queue_set_throttled(bool on) { throttled = on; }
+
+std::vector<DownloadInfo> download_queue_list() {
+    std::lock_guard<std::mutex> lk(mtx);
+    std::vector<DownloadInfo> out;
+    out.reserve(items.size());
+    for (const Item &it : items) out.push_back(it.info);
+    return out;
+}
@@ -0,0 +1,46 @@
+#ifndef DOWNLOAD_QUEUE_HPP
+#define DOWNLOAD_QUEUE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Background downloads for offline playback. One item is fetched at a time
+// with range requests and written in whole chunks at chunk-aligned offsets,
+// so an interrupted download (network loss, app exit) resumes at the last
+// chunk on disk. The queue is saved next to the downloads.
+#define DOWNLOAD_CHUNK_SIZE (1024 * 1024)
+#define DOWNLOAD_SAVE_EVERY 8                 // chunks between queue saves
+#define DOWNLOAD_THROTTLED_BPS (512 * 1024)   // bytes/s while the player runs
+#define DOWNLOAD_MAX_ATTEMPTS 5               // consecutive failures before giving up
+
+enum class DownloadState : uint8_t { Queued, Active, Paused, Done, Failed };
+
+struct DownloadInfo {
+    uint32_t id = 0;
+    std::string name; // file name inside the download directory
+    std::string url;
+    int64_t size = -1; // -1 until the server reported it
+    int64_t done = 0;  // bytes safely on disk
+    DownloadState state = DownloadState::Queued;
+    double bps = 0.0; // current transfer rate of the active item
+};
+
+// dir must end with '/'. Loads the saved queue and resumes unfinished items.
+void download_queue_init(const std::string &dir);
+void download_queue_shutdown();
+
+// name may be empty to use the last path segment of the URL. Returns the item
+// id, 0 when the queue is not running.
+uint32_t download_queue_add(const std::string &url, const std::string &name);
+void download_queue_pause(uint32_t id, bool paused);
+// Drops the item and its partial file; finished files are kept.
+void download_queue_remove(uint32_t id);
+
+// While throttled the transfer rate is capped and the card sees one chunk
+// write every couple of seconds, leaving bandwidth and I/O to playback.
+void download_queue_set_throttled(bool throttled);
+
+std::vector<DownloadInfo> download_queue_list();
+
+#endif
@@ -0,0 +1,450 @@
+#include "network/http_client.hpp"
+
+#include "logger/logger.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HTTP "HTTP"
+
+#define HTTP_RECV_BUF 16384
+#define HTTP_SOCK_RCVBUF (256 * 1024)
+#define HTTP_POLL_SLICE_MS 250
+#define HTTP_MAX_HEADER_BYTES 16384
+#define HTTP_POOL_MAX 4
+
+struct HttpConnection {
+    int fd = -1;
+    std::string host;
+    int port = 0;
+    int timeout_ms = HTTP_TIMEOUT_MS;
+    const std::atomic<bool> *abort = nullptr;
+
+    uint8_t rbuf[HTTP_RECV_BUF];
+    int rpos = 0;
+    int rlen = 0;
+
+    // Body framing of the response currently being read.
+    bool in_body = false;
+    bool chunked = false;
+    int64_t body_left = 0;  // Content-Length mode, -1 = until close
+    int64_t chunk_left = 0; // chunked mode
+    bool body_done = true;
+    bool keep_alive = false;
+};
+
+static std::mutex g_pool_mtx;
+static std::vector<HttpConnection *> g_pool;
+
+static double now_ms() { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+bool http_parse_url(const std::string &url, HttpUrl *out) {
+    size_t sep = url.find("://");
+    if (sep == std::string::npos) return false;
+
+    HttpUrl u;
+    u.scheme = url.substr(0, sep);
+    for (char &ch : u.scheme) ch = (char)tolower((unsigned char)ch);
+    if (u.scheme != "http" && u.scheme != "https") return false;
+    u.port = u.scheme == "https" ? 443 : 80;
+
+    size_t host_start = sep + 3;
+    size_t path_start = url.find('/', host_start);
+    std::string hostport = url.substr(host_start, path_start == std::string::npos ? std::string::npos : path_start - host_start);
+    u.path = path_start == std::string::npos ? "/" : url.substr(path_start);
+
+    size_t at = hostport.rfind('@');
+    if (at != std::string::npos) hostport = hostport.substr(at + 1);
+
+    size_t colon = hostport.rfind(':');
+    if (colon != std::string::npos && hostport.find(']') == std::string::npos) {
+        u.port = atoi(hostport.c_str() + colon + 1);
+        hostport.resize(colon);
+    }
+    if (hostport.empty() || u.port <= 0 || u.port > 65535) return false;
+    u.host = hostport;
+
+    *out = u;
+    return true;
+}
+
+std::string http_url_to_string(const HttpUrl &url) {
+    bool default_port = (url.scheme == "http" && url.port == 80) || (url.scheme == "https" && url.port == 443);
+    return url.scheme + "://" + url.host + (default_port ? "" : ":" + std::to_string(url.port)) + url.path;
+}
+
+std::string http_url_for_log(const std::string &url) {
+    std::string out = url.substr(0, url.find('?'));
+    size_t host_start = out.find("://");
+    host_start = host_start == std::string::npos ? 0 : host_start + 3;
+    size_t at = out.find('@', host_start);
+    if (at != std::string::npos && at < out.find('/', host_start)) out.erase(host_start, at + 1 - host_start);
+    if (url.find('?') != std::string::npos) out += "?...";
+    return out;
+}
+
+static void set_timeouts(int fd, int ms) {
+    struct timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+HttpConnection *http_connect(const HttpUrl &url, int timeout_ms) {
+    if (url.scheme != "http") {
+        log_message(LOG_ERROR, HTTP, "Unsupported scheme '%s' (no TLS support)", url.scheme.c_str());
+        return nullptr;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *res = nullptr;
+    char port[8];
+    snprintf(port, sizeof(port), "%d", url.port);
+    if (getaddrinfo(url.host.c_str(), port, &hints, &res) != 0 || !res) {
+        log_message(LOG_ERROR, HTTP, "Cannot resolve %s", url.host.c_str());
+        return nullptr;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return nullptr;
+    }
+
+    set_timeouts(fd, timeout_ms);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int rcvbuf = HTTP_SOCK_RCVBUF;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    if (connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        log_message(LOG_ERROR, HTTP, "Connect to %s:%d failed (%d)", url.host.c_str(), url.port, errno);
+        close(fd);
+        freeaddrinfo(res);
+        return nullptr;
+    }
+    freeaddrinfo(res);
+
+    // Short receive slices so an abort request is noticed while blocked.
+    set_timeouts(fd, HTTP_POLL_SLICE_MS);
+
+    HttpConnection *c = new HttpConnection;
+    c->fd = fd;
+    c->host = url.host;
+    c->port = url.port;
+    c->timeout_ms = timeout_ms;
+    return c;
+}
+
+void http_close(HttpConnection *c) {
+    if (!c) return;
+    if (c->fd >= 0) close(c->fd);
+    delete c;
+}
+
+void http_set_abort_flag(HttpConnection *c, const std::atomic<bool> *abort) {
+    if (c) c->abort = abort;
+}
+
+static bool aborted(HttpConnection *c) { return c->abort && c->abort->load(std::memory_order_relaxed); }
+
+static bool send_all(HttpConnection *c, const char *data, size_t len) {
+    double deadline = now_ms() + c->timeout_ms;
+    while (len > 0) {
+        ssize_t n = send(c->fd, data, len, 0);
+        if (n > 0) {
+            data += n;
+            len -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && !aborted(c) && now_ms() < deadline) continue;
+        return false;
+    }
+    return true;
+}
+
+// Refills rbuf; returns false on close, error, timeout or abort.
+static bool fill(HttpConnection *c) {
+    double deadline = now_ms() + c->timeout_ms;
+    for (;;) {
+        if (aborted(c)) return false;
+        ssize_t n = recv(c->fd, c->rbuf, sizeof(c->rbuf), 0);
+        if (n > 0) {
+            c->rpos = 0;
+            c->rlen = (int)n;
+            return true;
+        }
+        if (n == 0) return false;
+        if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && now_ms() < deadline) continue;
+        return false;
+    }
+}
+
+static bool read_line(HttpConnection *c, std::string *line) {
+    line->clear();
+    for (;;) {
+        if (c->rpos == c->rlen && !fill(c)) return false;
+        char ch = (char)c->rbuf[c->rpos++];
+        if (ch == '\n') {
+            if (!line->empty() && line->back() == '\r') line->pop_back();
+            return true;
+        }
+        if (line->size() >= HTTP_MAX_HEADER_BYTES) return false;
+        line->push_back(ch);
+    }
+}
+
+static void parse_header(const std::string &line, HttpResponse *resp) {
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return;
+
+    std::string name = line.substr(0, colon);
+    size_t v = line.find_first_not_of(" \t", colon + 1);
+    std::string value = v == std::string::npos ? "" : line.substr(v);
+
+    if (!strcasecmp(name.c_str(), "Content-Length")) {
+        resp->content_length = strtoll(value.c_str(), nullptr, 10);
+    } else if (!strcasecmp(name.c_str(), "Content-Range")) {
+        long long a = -1, b = -1, total = -1;
+        if (sscanf(value.c_str(), "bytes %lld-%lld/%lld", &a, &b, &total) >= 2) {
+            resp->range_start = a;
+            resp->range_end = b;
+            resp->total_size = total;
+        } else if (sscanf(value.c_str(), "bytes */%lld", &total) == 1) {
+            resp->total_size = total;
+        }
+    } else if (!strcasecmp(name.c_str(), "Accept-Ranges")) {
+        resp->accept_ranges = strcasecmp(value.c_str(), "none") != 0;
+    } else if (!strcasecmp(name.c_str(), "Connection")) {
+        if (!strcasecmp(value.c_str(), "close")) resp->keep_alive = false;
+    } else if (!strcasecmp(name.c_str(), "Transfer-Encoding")) {
+        if (strstr(value.c_str(), "chunked")) resp->chunked = true;
+    } else if (!strcasecmp(name.c_str(), "ETag")) {
+        resp->etag = value;
+    } else if (!strcasecmp(name.c_str(), "Last-Modified")) {
+        resp->last_modified = value;
+    } else if (!strcasecmp(name.c_str(), "Content-Type")) {
+        resp->content_type = value;
+    } else if (!strcasecmp(name.c_str(), "Location")) {
+        resp->location = value;
+    }
+}
+
+bool http_send_request(HttpConnection *c, const char *method, const HttpUrl &url, const std::vector<std::string> &extra_headers, HttpResponse *resp, const std::string &req_body) {
+    if (!c || c->fd < 0) return false;
+
+    std::string req = std::string(method) + " " + url.path + " HTTP/1.1\r\nHost: " + url.host;
+    if (url.port != 80) req += ":" + std::to_string(url.port);
+    req += "\r\nUser-Agent: CafeMP\r\nConnection: keep-alive\r\n";
+    for (const std::string &h : extra_headers) req += h + "\r\n";
+    if (!req_body.empty()) req += "Content-Length: " + std::to_string(req_body.size()) + "\r\n";
+    req += "\r\n";
+    req += req_body;
+
+    if (!send_all(c, req.data(), req.size())) return false;
+
+    *resp = HttpResponse{};
+    std::string line;
+    do {
+        if (!read_line(c, &line)) return false;
+    } while (line.empty());
+
+    int major = 1, minor = 1;
+    if (sscanf(line.c_str(), "HTTP/%d.%d %d", &major, &minor, &resp->status) != 3) return false;
+    if (major == 1 && minor == 0) resp->keep_alive = false;
+
+    for (;;) {
+        if (!read_line(c, &line)) return false;
+        if (line.empty()) break;
+        parse_header(line, resp);
+    }
+
+    bool no_body = !strcmp(method, "HEAD") || resp->status == 204 || resp->status == 304 || (resp->status >= 100 && resp->status < 200);
+    c->in_body = !no_body;
+    c->chunked = resp->chunked;
+    c->chunk_left = 0;
+    c->body_left = resp->chunked ? 0 : resp->content_length;
+    c->body_done = no_body || (!resp->chunked && resp->content_length == 0);
+    c->keep_alive = resp->keep_alive && (resp->chunked || resp->content_length >= 0 || no_body);
+    return true;
+}
+
+static int read_raw(HttpConnection *c, void *buf, int len) {
+    if (c->rpos == c->rlen && !fill(c)) return -1;
+    int n = c->rlen - c->rpos;
+    if (n > len) n = len;
+    memcpy(buf, c->rbuf + c->rpos, (size_t)n);
+    c->rpos += n;
+    return n;
+}
+
+int http_read_body(HttpConnection *c, void *buf, int len) {
+    if (!c || c->body_done) return 0;
+
+    if (c->chunked) {
+        if (c->chunk_left == 0) {
+            std::string line;
+            if (!read_line(c, &line)) return -1;
+            if (line.empty() && !read_line(c, &line)) return -1; // CRLF after previous chunk
+            c->chunk_left = strtoll(line.c_str(), nullptr, 16);
+            if (c->chunk_left == 0) {
+                do {
+                    if (!read_line(c, &line)) return -1; // trailers
+                } while (!line.empty());
+                c->body_done = true;
+                return 0;
+            }
+        }
+        if (len > c->chunk_left) len = (int)c->chunk_left;
+        int n = read_raw(c, buf, len);
+        if (n < 0) return -1;
+        c->chunk_left -= n;
+        return n;
+    }
+
+    if (c->body_left >= 0 && len > c->body_left) len = (int)c->body_left;
+    int n = read_raw(c, buf, len);
+    if (n < 0) {
+        // Read-until-close bodies end here; anything else is truncated.
+        if (c->body_left < 0) {
+            c->body_done = true;
+            c->keep_alive = false;
+            return 0;
+        }
+        return -1;
+    }
+    if (c->body_left >= 0) {
+        c->body_left -= n;
+        if (c->body_left == 0) c->body_done = true;
+    }
+    return n;
+}
+
+bool http_drain_body(HttpConnection *c) {
+    uint8_t tmp[4096];
+    int n;
+    while ((n = http_read_body(c, tmp, sizeof(tmp))) > 0) {}
+    return n == 0;
+}
+
+bool http_reusable(HttpConnection *c) { return c && c->fd >= 0 && c->body_done && c->keep_alive; }
+
+HttpConnection *http_pool_acquire(const HttpUrl &url) {
+    {
+        std::lock_guard<std::mutex> lk(g_pool_mtx);
+        for (size_t i = 0; i < g_pool.size(); ++i) {
+            if (g_pool[i]->host == url.host && g_pool[i]->port == url.port) {
+                HttpConnection *c = g_pool[i];
+                g_pool.erase(g_pool.begin() + i);
+                return c;
+            }
+        }
+    }
+    return http_connect(url);
+}
+
+void http_pool_release(HttpConnection *c) {
+    if (!c) return;
+    if (!http_reusable(c)) {
+        http_close(c);
+        return;
+    }
+    c->abort = nullptr;
+
+    std::lock_guard<std::mutex> lk(g_pool_mtx);
+    if (g_pool.size() >= HTTP_POOL_MAX) {
+        http_close(g_pool.front());
+        g_pool.erase(g_pool.begin());
+    }
+    g_pool.push_back(c);
+}
+
+void http_pool_clear() {
+    std::lock_guard<std::mutex> lk(g_pool_mtx);
+    for (HttpConnection *c : g_pool) http_close(c);
+    g_pool.clear();
+}
+
+static bool http_request(const char *method, const std::string &url_str, const std::vector<std::string> &extra_headers, const std::string &req_body, HttpResponse *resp, std::string *body, size_t max_body, const std::atomic<bool> *abort) {
+    HttpUrl url;
+    if (!http_parse_url(url_str, &url)) {
+        log_message(LOG_ERROR, HTTP, "Bad URL '%s'", http_url_for_log(url_str).c_str());
+        return false;
+    }
+
+    for (int redirects = 0; redirects <= HTTP_MAX_REDIRECTS; ++redirects) {
+        if (abort && abort->load()) return false;
+        HttpConnection *c = http_pool_acquire(url);
+        if (!c) return false;
+        http_set_abort_flag(c, abort);
+
+        // A pooled connection may have been closed by the server meanwhile;
+        // retry once on a fresh one.
+        if (!http_send_request(c, method, url, extra_headers, resp, req_body)) {
+            http_close(c);
+            if (abort && abort->load()) return false;
+            c = http_connect(url);
+            http_set_abort_flag(c, abort);
+            if (!c || !http_send_request(c, method, url, extra_headers, resp, req_body)) {
+                http_close(c);
+                return false;
+            }
+        }
+
+        if (resp->status >= 300 && resp->status < 400 && resp->status != 304 && !resp->location.empty()) {
+            http_drain_body(c);
+            http_pool_release(c);
+            HttpUrl next;
+            if (resp->location[0] == '/') {
+                url.path = resp->location;
+            } else if (http_parse_url(resp->location, &next)) {
+                url = next;
+            } else {
+                return false;
+            }
+            continue;
+        }
+
+        if (body) {
+            body->clear();
+            char tmp[4096];
+            int n;
+            while ((n = http_read_body(c, tmp, sizeof(tmp))) > 0) {
+                if (body->size() < max_body) body->append(tmp, std::min((size_t)n, max_body - body->size()));
+            }
+            if (n < 0) {
+                http_close(c);
+                return false;
+            }
+        } else {
+            http_drain_body(c);
+        }
+        http_pool_release(c);
+        return true;
+    }
+
+    log_message(LOG_ERROR, HTTP, "Too many redirects for '%s'", http_url_for_log(url_str).c_str());
+    return false;
+}
+
+bool http_get(const std::string &url, const std::vector<std::string> &extra_headers, HttpResponse *resp, std::string *body, size_t max_body, const std::atomic<bool> *abort) { return http_request("GET", url, extra_headers, std::string(), resp, body, max_body, abort); }
+
+bool http_post(const std::string &url, const std::vector<std::string> &extra_headers, const std::string &req_body, HttpResponse *resp, std::string *body, size_t max_body, const std::atomic<bool> *abort) { return http_request("POST", url, extra_headers, req_body, resp, body, max_body, abort); }
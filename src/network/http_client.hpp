@@ -0,0 +1,79 @@
+#ifndef HTTP_CLIENT_HPP
+#define HTTP_CLIENT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define HTTP_TIMEOUT_MS 10000
+#define HTTP_MAX_REDIRECTS 5
+
+struct HttpUrl {
+    std::string scheme;
+    std::string host;
+    int port = 80;
+    std::string path; // path and query, always starts with '/'
+};
+
+struct HttpResponse {
+    int status = 0;
+    int64_t content_length = -1;
+    int64_t range_start = -1;
+    int64_t range_end = -1;
+    int64_t total_size = -1; // from Content-Range, -1 when unknown
+    bool accept_ranges = false;
+    bool keep_alive = true;
+    bool chunked = false;
+    std::string etag;
+    std::string last_modified;
+    std::string content_type;
+    std::string location;
+};
+
+struct HttpConnection;
+
+bool http_parse_url(const std::string &url, HttpUrl *out);
+std::string http_url_to_string(const HttpUrl &url);
+
+// The URL without credentials or query string, which may carry an api_key;
+// use this form for anything that gets logged.
+std::string http_url_for_log(const std::string &url);
+
+// Plain HTTP/1.1 over BSD sockets with keep-alive. There is no TLS stack in
+// the build, so https URLs are rejected.
+HttpConnection *http_connect(const HttpUrl &url, int timeout_ms = HTTP_TIMEOUT_MS);
+void http_close(HttpConnection *c);
+
+// When set, blocking reads and connects give up soon after the flag is raised.
+void http_set_abort_flag(HttpConnection *c, const std::atomic<bool> *abort);
+
+// Sends one request and parses the response head. extra_headers are complete
+// "Name: value" lines. The body must be read (or drained) before the
+// connection can carry another request. A non-empty req_body is sent with a
+// Content-Length header.
+bool http_send_request(HttpConnection *c, const char *method, const HttpUrl &url, const std::vector<std::string> &extra_headers, HttpResponse *resp, const std::string &req_body = std::string());
+
+// Reads up to len body bytes, handling Content-Length and chunked framing.
+// Returns the number of bytes read, 0 at the end of the body, -1 on error.
+int http_read_body(HttpConnection *c, void *buf, int len);
+bool http_drain_body(HttpConnection *c);
+
+// True when the last response has been fully read and the server allows the
+// connection to be reused.
+bool http_reusable(HttpConnection *c);
+
+// Idle keep-alive connections shared by one-shot requests.
+HttpConnection *http_pool_acquire(const HttpUrl &url);
+void http_pool_release(HttpConnection *c);
+void http_pool_clear();
+
+// One-shot GET following redirects; the body is truncated at max_body bytes.
+// A raised abort flag makes it fail soon, as with http_set_abort_flag.
+bool http_get(const std::string &url, const std::vector<std::string> &extra_headers, HttpResponse *resp, std::string *body, size_t max_body, const std::atomic<bool> *abort = nullptr);
+
+// One-shot POST; extra_headers should carry the Content-Type of req_body.
+bool http_post(const std::string &url, const std::vector<std::string> &extra_headers, const std::string &req_body, HttpResponse *resp, std::string *body, size_t max_body, const std::atomic<bool> *abort = nullptr);
+
+#endif
@@ -0,0 +1,316 @@
+#include "network/http_source.hpp"
+
+#include "logger/logger.hpp"
+#include "network/disk_cache.hpp"
+#include "network/http_client.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define HS "HttpSource"
+
+#define HTTP_SOURCE_MAX_RETRIES 3
+#define HTTP_SOURCE_THROUGHPUT_ALPHA 0.2
+
+enum class BlockState { Pending, Ready, Failed };
+
+struct HttpBlock {
+    BlockState state = BlockState::Pending;
+    std::vector<uint8_t> data;
+    uint64_t last_use = 0;
+    int failures = 0;
+};
+
+struct HttpSource {
+    HttpUrl url;
+    int64_t size = -1;
+    uint64_t cache_id = 0; // disk cache resource, 0 when blocks are not cached
+
+    std::mutex mtx;
+    std::condition_variable work_cv;  // workers: new block wanted or abort
+    std::condition_variable ready_cv; // reader: a block finished
+    std::map<int64_t, HttpBlock> blocks;
+    uint64_t use_clock = 0;
+
+    int64_t pos = 0;
+    std::atomic<bool> abort{false};
+
+    std::thread workers[HTTP_SOURCE_WORKERS];
+
+    HttpSourceStats stats = {};
+};
+
+static int64_t block_count(const HttpSource *src) { return (src->size + HTTP_SOURCE_BLOCK_SIZE - 1) / HTTP_SOURCE_BLOCK_SIZE; }
+
+// Next block a worker should fetch: the first missing one at or after the
+// read position, within the read-ahead window. Caller holds mtx.
+static int64_t pick_block(HttpSource *src) {
+    int64_t first = src->pos / HTTP_SOURCE_BLOCK_SIZE;
+    int64_t last = std::min(block_count(src), first + HTTP_SOURCE_READAHEAD_BLOCKS);
+    for (int64_t b = first; b < last; ++b) {
+        auto it = src->blocks.find(b);
+        if (it == src->blocks.end()) return b;
+        if (it->second.state == BlockState::Failed && it->second.failures < HTTP_SOURCE_MAX_RETRIES) return b;
+    }
+    return -1;
+}
+
+// Drops least recently used blocks outside the read-ahead window until the
+// cache is back under its limit. Caller holds mtx.
+static void evict_blocks(HttpSource *src) {
+    int64_t first = src->pos / HTTP_SOURCE_BLOCK_SIZE;
+    int64_t last = first + HTTP_SOURCE_READAHEAD_BLOCKS;
+    while ((int)src->blocks.size() > HTTP_SOURCE_CACHE_BLOCKS) {
+        auto victim = src->blocks.end();
+        for (auto it = src->blocks.begin(); it != src->blocks.end(); ++it) {
+            if (it->second.state == BlockState::Pending) continue;
+            if (it->first >= first && it->first < last) continue;
+            if (victim == src->blocks.end() || it->second.last_use < victim->second.last_use) victim = it;
+        }
+        if (victim == src->blocks.end()) break;
+        src->blocks.erase(victim);
+    }
+}
+
+static bool fetch_range(HttpSource *src, HttpConnection **conn, int64_t start, int64_t len, uint8_t *dst) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (!*conn) {
+            *conn = http_connect(src->url);
+            if (!*conn) return false;
+            http_set_abort_flag(*conn, &src->abort);
+        }
+
+        char range[64];
+        snprintf(range, sizeof(range), "Range: bytes=%lld-%lld", (long long)start, (long long)(start + len - 1));
+        HttpResponse resp;
+        if (!http_send_request(*conn, "GET", src->url, {range}, &resp)) {
+            // Keep-alive connection closed by the server; retry on a new one.
+            http_close(*conn);
+            *conn = nullptr;
+            continue;
+        }
+        if (resp.status != 206 || resp.range_start != start) {
+            log_message(LOG_ERROR, HS, "Range %lld+%lld answered with %d", (long long)start, (long long)len, resp.status);
+            http_close(*conn);
+            *conn = nullptr;
+            return false;
+        }
+
+        int64_t got = 0;
+        while (got < len) {
+            int n = http_read_body(*conn, dst + got, (int)std::min<int64_t>(len - got, 64 * 1024));
+            if (n <= 0) break;
+            got += n;
+        }
+        if (got != len || !http_drain_body(*conn) || !http_reusable(*conn)) {
+            http_close(*conn);
+            *conn = nullptr;
+        }
+        return got == len;
+    }
+    return false;
+}
+
+static void worker_thread(HttpSource *src) {
+    HttpConnection *conn = nullptr;
+
+    for (;;) {
+        int64_t b;
+        {
+            std::unique_lock<std::mutex> lk(src->mtx);
+            src->work_cv.wait(lk, [src, &b] { return src->abort.load() || (b = pick_block(src)) >= 0; });
+            if (src->abort.load()) break;
+            HttpBlock &blk = src->blocks[b];
+            blk.state = BlockState::Pending;
+            evict_blocks(src);
+        }
+
+        int64_t start = b * HTTP_SOURCE_BLOCK_SIZE;
+        int64_t len = std::min<int64_t>(HTTP_SOURCE_BLOCK_SIZE, src->size - start);
+        std::vector<uint8_t> data;
+
+        bool from_disk = src->cache_id && disk_cache_read(src->cache_id, b, &data) && (int64_t)data.size() == len;
+        bool ok = from_disk;
+        double secs = 0.0;
+        if (!from_disk) {
+            data.resize((size_t)len);
+            auto t0 = std::chrono::steady_clock::now();
+            ok = fetch_range(src, &conn, start, len, data.data());
+            secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            if (ok && src->cache_id) disk_cache_store(src->cache_id, b, data.data(), data.size());
+        }
+
+        {
+            std::lock_guard<std::mutex> lk(src->mtx);
+            HttpBlock &blk = src->blocks[b];
+            if (ok && from_disk) {
+                blk.state = BlockState::Ready;
+                blk.data.swap(data);
+                blk.last_use = ++src->use_clock;
+                src->stats.disk_hits++;
+            } else if (ok) {
+                blk.state = BlockState::Ready;
+                blk.data.swap(data);
+                blk.last_use = ++src->use_clock;
+                src->stats.bytes_fetched += (uint64_t)len;
+                src->stats.blocks_fetched++;
+                if (secs > 0.0) {
+                    double bps = len * 8.0 / secs;
+                    src->stats.throughput_bps = src->stats.throughput_bps > 0.0 ? src->stats.throughput_bps + HTTP_SOURCE_THROUGHPUT_ALPHA * (bps - src->stats.throughput_bps) : bps;
+                }
+            } else {
+                blk.state = BlockState::Failed;
+                blk.failures++;
+                src->stats.retries++;
+            }
+        }
+        src->ready_cv.notify_all();
+        src->work_cv.notify_one();
+    }
+
+    http_close(conn);
+}
+
+HttpSource *http_source_open(const char *url) {
+    HttpSource *src = new HttpSource;
+    if (!http_parse_url(url, &src->url)) {
+        log_message(LOG_ERROR, HS, "Bad URL '%s'", http_url_for_log(url).c_str());
+        delete src;
+        return nullptr;
+    }
+
+    // Probe with a one-byte range: it both confirms range support and yields
+    // the total size. Redirects are resolved here once.
+    HttpConnection *conn = nullptr;
+    HttpResponse resp;
+    for (int redirects = 0; redirects <= HTTP_MAX_REDIRECTS; ++redirects) {
+        conn = http_connect(src->url);
+        if (!conn || !http_send_request(conn, "GET", src->url, {"Range: bytes=0-0"}, &resp)) {
+            http_close(conn);
+            delete src;
+            return nullptr;
+        }
+        http_drain_body(conn);
+        if (resp.status < 300 || resp.status >= 400 || resp.location.empty()) break;
+
+        http_close(conn);
+        conn = nullptr;
+        HttpUrl next;
+        if (resp.location[0] == '/')
+            src->url.path = resp.location;
+        else if (http_parse_url(resp.location, &next))
+            src->url = next;
+    }
+    http_close(conn);
+
+    if (resp.status != 206 || resp.total_size <= 0) {
+        log_message(LOG_WARNING, HS, "No range support (status %d), not using read-ahead source", resp.status);
+        delete src;
+        return nullptr;
+    }
+
+    src->size = resp.total_size;
+    src->stats.size = src->size;
+    static_assert(HTTP_SOURCE_BLOCK_SIZE <= DISK_CACHE_SLOT_SIZE, "blocks must fit in a disk cache slot");
+    src->cache_id = disk_cache_resource_id(http_url_to_string(src->url), src->size);
+    for (int i = 0; i < HTTP_SOURCE_WORKERS; ++i) src->workers[i] = std::thread(worker_thread, src);
+
+    log_message(LOG_OK, HS, "Opened %s (%lld bytes)", http_url_for_log(http_url_to_string(src->url)).c_str(), (long long)src->size);
+    return src;
+}
+
+void http_source_abort(HttpSource *src) {
+    if (!src) return;
+    {
+        std::lock_guard<std::mutex> lk(src->mtx);
+        src->abort.store(true);
+    }
+    src->work_cv.notify_all();
+    src->ready_cv.notify_all();
+}
+
+void http_source_close(HttpSource *src) {
+    if (!src) return;
+    http_source_abort(src);
+    for (int i = 0; i < HTTP_SOURCE_WORKERS; ++i)
+        if (src->workers[i].joinable()) src->workers[i].join();
+
+    log_message(LOG_DEBUG, HS, "Closed: %u blocks fetched, %u from disk, %u hits, %u misses, %u retries, %.0f kbit/s", src->stats.blocks_fetched, src->stats.disk_hits, src->stats.block_hits, src->stats.block_misses, src->stats.retries, src->stats.throughput_bps / 1000.0);
+    delete src;
+}
+
+int http_source_read(HttpSource *src, uint8_t *buf, int size) {
+    std::unique_lock<std::mutex> lk(src->mtx);
+    if (src->abort.load()) return -1;
+    if (src->pos >= src->size) return 0;
+
+    int64_t b = src->pos / HTTP_SOURCE_BLOCK_SIZE;
+    auto it = src->blocks.find(b);
+    if (it != src->blocks.end() && it->second.state == BlockState::Ready) {
+        src->stats.block_hits++;
+    } else {
+        src->stats.block_misses++;
+        src->work_cv.notify_all();
+        src->ready_cv.wait(lk, [src, b, &it] {
+            if (src->abort.load()) return true;
+            it = src->blocks.find(b);
+            return it != src->blocks.end() && (it->second.state == BlockState::Ready || (it->second.state == BlockState::Failed && it->second.failures >= HTTP_SOURCE_MAX_RETRIES));
+        });
+        if (src->abort.load() || it->second.state != BlockState::Ready) {
+            if (!src->abort.load()) log_message(LOG_ERROR, HS, "Block %lld failed", (long long)b);
+            return -1;
+        }
+    }
+
+    HttpBlock &blk = it->second;
+    blk.last_use = ++src->use_clock;
+    int64_t off = src->pos - b * HTTP_SOURCE_BLOCK_SIZE;
+    int n = (int)std::min<int64_t>(size, (int64_t)blk.data.size() - off);
+    memcpy(buf, blk.data.data() + off, (size_t)n);
+
+    // Crossing into a new block moves the read-ahead window.
+    bool new_block = (src->pos + n) / HTTP_SOURCE_BLOCK_SIZE != b;
+    src->pos += n;
+    if (new_block) src->work_cv.notify_all();
+    return n;
+}
+
+int64_t http_source_seek(HttpSource *src, int64_t offset, int whence) {
+    std::lock_guard<std::mutex> lk(src->mtx);
+    int64_t target;
+    switch (whence) {
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = src->pos + offset;
+            break;
+        case SEEK_END:
+            target = src->size + offset;
+            break;
+        default:
+            return -1;
+    }
+    if (target < 0) return -1;
+    if (target > src->size) target = src->size;
+
+    bool moved_block = target / HTTP_SOURCE_BLOCK_SIZE != src->pos / HTTP_SOURCE_BLOCK_SIZE;
+    src->pos = target;
+    if (moved_block) src->work_cv.notify_all();
+    return target;
+}
+
+int64_t http_source_size(HttpSource *src) { return src ? src->size : -1; }
+
+void http_source_get_stats(HttpSource *src, HttpSourceStats *stats) {
+    std::lock_guard<std::mutex> lk(src->mtx);
+    *stats = src->stats;
+}
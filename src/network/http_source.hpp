@@ -0,0 +1,44 @@
+#ifndef HTTP_SOURCE_HPP
+#define HTTP_SOURCE_HPP
+
+#include <cstdint>
+
+// Random-access byte source over HTTP range requests. Fixed-size blocks are
+// fetched ahead of the read position by several workers, each on its own
+// keep-alive connection, into an LRU window that later seeks can reuse.
+#define HTTP_SOURCE_BLOCK_SIZE (256 * 1024)
+#define HTTP_SOURCE_WORKERS 3
+#define HTTP_SOURCE_READAHEAD_BLOCKS 12
+#define HTTP_SOURCE_CACHE_BLOCKS 48
+
+struct HttpSource;
+
+struct HttpSourceStats {
+    int64_t size;
+    uint64_t bytes_fetched;
+    uint32_t blocks_fetched;
+    uint32_t disk_hits; // blocks served by the disk cache
+    uint32_t block_hits;
+    uint32_t block_misses;
+    uint32_t retries;
+    double throughput_bps; // smoothed over recent block fetches
+};
+
+// Returns nullptr when the URL cannot be reached or the server does not
+// honour range requests.
+HttpSource *http_source_open(const char *url);
+void http_source_close(HttpSource *src);
+
+// Makes blocked and future reads fail quickly; used before tearing down.
+void http_source_abort(HttpSource *src);
+
+// Returns bytes read, 0 at end of resource, -1 on error.
+int http_source_read(HttpSource *src, uint8_t *buf, int size);
+
+// whence is SEEK_SET, SEEK_CUR or SEEK_END; returns the new position or -1.
+int64_t http_source_seek(HttpSource *src, int64_t offset, int whence);
+
+int64_t http_source_size(HttpSource *src);
+void http_source_get_stats(HttpSource *src, HttpSourceStats *stats);
+
+#endif
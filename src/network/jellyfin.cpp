@@ -0,0 +1,195 @@
+#include "network/jellyfin.hpp"
+
+#include "logger/logger.hpp"
+#include "main.hpp"
+#include "network/http_client.hpp"
+#include "player/media_player.hpp"
+#include "settings/settings.hpp"
+#include "utils/byte_stream.hpp"
+#include "utils/hash.hpp"
+
+#include <cstdio>
+#include <sys/stat.h>
+
+#define JF "Jellyfin"
+
+#define JELLYFIN_CACHE_DIR CACHE_PATH "jellyfin/"
+#define JELLYFIN_IMAGE_CACHE_DIR CACHE_PATH "jellyfin/img/"
+#define JELLYFIN_MAX_JSON (4 * 1024 * 1024)
+#define JELLYFIN_MAX_IMAGE (1024 * 1024)
+#define JELLYFIN_IMAGE_QUALITY 85
+#define JELLYFIN_MAX_PLAYBACK_INFO (512 * 1024)
+
+static std::string server_base() {
+    std::string url = settings_get_all()->jellyfin_url;
+    while (!url.empty() && url.back() == '/') url.pop_back();
+    return url;
+}
+
+static std::vector<std::string> auth_headers() { return {std::string("X-Emby-Token: ") + settings_get_all()->jellyfin_api_key}; }
+
+bool jellyfin_configured() { return settings_get_all()->jellyfin_url[0] && settings_get_all()->jellyfin_api_key[0]; }
+
+static std::string cache_file(const char *dir, const std::string &url) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.jfc", (unsigned long long)hash_fnv1a64(url.data(), url.size()));
+    return std::string(dir) + name;
+}
+
+static bool cache_load(const std::string &file, JellyfinCachedResponse *out, size_t max_body) {
+    std::vector<uint8_t> data;
+    return byte_stream_read_file(file.c_str(), data, max_body + 1024) && jellyfin_cache_decode(data, max_body, out);
+}
+
+static void cache_store(const char *dir, const std::string &file, const JellyfinCachedResponse &resp) {
+    mkdir(CACHE_PATH, 0777);
+    mkdir(JELLYFIN_CACHE_DIR, 0777);
+    mkdir(dir, 0777);
+
+    if (!byte_stream_write_file(file.c_str(), jellyfin_cache_encode(resp))) log_message(LOG_WARNING, JF, "Failed to write %s", file.c_str());
+}
+
+// GET through the SD cache. Immutable resources are served from the cache
+// without a request; everything else is revalidated conditionally.
+static bool cached_get(const char *dir, const std::string &url, bool immutable, size_t max_body, std::string *body, const std::atomic<bool> *abort) {
+    std::string file = cache_file(dir, url);
+    JellyfinCachedResponse cached;
+    bool have_cached = cache_load(file, &cached, max_body);
+
+    if (have_cached && immutable) {
+        body->swap(cached.body);
+        return true;
+    }
+
+    std::vector<std::string> headers = auth_headers();
+    if (have_cached) {
+        std::vector<std::string> conditional = jellyfin_revalidate_headers(cached);
+        headers.insert(headers.end(), conditional.begin(), conditional.end());
+    }
+
+    HttpResponse resp;
+    JellyfinCachedResponse fresh;
+    bool fetched = http_get(url, headers, &resp, &fresh.body, max_body, abort);
+    if (!fetched && abort && abort->load()) return false;
+    if (fetched && resp.status != 200 && resp.status != 304) log_message(LOG_ERROR, JF, "HTTP %d for %s", resp.status, http_url_for_log(url).c_str());
+
+    switch (jellyfin_cache_use(have_cached, fetched, resp.status)) {
+        case JellyfinCacheUse::Fresh:
+            fresh.etag = resp.etag;
+            fresh.last_modified = resp.last_modified;
+            cache_store(dir, file, fresh);
+            body->swap(fresh.body);
+            return true;
+        case JellyfinCacheUse::Cached:
+            if (!fetched) log_message(LOG_WARNING, JF, "Server unreachable, using cached response");
+            body->swap(cached.body);
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool jellyfin_fetch_page(const std::string &parent_id, int start_index, int limit, JellyfinPage *out, const std::atomic<bool> *abort) {
+    if (!jellyfin_configured()) return false;
+
+    std::string url = server_base() + jellyfin_items_path(parent_id, start_index, limit);
+    std::string body;
+    if (!cached_get(JELLYFIN_CACHE_DIR, url, false, JELLYFIN_MAX_JSON, &body, abort)) return false;
+    if (!jellyfin_parse_items(body.data(), body.size(), out)) return false;
+    if (parent_id.empty()) out->start_index = 0;
+    return true;
+}
+
+std::string jellyfin_image_url(const JellyfinItem &item, int width, int height) {
+    char query[128];
+    snprintf(query, sizeof(query), "?fillWidth=%d&fillHeight=%d&quality=%d", width, height, JELLYFIN_IMAGE_QUALITY);
+    std::string url = server_base() + "/Items/" + item.id + "/Images/Primary" + query;
+    if (!item.primary_image_tag.empty()) url += "&tag=" + item.primary_image_tag;
+    return url;
+}
+
+bool jellyfin_fetch_image(const JellyfinItem &item, int width, int height, std::string *bytes, const std::atomic<bool> *abort) {
+    if (!jellyfin_configured() || item.primary_image_tag.empty()) return false;
+    return cached_get(JELLYFIN_IMAGE_CACHE_DIR, jellyfin_image_url(item, width, height), true, JELLYFIN_MAX_IMAGE, bytes, abort);
+}
+
+std::string jellyfin_stream_url(const JellyfinItem &item) {
+    const char *kind = item.media_type == "Audio" ? "Audio" : "Videos";
+    return server_base() + "/" + kind + "/" + item.id + "/stream?static=true&api_key=" + settings_get_all()->jellyfin_api_key;
+}
+
+std::string jellyfin_download_url(const JellyfinItem &item) { return server_base() + "/Items/" + item.id + "/Download?api_key=" + settings_get_all()->jellyfin_api_key; }
+
+std::string jellyfin_download_name(const JellyfinItem &item) {
+    std::string ext = item.container.empty() ? (item.media_type == "Audio" ? "mp3" : "mkv") : item.container;
+    return item.name + "." + ext;
+}
+
+JellyfinDeviceCaps jellyfin_device_caps() {
+    DecodeCaps dc = media_player_get_decode_caps();
+    JellyfinDeviceCaps caps;
+    caps.hw_h264 = dc.hw_h264;
+    caps.sw_pixels_per_sec = dc.sw_pixels_per_sec;
+    caps.audio_out_rate = dc.audio_rate;
+    caps.audio_out_channels = dc.audio_channels;
+    return caps;
+}
+
+static bool fetch_playback_info(const JellyfinItem &item, const JellyfinDeviceCaps &caps, bool allow_direct_play, JellyfinPlaybackInfo *info, const std::atomic<bool> *abort) {
+    std::vector<std::string> headers = auth_headers();
+    headers.push_back("Content-Type: application/json");
+
+    HttpResponse resp;
+    std::string body;
+    std::string url = server_base() + "/Items/" + item.id + "/PlaybackInfo";
+    if (!http_post(url, headers, jellyfin_build_playback_request(caps, allow_direct_play), &resp, &body, JELLYFIN_MAX_PLAYBACK_INFO, abort)) return false;
+    if (resp.status != 200) {
+        log_message(LOG_ERROR, JF, "PlaybackInfo answered with %d", resp.status);
+        return false;
+    }
+    return jellyfin_parse_playback_info(body.data(), body.size(), info);
+}
+
+bool jellyfin_resolve_stream(const JellyfinItem &item, std::string *url, const std::atomic<bool> *abort) {
+    JellyfinDeviceCaps caps = jellyfin_device_caps();
+    JellyfinPlaybackInfo info;
+    if (!fetch_playback_info(item, caps, true, &info, abort)) {
+        if (abort && abort->load()) return false;
+        log_message(LOG_WARNING, JF, "No PlaybackInfo for '%s', trying the original file", item.name.c_str());
+        *url = jellyfin_stream_url(item);
+        return true;
+    }
+
+    JellyfinPlayDecision d = jellyfin_decide(caps, info);
+
+    // The server offered direct play of something the local check rejects
+    // (e.g. beyond the measured SW decode rate); ask again for a transcode.
+    bool server_direct = false;
+    for (const JellyfinMediaSource &src : info.sources) server_direct |= src.supports_direct_play;
+    if (d.method != JellyfinPlayMethod::DirectPlay && server_direct) {
+        JellyfinPlaybackInfo forced;
+        if (fetch_playback_info(item, caps, false, &forced, abort)) {
+            std::string why = d.reason;
+            d = jellyfin_decide(caps, forced);
+            d.reason = why;
+            info = std::move(forced);
+        }
+    }
+
+    if (d.method == JellyfinPlayMethod::Unplayable) {
+        log_message(LOG_ERROR, JF, "'%s' is not playable: %s", item.name.c_str(), d.reason.c_str());
+        return false;
+    }
+
+    const JellyfinMediaSource &src = info.sources[d.source];
+    if (d.method == JellyfinPlayMethod::DirectPlay) {
+        const char *kind = item.media_type == "Audio" ? "Audio" : "Videos";
+        *url = server_base() + "/" + kind + "/" + item.id + "/stream?static=true&MediaSourceId=" + src.id + "&PlaySessionId=" + info.play_session_id + "&api_key=" + settings_get_all()->jellyfin_api_key;
+    } else {
+        *url = server_base() + (src.has_video ? jellyfin_limit_transcode_url(src.transcoding_url) : src.transcoding_url);
+        if (url->find("api_key=") == std::string::npos && url->find("ApiKey=") == std::string::npos) *url += std::string(url->find('?') == std::string::npos ? "?" : "&") + "api_key=" + settings_get_all()->jellyfin_api_key;
+    }
+
+    log_message(LOG_OK, JF, "'%s': %s (%s)", item.name.c_str(), d.method == JellyfinPlayMethod::DirectPlay ? "direct play" : "transcode", d.reason.c_str());
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef JELLYFIN_HPP
+#define JELLYFIN_HPP
+
+#include "network/jellyfin_browse.hpp"
+#include "network/jellyfin_profile.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+bool jellyfin_configured();
+
+// Children of parent_id, or the library roots when parent_id is empty. Answers
+// are kept on the SD card and revalidated with ETag/Last-Modified; when the
+// server is unreachable the cached copy is returned.
+//
+// The fetches take an optional abort flag; raising it makes a request in
+// flight give up soon instead of running into HTTP_TIMEOUT_MS.
+bool jellyfin_fetch_page(const std::string &parent_id, int start_index, int limit, JellyfinPage *out, const std::atomic<bool> *abort = nullptr);
+
+// Primary image scaled by the server to fit width x height. Tagged URLs are
+// immutable, so cached copies are used without asking the server again.
+std::string jellyfin_image_url(const JellyfinItem &item, int width, int height);
+bool jellyfin_fetch_image(const JellyfinItem &item, int width, int height, std::string *bytes, const std::atomic<bool> *abort = nullptr);
+
+// Direct (static) stream of the original file.
+std::string jellyfin_stream_url(const JellyfinItem &item);
+
+// Original file for offline use, and a file name for it with the container as
+// extension.
+std::string jellyfin_download_url(const JellyfinItem &item);
+std::string jellyfin_download_name(const JellyfinItem &item);
+
+JellyfinDeviceCaps jellyfin_device_caps();
+
+// Negotiates with the server through PlaybackInfo using a device profile
+// built from the player's decode capabilities. Yields the original file when
+// it will play smoothly, the server's H.264 720p transcode otherwise.
+bool jellyfin_resolve_stream(const JellyfinItem &item, std::string *url, const std::atomic<bool> *abort = nullptr);
+
+#endif
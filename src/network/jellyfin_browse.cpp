@@ -0,0 +1,133 @@
+#include "network/jellyfin_browse.hpp"
+
+#include "logger/logger.hpp"
+#include "utils/byte_stream.hpp"
+
+#include <cstdio>
+#include <jansson.h>
+
+#define JF "Jellyfin"
+
+#define JELLYFIN_CACHE_MAGIC 0x3143464Au // "JFC1"
+#define JELLYFIN_MAX_VALIDATOR 256
+
+static std::string json_str(json_t *obj, const char *key) {
+    json_t *v = json_object_get(obj, key);
+    return json_is_string(v) ? json_string_value(v) : "";
+}
+
+bool jellyfin_parse_items(const char *json, size_t len, JellyfinPage *out) {
+    json_error_t error;
+    json_t *root = json_loadb(json, len, 0, &error);
+    if (!root) {
+        log_message(LOG_ERROR, JF, "Bad JSON: %s (line %d)", error.text, error.line);
+        return false;
+    }
+
+    json_t *items = json_object_get(root, "Items");
+    if (!json_is_array(items)) {
+        json_decref(root);
+        return false;
+    }
+
+    out->items.clear();
+    out->items.reserve(json_array_size(items));
+
+    size_t i;
+    json_t *it;
+    json_array_foreach(items, i, it) {
+        JellyfinItem item;
+        item.id = json_str(it, "Id");
+        if (item.id.empty()) continue;
+        item.name = json_str(it, "Name");
+        item.type = json_str(it, "Type");
+        item.media_type = json_str(it, "MediaType");
+        item.container = json_str(it, "Container");
+        item.container = item.container.substr(0, item.container.find(','));
+        item.is_folder = json_is_true(json_object_get(it, "IsFolder"));
+
+        json_t *ticks = json_object_get(it, "RunTimeTicks");
+        if (json_is_integer(ticks)) item.run_time_ticks = json_integer_value(ticks);
+
+        json_t *tags = json_object_get(it, "ImageTags");
+        if (json_is_object(tags)) item.primary_image_tag = json_str(tags, "Primary");
+
+        out->items.push_back(std::move(item));
+    }
+
+    json_t *total = json_object_get(root, "TotalRecordCount");
+    out->total = json_is_integer(total) ? (int)json_integer_value(total) : (int)out->items.size();
+    json_t *start = json_object_get(root, "StartIndex");
+    out->start_index = json_is_integer(start) ? (int)json_integer_value(start) : 0;
+
+    json_decref(root);
+    return true;
+}
+
+std::string jellyfin_items_path(const std::string &parent_id, int start_index, int limit) {
+    if (parent_id.empty()) return "/Library/MediaFolders";
+
+    char query[160];
+    snprintf(query, sizeof(query), "&StartIndex=%d&Limit=%d&SortBy=IsFolder,SortName&SortOrder=Descending,Ascending&EnableTotalRecordCount=true", start_index, limit);
+    return "/Items?ParentId=" + parent_id + query;
+}
+
+const JellyfinItem *jellyfin_pager_item(const JellyfinPager &pager, int index, int *missing_page) {
+    int page = index / JELLYFIN_PAGE_SIZE;
+    auto it = pager.pages.find(page);
+    if (it == pager.pages.end()) {
+        *missing_page = page;
+        return nullptr;
+    }
+    *missing_page = -1;
+    int off = index % JELLYFIN_PAGE_SIZE;
+    return off < (int)it->second.size() ? &it->second[off] : nullptr;
+}
+
+bool jellyfin_pager_request(JellyfinPager *pager, int page) {
+    if (page < 0 || pager->pages.count(page) || pager->requested.count(page)) return false;
+    pager->requested.insert(page);
+    return true;
+}
+
+void jellyfin_pager_store(JellyfinPager *pager, int page, bool ok, JellyfinPage *result) {
+    pager->requested.erase(page);
+    if (!ok) {
+        if (pager->total < 0) pager->total = 0;
+        return;
+    }
+    pager->total = result->total;
+    pager->pages[page] = std::move(result->items);
+}
+
+void jellyfin_pager_forget_requests(JellyfinPager *pager) { pager->requested.clear(); }
+
+std::vector<uint8_t> jellyfin_cache_encode(const JellyfinCachedResponse &resp) {
+    ByteWriter w;
+    w.u32(JELLYFIN_CACHE_MAGIC);
+    w.str(resp.etag);
+    w.str(resp.last_modified);
+    w.str(resp.body);
+    return w.buf;
+}
+
+bool jellyfin_cache_decode(const std::vector<uint8_t> &data, size_t max_body, JellyfinCachedResponse *out) {
+    ByteReader r(data.data(), data.size());
+    if (r.u32() != JELLYFIN_CACHE_MAGIC) return false;
+    r.str(out->etag, JELLYFIN_MAX_VALIDATOR);
+    r.str(out->last_modified, JELLYFIN_MAX_VALIDATOR);
+    r.str(out->body, max_body);
+    return r.ok;
+}
+
+std::vector<std::string> jellyfin_revalidate_headers(const JellyfinCachedResponse &cached) {
+    std::vector<std::string> headers;
+    if (!cached.etag.empty()) headers.push_back("If-None-Match: " + cached.etag);
+    if (!cached.last_modified.empty()) headers.push_back("If-Modified-Since: " + cached.last_modified);
+    return headers;
+}
+
+JellyfinCacheUse jellyfin_cache_use(bool have_cached, bool fetched, int status) {
+    if (fetched && status == 200) return JellyfinCacheUse::Fresh;
+    return have_cached ? JellyfinCacheUse::Cached : JellyfinCacheUse::Fail;
+}
@@ -0,0 +1,80 @@
+#ifndef JELLYFIN_BROWSE_HPP
+#define JELLYFIN_BROWSE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define JELLYFIN_PAGE_SIZE 100
+
+struct JellyfinItem {
+    std::string id;
+    std::string name;
+    std::string type;       // "CollectionFolder", "Folder", "Series", "Movie", "Audio", ...
+    std::string media_type; // "Video", "Audio" or empty for folders
+    std::string primary_image_tag;
+    std::string container; // first entry of the server's list, e.g. "mkv"
+    bool is_folder = false;
+    int64_t run_time_ticks = 0;
+};
+
+struct JellyfinPage {
+    std::vector<JellyfinItem> items;
+    int start_index = 0;
+    int total = 0;
+};
+
+// Parses an Items-style response ({"Items": [...], "TotalRecordCount": n}).
+bool jellyfin_parse_items(const char *json, size_t len, JellyfinPage *out);
+
+// Path and query for one page of parent_id's children, or of the library
+// roots when parent_id is empty.
+std::string jellyfin_items_path(const std::string &parent_id, int start_index, int limit);
+
+// The items of one folder, loaded a page at a time as rows come into view.
+struct JellyfinPager {
+    int total = -1; // unknown until the first page arrives
+    std::unordered_map<int, std::vector<JellyfinItem>> pages;
+    std::unordered_set<int> requested;
+};
+
+// The item at index, or nullptr. *missing_page is set to the page that has to
+// be fetched first, -1 when the page is there (or index is past its end).
+const JellyfinItem *jellyfin_pager_item(const JellyfinPager &pager, int index, int *missing_page);
+
+// True when page should be fetched now; it then counts as requested.
+bool jellyfin_pager_request(JellyfinPager *pager, int page);
+
+// Files a fetched page. A failed first page leaves the folder empty rather
+// than loading forever.
+void jellyfin_pager_store(JellyfinPager *pager, int page, bool ok, JellyfinPage *result);
+
+// Fetches in flight were dropped; allow the pages to be requested again.
+void jellyfin_pager_forget_requests(JellyfinPager *pager);
+
+// One cached server answer, with the validators needed to revalidate it.
+struct JellyfinCachedResponse {
+    std::string etag;
+    std::string last_modified;
+    std::string body;
+};
+
+std::vector<uint8_t> jellyfin_cache_encode(const JellyfinCachedResponse &resp);
+bool jellyfin_cache_decode(const std::vector<uint8_t> &data, size_t max_body, JellyfinCachedResponse *out);
+
+// Conditional request headers for revalidating cached.
+std::vector<std::string> jellyfin_revalidate_headers(const JellyfinCachedResponse &cached);
+
+enum class JellyfinCacheUse {
+    Fresh,  // use and store the new body
+    Cached, // not modified, or the server failed and a cached copy exists
+    Fail,
+};
+
+// fetched is false when no response came at all; status is ignored then.
+JellyfinCacheUse jellyfin_cache_use(bool have_cached, bool fetched, int status);
+
+#endif
@@ -0,0 +1,415 @@
+#include "network/jellyfin_profile.hpp"
+
+#include "logger/logger.hpp"
+#include "player/decoder_select.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <jansson.h>
+#include <strings.h>
+
+#define JP "JellyfinProfile"
+
+#define JELLYFIN_PROFILE_ASSUMED_FPS 30.0
+
+#define JELLYFIN_CONTAINERS "mp4,m4v,mov,mkv,webm,avi,ts,mpegts,m2ts,flv,ogv"
+#define JELLYFIN_AUDIO_CONTAINERS "mp3,flac,aac,m4a,m4b,ogg,oga,opus,wav,webma"
+#define JELLYFIN_AUDIO_CODECS "aac,mp3,mp2,ac3,eac3,flac,alac,opus,vorbis,pcm_s16le,pcm_s24le"
+#define JELLYFIN_SW_VIDEO_CODECS "mpeg4,msmpeg4v3,h263,mpeg1video,mpeg2video,vp8,vp9,hevc"
+
+double jellyfin_default_sw_pixels_per_sec() { return DECODER_DEFAULT_SW_PIXELS_PER_SEC; }
+
+static double sw_budget(const JellyfinDeviceCaps &caps) {
+    double rate = caps.sw_pixels_per_sec > 0.0 ? caps.sw_pixels_per_sec : DECODER_DEFAULT_SW_PIXELS_PER_SEC;
+    return rate * DECODER_SW_HEADROOM;
+}
+
+static bool in_list(const char *list, const std::string &value) {
+    if (value.empty()) return false;
+    const char *p = list;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        if (n == value.size() && !strncasecmp(p, value.c_str(), n)) return true;
+        if (!end) break;
+        p = end + 1;
+    }
+    return false;
+}
+
+struct ProfileName {
+    const char *name;
+    int id; // FFmpeg profile, constraint flags dropped
+};
+
+// Jellyfin reports H.264 profiles by name; FFmpeg and the capability table
+// use the numbers.
+static const ProfileName h264_profiles[] = {
+    {"Constrained Baseline", 66}, {"Baseline", 66}, {"Main", 77}, {"Extended", 88}, {"High", 100}, {"High 10", 110}, {"High 10 Intra", 110},
+    {"High 4:2:2", 122}, {"High 4:2:2 Intra", 122}, {"High 4:4:4 Predictive", 244}, {"High 4:4:4 Intra", 244}, {"CAVLC 4:4:4", 44},
+};
+
+static int h264_profile_id(const std::string &name) {
+    for (const ProfileName &p : h264_profiles)
+        if (!strcasecmp(p.name, name.c_str())) return p.id;
+    return 0;
+}
+
+static const DecoderCapability *table_row(DecoderKind kind, const char *codec) {
+    int n;
+    const DecoderCapability *table = decoder_table(&n);
+    for (int i = 0; i < n; ++i)
+        if (table[i].kind == kind && !strcmp(table[i].codec, codec)) return &table[i];
+    return nullptr;
+}
+
+// The hardware row needs its decoder on the console; the software one any
+// codec the direct-play profile lists.
+static bool row_present(const JellyfinDeviceCaps &caps, const DecoderCapability &cap, const VideoStreamDesc &v) {
+    if (cap.kind == DecoderKind::Hardware) return caps.hw_h264 && cap.decoder && !strcmp(cap.decoder, "h264_wiiu");
+    return v.has_default_decoder;
+}
+
+static VideoStreamDesc video_desc(const JellyfinMediaSource &src) {
+    const JellyfinVideoStream &js = src.video;
+    VideoStreamDesc v;
+    v.codec = js.codec;
+    for (char &c : v.codec)
+        c = (char)tolower((unsigned char)c);
+    bool h264 = v.codec == "h264";
+    v.profile = h264 ? h264_profile_id(js.profile) : 0;
+    v.level = js.level;
+    v.width = js.width;
+    v.height = js.height;
+    v.fps = js.fps > 0.0 ? js.fps : JELLYFIN_PROFILE_ASSUMED_FPS;
+    v.bitrate = src.bitrate;
+    v.bit_depth = js.bit_depth;
+    if (!js.pix_fmt.empty())
+        v.chroma_420 = js.pix_fmt.find("420") != std::string::npos || js.pix_fmt.find("nv12") != std::string::npos || js.pix_fmt.find("nv21") != std::string::npos;
+    else
+        v.chroma_420 = !h264 || (v.profile != 122 && v.profile != 244 && v.profile != 44);
+    v.interlaced = js.interlaced;
+    v.has_default_decoder = h264 || in_list(JELLYFIN_SW_VIDEO_CODECS, v.codec);
+    return v;
+}
+
+static json_t *condition(const char *cond, const char *property, int value) {
+    json_t *c = json_object();
+    json_object_set_new(c, "Condition", json_string(cond));
+    json_object_set_new(c, "Property", json_string(property));
+    json_object_set_new(c, "Value", json_string(std::to_string(value).c_str()));
+    json_object_set_new(c, "IsRequired", json_false());
+    return c;
+}
+
+static json_t *condition_str(const char *cond, const char *property, const std::string &value) {
+    json_t *c = json_object();
+    json_object_set_new(c, "Condition", json_string(cond));
+    json_object_set_new(c, "Property", json_string(property));
+    json_object_set_new(c, "Value", json_string(value.c_str()));
+    json_object_set_new(c, "IsRequired", json_false());
+    return c;
+}
+
+static json_t *codec_profile(const char *type, const char *codec, json_t *conditions) {
+    json_t *p = json_object();
+    json_object_set_new(p, "Type", json_string(type));
+    if (codec) json_object_set_new(p, "Codec", json_string(codec));
+    json_object_set_new(p, "Conditions", conditions);
+    return p;
+}
+
+static json_t *direct_play_profile(const char *type, const char *container, const char *video_codec, const char *audio_codec) {
+    json_t *p = json_object();
+    json_object_set_new(p, "Type", json_string(type));
+    json_object_set_new(p, "Container", json_string(container));
+    if (video_codec) json_object_set_new(p, "VideoCodec", json_string(video_codec));
+    json_object_set_new(p, "AudioCodec", json_string(audio_codec));
+    return p;
+}
+
+static json_t *transcoding_profile(const char *type, const char *container, const char *protocol, const char *video_codec, const char *audio_codec, int channels) {
+    json_t *p = json_object();
+    json_object_set_new(p, "Type", json_string(type));
+    json_object_set_new(p, "Context", json_string("Streaming"));
+    json_object_set_new(p, "Container", json_string(container));
+    json_object_set_new(p, "Protocol", json_string(protocol));
+    if (video_codec) json_object_set_new(p, "VideoCodec", json_string(video_codec));
+    json_object_set_new(p, "AudioCodec", json_string(audio_codec));
+    json_object_set_new(p, "MaxAudioChannels", json_string(std::to_string(channels).c_str()));
+    return p;
+}
+
+std::string jellyfin_build_playback_request(const JellyfinDeviceCaps &caps, bool allow_direct_play) {
+    // Everything the SW decoders get is bounded by the measured throughput.
+    // The profile has no pixel-rate property, so assume 30 fps at 16:9 and
+    // leave the exact check to jellyfin_source_playable().
+    double max_pixels = sw_budget(caps) / JELLYFIN_PROFILE_ASSUMED_FPS;
+    int sw_w = ((int)std::sqrt(max_pixels * 16.0 / 9.0)) & ~15;
+    int sw_h = ((int)(max_pixels / (sw_w > 0 ? sw_w : 1))) & ~15;
+
+    std::string video_codecs = caps.hw_h264 ? "h264," JELLYFIN_SW_VIDEO_CODECS : JELLYFIN_SW_VIDEO_CODECS ",h264";
+    std::string sw_codecs = caps.hw_h264 ? JELLYFIN_SW_VIDEO_CODECS : JELLYFIN_SW_VIDEO_CODECS ",h264";
+
+    json_t *direct = json_array();
+    json_array_append_new(direct, direct_play_profile("Video", JELLYFIN_CONTAINERS, video_codecs.c_str(), JELLYFIN_AUDIO_CODECS));
+    json_array_append_new(direct, direct_play_profile("Audio", JELLYFIN_AUDIO_CONTAINERS, nullptr, JELLYFIN_AUDIO_CODECS));
+
+    json_t *transcode = json_array();
+    json_array_append_new(transcode, transcoding_profile("Video", "ts", "hls", "h264", "aac", caps.audio_out_channels));
+    json_array_append_new(transcode, transcoding_profile("Audio", "mp3", "http", nullptr, "mp3", caps.audio_out_channels));
+
+    json_t *codecs = json_array();
+    const DecoderCapability *hw = caps.hw_h264 ? table_row(DecoderKind::Hardware, "h264") : nullptr;
+    if (hw) {
+        // Profiles up to the row's limit, which also keeps out 4:2:2 and 4:4:4.
+        std::string profiles;
+        for (const ProfileName &p : h264_profiles) {
+            if (p.id > hw->max_profile) continue;
+            if (!profiles.empty()) profiles += '|';
+            for (const char *n = p.name; *n; ++n)
+                profiles += (char)tolower((unsigned char)*n);
+        }
+        json_t *c = json_array();
+        json_array_append_new(c, condition("LessThanEqual", "Width", hw->max_width));
+        json_array_append_new(c, condition("LessThanEqual", "Height", hw->max_height));
+        json_array_append_new(c, condition("LessThanEqual", "VideoLevel", hw->max_level));
+        json_array_append_new(c, condition("LessThanEqual", "VideoBitDepth", hw->max_bit_depth));
+        json_array_append_new(c, condition_str("EqualsAny", "VideoProfile", profiles));
+        if (!hw->interlaced) json_array_append_new(c, condition_str("Equals", "IsInterlaced", "false"));
+        json_array_append_new(codecs, codec_profile("Video", "h264", c));
+    }
+    const DecoderCapability *sw = table_row(DecoderKind::Software, "*");
+    if (sw) {
+        json_t *c = json_array();
+        json_array_append_new(c, condition("LessThanEqual", "Width", sw_w));
+        json_array_append_new(c, condition("LessThanEqual", "Height", sw_h));
+        json_array_append_new(c, condition("LessThanEqual", "VideoBitDepth", sw->max_bit_depth));
+        if (!sw->interlaced) json_array_append_new(c, condition_str("Equals", "IsInterlaced", "false"));
+        json_array_append_new(codecs, codec_profile("Video", sw_codecs.c_str(), c));
+    }
+    {
+        json_t *c = json_array();
+        json_array_append_new(c, condition("LessThanEqual", "AudioChannels", caps.max_audio_channels));
+        json_array_append_new(codecs, codec_profile("VideoAudio", nullptr, c));
+    }
+    {
+        json_t *c = json_array();
+        json_array_append_new(c, condition("LessThanEqual", "AudioChannels", caps.max_audio_channels));
+        json_array_append_new(codecs, codec_profile("Audio", nullptr, c));
+    }
+
+    json_t *profile = json_object();
+    json_object_set_new(profile, "Name", json_string("CafeMP"));
+    json_object_set_new(profile, "MaxStreamingBitrate", json_integer(caps.max_bitrate));
+    json_object_set_new(profile, "MaxStaticBitrate", json_integer(caps.max_bitrate));
+    json_object_set_new(profile, "MusicStreamingTranscodingBitrate", json_integer(192000));
+    json_object_set_new(profile, "DirectPlayProfiles", direct);
+    json_object_set_new(profile, "TranscodingProfiles", transcode);
+    json_object_set_new(profile, "CodecProfiles", codecs);
+    json_object_set_new(profile, "SubtitleProfiles", json_array());
+
+    json_t *root = json_object();
+    json_object_set_new(root, "DeviceProfile", profile);
+    json_object_set_new(root, "MaxStreamingBitrate", json_integer(caps.max_bitrate));
+    json_object_set_new(root, "EnableDirectPlay", json_boolean(allow_direct_play));
+    json_object_set_new(root, "EnableDirectStream", json_false());
+    json_object_set_new(root, "EnableTranscoding", json_true());
+    json_object_set_new(root, "AutoOpenLiveStream", json_true());
+
+    char *dump = json_dumps(root, JSON_COMPACT);
+    std::string body = dump ? dump : "";
+    free(dump);
+    json_decref(root);
+    return body;
+}
+
+static std::string json_str(json_t *obj, const char *key) {
+    json_t *v = json_object_get(obj, key);
+    return json_is_string(v) ? json_string_value(v) : "";
+}
+
+static int json_int(json_t *obj, const char *key) {
+    json_t *v = json_object_get(obj, key);
+    return json_is_number(v) ? (int)json_number_value(v) : 0;
+}
+
+static void parse_source(json_t *js, JellyfinMediaSource *src) {
+    src->id = json_str(js, "Id");
+    src->container = json_str(js, "Container");
+    json_t *bitrate = json_object_get(js, "Bitrate");
+    if (json_is_number(bitrate)) src->bitrate = (int64_t)json_number_value(bitrate);
+    src->supports_direct_play = json_is_true(json_object_get(js, "SupportsDirectPlay"));
+    src->supports_transcoding = json_is_true(json_object_get(js, "SupportsTranscoding"));
+    src->transcoding_url = json_str(js, "TranscodingUrl");
+
+    json_t *default_audio = json_object_get(js, "DefaultAudioStreamIndex");
+    int audio_index = json_is_integer(default_audio) ? (int)json_integer_value(default_audio) : -1;
+    bool have_audio = false;
+
+    size_t i;
+    json_t *st;
+    json_array_foreach(json_object_get(js, "MediaStreams"), i, st) {
+        std::string type = json_str(st, "Type");
+        if (type == "Video" && !src->has_video) {
+            src->has_video = true;
+            JellyfinVideoStream &v = src->video;
+            v.codec = json_str(st, "Codec");
+            v.profile = json_str(st, "Profile");
+            v.pix_fmt = json_str(st, "PixelFormat");
+            v.width = json_int(st, "Width");
+            v.height = json_int(st, "Height");
+            v.level = json_int(st, "Level");
+            int depth = json_int(st, "BitDepth");
+            if (depth > 0) v.bit_depth = depth;
+            v.interlaced = json_is_true(json_object_get(st, "IsInterlaced"));
+            json_t *fps = json_object_get(st, "RealFrameRate");
+            if (!json_is_number(fps)) fps = json_object_get(st, "AverageFrameRate");
+            if (json_is_number(fps)) v.fps = json_number_value(fps);
+        } else if (type == "Audio" && (!have_audio || json_int(st, "Index") == audio_index)) {
+            have_audio = true;
+            src->audio_codec = json_str(st, "Codec");
+            src->audio_channels = json_int(st, "Channels");
+        }
+    }
+}
+
+bool jellyfin_parse_playback_info(const char *json, size_t len, JellyfinPlaybackInfo *out) {
+    json_error_t error;
+    json_t *root = json_loadb(json, len, 0, &error);
+    if (!root) {
+        log_message(LOG_ERROR, JP, "Bad PlaybackInfo JSON: %s (line %d)", error.text, error.line);
+        return false;
+    }
+
+    json_t *sources = json_object_get(root, "MediaSources");
+    if (!json_is_array(sources)) {
+        json_t *code = json_object_get(root, "ErrorCode");
+        log_message(LOG_ERROR, JP, "PlaybackInfo without media sources (%s)", json_is_string(code) ? json_string_value(code) : "no error code");
+        json_decref(root);
+        return false;
+    }
+
+    out->play_session_id = json_str(root, "PlaySessionId");
+    out->sources.clear();
+
+    size_t i;
+    json_t *js;
+    json_array_foreach(sources, i, js) {
+        JellyfinMediaSource src;
+        parse_source(js, &src);
+        out->sources.push_back(std::move(src));
+    }
+
+    json_decref(root);
+    return true;
+}
+
+bool jellyfin_source_playable(const JellyfinDeviceCaps &caps, const JellyfinMediaSource &src, std::string *reason) {
+    char buf[128];
+
+    if (src.bitrate > 0 && src.bitrate > caps.max_bitrate) {
+        snprintf(buf, sizeof(buf), "bitrate %lld above %d", (long long)src.bitrate, caps.max_bitrate);
+        *reason = buf;
+        return false;
+    }
+
+    if (!src.audio_codec.empty() && !in_list(JELLYFIN_AUDIO_CODECS, src.audio_codec)) {
+        *reason = "audio codec " + src.audio_codec;
+        return false;
+    }
+    if (src.audio_channels > caps.max_audio_channels) {
+        snprintf(buf, sizeof(buf), "%d audio channels", src.audio_channels);
+        *reason = buf;
+        return false;
+    }
+
+    if (!src.has_video) return true;
+
+    // The first decoder that takes the stream in real time, as for a local file.
+    VideoStreamDesc v = video_desc(src);
+    if (!v.has_default_decoder) {
+        *reason = "video codec " + src.video.codec;
+        return false;
+    }
+    int n;
+    const DecoderCapability *table = decoder_table(&n);
+    std::string why;
+    for (int i = 0; i < n; ++i) {
+        if (!row_present(caps, table[i], v)) continue;
+        bool realtime = false;
+        std::string r;
+        if (decoder_fits(table[i], v, caps.sw_pixels_per_sec, &realtime, &r) && realtime) return true;
+        if (why.empty()) why = r;
+    }
+    *reason = why.empty() ? "no decoder for " + src.video.codec : why;
+    return false;
+}
+
+JellyfinPlayDecision jellyfin_decide(const JellyfinDeviceCaps &caps, const JellyfinPlaybackInfo &info) {
+    JellyfinPlayDecision d;
+
+    for (size_t i = 0; i < info.sources.size(); ++i) {
+        const JellyfinMediaSource &src = info.sources[i];
+        if (!src.supports_direct_play) continue;
+        std::string why;
+        if (jellyfin_source_playable(caps, src, &why)) {
+            d.method = JellyfinPlayMethod::DirectPlay;
+            d.source = (int)i;
+            d.reason = "direct play";
+            return d;
+        }
+        d.reason = why;
+    }
+
+    for (size_t i = 0; i < info.sources.size(); ++i) {
+        const JellyfinMediaSource &src = info.sources[i];
+        if (!src.supports_transcoding || src.transcoding_url.empty()) continue;
+        d.method = JellyfinPlayMethod::Transcode;
+        d.source = (int)i;
+        if (d.reason.empty()) d.reason = "server chose transcode";
+        return d;
+    }
+
+    if (d.reason.empty()) d.reason = "no playable source";
+    return d;
+}
+
+// Replaces (case-insensitively) or appends one query parameter.
+static std::string set_query_param(const std::string &url, const char *key, const std::string &value) {
+    size_t q = url.find('?');
+    if (q == std::string::npos) return url + "?" + key + "=" + value;
+
+    size_t klen = strlen(key);
+    size_t pos = q + 1;
+    while (pos < url.size()) {
+        size_t end = url.find('&', pos);
+        if (end == std::string::npos) end = url.size();
+        size_t eq = url.find('=', pos);
+        if (eq != std::string::npos && eq < end && eq - pos == klen && !strncasecmp(url.c_str() + pos, key, klen)) return url.substr(0, eq + 1) + value + url.substr(end);
+        pos = end + 1;
+    }
+    return url + "&" + key + "=" + value;
+}
+
+static int query_int(const std::string &url, const char *key) {
+    size_t klen = strlen(key);
+    size_t pos = url.find('?');
+    while (pos != std::string::npos && pos < url.size()) {
+        pos++;
+        if (!strncasecmp(url.c_str() + pos, key, klen) && url[pos + klen] == '=') return atoi(url.c_str() + pos + klen + 1);
+        pos = url.find('&', pos);
+    }
+    return 0;
+}
+
+std::string jellyfin_limit_transcode_url(const std::string &url) {
+    std::string out = set_query_param(url, "MaxWidth", std::to_string(JELLYFIN_TRANSCODE_MAX_WIDTH));
+    out = set_query_param(out, "MaxHeight", std::to_string(JELLYFIN_TRANSCODE_MAX_HEIGHT));
+    int bitrate = query_int(out, "VideoBitrate");
+    if (bitrate <= 0 || bitrate > JELLYFIN_TRANSCODE_BITRATE) out = set_query_param(out, "VideoBitrate", std::to_string(JELLYFIN_TRANSCODE_BITRATE));
+    return out;
+}
@@ -0,0 +1,86 @@
+#ifndef JELLYFIN_PROFILE_HPP
+#define JELLYFIN_PROFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Transcodes are always H.264 720p with stereo AAC, the one format the HW
+// decoder is guaranteed to sustain.
+#define JELLYFIN_TRANSCODE_MAX_WIDTH 1280
+#define JELLYFIN_TRANSCODE_MAX_HEIGHT 720
+#define JELLYFIN_TRANSCODE_BITRATE 4000000
+
+// What the player can sustain, gathered from the decoders at runtime. Video
+// limits come from the decoder_select capability table.
+struct JellyfinDeviceCaps {
+    bool hw_h264 = false;           // h264_wiiu present
+    double sw_pixels_per_sec = 0.0; // measured SW decode throughput, 0 when never measured
+    int audio_out_rate = 48000;
+    int audio_out_channels = 2;
+    int max_audio_channels = 6; // downmixed to audio_out_channels by swresample
+    int max_bitrate = 20000000;
+};
+
+struct JellyfinVideoStream {
+    std::string codec;
+    std::string profile; // as Jellyfin names it, e.g. "High", "Main 10"
+    std::string pix_fmt; // FFmpeg name, empty when the server does not say
+    int width = 0;
+    int height = 0;
+    double fps = 0.0;
+    int level = 0;
+    int bit_depth = 8;
+    bool interlaced = false;
+};
+
+struct JellyfinMediaSource {
+    std::string id;
+    std::string container;
+    int64_t bitrate = 0;
+    bool supports_direct_play = false;
+    bool supports_transcoding = false;
+    std::string transcoding_url;
+    bool has_video = false;
+    JellyfinVideoStream video;
+    std::string audio_codec;
+    int audio_channels = 0;
+};
+
+struct JellyfinPlaybackInfo {
+    std::string play_session_id;
+    std::vector<JellyfinMediaSource> sources;
+};
+
+enum class JellyfinPlayMethod { DirectPlay, Transcode, Unplayable };
+
+struct JellyfinPlayDecision {
+    JellyfinPlayMethod method = JellyfinPlayMethod::Unplayable;
+    int source = -1;
+    std::string reason;
+};
+
+// SW decode throughput assumed until a local file has been played.
+double jellyfin_default_sw_pixels_per_sec();
+
+// PlaybackInfo request body: a DeviceProfile derived from caps plus the
+// bitrate limit. allow_direct_play = false forces the server to transcode.
+std::string jellyfin_build_playback_request(const JellyfinDeviceCaps &caps, bool allow_direct_play);
+
+bool jellyfin_parse_playback_info(const char *json, size_t len, JellyfinPlaybackInfo *out);
+
+// Local check of one source against caps: the video goes through the same
+// decoder_fits test as a local file, so direct play means some decoder takes
+// it in real time. The profile can only express per-dimension limits; this
+// also weighs resolution x frame rate against the measured SW throughput.
+bool jellyfin_source_playable(const JellyfinDeviceCaps &caps, const JellyfinMediaSource &src, std::string *reason);
+
+// Direct play only when the server offers it and the local check agrees,
+// otherwise the server's transcode.
+JellyfinPlayDecision jellyfin_decide(const JellyfinDeviceCaps &caps, const JellyfinPlaybackInfo &info);
+
+// Caps the resolution and bitrate of a server transcoding URL to the 720p target.
+std::string jellyfin_limit_transcode_url(const std::string &url);
+
+#endif
@@ -0,0 +1,148 @@
+#include "player/abr.hpp"
+
+#include <algorithm>
+
+#define ABR_FAST_ALPHA 0.5
+#define ABR_SLOW_ALPHA 0.1
+#define ABR_LOAD_ALPHA 0.4
+#define ABR_MIN_NET_SECONDS 0.05 // shorter transfers say more about latency than bandwidth
+
+#define ABR_DOWN_MARGIN 0.9 // the current bitrate must fit in 90% of the throughput
+#define ABR_UP_MARGIN 0.7   // a higher one must fit in 70%
+#define ABR_LOAD_HIGH 0.85  // decoder busy for 85% of each frame's time
+#define ABR_LOAD_UP 0.65
+#define ABR_LATE_FRACTION 0.5 // mean lateness above half a frame
+
+#define ABR_UP_HOLD_SECONDS 10.0
+#define ABR_MIN_SWITCH_SECONDS 2.0
+#define ABR_LOW_BUFFER_SECONDS 2.0
+#define ABR_PENALTY_SECONDS 60.0
+
+static double pixels(const AbrVariant &v) { return (double)v.width * v.height; }
+
+static double pixel_ratio(const AbrVariant &to, const AbrVariant &from) { return pixels(from) > 0.0 && pixels(to) > 0.0 ? pixels(to) / pixels(from) : 1.0; }
+
+void abr_init(AbrController *abr, const std::vector<AbrVariant> &variants, int start) {
+    *abr = AbrController{};
+    abr->variants = variants;
+    if (abr->variants.size() > ABR_MAX_VARIANTS) abr->variants.resize(ABR_MAX_VARIANTS);
+    abr->current = start < 0 ? 0 : start >= (int)abr->variants.size() ? (int)abr->variants.size() - 1 : start;
+}
+
+std::vector<int> abr_spread(int n, int keep) {
+    std::vector<int> out;
+    if (n <= 0 || keep <= 0) return out;
+    if (keep >= n) keep = n;
+    for (int i = 0; i < keep; ++i)
+        out.push_back(keep == 1 ? n - 1 : (int)((int64_t)i * (n - 1) / (keep - 1)));
+    return out;
+}
+
+static bool same_time_base(const AbrCandidate &a, const AbrCandidate &b) { return (int64_t)a.time_base_num * b.time_base_den == (int64_t)b.time_base_num * a.time_base_den; }
+
+static bool same_audio(const AbrCandidate &a, const AbrCandidate &b) { return a.audio_codec_id == b.audio_codec_id && a.audio_sample_rate == b.audio_sample_rate && a.audio_channels == b.audio_channels; }
+
+int abr_build_ladder(const std::vector<AbrCandidate> &streams, int ref, double budget_bps, std::vector<AbrVariant> *variants, std::vector<AbrLadderEntry> *ladder) {
+    variants->clear();
+    ladder->clear();
+    if (ref < 0 || ref >= (int)streams.size()) return -1;
+    const AbrCandidate &r = streams[ref];
+    bool ref_audio = r.audio_idx >= 0;
+
+    std::vector<const AbrCandidate *> kept;
+    for (const AbrCandidate &c : streams) {
+        if (c.attached_pic || c.codec_id != r.codec_id || !same_time_base(c, r)) continue;
+        if (ref_audio && c.audio_idx >= 0 && !same_audio(c, r)) continue;
+        if (c.variant.bitrate <= 0) continue;
+        kept.push_back(&c);
+    }
+    if (kept.size() < 2) return -1;
+
+    // A long ladder is thinned to a spread of bitrates, lowest and highest kept.
+    std::stable_sort(kept.begin(), kept.end(), [](const AbrCandidate *a, const AbrCandidate *b) { return a->variant.bitrate < b->variant.bitrate; });
+    int start = 0;
+    for (int k : abr_spread((int)kept.size(), ABR_MAX_VARIANTS)) {
+        variants->push_back(kept[k]->variant);
+        ladder->push_back({kept[k]->video_idx, ref_audio ? kept[k]->audio_idx : -1});
+        if (kept[k]->variant.bitrate <= budget_bps) start = (int)variants->size() - 1;
+    }
+    return start;
+}
+
+double abr_throughput(const AbrController *abr) { return abr->tput_fast < abr->tput_slow ? abr->tput_fast : abr->tput_slow; }
+
+static void switch_to(AbrController *abr, int idx) {
+    // The decoder load follows the pixel count until it is measured again.
+    abr->decode_load *= pixel_ratio(abr->variants[idx], abr->variants[abr->current]);
+    abr->current = idx;
+    abr->since_switch = 0.0;
+    abr->up_stable = 0.0;
+    abr->switches++;
+}
+
+int abr_update(AbrController *abr, const AbrSample &s) {
+    int n = (int)abr->variants.size();
+    if (n <= 1) return abr->current;
+
+    abr->since_switch += s.seconds;
+    for (int i = 0; i < n; ++i) {
+        abr->penalty[i] -= s.seconds;
+        if (abr->penalty[i] < 0.0) abr->penalty[i] = 0.0;
+    }
+
+    if (s.net_seconds >= ABR_MIN_NET_SECONDS && s.net_bytes) {
+        double bps = s.net_bytes * 8.0 / s.net_seconds;
+        if (abr->tput_slow <= 0.0) {
+            abr->tput_fast = abr->tput_slow = bps;
+        } else {
+            abr->tput_fast += ABR_FAST_ALPHA * (bps - abr->tput_fast);
+            abr->tput_slow += ABR_SLOW_ALPHA * (bps - abr->tput_slow);
+        }
+    }
+    if (s.frames_decoded > 0 && s.frame_duration > 0.0) {
+        double load = s.decode_seconds / (s.frames_decoded * s.frame_duration);
+        abr->decode_load = abr->decode_load > 0.0 ? abr->decode_load + ABR_LOAD_ALPHA * (load - abr->decode_load) : load;
+    }
+
+    const AbrVariant &cur = abr->variants[abr->current];
+    double tput = abr_throughput(abr);
+    double late = s.frames_shown > 0 ? s.lateness_seconds / s.frames_shown : 0.0;
+
+    // Lateness and decoder load rise before frames are dropped; either one
+    // is reason enough to leave a variant.
+    bool decode_trouble = s.frames_dropped > 0 || abr->decode_load > ABR_LOAD_HIGH || (s.frame_duration > 0.0 && late > s.frame_duration * ABR_LATE_FRACTION);
+    bool net_trouble = tput > 0.0 && cur.bitrate > tput * ABR_DOWN_MARGIN;
+
+    int target = abr->current;
+    if (net_trouble) {
+        target = 0;
+        for (int i = abr->current - 1; i > 0; --i)
+            if (abr->variants[i].bitrate <= tput * ABR_UP_MARGIN) {
+                target = i;
+                break;
+            }
+    }
+    if (decode_trouble && abr->current > 0) {
+        int i = abr->current - 1;
+        while (i > 0 && pixels(abr->variants[i]) >= pixels(cur)) i--;
+        if (i < target) target = i;
+        abr->penalty[abr->current] = ABR_PENALTY_SECONDS;
+    }
+
+    if (target < abr->current) {
+        // Back-to-back switches are held off unless the buffer is running dry.
+        if (abr->since_switch >= ABR_MIN_SWITCH_SECONDS || s.buffer_seconds < ABR_LOW_BUFFER_SECONDS) switch_to(abr, target);
+        return abr->current;
+    }
+
+    if (abr->current + 1 < n && abr->penalty[abr->current + 1] <= 0.0) {
+        const AbrVariant &next = abr->variants[abr->current + 1];
+        bool net_ok = tput > 0.0 && next.bitrate <= tput * ABR_UP_MARGIN;
+        bool decode_ok = !decode_trouble && abr->decode_load * pixel_ratio(next, cur) <= ABR_LOAD_UP;
+        abr->up_stable = net_ok && decode_ok ? abr->up_stable + s.seconds : 0.0;
+        if (abr->up_stable >= ABR_UP_HOLD_SECONDS && abr->since_switch >= ABR_UP_HOLD_SECONDS) switch_to(abr, abr->current + 1);
+    } else {
+        abr->up_stable = 0.0;
+    }
+    return abr->current;
+}
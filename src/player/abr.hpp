@@ -0,0 +1,87 @@
+#ifndef ABR_HPP
+#define ABR_HPP
+
+#include <cstdint>
+#include <vector>
+
+#define ABR_MAX_VARIANTS 16
+
+struct AbrVariant {
+    int64_t bitrate = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// One measurement window, as deltas since the previous sample.
+struct AbrSample {
+    double seconds = 0.0;        // wall time covered
+    uint64_t net_bytes = 0;      // payload bytes demuxed
+    double net_seconds = 0.0;    // time spent blocked inside the demuxer
+    int frames_decoded = 0;      // frames out of the video decoder
+    double decode_seconds = 0.0; // time spent inside the video decoder
+    int frames_shown = 0;
+    int frames_dropped = 0;
+    double lateness_seconds = 0.0; // summed lateness of shown frames
+    double frame_duration = 0.0;   // nominal, 1 / fps
+    double buffer_seconds = 0.0;   // demuxed video not yet decoded
+};
+
+struct AbrController {
+    std::vector<AbrVariant> variants; // ascending bitrate
+    int current = 0;
+
+    double tput_fast = 0.0; // bit/s, short and long EWMA
+    double tput_slow = 0.0;
+    double decode_load = 0.0; // decode time / frame time of the current variant
+
+    double since_switch = 0.0;
+    double up_stable = 0.0; // how long an up-switch has looked safe
+    double penalty[ABR_MAX_VARIANTS] = {}; // seconds a variant stays locked after it overloaded the decoder
+    int switches = 0;
+};
+
+// Which of n variants sorted by bitrate to keep when there are more than
+// keep: both ends and an even spread between them, ascending.
+std::vector<int> abr_spread(int n, int keep);
+
+// A video stream of an HLS/DASH input, with the audio stream of its program.
+// Codec ids and time bases are compared as given, never interpreted.
+struct AbrCandidate {
+    int video_idx = -1;
+    int codec_id = 0;
+    int time_base_num = 0;
+    int time_base_den = 1;
+    bool attached_pic = false;
+    AbrVariant variant;
+
+    int audio_idx = -1; // -1 when the program carries no audio
+    int audio_codec_id = 0;
+    int audio_sample_rate = 0;
+    int audio_channels = 0;
+};
+
+struct AbrLadderEntry {
+    int video_idx;
+    int audio_idx; // -1 when the variants share one audio stream
+};
+
+// Keeps the candidates that can replace ref without reopening a decoder (same
+// codec and time base, same audio format when both carry audio), sorted by
+// ascending bitrate and thinned with abr_spread. The start variant is the
+// highest that fits budget_bps, else the lowest. Returns it, or -1 when fewer
+// than two variants are left.
+int abr_build_ladder(const std::vector<AbrCandidate> &streams, int ref, double budget_bps, std::vector<AbrVariant> *variants, std::vector<AbrLadderEntry> *ladder);
+
+// variants must be sorted by ascending bitrate.
+void abr_init(AbrController *abr, const std::vector<AbrVariant> &variants, int start);
+
+// Feeds one sample and returns the variant to play. Switches down as soon as
+// throughput or decode headroom run short (before frames are dropped), and up
+// one step at a time only after the next variant has looked sustainable for a
+// while.
+int abr_update(AbrController *abr, const AbrSample &s);
+
+// Throughput estimate used for decisions: the lower of both averages.
+double abr_throughput(const AbrController *abr);
+
+#endif
@@ -0,0 +1,283 @@
+#include "player/audio_mixer.hpp"
+
+#include "logger/logger.hpp"
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#define AM "AudioMixer"
+
+#define PERIOD_SAMPLES (MIXER_PERIOD_FRAMES * MIXER_CHANNELS)
+#define GAIN_UNITY (1 << 15) // gains are Q15
+#define GAIN_MAX (2 << 15)
+
+struct MixSlot {
+    MixerSource id = 0; // 0: free; the ring may still wait to be freed
+    std::vector<int16_t> ring;
+    uint32_t rpos = 0; // samples
+    uint32_t fill = 0;
+    bool paused = true;
+    bool released = false; // owned by the mixer, freed once drained or faded out
+    int32_t gain = GAIN_UNITY;
+    int32_t target = GAIN_UNITY;
+    uint32_t ramp_left = 0; // frames until gain reaches target
+};
+
+static struct {
+    std::mutex mtx;
+    SDL_AudioDeviceID dev = 0;
+    double latency = 0.0;
+    MixerSource next_id = 1;
+    MixSlot slots[MIXER_MAX_SOURCES];
+
+    // Callback scratch.
+    int32_t acc[PERIOD_SAMPLES];
+    int16_t tmp[PERIOD_SAMPLES];
+} g_mixer;
+
+// Mixing kernels. Espresso has no integer SIMD, so these are fixed-point
+// loops without branches in the body, unrolled by one stereo pair or two so
+// the loads, multiplies and adds of neighbouring samples overlap.
+
+static void mix_add(int32_t *acc, const int16_t *s, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[i] += s[i];
+        acc[i + 1] += s[i + 1];
+        acc[i + 2] += s[i + 2];
+        acc[i + 3] += s[i + 3];
+    }
+    for (; i < n; ++i)
+        acc[i] += s[i];
+}
+
+static void mix_add_gain(int32_t *acc, const int16_t *s, int n, int32_t gain) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[i] += (s[i] * gain) >> 15;
+        acc[i + 1] += (s[i + 1] * gain) >> 15;
+        acc[i + 2] += (s[i + 2] * gain) >> 15;
+        acc[i + 3] += (s[i + 3] * gain) >> 15;
+    }
+    for (; i < n; ++i)
+        acc[i] += (s[i] * gain) >> 15;
+}
+
+// Gain moves linearly from g0 to g1 across the frames; 8 extra fraction bits
+// keep short ramps from stepping audibly.
+static void mix_add_ramp(int32_t *acc, const int16_t *s, int frames, int32_t g0, int32_t g1) {
+    int32_t g = g0 * 256;
+    int32_t step = (g1 - g0) * 256 / frames;
+    for (int i = 0; i < frames; ++i, g += step) {
+        int32_t q = g >> 8;
+        acc[2 * i] += (s[2 * i] * q) >> 15;
+        acc[2 * i + 1] += (s[2 * i + 1] * q) >> 15;
+    }
+}
+
+static void mix_store(int16_t *out, const int32_t *acc, int n) {
+    for (int i = 0; i < n; ++i)
+        out[i] = (int16_t)std::clamp<int32_t>(acc[i], INT16_MIN, INT16_MAX);
+}
+
+static MixSlot *find_slot(MixerSource src) {
+    if (!src) return nullptr;
+    for (MixSlot &s : g_mixer.slots)
+        if (s.id == src && !s.released) return &s;
+    return nullptr;
+}
+
+// Rings are never freed inside the callback; a dead slot keeps its ring until
+// the next call from a regular thread moves it into graveyard.
+static void reap_slots(std::vector<std::vector<int16_t>> *graveyard) {
+    for (MixSlot &s : g_mixer.slots)
+        if (!s.id && !s.ring.empty()) graveyard->push_back(std::move(s.ring));
+}
+
+static void ring_read(MixSlot &s, int16_t *dst, uint32_t n) {
+    uint32_t cap = (uint32_t)s.ring.size();
+    uint32_t first = std::min(n, cap - s.rpos);
+    memcpy(dst, s.ring.data() + s.rpos, first * sizeof(int16_t));
+    if (n > first) memcpy(dst + first, s.ring.data(), (n - first) * sizeof(int16_t));
+    s.rpos = (s.rpos + n) % cap;
+    s.fill -= n;
+}
+
+static void mix_source(MixSlot &s, int samples) {
+    int n = (int)std::min<uint32_t>((uint32_t)samples, s.fill);
+    if (n <= 0) return;
+    ring_read(s, g_mixer.tmp, (uint32_t)n);
+
+    int frames = n / MIXER_CHANNELS;
+    int ramp = (int)std::min<uint32_t>((uint32_t)frames, s.ramp_left);
+    if (ramp > 0) {
+        int32_t g1 = s.gain + (int32_t)((int64_t)(s.target - s.gain) * ramp / (int64_t)s.ramp_left);
+        mix_add_ramp(g_mixer.acc, g_mixer.tmp, ramp, s.gain, g1);
+        s.gain = g1;
+        s.ramp_left -= ramp;
+    }
+    int off = ramp * MIXER_CHANNELS;
+    if (s.gain == GAIN_UNITY)
+        mix_add(g_mixer.acc + off, g_mixer.tmp + off, n - off);
+    else if (s.gain > 0)
+        mix_add_gain(g_mixer.acc + off, g_mixer.tmp + off, n - off, s.gain);
+}
+
+static void mix_period(int16_t *out, int samples) {
+    memset(g_mixer.acc, 0, samples * sizeof(int32_t));
+    {
+        std::lock_guard<std::mutex> lk(g_mixer.mtx);
+        for (MixSlot &s : g_mixer.slots) {
+            if (!s.id || s.paused) continue;
+            mix_source(s, samples);
+            if (s.released && (!s.fill || (!s.gain && !s.ramp_left))) s.id = 0;
+        }
+    }
+    mix_store(out, g_mixer.acc, samples);
+}
+
+static void mixer_callback(void * /*userdata*/, Uint8 *stream, int len) {
+    int16_t *out = (int16_t *)stream;
+    int samples = len / (int)sizeof(int16_t);
+    for (int off = 0; off < samples; off += PERIOD_SAMPLES)
+        mix_period(out + off, std::min(samples - off, PERIOD_SAMPLES));
+}
+
+bool audio_mixer_init() {
+    if (g_mixer.dev) return true;
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        log_message(LOG_ERROR, AM, "SDL audio init: %s", SDL_GetError());
+        return false;
+    }
+
+    SDL_AudioSpec want{};
+    want.freq = MIXER_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = MIXER_CHANNELS;
+    want.samples = MIXER_PERIOD_FRAMES;
+    want.callback = mixer_callback;
+    SDL_AudioSpec have{};
+    g_mixer.dev = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+    if (!g_mixer.dev) {
+        log_message(LOG_ERROR, AM, "SDL_OpenAudioDevice: %s", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+    g_mixer.latency = (double)have.samples / (double)have.freq;
+    SDL_PauseAudioDevice(g_mixer.dev, 0);
+    log_message(LOG_OK, AM, "Output %d Hz, %d frames per period (%.1f ms)", have.freq, have.samples, g_mixer.latency * 1000.0);
+    return true;
+}
+
+void audio_mixer_shutdown() {
+    if (!g_mixer.dev) return;
+    SDL_CloseAudioDevice(g_mixer.dev);
+    g_mixer.dev = 0;
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    for (MixSlot &s : g_mixer.slots)
+        s = MixSlot{};
+}
+
+MixerSource audio_mixer_add_source(uint32_t capacity) {
+    if (!g_mixer.dev) return 0;
+    uint32_t samples = std::max<uint32_t>(capacity / sizeof(int16_t), PERIOD_SAMPLES);
+    std::vector<int16_t> ring(samples - samples % MIXER_CHANNELS);
+    std::vector<std::vector<int16_t>> graveyard;
+
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    reap_slots(&graveyard);
+    for (MixSlot &s : g_mixer.slots) {
+        if (s.id) continue;
+        s = MixSlot{};
+        s.ring = std::move(ring);
+        s.id = g_mixer.next_id++;
+        if (!g_mixer.next_id) g_mixer.next_id = 1;
+        return s.id;
+    }
+    log_message(LOG_WARNING, AM, "All %d sources in use", MIXER_MAX_SOURCES);
+    return 0;
+}
+
+void audio_mixer_remove_source(MixerSource src) {
+    std::vector<std::vector<int16_t>> graveyard;
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    if (MixSlot *s = find_slot(src)) s->id = 0;
+    reap_slots(&graveyard);
+}
+
+void audio_mixer_release(MixerSource src, double fade_seconds) {
+    std::vector<std::vector<int16_t>> graveyard;
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    MixSlot *s = find_slot(src);
+    if (!s) return;
+    if (s->paused || fade_seconds <= 0.0) {
+        s->id = 0;
+    } else {
+        s->released = true;
+        s->target = 0;
+        s->ramp_left = std::max<uint32_t>((uint32_t)(fade_seconds * MIXER_RATE), 1);
+    }
+    reap_slots(&graveyard);
+}
+
+uint32_t audio_mixer_queue(MixerSource src, const int16_t *samples, uint32_t bytes) {
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    MixSlot *s = find_slot(src);
+    if (!s) return 0;
+    uint32_t cap = (uint32_t)s->ring.size();
+    uint32_t n = std::min(bytes / (uint32_t)sizeof(int16_t), cap - s->fill);
+    n -= n % MIXER_CHANNELS;
+    uint32_t wpos = (s->rpos + s->fill) % cap;
+    uint32_t first = std::min(n, cap - wpos);
+    memcpy(s->ring.data() + wpos, samples, first * sizeof(int16_t));
+    if (n > first) memcpy(s->ring.data(), samples + first, (n - first) * sizeof(int16_t));
+    s->fill += n;
+    return n * (uint32_t)sizeof(int16_t);
+}
+
+uint32_t audio_mixer_queued(MixerSource src) {
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    MixSlot *s = find_slot(src);
+    return s ? s->fill * (uint32_t)sizeof(int16_t) : 0;
+}
+
+void audio_mixer_clear(MixerSource src) {
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    if (MixSlot *s = find_slot(src)) {
+        s->rpos = 0;
+        s->fill = 0;
+    }
+}
+
+void audio_mixer_pause(MixerSource src, bool paused) {
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    if (MixSlot *s = find_slot(src)) s->paused = paused;
+}
+
+void audio_mixer_set_gain(MixerSource src, float gain, double seconds) {
+    int32_t q = (int32_t)(std::clamp(gain, 0.0f, 2.0f) * GAIN_UNITY);
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    MixSlot *s = find_slot(src);
+    if (!s) return;
+    s->target = std::min(q, GAIN_MAX);
+    s->ramp_left = seconds > 0.0 ? std::max<uint32_t>((uint32_t)(seconds * MIXER_RATE), 1) : 0;
+    if (!s->ramp_left) s->gain = s->target;
+}
+
+void audio_mixer_play_clip(const int16_t *samples, uint32_t bytes, float gain) {
+    MixerSource src = audio_mixer_add_source(bytes);
+    if (!src) return;
+    audio_mixer_queue(src, samples, bytes);
+    audio_mixer_set_gain(src, gain, 0.0);
+
+    std::lock_guard<std::mutex> lk(g_mixer.mtx);
+    if (MixSlot *s = find_slot(src)) {
+        s->paused = false;
+        s->released = true; // plays out at its gain, then frees itself
+    }
+}
+
+double audio_mixer_latency() { return g_mixer.latency; }
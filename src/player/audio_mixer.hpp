@@ -0,0 +1,47 @@
+#ifndef AUDIO_MIXER_HPP
+#define AUDIO_MIXER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// The app's single audio device. Sources queue interleaved S16 stereo at
+// MIXER_RATE (their owners resample), and the device callback sums every
+// running source with its gain into fixed MIXER_PERIOD_FRAMES periods, so the
+// output latency does not depend on how many sources play.
+#define MIXER_RATE 48000
+#define MIXER_CHANNELS 2
+#define MIXER_BYTES_PER_SEC (MIXER_RATE * MIXER_CHANNELS * 2)
+#define MIXER_PERIOD_FRAMES 1024
+#define MIXER_MAX_SOURCES 8
+
+// 0 is never a valid source.
+typedef uint32_t MixerSource;
+
+// Opens the device once; it stays open until shutdown.
+bool audio_mixer_init();
+void audio_mixer_shutdown();
+
+// capacity is the most bytes the source holds queued. Sources start paused.
+MixerSource audio_mixer_add_source(uint32_t capacity);
+// Silences the source at once and frees it.
+void audio_mixer_remove_source(MixerSource src);
+// Hands the source over to the mixer: what is still queued keeps playing while
+// it fades out over fade_seconds, then the source is freed. Paused sources are
+// freed at once.
+void audio_mixer_release(MixerSource src, double fade_seconds);
+
+// Returns the bytes taken; the rest did not fit.
+uint32_t audio_mixer_queue(MixerSource src, const int16_t *samples, uint32_t bytes);
+uint32_t audio_mixer_queued(MixerSource src);
+void audio_mixer_clear(MixerSource src);
+void audio_mixer_pause(MixerSource src, bool paused);
+// Ramps linearly to gain (1.0 is unity, at most 2.0) over seconds.
+void audio_mixer_set_gain(MixerSource src, float gain, double seconds);
+
+// Plays a short clip once, e.g. a UI sound; it is freed when done.
+void audio_mixer_play_clip(const int16_t *samples, uint32_t bytes, float gain);
+
+// Seconds between a sample leaving a source and reaching the speaker.
+double audio_mixer_latency();
+
+#endif
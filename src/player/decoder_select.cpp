@@ -0,0 +1,138 @@
+#include "player/decoder_select.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+// Only 8-bit 4:2:0 has a render path (YUV420P from SW, NV12 from HW), so every
+// row is limited to it. h264_wiiu covers Baseline to High up to level 4.2 and
+// 1080p30, progressive only. The software row takes any codec FFmpeg decodes,
+// at whatever rate the CPU was measured at.
+static const DecoderCapability g_table[] = {
+    {"h264", "h264_wiiu", DecoderKind::Hardware, 100, 42, 1920, 1088, 8, true, false, 50000000, 1920.0 * 1088.0 * 30.0},
+    {"*", nullptr, DecoderKind::Software, 0, 0, 0, 0, 8, true, true, 0, 0.0},
+};
+
+const DecoderCapability *decoder_table(int *count) {
+    *count = (int)(sizeof(g_table) / sizeof(g_table[0]));
+    return g_table;
+}
+
+static bool codec_matches(const DecoderCapability &cap, const VideoStreamDesc &v) { return !strcmp(cap.codec, "*") || v.codec == cap.codec; }
+
+// Format only: a decoder that matches here can at least produce frames the
+// renderer takes.
+static bool format_fits(const DecoderCapability &cap, const VideoStreamDesc &v, std::string *reason) {
+    char buf[96];
+    if (!codec_matches(cap, v)) return false;
+    if (cap.max_bit_depth && v.bit_depth > cap.max_bit_depth) {
+        snprintf(buf, sizeof(buf), "%d-bit video", v.bit_depth);
+        *reason = buf;
+        return false;
+    }
+    if (cap.chroma_420_only && !v.chroma_420) {
+        *reason = "chroma other than 4:2:0";
+        return false;
+    }
+    return true;
+}
+
+bool decoder_fits(const DecoderCapability &cap, const VideoStreamDesc &v, double sw_pixels_per_sec, bool *realtime, std::string *reason) {
+    char buf[128];
+    *realtime = false;
+    if (!format_fits(cap, v, reason)) return false;
+
+    if (cap.max_profile && (v.profile & 0xff) > cap.max_profile) {
+        snprintf(buf, sizeof(buf), "%s profile %d beyond %s", v.codec.c_str(), v.profile, decoder_name(&cap));
+        *reason = buf;
+        return false;
+    }
+    if (cap.max_level && v.level > cap.max_level) {
+        snprintf(buf, sizeof(buf), "%s level %d beyond %s", v.codec.c_str(), v.level, decoder_name(&cap));
+        *reason = buf;
+        return false;
+    }
+    if ((cap.max_width && v.width > cap.max_width) || (cap.max_height && v.height > cap.max_height)) {
+        snprintf(buf, sizeof(buf), "%dx%d beyond %s", v.width, v.height, decoder_name(&cap));
+        *reason = buf;
+        return false;
+    }
+    if (!cap.interlaced && v.interlaced) {
+        snprintf(buf, sizeof(buf), "interlaced video on %s", decoder_name(&cap));
+        *reason = buf;
+        return false;
+    }
+    if (cap.max_bitrate && v.bitrate > cap.max_bitrate) {
+        snprintf(buf, sizeof(buf), "%lld bit/s beyond %s", (long long)v.bitrate, decoder_name(&cap));
+        *reason = buf;
+        return false;
+    }
+
+    double budget = cap.max_pixels_per_sec > 0.0 ? cap.max_pixels_per_sec : (sw_pixels_per_sec > 0.0 ? sw_pixels_per_sec : DECODER_DEFAULT_SW_PIXELS_PER_SEC) * DECODER_SW_HEADROOM;
+    double fps = v.fps > 0.0 ? v.fps : 30.0;
+    double need = (double)v.width * v.height * fps;
+    *realtime = need <= budget;
+    if (!*realtime) {
+        snprintf(buf, sizeof(buf), "%dx%d@%.0f needs %.1f Mpx/s, %s does %.1f", v.width, v.height, fps, need / 1e6, decoder_name(&cap), budget / 1e6);
+        *reason = buf;
+    }
+    return true;
+}
+
+static bool present(const DecoderCapability &cap, const VideoStreamDesc &v, DecoderAvailableFn available) { return cap.decoder ? available(cap.decoder) : v.has_default_decoder; }
+
+DecoderPlan decoder_plan(const VideoStreamDesc &v, double sw_pixels_per_sec, DecoderAvailableFn available) {
+    DecoderPlan plan;
+    const DecoderCapability *slow = nullptr; // fits, but not in real time
+    std::string why;
+
+    for (const DecoderCapability &cap : g_table) {
+        if (!codec_matches(cap, v) || !present(cap, v, available)) continue;
+        bool realtime = false;
+        std::string r;
+        if (!decoder_fits(cap, v, sw_pixels_per_sec, &realtime, &r)) {
+            if (why.empty()) why = r;
+            continue;
+        }
+        if (realtime) {
+            plan.primary = &cap;
+            plan.realtime = true;
+            break;
+        }
+        if (!slow) {
+            slow = &cap;
+            if (why.empty()) why = r;
+        }
+    }
+    if (!plan.primary) plan.primary = slow;
+    plan.reason = why;
+    if (!plan.primary) return plan;
+
+    // The fallback only has to produce frames the renderer takes: a decoder
+    // over its nominal limits still beats one that has stopped working.
+    for (const DecoderCapability &cap : g_table) {
+        std::string r;
+        if (&cap != plan.primary && cap.kind != plan.primary->kind && present(cap, v, available) && format_fits(cap, v, &r)) {
+            plan.fallback = &cap;
+            break;
+        }
+    }
+    return plan;
+}
+
+const char *decoder_name(const DecoderCapability *cap) {
+    if (!cap) return "none";
+    return cap->decoder ? cap->decoder : "software";
+}
+
+void decoder_watch_error(DecoderWatch *w) { w->errors++; }
+void decoder_watch_packet(DecoderWatch *w) { w->packets_since_frame++; }
+
+void decoder_watch_frame(DecoderWatch *w, bool usable) {
+    w->packets_since_frame = 0;
+    if (usable)
+        w->errors = 0;
+    else
+        w->errors++;
+}
+
+bool decoder_watch_failed(const DecoderWatch &w) { return w.errors >= DECODER_ERROR_LIMIT || w.packets_since_frame >= DECODER_STALL_PACKETS; }
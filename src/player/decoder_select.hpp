@@ -0,0 +1,84 @@
+#ifndef DECODER_SELECT_HPP
+#define DECODER_SELECT_HPP
+
+// Video decoder choice. A capability table lists what each decoder handles
+// and how fast; a stream gets the first decoder that fits it and keeps up in
+// real time, plus a fallback the player moves to when the first one keeps
+// failing mid-stream. No FFmpeg types, so the table and the decisions build
+// and run on the host.
+
+#include <cstdint>
+#include <string>
+
+// 854x480 at 30 fps, what the SW decoders manage on the Espresso with two
+// slice threads. Used until a local file has been measured.
+#define DECODER_DEFAULT_SW_PIXELS_PER_SEC (854.0 * 480.0 * 30.0)
+#define DECODER_SW_HEADROOM 0.8 // share of the measured SW throughput playback may use
+#define DECODER_ERROR_LIMIT 8     // consecutive errors before a decoder counts as failed
+#define DECODER_STALL_PACKETS 120 // packets in without a frame out
+
+enum class DecoderKind { Hardware, Software };
+
+// One row of the capability table. Limits of 0 are unlimited.
+struct DecoderCapability {
+    const char *codec;   // FFmpeg codec name; "*" matches any
+    const char *decoder; // FFmpeg decoder name; nullptr for the codec's default decoder
+    DecoderKind kind;
+    int max_profile;     // compared without constraint flags (profile & 0xff)
+    int max_level;
+    int max_width;
+    int max_height;
+    int max_bit_depth;
+    bool chroma_420_only;
+    bool interlaced;
+    int64_t max_bitrate;
+    double max_pixels_per_sec; // 0: measured SW throughput x DECODER_SW_HEADROOM
+};
+
+// What decoding a video stream demands.
+struct VideoStreamDesc {
+    std::string codec; // FFmpeg codec name
+    int profile = 0;
+    int level = 0;
+    int width = 0;
+    int height = 0;
+    double fps = 0.0;
+    int64_t bitrate = 0;
+    int bit_depth = 8;
+    bool chroma_420 = true;
+    bool interlaced = false;
+    bool has_default_decoder = true; // FFmpeg has a decoder for the codec
+};
+
+typedef bool (*DecoderAvailableFn)(const char *decoder);
+
+struct DecoderPlan {
+    const DecoderCapability *primary = nullptr;
+    const DecoderCapability *fallback = nullptr; // same format, other kind; limits are not enforced
+    bool realtime = false;                       // primary is expected to keep up
+    std::string reason;                          // why a better choice was passed over, or why nothing fits
+};
+
+const DecoderCapability *decoder_table(int *count);
+
+// Checks format and limits; realtime is set when the pixel rate fits too.
+bool decoder_fits(const DecoderCapability &cap, const VideoStreamDesc &v, double sw_pixels_per_sec, bool *realtime, std::string *reason);
+
+// sw_pixels_per_sec is the measured SW throughput, 0 when never measured.
+DecoderPlan decoder_plan(const VideoStreamDesc &v, double sw_pixels_per_sec, DecoderAvailableFn available);
+
+const char *decoder_name(const DecoderCapability *cap);
+
+// Health of the running decoder, fed by the decode loop.
+struct DecoderWatch {
+    int errors = 0;             // consecutive
+    int packets_since_frame = 0;
+};
+
+void decoder_watch_error(DecoderWatch *w);
+void decoder_watch_packet(DecoderWatch *w);
+// usable: the frame has a format the renderer takes.
+void decoder_watch_frame(DecoderWatch *w, bool usable);
+bool decoder_watch_failed(const DecoderWatch &w);
+
+#endif
@@ -0,0 +1,399 @@
+#include "player/faststart.hpp"
+
+#include "logger/logger.hpp"
+#include "main.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <thread>
+
+#define FS "Faststart"
+
+#define FASTSTART_SPACE_MARGIN (16 * 1024 * 1024) // left free beyond the second copy
+#define FASTSTART_SCAN_DEPTH 8                   // folder levels searched for leftovers of a swap
+
+// Where the browser finds local files, searched for swaps cut short.
+static const char *media_roots[] = {
+    MEDIA_PATH_VIDEO,
+    MEDIA_PATH_AUDIO,
+#ifdef MEDIA_PATH_USB
+    MEDIA_PATH_USB,
+#endif
+};
+
+static std::mutex mtx;
+static std::condition_variable cv;
+static std::deque<std::string> pending;
+static std::set<std::string> seen;
+static std::thread worker;
+static bool running = false;
+static bool quit = false;
+static std::map<std::string, int> held; // open readers per path; the worker pauses while any exist
+
+// Worker thread only.
+static FILE *out_file = nullptr;
+static int (*default_io_open)(AVFormatContext *, AVIOContext **, const char *, int, AVDictionary **) = nullptr;
+
+static bool file_exists(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// Blocks while a player or a background reader has a file open. false once
+// the app shuts down.
+static bool wait_while_paused() {
+    std::unique_lock<std::mutex> lk(mtx);
+    cv.wait(lk, [] { return quit || held.empty(); });
+    return !quit;
+}
+
+std::vector<IndexPoint> faststart_index_points(AVStream *st, int max_points) {
+    std::vector<IndexPoint> out;
+    int n = avformat_index_get_entries_count(st);
+    if (n <= 0 || max_points <= 0) return out;
+
+    double tb = av_q2d(st->time_base);
+    int step = std::max(1, n / max_points);
+    out.reserve(n / step + 1);
+    for (int i = 0; i < n; i += step) {
+        const AVIndexEntry *e = avformat_index_get_entry(st, i);
+        out.push_back({e->pos, e->timestamp * tb});
+    }
+    std::sort(out.begin(), out.end(), [](const IndexPoint &a, const IndexPoint &b) { return a.pos < b.pos; });
+    return out;
+}
+
+// An interrupted swap leaves the original under FASTSTART_OLD_SUFFIX: it is
+// dropped when the remuxed file made it into place, and restored otherwise.
+static void recover_swap(const std::string &path) {
+    std::string old_path = path + FASTSTART_OLD_SUFFIX;
+    std::string tmp_path = path + FASTSTART_TMP_SUFFIX;
+    if (file_exists(old_path)) {
+        if (file_exists(path)) {
+            remove(old_path.c_str());
+        } else if (rename(old_path.c_str(), path.c_str()) == 0) {
+            log_message(LOG_WARNING, FS, "Restored %s after an interrupted swap", path.c_str());
+        }
+    }
+    if (file_exists(tmp_path)) remove(tmp_path.c_str());
+}
+
+static bool ends_with(const std::string &s, const char *suffix) {
+    size_t n = strlen(suffix);
+    return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// A swap cut short can leave the original only under its FASTSTART_OLD_SUFFIX
+// name, which the browser does not list and so never queues. The worker looks
+// for such leftovers once at start-up.
+static void recover_dir(const std::string &dir, int depth) {
+    DIR *d = opendir(dir.c_str());
+    if (!d) return;
+    std::vector<std::string> subdirs, leftovers;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != nullptr) {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..") continue;
+        std::string full = dir + name;
+        if (ent->d_type == DT_DIR)
+            subdirs.push_back(full + "/");
+        else if (ends_with(name, FASTSTART_OLD_SUFFIX))
+            leftovers.push_back(full.substr(0, full.size() - strlen(FASTSTART_OLD_SUFFIX)));
+        else if (ends_with(name, FASTSTART_TMP_SUFFIX))
+            leftovers.push_back(full.substr(0, full.size() - strlen(FASTSTART_TMP_SUFFIX)));
+    }
+    closedir(d);
+
+    for (const std::string &path : leftovers)
+        recover_swap(path);
+    if (depth <= 0) return;
+    for (const std::string &sub : subdirs) {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            if (quit) return;
+        }
+        recover_dir(sub, depth - 1);
+    }
+}
+
+// The remux writes a second copy beside the original; a card that cannot take
+// it is left alone rather than filled up.
+static bool has_room_for_copy(const std::string &path) {
+    struct stat st;
+    struct statvfs vfs;
+    if (stat(path.c_str(), &st) != 0) return false;
+    if (statvfs(path.c_str(), &vfs) != 0) {
+        log_message(LOG_WARNING, FS, "Cannot tell the free space for %s, not remuxing", path.c_str());
+        return false;
+    }
+    uint64_t avail = (uint64_t)vfs.f_bavail * (vfs.f_frsize ? vfs.f_frsize : vfs.f_bsize);
+    if (avail < (uint64_t)st.st_size + FASTSTART_SPACE_MARGIN) {
+        log_message(LOG_WARNING, FS, "%s: %llu MiB free, not enough for a copy", path.c_str(), (unsigned long long)(avail >> 20));
+        return false;
+    }
+    return true;
+}
+
+static bool read_at(void *opaque, int64_t offset, uint8_t *buf, size_t len) {
+    FILE *f = (FILE *)opaque;
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0 && fread(buf, 1, len, f) == len;
+}
+
+static LayoutVerdict check_file(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return LayoutVerdict::Unsupported;
+
+    std::vector<LayoutAtom> atoms;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return LayoutVerdict::Unsupported;
+    bool ok = media_layout_scan_atoms(read_at, f, (int64_t)st.st_size, &atoms);
+    fclose(f);
+    if (!ok) return LayoutVerdict::Unsupported;
+
+    LayoutVerdict v = media_layout_classify(atoms, 0.0);
+    if (v != LayoutVerdict::Good) return v;
+
+    // The index is in front, so opening the file only reads the header.
+    AVFormatContext *fmt = nullptr;
+    if (avformat_open_input(&fmt, ("file:" + path).c_str(), nullptr, nullptr) < 0) return LayoutVerdict::Unsupported;
+    int vidx = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    int aidx = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, vidx, nullptr, 0);
+    double skew = 0.0;
+    if (vidx >= 0 && aidx >= 0) skew = media_layout_interleave_skew(faststart_index_points(fmt->streams[vidx], LAYOUT_INDEX_POINTS), faststart_index_points(fmt->streams[aidx], LAYOUT_INDEX_POINTS));
+    avformat_close_input(&fmt);
+    return media_layout_classify(atoms, skew);
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int out_write(void *opaque, const uint8_t *buf, int size) {
+#else
+static int out_write(void *opaque, uint8_t *buf, int size) {
+#endif
+    return fwrite(buf, 1, size, (FILE *)opaque) == (size_t)size ? size : AVERROR(EIO);
+}
+
+static int64_t out_seek(void *opaque, int64_t offset, int whence) {
+    FILE *f = (FILE *)opaque;
+    if (whence == AVSEEK_SIZE) return -1;
+    if (fseeko(f, (off_t)offset, whence & ~AVSEEK_FORCE) != 0) return AVERROR(EIO);
+    return (int64_t)ftello(f);
+}
+
+// The mov muxer rereads its own output to move the index to the front; what
+// sits in the stdio buffer has to reach the file first.
+static int out_io_open(AVFormatContext *s, AVIOContext **pb, const char *url, int flags, AVDictionary **options) {
+    if (out_file) fflush(out_file);
+    return default_io_open(s, pb, url, flags, options);
+}
+
+static bool remux(const std::string &path) {
+    std::string tmp_path = path + FASTSTART_TMP_SUFFIX;
+    AVFormatContext *in = nullptr;
+    AVFormatContext *out = nullptr;
+    AVPacket *pkt = nullptr;
+    AVDictionary *opts = nullptr;
+    bool ok = false;
+    int64_t packets = 0;
+
+    if (avformat_open_input(&in, ("file:" + path).c_str(), nullptr, nullptr) < 0) return false;
+    const AVOutputFormat *ofmt = av_guess_format(nullptr, path.c_str(), nullptr);
+    if (!ofmt || avformat_alloc_output_context2(&out, ofmt, nullptr, tmp_path.c_str()) < 0) goto done;
+    if (in->nb_chapters) {
+        log_message(LOG_DEBUG, FS, "%s has chapters, left as is", path.c_str());
+        goto done;
+    }
+
+    // Every stream is kept; a file the muxer cannot take whole is left alone.
+    for (unsigned i = 0; i < in->nb_streams; ++i) {
+        AVStream *is = in->streams[i];
+        if (avformat_query_codec(ofmt, is->codecpar->codec_id, FF_COMPLIANCE_NORMAL) != 1) {
+            log_message(LOG_DEBUG, FS, "%s: stream %u (%s) cannot be copied", path.c_str(), i, avcodec_get_name(is->codecpar->codec_id));
+            goto done;
+        }
+        AVStream *os = avformat_new_stream(out, nullptr);
+        if (!os || avcodec_parameters_copy(os->codecpar, is->codecpar) < 0) goto done;
+        os->codecpar->codec_tag = 0;
+        os->time_base = is->time_base;
+        os->disposition = is->disposition;
+        av_dict_copy(&os->metadata, is->metadata, 0);
+    }
+    av_dict_copy(&out->metadata, in->metadata, 0);
+    out->max_interleave_delta = FASTSTART_INTERLEAVE_US;
+
+    out_file = fopen(tmp_path.c_str(), "wb");
+    if (!out_file) goto done;
+    setvbuf(out_file, nullptr, _IOFBF, FASTSTART_IO_BUFFER);
+    {
+        uint8_t *buf = (uint8_t *)av_malloc(FASTSTART_AVIO_BUFFER);
+        out->pb = buf ? avio_alloc_context(buf, FASTSTART_AVIO_BUFFER, 1, out_file, nullptr, out_write, out_seek) : nullptr;
+        if (!out->pb) {
+            av_free(buf);
+            goto done;
+        }
+    }
+    out->flags |= AVFMT_FLAG_CUSTOM_IO;
+    default_io_open = out->io_open;
+    out->io_open = out_io_open;
+
+    av_dict_set(&opts, "movflags", "faststart", 0);
+    if (avformat_write_header(out, &opts) < 0) goto done;
+
+    pkt = av_packet_alloc();
+    if (!pkt) goto done;
+    for (;;) {
+        if (!wait_while_paused()) goto done;
+        int ret = av_read_frame(in, pkt);
+        if (ret == AVERROR_EOF) break;
+        if (ret < 0) goto done;
+        av_packet_rescale_ts(pkt, in->streams[pkt->stream_index]->time_base, out->streams[pkt->stream_index]->time_base);
+        pkt->pos = -1;
+        if (av_interleaved_write_frame(out, pkt) < 0) goto done;
+        packets++;
+    }
+    ok = av_write_trailer(out) >= 0;
+    avio_flush(out->pb);
+    ok = ok && !ferror(out_file);
+
+done:
+    av_packet_free(&pkt);
+    av_dict_free(&opts);
+    if (out && out->pb) {
+        av_freep(&out->pb->buffer);
+        avio_context_free(&out->pb);
+    }
+    if (out_file) {
+        ok = fclose(out_file) == 0 && ok;
+        out_file = nullptr;
+    }
+    avformat_free_context(out);
+    avformat_close_input(&in);
+    if (!ok) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    log_message(LOG_DEBUG, FS, "%s: %lld packets rewritten", path.c_str(), (long long)packets);
+    return true;
+}
+
+// Neither rename may replace an existing file on FAT, so the original steps
+// aside first; recover_swap settles a swap cut short in between. Called with
+// mtx held and path not open, so no reader can open it halfway.
+static bool swap_in(const std::string &path) {
+    std::string old_path = path + FASTSTART_OLD_SUFFIX;
+    std::string tmp_path = path + FASTSTART_TMP_SUFFIX;
+    if (rename(path.c_str(), old_path.c_str()) != 0) return false;
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        rename(old_path.c_str(), path.c_str());
+        return false;
+    }
+    remove(old_path.c_str());
+    return true;
+}
+
+static void worker_thread() {
+    for (const char *root : media_roots)
+        recover_dir(root, FASTSTART_SCAN_DEPTH);
+
+    for (;;) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [] { return quit || (held.empty() && !pending.empty()); });
+            if (quit) break;
+            path = pending.front();
+            pending.pop_front();
+        }
+
+        recover_swap(path);
+        LayoutVerdict v = check_file(path);
+        if (v == LayoutVerdict::Good || v == LayoutVerdict::Unsupported) continue;
+
+        if (!has_room_for_copy(path)) continue;
+        log_message(LOG_OK, FS, "%s is %s, remuxing", path.c_str(), media_layout_verdict_name(v));
+        if (!remux(path)) {
+            log_message(LOG_WARNING, FS, "Remux of %s stopped or failed", path.c_str());
+            continue;
+        }
+        // A reader may have opened the file meanwhile; swap only once none
+        // has it open, and keep the lock so none opens it during the renames.
+        std::unique_lock<std::mutex> lk(mtx);
+        cv.wait(lk, [&] { return quit || !held.count(path); });
+        if (quit) {
+            remove((path + FASTSTART_TMP_SUFFIX).c_str());
+            break;
+        }
+        if (swap_in(path))
+            log_message(LOG_OK, FS, "%s optimized", path.c_str());
+        else
+            log_message(LOG_ERROR, FS, "Cannot swap in %s", path.c_str());
+    }
+}
+
+void faststart_init() {
+    if (running) return;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = false;
+        running = true;
+    }
+    worker = std::thread(worker_thread);
+}
+
+void faststart_shutdown() {
+    if (!running) return;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+
+    std::lock_guard<std::mutex> lk(mtx);
+    pending.clear();
+    running = false;
+}
+
+void faststart_consider(const std::string &path) {
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos) return;
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext != "mp4" && ext != "m4v" && ext != "m4a" && ext != "mov") return;
+
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (!running || !seen.insert(path).second) return;
+        pending.push_back(path);
+    }
+    cv.notify_all();
+}
+
+void faststart_hold(const std::string &path) {
+    std::lock_guard<std::mutex> lk(mtx);
+    held[path]++;
+}
+
+void faststart_release(const std::string &path) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = held.find(path);
+        if (it == held.end()) return;
+        if (--it->second == 0) held.erase(it);
+    }
+    cv.notify_all();
+}
@@ -0,0 +1,41 @@
+#ifndef FASTSTART_HPP
+#define FASTSTART_HPP
+
+#include "utils/media_layout.hpp"
+
+#include <string>
+#include <vector>
+
+struct AVStream;
+
+// Background remux of local MP4/MOV files whose layout makes playback seek:
+// the index (moov) stored after the media, or audio and video stored far
+// apart. Packets are copied without re-encoding into a temporary file beside
+// the original, interleaved in short runs with the index in front, and the
+// result replaces the original only once it is complete. The job waits while
+// any file is held open, and a file is never swapped while it is held. A file
+// is only remuxed when its volume has room for the copy, and leftovers of a
+// swap cut short are settled when the worker starts.
+#define FASTSTART_IO_BUFFER (1024 * 1024) // stdio buffer, so the card sees large sequential writes
+#define FASTSTART_AVIO_BUFFER (64 * 1024)
+#define FASTSTART_INTERLEAVE_US 500000    // longest run of one stream in the output
+#define FASTSTART_TMP_SUFFIX ".remux~"
+#define FASTSTART_OLD_SUFFIX ".orig~"
+
+void faststart_init();
+void faststart_shutdown();
+
+// Queues a local file for checking; the checks themselves run on the worker.
+// Each file is looked at once per session.
+void faststart_consider(const std::string &path);
+
+// Every player and background reader holds the path it opens until it closes
+// it. Holds are counted per path.
+void faststart_hold(const std::string &path);
+void faststart_release(const std::string &path);
+
+// Up to max_points samples of the stream's in-memory index, ordered by file
+// position. Empty when the demuxer keeps no index.
+std::vector<IndexPoint> faststart_index_points(AVStream *st, int max_points);
+
+#endif
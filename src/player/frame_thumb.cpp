@@ -0,0 +1,140 @@
+#include "player/frame_thumb.hpp"
+
+#include "logger/logger.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <algorithm>
+#include <cmath>
+
+#define FT "Thumb"
+
+AVCodecContext *frame_thumb_open_decoder(AVFormatContext *fmt, int max_w, int max_h, int *stream_index) {
+    const AVCodec *codec = nullptr;
+    int vidx = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (vidx < 0 || !codec) return nullptr;
+    for (unsigned i = 0; i < fmt->nb_streams; ++i)
+        fmt->streams[i]->discard = (int)i == vidx ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+
+    // Always the software decoder: the hardware one belongs to the player.
+    AVCodecContext *avctx = avcodec_alloc_context3(codec);
+    if (!avctx || avcodec_parameters_to_context(avctx, fmt->streams[vidx]->codecpar) < 0) {
+        avcodec_free_context(&avctx);
+        return nullptr;
+    }
+    avctx->thread_count = 1;
+    avctx->skip_frame = AVDISCARD_NONKEY;
+    avctx->skip_loop_filter = AVDISCARD_ALL;
+    while (avctx->lowres < codec->max_lowres && (avctx->width >> avctx->lowres) >= max_w * 2 && (avctx->height >> avctx->lowres) >= max_h * 2)
+        avctx->lowres++;
+    if ((int64_t)(avctx->width >> avctx->lowres) * (avctx->height >> avctx->lowres) > FRAME_THUMB_MAX_SOURCE_PIXELS) {
+        log_message(LOG_DEBUG, FT, "%dx%d %s is too large for a thumbnail", avctx->width, avctx->height, codec->name);
+        avcodec_free_context(&avctx);
+        return nullptr;
+    }
+    if (avcodec_open2(avctx, codec, nullptr) < 0) {
+        avcodec_free_context(&avctx);
+        return nullptr;
+    }
+    *stream_index = vidx;
+    return avctx;
+}
+
+// Means of fw x fh blocks of one plane into ow x oh samples. Each output row
+// first sums its fh source rows into acc and then folds runs of fw, so the
+// inner loops walk contiguous memory with no per-sample branches.
+static void box_plane(const uint8_t *src, int stride, int step, int fw, int fh, int ow, int oh, std::vector<uint32_t> &acc, uint8_t *out) {
+    const int span = ow * fw;
+    const uint32_t area = (uint32_t)(fw * fh), round = area / 2;
+    acc.resize(span);
+    for (int y = 0; y < oh; ++y) {
+        std::fill(acc.begin(), acc.end(), 0);
+        for (int j = 0; j < fh; ++j) {
+            const uint8_t *row = src + (size_t)(y * fh + j) * stride;
+            if (step == 1) {
+                for (int x = 0; x < span; ++x)
+                    acc[x] += row[x];
+            } else {
+                for (int x = 0; x < span; ++x)
+                    acc[x] += row[x * step];
+            }
+        }
+        uint8_t *dst = out + (size_t)y * ow;
+        const uint32_t *a = acc.data();
+        for (int x = 0; x < ow; ++x, a += fw) {
+            uint32_t s = 0;
+            for (int i = 0; i < fw; ++i)
+                s += a[i];
+            dst[x] = (uint8_t)((s + round) / area);
+        }
+    }
+}
+
+static inline uint32_t clamp8(int v) { return (uint32_t)(v < 0 ? 0 : v > 255 ? 255 : v); }
+
+bool frame_thumb_convert(const AVFrame *f, int max_w, int max_h, std::vector<uint32_t> *rgba, int *w, int *h, ThumbStats *stats) {
+    const AVPixFmtDescriptor *d = av_pix_fmt_desc_get((AVPixelFormat)f->format);
+    if (!d || d->nb_components < 3 || (d->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL)) || d->comp[0].depth != 8) return false;
+
+    // An even factor keeps the chroma blocks aligned with the luma ones.
+    int factor = std::max((f->width + max_w - 1) / max_w, (f->height + max_h - 1) / max_h);
+    if (factor > 1) factor = (factor + 1) & ~1;
+    else factor = 1;
+    const int ow = f->width / factor, oh = f->height / factor;
+    if (ow <= 0 || oh <= 0) return false;
+
+    // With factor 1 the chroma planes stay at their own size and are read
+    // with a shift; otherwise they are filtered to the output size.
+    const int sw = factor == 1 ? d->log2_chroma_w : 0, sh = factor == 1 ? d->log2_chroma_h : 0;
+    const int cw = (ow + (1 << sw) - 1) >> sw, ch = (oh + (1 << sh) - 1) >> sh;
+    const int cfw = std::max(1, factor >> d->log2_chroma_w), cfh = std::max(1, factor >> d->log2_chroma_h);
+
+    std::vector<uint32_t> acc;
+    std::vector<uint8_t> planes((size_t)ow * oh + 2 * (size_t)cw * ch);
+    uint8_t *Y = planes.data(), *U = Y + (size_t)ow * oh, *V = U + (size_t)cw * ch;
+    const AVComponentDescriptor &cy = d->comp[0], &cu = d->comp[1], &cv = d->comp[2];
+    box_plane(f->data[cy.plane] + cy.offset, f->linesize[cy.plane], cy.step, factor, factor, ow, oh, acc, Y);
+    box_plane(f->data[cu.plane] + cu.offset, f->linesize[cu.plane], cu.step, cfw, cfh, cw, ch, acc, U);
+    box_plane(f->data[cv.plane] + cv.offset, f->linesize[cv.plane], cv.step, cfw, cfh, cw, ch, acc, V);
+
+    const bool full = f->color_range == AVCOL_RANGE_JPEG || f->format == AV_PIX_FMT_YUVJ420P;
+    uint64_t sum = 0, sum2 = 0;
+    rgba->resize((size_t)ow * oh);
+    for (int y = 0; y < oh; ++y) {
+        const uint8_t *yr = Y + (size_t)y * ow, *ur = U + (size_t)(y >> sh) * cw, *vr = V + (size_t)(y >> sh) * cw;
+        uint32_t *dst = rgba->data() + (size_t)y * ow;
+        for (int x = 0; x < ow; ++x) {
+            int l = yr[x], u = ur[x >> sw] - 128, v = vr[x >> sw] - 128;
+            sum += l;
+            sum2 += (uint32_t)(l * l);
+
+            // BT.601, 8.8 fixed point.
+            int r, g, b;
+            if (full) {
+                int c = 256 * l;
+                r = (c + 359 * v + 128) >> 8;
+                g = (c - 88 * u - 183 * v + 128) >> 8;
+                b = (c + 454 * u + 128) >> 8;
+            } else {
+                int c = 298 * (l - 16);
+                r = (c + 409 * v + 128) >> 8;
+                g = (c - 100 * u - 208 * v + 128) >> 8;
+                b = (c + 516 * u + 128) >> 8;
+            }
+            dst[x] = 0xff000000u | (clamp8(b) << 16) | (clamp8(g) << 8) | clamp8(r);
+        }
+    }
+
+    if (stats) {
+        double n = (double)ow * oh, mean = sum / n;
+        stats->mean = (int)mean;
+        stats->stddev = (int)std::sqrt(std::max(0.0, sum2 / n - mean * mean));
+    }
+    *w = ow;
+    *h = oh;
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef FRAME_THUMB_HPP
+#define FRAME_THUMB_HPP
+
+#include <cstdint>
+#include <vector>
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+
+// Small RGBA pictures of video frames for the browser: the preview and the
+// poster frames. Both decode keyframes only, with the cheapest setup the
+// decoder allows, and never touch the player's decoders or GX2 planes.
+#define FRAME_THUMB_MAX_SOURCE_PIXELS (1920 * 1088) // after lowres; bigger streams are skipped
+
+struct ThumbStats {
+    int mean = 0;   // luma, 0-255
+    int stddev = 0; // luma; low means flat
+};
+
+// Finds the best video stream of an opened input, discards every other
+// stream and the video's non-keyframes, and opens its software decoder with
+// one thread, no loop filter and as much lowres as still leaves max_w x max_h
+// twice over. nullptr when there is no video or it is too large.
+AVCodecContext *frame_thumb_open_decoder(AVFormatContext *fmt, int max_w, int max_h, int *stream_index);
+
+// 8-bit YUV, planar or semi-planar, box-filtered to fit max_w x max_h and
+// converted to ImGui's RGBA32 layout. stats may be nullptr. false for pixel
+// formats it does not handle.
+bool frame_thumb_convert(const AVFrame *f, int max_w, int max_h, std::vector<uint32_t> *rgba, int *w, int *h, ThumbStats *stats);
+
+#endif
@@ -1,11 +1,15 @@
 // Architecture loosely based on FFmpeg's ffplay.c (Copyright (c) 2003 Fabrice Bellard, LGPL 2.1+).
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <limits>
 #include <malloc.h>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <unistd.h>
@@ -14,24 +18,38 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/mathematics.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/time.h>
 #include <libswresample/swresample.h>
 }
 
 #include "logger/logger.hpp"
+#include "network/download_queue.hpp"
+#include "network/http_client.hpp"
+#include "network/http_source.hpp"
 #include "nv12_shader.h"
+#include "player/abr.hpp"
+#include "player/audio_mixer.hpp"
+#include "player/decoder_select.hpp"
+#include "player/faststart.hpp"
 #include "player/media_player.hpp"
+#include "player/player_arena.hpp"
+#include "player/preopen.hpp"
+#include "player/stream_cache.hpp"
+#include "utils/byte_stream.hpp"
 #include "utils/display.hpp"
 #include "utils/media_info.hpp"
+#include "utils/profiler.hpp"
 #include "yuv420p_shader.h"
 
-#include <SDL2/SDL.h>
 #include <coreinit/cache.h>
 #include <coreinit/memory.h>
 #include <coreinit/time.h>
 #include <gx2/draw.h>
+#include <gx2/event.h>
 #include <gx2/mem.h>
 #include <gx2/registers.h>
 #include <gx2/sampler.h>
@@ -42,18 +60,73 @@ extern "C" {
 
 #define MP "MediaPlayer"
 
-#define VIDEO_FRAME_QUEUE_SIZE 16
+#define FRAME_QUEUE_MAX 64
+#define VIDEO_FRAME_QUEUE_SIZE 16 // upper bound; the depth is sized per stream
 #define AUDIO_FRAME_QUEUE_SIZE 16
 #define MIN_FRAMES 8
+#define MIN_QUEUE_SECONDS 1.0
 
 #define AV_SYNC_THRESHOLD_MIN 0.04
 #define AV_SYNC_THRESHOLD_MAX 0.10
 #define AV_SYNC_FRAMEDUP_THR 0.10
 #define AV_NOSYNC_THRESHOLD 10.0
 
-#define AUDIO_OUT_CHANNELS 2
-#define AUDIO_OUT_RATE 48000
+#define AUDIO_OUT_CHANNELS MIXER_CHANNELS
+#define AUDIO_OUT_RATE MIXER_RATE
 #define AUDIO_BUF_MAX_BYTES (768 * 1024)
+#define AUDIO_BYTES_PER_SEC MIXER_BYTES_PER_SEC
+#define AUDIO_BUF_LOW_SECONDS 1.0
+// Mixer sources hold one decoded frame past the pump's high watermark.
+#define AUDIO_SOURCE_SLACK (256 * 1024)
+// Closing a playing instance fades its queued audio out instead of cutting it.
+#define AUDIO_CLOSE_FADE_SECONDS 0.3
+
+#define HTTP_AVIO_BUFFER_SIZE (64 * 1024)
+
+// Picture queue sizing: decoded frames ahead of the display cover this much
+// decoder jitter, plus the frames the decoder itself holds back. A 720p
+// YUV420P frame is about 1.4 MB, so every slot counts.
+#define PICTQ_SECONDS 0.2
+#define PICTQ_MIN_DEPTH 3
+#define PICTQ_HW_LATENCY 2            // frames h264_wiiu keeps in flight
+#define PICTQ_DECODER_REFS 4          // reference frames assumed beside the queue
+#define PICTQ_HEAP_BUDGET (48 * 1024 * 1024) // without the arena
+
+// SW decode throughput is only trusted after this many frames, and blended
+// into the running estimate with this weight.
+#define DECODE_RATE_MIN_FRAMES 120
+#define DECODE_RATE_ALPHA 0.3
+
+// Adaptive streams start at or below this bitrate until a throughput figure
+// from an earlier session is available.
+#define ABR_START_BITRATE 1500000
+#define ABR_TICK_SECONDS 1.0
+
+// The reader is woken once a packet queue drains below this fraction of its
+// target duration, so it refills in bursts instead of per packet.
+#define PKTQ_LOW_FRACTION 0.5
+
+// Audio-only playback trades latency for fewer wakeups: deep buffers that are
+// topped up in bursts, with the threads asleep in between.
+#define AUDIO_ONLY_FRAME_QUEUE_SIZE 64
+#define AUDIO_ONLY_BUF_MAX_BYTES (AUDIO_BYTES_PER_SEC * 8)
+#define AUDIO_ONLY_BUF_LOW_SECONDS 3.0
+#define AUDIO_ONLY_QUEUE_SECONDS 20.0
+
+// Scrubbing: seek requests are coalesced and only one demuxer seek is in
+// flight; the next goes out once its keyframe is on screen (or after the
+// timeout). Playback resumes when no request came in for the settle time.
+#define SCRUB_SETTLE_SECONDS 0.35
+#define SCRUB_PREVIEW_TIMEOUT 0.5
+
+// Local files whose audio and video sit further apart than this (judged from
+// the container index) get a second demuxer for audio, see open_audio_demuxer.
+#define DUAL_DEMUX_SKEW_SECONDS 2.0
+
+// Decoded bitmap subtitle images queued ahead of the video clock. A 1080p PGS
+// event is rarely more than a few hundred KiB.
+#define SUBTITLE_BITMAP_BUDGET (4 * 1024 * 1024)
+#define SUBTITLE_BITMAP_WAIT_MS 100
 
 __attribute__((always_inline)) static inline double wall_now() { return (double)OSGetSystemTime() * (1.0 / (double)OSTimerClockSpeed); }
 
@@ -71,7 +144,8 @@ struct PktNodePool {
     PktNode *freelist = nullptr;
     std::mutex mtx;
 
-    void init() {
+    // Shared by every player instance, so it is linked once at start-up.
+    PktNodePool() {
         for (int i = 0; i < PKT_POOL_SIZE - 1; ++i)
             nodes[i].next = &nodes[i + 1];
         nodes[PKT_POOL_SIZE - 1].next = nullptr;
@@ -193,6 +267,32 @@ static void upload_plane(VideoPlane &p, int write_idx, const uint8_t *src, int s
     GX2RUnlockSurfaceEx(&surf, 0, GX2R_RESOURCE_BIND_NONE);
 }
 
+// Coalescing wake-up: signals set a pending flag so none are lost between a
+// waiter's last check and its wait.
+struct Waker {
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool pending = false;
+    uint32_t wakeups = 0;
+};
+
+static void waker_signal(Waker *w) {
+    std::lock_guard<std::mutex> lk(w->mtx);
+    w->pending = true;
+    w->cv.notify_one();
+}
+
+// Blocks until signalled, or for at most timeout_ms when it is not negative.
+static void waker_wait(Waker *w, int timeout_ms) {
+    std::unique_lock<std::mutex> lk(w->mtx);
+    if (timeout_ms < 0)
+        w->cv.wait(lk, [w] { return w->pending; });
+    else
+        w->cv.wait_for(lk, std::chrono::milliseconds(timeout_ms), [w] { return w->pending; });
+    w->pending = false;
+    w->wakeups++;
+}
+
 struct PacketQueue {
     PktNode *head = nullptr;
     PktNode *tail = nullptr;
@@ -203,10 +303,45 @@ struct PacketQueue {
     bool abort = false;
     std::mutex mtx;
     std::condition_variable cond;
+
+    // Low watermark, armed by the reader before it blocks on a full queue.
+    Waker *low_waker = nullptr;
+    int64_t low_dur = 0;
 };
 
 static AVPacket *g_flush_pkt = nullptr;
 
+// Pixels per second the SW video decoder managed in past sessions; read by
+// the network code when describing the device to a server.
+static std::atomic<double> g_sw_pixels_per_sec{0.0};
+
+// Throughput the adaptive-stream controller ended the last session with.
+static double g_abr_last_throughput = 0.0;
+
+static void arena_buffer_free(void * /*opaque*/, uint8_t *data) { player_arena_free(data); }
+
+// Moves a demuxed payload into the packet budget of the player arena. The
+// demuxer's heap buffer is released straight away, so only short-lived heap
+// blocks are left behind however deep the queues get.
+static void arena_adopt_packet(AVPacket *p) {
+    if (p->size <= 0 || !p->data) return;
+
+    uint8_t *mem = (uint8_t *)player_arena_alloc(ARENA_PACKETS, (size_t)p->size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!mem) return;
+
+    AVBufferRef *buf = av_buffer_create(mem, p->size + AV_INPUT_BUFFER_PADDING_SIZE, arena_buffer_free, nullptr, 0);
+    if (!buf) {
+        player_arena_free(mem);
+        return;
+    }
+    memcpy(mem, p->data, p->size);
+    memset(mem + p->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    av_buffer_unref(&p->buf);
+    p->buf = buf;
+    p->data = mem;
+}
+
 static void pq_init(PacketQueue *q) {
     q->head = q->tail = nullptr;
     q->nb_packets = q->size = q->serial = 0;
@@ -247,6 +382,7 @@ static bool pq_put(PacketQueue *q, AVPacket *pkt) {
     }
 
     av_packet_move_ref(p, pkt);
+    arena_adopt_packet(p);
     std::lock_guard<std::mutex> lk(q->mtx);
 
     if (q->abort) {
@@ -277,6 +413,11 @@ static int pq_get(PacketQueue *q, AVPacket *pkt, bool block, int *serial_out) {
             av_packet_free(&n->pkt);
             g_pkt_pool.free_node(n);
 
+            if (q->low_waker && (q->nb_packets <= MIN_FRAMES || (q->dur && q->dur <= q->low_dur))) {
+                waker_signal(q->low_waker);
+                q->low_waker = nullptr;
+            }
+
             return 1;
         }
         if (!block) return 0;
@@ -300,6 +441,22 @@ static void pq_flush_locked(PacketQueue *q) {
     q->serial++;
 }
 
+// Arms the low watermark; returns false (and leaves it disarmed) when the queue
+// is already below it, so the caller must not block.
+static bool pq_arm_low(PacketQueue *q, Waker *w, int64_t low_dur) {
+    std::lock_guard<std::mutex> lk(q->mtx);
+    if (q->abort) return true;
+    if (q->nb_packets <= MIN_FRAMES || (q->dur && q->dur <= low_dur)) return false;
+    q->low_dur = low_dur;
+    q->low_waker = w;
+    return true;
+}
+
+static void pq_disarm_low(PacketQueue *q) {
+    std::lock_guard<std::mutex> lk(q->mtx);
+    q->low_waker = nullptr;
+}
+
 static void pq_abort(PacketQueue *q) {
     std::lock_guard<std::mutex> lk(q->mtx);
     q->abort = true;
@@ -330,15 +487,21 @@ struct Frame {
 };
 
 struct FrameQueue {
-    Frame buf[16];
+    Frame buf[FRAME_QUEUE_MAX];
     int rindex = 0, windex = 0, size = 0;
     int max_size = 0, keep_last = 0, rindex_shown = 0;
     std::mutex mtx;
     std::condition_variable cond;
     PacketQueue *pktq = nullptr;
+
+    // Consumer that is not blocked on cond (the audio pump) asks to be woken
+    // by the next push.
+    std::atomic<bool> want_push{false};
+    Waker *push_waker = nullptr;
 };
 
 static int fq_init(FrameQueue *f, PacketQueue *pktq, int max_size, int keep_last) {
+    if (max_size > FRAME_QUEUE_MAX) max_size = FRAME_QUEUE_MAX;
     f->rindex = f->windex = f->size = f->rindex_shown = 0;
     f->max_size = max_size;
     f->keep_last = !!keep_last;
@@ -378,6 +541,7 @@ static void fq_push(FrameQueue *f) {
     std::lock_guard<std::mutex> lk(f->mtx);
     f->size++;
     f->cond.notify_one();
+    if (f->push_waker && f->want_push.exchange(false)) waker_signal(f->push_waker);
 }
 
 static void fq_next(FrameQueue *f) {
@@ -441,6 +605,12 @@ struct Decoder {
     AVRational start_pts_tb = {0, 1};
     int64_t next_pts = AV_NOPTS_VALUE;
     AVRational next_pts_tb = {0, 1};
+    // Time spent inside the codec and frames it returned, for the measured
+    // decode throughput.
+    std::atomic<uint64_t> busy_ticks{0};
+    std::atomic<int> frames{0};
+    DecoderWatch watch;
+    bool wait_keyframe = false; // after a decoder switch, until the next keyframe
 };
 
 static int decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue) {
@@ -452,6 +622,8 @@ static int decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue) {
     d->finished = d->packet_pending = 0;
     d->start_pts = d->next_pts = AV_NOPTS_VALUE;
     d->start_pts_tb = d->next_pts_tb = {0, 1};
+    d->watch = DecoderWatch{};
+    d->wait_keyframe = false;
     return 0;
 }
 
@@ -462,17 +634,26 @@ static void decoder_abort(Decoder *d, FrameQueue *fq) {
     fq_signal(fq);
 }
 
+#define DECODE_FAILING 2 // the video decoder keeps failing; see decoder_watch_failed
+
 static int decoder_decode_frame(Decoder *d, AVFrame *frame) {
     int ret = AVERROR(EAGAIN);
     for (;;) {
         if (d->queue->serial == d->pkt_serial) {
             do {
                 if (d->queue->abort) return -1;
+                if (d->avctx->codec_type == AVMEDIA_TYPE_VIDEO && decoder_watch_failed(d->watch)) return DECODE_FAILING;
                 switch (d->avctx->codec_type) {
-                    case AVMEDIA_TYPE_VIDEO:
+                    case AVMEDIA_TYPE_VIDEO: {
+                        uint64_t t0 = OSGetSystemTime();
                         ret = avcodec_receive_frame(d->avctx, frame);
-                        if (ret >= 0) frame->pts = frame->best_effort_timestamp;
+                        d->busy_ticks += OSGetSystemTime() - t0;
+                        if (ret >= 0) {
+                            frame->pts = frame->best_effort_timestamp;
+                            d->frames++;
+                        }
                         break;
+                    }
                     case AVMEDIA_TYPE_AUDIO:
                         ret = avcodec_receive_frame(d->avctx, frame);
                         if (ret >= 0) {
@@ -496,6 +677,7 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame) {
                     return 0;
                 }
                 if (ret >= 0) return 1;
+                if (ret != AVERROR(EAGAIN)) decoder_watch_error(&d->watch);
             } while (ret != AVERROR(EAGAIN));
         }
         do {
@@ -525,26 +707,165 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame) {
             av_packet_unref(d->pkt);
             continue;
         }
-        if (avcodec_send_packet(d->avctx, d->pkt) == AVERROR(EAGAIN))
+        if (d->wait_keyframe) {
+            if (!(d->pkt->flags & AV_PKT_FLAG_KEY)) {
+                av_packet_unref(d->pkt);
+                continue;
+            }
+            d->wait_keyframe = false;
+        }
+        uint64_t t0 = OSGetSystemTime();
+        int sent = avcodec_send_packet(d->avctx, d->pkt);
+        d->busy_ticks += OSGetSystemTime() - t0;
+        if (sent == AVERROR(EAGAIN)) {
             d->packet_pending = 1;
-        else
+        } else {
+            if (sent < 0)
+                decoder_watch_error(&d->watch);
+            else
+                decoder_watch_packet(&d->watch);
             av_packet_unref(d->pkt);
+        }
     }
 }
 
+// Per-plane buffer pools for the software decoder, backed by the video frame
+// budget of the player arena. Pools are rebuilt when the plane sizes change.
+struct ArenaFramePool {
+    AVBufferPool *pools[3] = {};
+    size_t sizes[3] = {};
+    std::mutex mtx;
+};
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+static AVBufferRef *arena_pool_alloc(void * /*opaque*/, size_t size) {
+#else
+static AVBufferRef *arena_pool_alloc(void * /*opaque*/, int size) {
+#endif
+    void *mem = player_arena_alloc(ARENA_VIDEO_FRAMES, size);
+    if (!mem) return nullptr;
+    AVBufferRef *buf = av_buffer_create((uint8_t *)mem, size, arena_buffer_free, nullptr, 0);
+    if (!buf) player_arena_free(mem);
+    return buf;
+}
+
+static void arena_frame_pool_free(ArenaFramePool *fp) {
+    std::lock_guard<std::mutex> lk(fp->mtx);
+    for (int i = 0; i < 3; ++i) {
+        av_buffer_pool_uninit(&fp->pools[i]);
+        fp->sizes[i] = 0;
+    }
+}
+
+// get_buffer2 for YUV420P software decoding; plane layout follows
+// avcodec_default_get_buffer2. Anything it cannot serve goes to the default.
+static int arena_get_buffer2(AVCodecContext *avctx, AVFrame *frame, int flags) {
+    ArenaFramePool *fp = (ArenaFramePool *)avctx->opaque;
+    if (!fp || frame->format != AV_PIX_FMT_YUV420P) return avcodec_default_get_buffer2(avctx, frame, flags);
+
+    int w = frame->width, h = frame->height;
+    int align[AV_NUM_DATA_POINTERS];
+    int linesize[4];
+    avcodec_align_dimensions2(avctx, &w, &h, align);
+
+    int unaligned;
+    do {
+        if (av_image_fill_linesizes(linesize, AV_PIX_FMT_YUV420P, w) < 0) return avcodec_default_get_buffer2(avctx, frame, flags);
+        w += w & ~(w - 1);
+        unaligned = 0;
+        for (int i = 0; i < 3; ++i) unaligned |= linesize[i] % align[i];
+    } while (unaligned);
+
+    size_t sizes[3] = {(size_t)linesize[0] * h, (size_t)linesize[1] * ((h + 1) >> 1), (size_t)linesize[2] * ((h + 1) >> 1)};
+
+    AVBufferRef *bufs[3] = {};
+    {
+        std::lock_guard<std::mutex> lk(fp->mtx);
+        for (int i = 0; i < 3; ++i) {
+            size_t want = sizes[i] + 16 + 64 - 1;
+            if (fp->sizes[i] != want) {
+                av_buffer_pool_uninit(&fp->pools[i]);
+                fp->pools[i] = av_buffer_pool_init2(want, nullptr, arena_pool_alloc, nullptr);
+                fp->sizes[i] = fp->pools[i] ? want : 0;
+            }
+            bufs[i] = fp->pools[i] ? av_buffer_pool_get(fp->pools[i]) : nullptr;
+        }
+    }
+    if (!bufs[0] || !bufs[1] || !bufs[2]) {
+        for (int i = 0; i < 3; ++i) av_buffer_unref(&bufs[i]);
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        frame->buf[i] = bufs[i];
+        frame->data[i] = bufs[i]->data;
+        frame->linesize[i] = linesize[i];
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
 enum class VideoFmt { Unknown, YUV420P, NV12 };
 
-struct PlayerState;
-using RenderFn = void (*)(const rect &);
+enum class PlayerCmdType { Play, Pause, Seek, SwitchAudio };
+
+struct PlayerCmd {
+    PlayerCmdType type;
+    int64_t pos;
+    int stream_idx;
+    uint64_t issued;
+};
+
+struct MediaPlayer;
+using RenderFn = void (*)(MediaPlayer *, const rect &);
+
+// One variant of an adaptive stream. HLS/DASH demuxers expose every variant
+// as its own streams; audio_idx is -1 when audio is shared between them.
+// Counters sampled by the ABR tick on the UI thread.
+struct AbrCounters {
+    uint64_t net_bytes = 0;
+    uint64_t net_ticks = 0;
+    uint64_t busy_ticks = 0;
+    int decoded = 0;
+    int shown = 0;
+    int dropped = 0;
+    double lateness = 0.0;
+};
+
+// A subtitle track: an internal stream with its decoder, or a sidecar file
+// parsed at open (stream_index -1). Bitmap tracks keep no cues; their events
+// go through subq and sub_bitmaps instead.
+struct SubtitleSource {
+    int stream_index = -1;
+    AVCodecContext *avctx = nullptr;
+    bool bitmap = false;
+    std::string label;
+    SubtitleTrack track;
+};
 
-struct PlayerState {
+struct MediaPlayer {
+    MediaPlayerOptions opts;
+    bool main = false; // the instance behind media_player_*, which publishes media_info
+    std::string source; // as passed to player_open, held against the remuxer
     AVFormatContext *fmt_ctx = nullptr;
-    int video_idx = -1;
-    int audio_idx = -1;
+    HttpSource *http_src = nullptr;
+    AVIOContext *http_avio = nullptr;
+    // HLS/DASH segments opened through HttpSource, so they reach the disk cache.
+    int (*default_io_open)(AVFormatContext *, AVIOContext **, const char *, int, AVDictionary **) = nullptr;
+    int (*default_io_close2)(AVFormatContext *, AVIOContext *) = nullptr;
+    std::mutex segment_mtx;
+    std::vector<HttpSource *> segment_srcs;
+    // Changed by the read thread on ABR switches and audio track changes,
+    // read everywhere else.
+    std::atomic<int> video_idx{-1};
+    std::atomic<int> audio_idx{-1};
     AVRational video_tb = {0, 1};
 
-    AVCodecContext *video_avctx = nullptr;
+    // Replaced by the decode thread on a decoder switch; other threads only
+    // test it for null.
+    std::atomic<AVCodecContext *> video_avctx{nullptr};
     AVCodecContext *audio_avctx = nullptr;
+    ArenaFramePool frame_pool;
 
     PacketQueue videoq, audioq;
     FrameQueue pictq, sampq;
@@ -556,9 +877,22 @@ struct PlayerState {
     double wall_play_offset = 0.0;
 
     SwrContext *swr_ctx = nullptr;
-    SDL_AudioDeviceID audio_dev = 0;
-    SDL_AudioSpec audio_spec = {};
-    bool audio_enabled = false;
+    std::vector<uint8_t> pcm_buf; // pump thread, resampler output
+    MixerSource audio_src = 0;
+    std::atomic<bool> audio_enabled{false};
+    std::atomic<bool> audio_clock_primed{false};
+
+    bool audio_only = false;
+    uint32_t audio_buf_max = AUDIO_BUF_MAX_BYTES;
+    double audio_buf_low = AUDIO_BUF_LOW_SECONDS;
+    double queue_seconds = MIN_QUEUE_SECONDS;
+    std::vector<uint8_t> cover_art;
+
+    // Audio codec/mixer setup runs beside video start-up; audio_mtx guards the
+    // hand-over of audio_src between that thread and play/seek on the UI thread.
+    std::thread audio_setup_tid;
+    std::atomic<bool> audio_setup_done{false}; // audio_setup_tid has finished; its results may be read
+    std::mutex audio_mtx;
 
     std::atomic<VideoFmt> video_fmt{VideoFmt::Unknown};
 
@@ -572,8 +906,7 @@ struct PlayerState {
 
     int plane_write_idx = 0;
 
-    WHBGfxShaderGroup *shader_yuv420p = nullptr;
-    WHBGfxShaderGroup *shader_nv12 = nullptr;
+    VideoFmt plane_fmt = VideoFmt::Unknown;
 
     void *quad_vtx = nullptr;
     uint32_t quad_vtx_size = 0;
@@ -584,7 +917,9 @@ struct PlayerState {
     bool dest_rect_init = false;
     int out_w = 0;
     int out_h = 0;
-    bool hw_decoder = false;
+    std::atomic<bool> hw_decoder{false};
+    DecoderPlan decoder_plan;
+    int pictq_depth = 0;
 
     double frame_timer = 0.0;
     double max_frame_dur = 3600.0;
@@ -595,27 +930,105 @@ struct PlayerState {
     bool force_refresh = false;
     bool eof = false;
 
+    // Scrub state, UI thread only except scrub_read.
+    bool scrubbing = false;
+    bool scrub_resume = false; // was playing when the scrub began
+    double scrub_target = 0.0;
+    double scrub_issued = NAN; // target of the last seek sent to the read thread
+    double scrub_input_time = 0.0;
+    double scrub_issue_time = 0.0;
+    int scrub_issue_serial = -1; // videoq serial before that seek
+    int scrub_shown_serial = -1; // serial of the last preview frame put on screen
+    std::atomic<bool> scrub_read{false}; // demux while paused so previews can decode
+
     std::thread read_tid, video_tid, audio_tid, audio_pump_tid;
 
-    std::mutex seek_mtx;
-    std::condition_variable seek_cv;
-    bool seek_req = false;
-    int64_t seek_pos = 0;
+    // Commands for the read thread; guarded by read_waker.mtx.
+    std::deque<PlayerCmd> cmds;
+    Waker read_waker;
+    Waker pump_waker;
+
+    // Badly interleaved files: a second demuxer with its own AVIO handle reads
+    // the audio stream and refills audioq, while read_thread only fetches video.
+    // audio_cmds is guarded by audio_read_waker.mtx.
+    AVFormatContext *audio_fmt_ctx = nullptr;
+    std::thread audio_read_tid;
+    std::deque<PlayerCmd> audio_cmds;
+    Waker audio_read_waker;
 
-    std::mutex read_sleep_mtx;
-    std::condition_variable read_sleep_cv;
+    uint32_t cmds_done = 0;
+    uint64_t cmd_latency_sum_us = 0;
+    uint64_t cmd_latency_max_us = 0;
 
     std::vector<AudioTrackInfo> audio_tracks;
     std::mutex audio_tracks_mtx;
     int cur_audio_track = -1;
 
+    // The list is fixed before the threads start. The read thread adds cues of
+    // internal streams under sub_mtx and bumps sub_version; the UI thread only
+    // looks them up again when the version or the cursor window says so.
+    std::vector<SubtitleSource> subtitles;
+    std::mutex sub_mtx;
+    std::atomic<uint32_t> sub_version{0};
+    int sub_selected = -1;
+    bool sub_dirty = false; // selection changed since the last player_get_subtitles
+    SubtitleCursor sub_cursor;
+
+    // Bitmap subtitles: packets of the selected bitmap stream go to subq, the
+    // subtitle thread turns each event into one image in sub_bitmaps (under
+    // sub_mtx, at most SUBTITLE_BITMAP_BUDGET bytes), and the UI thread keeps
+    // the one on screen in sub_bitmap_shown until the video clock leaves it.
+    PacketQueue subq;
+    std::thread sub_tid;
+    std::atomic<int> sub_bitmap_stream{-1};
+    Waker sub_waker; // the UI retired images
+    std::deque<std::shared_ptr<SubtitleBitmap>> sub_bitmaps;
+    size_t sub_bitmap_bytes = 0;
+    std::shared_ptr<SubtitleBitmap> sub_bitmap_shown;
+    uint32_t sub_bitmap_version = 0;
+    double sub_bitmap_from = 1.0;
+    double sub_bitmap_until = 0.0;
+
     int frames_decoded = 0;
     int frames_dropped = 0;
     double last_log_time = 0.0;
+
+    profiler startup_prof{};
+    bool first_frame_shown = false;
+
+    // Bytes demuxed and time spent blocked in av_read_frame (read thread).
+    std::atomic<uint64_t> net_bytes{0};
+    std::atomic<uint64_t> net_ticks{0};
+    double lateness_sum = 0.0; // UI thread, how late shown frames were
+
+    // Adaptive streaming. The controller runs on the UI thread and publishes
+    // abr_target; the read thread enables that variant and moves over at its
+    // first keyframe, so the decoder keeps running across the switch.
+    std::vector<AbrLadderEntry> abr_ladder; // same order as abr.variants
+    AbrController abr;
+    std::atomic<int> abr_target{-1};
+    int abr_active = -1;  // read thread
+    int abr_pending = -1; // read thread
+    double abr_frame_dur = 0.0;
+    double abr_last_tick = 0.0;
+    AbrCounters abr_last;
 };
 
-static PlayerState *S = nullptr;
-static void rebuild_swr();
+// Resources that outlive player instances, so the next open skips shader
+// loading, texture allocation and network start-up. UI thread only.
+static struct {
+    bool network = false;
+    WHBGfxShaderGroup *shader_yuv420p = nullptr;
+    WHBGfxShaderGroup *shader_nv12 = nullptr;
+
+    // Planes and quad of the last closed instance, kept for the next one.
+    VideoFmt spare_fmt = VideoFmt::Unknown;
+    VideoPlane spare_y, spare_u, spare_v, spare_uv;
+    void *spare_quad = nullptr;
+} g_ctx;
+
+static void rebuild_swr(MediaPlayer *ps);
+static double get_master_clock(MediaPlayer *ps);
 
 static WHBGfxShaderGroup *load_shader(const uint8_t *gsh_data, const char *name) {
     WHBGfxShaderGroup *g = new WHBGfxShaderGroup{};
@@ -651,79 +1064,125 @@ static void free_shader(WHBGfxShaderGroup *&g) {
     g = nullptr;
 }
 
-static bool init_video_planes(VideoFmt fmt, int coded_w, int coded_h) {
+static void free_spare_planes() {
+    free_plane(g_ctx.spare_y);
+    free_plane(g_ctx.spare_u);
+    free_plane(g_ctx.spare_v);
+    free_plane(g_ctx.spare_uv);
+    g_ctx.spare_fmt = VideoFmt::Unknown;
+}
+
+static void video_render_yuv420p(MediaPlayer *ps, const rect &dest);
+static void video_render_nv12(MediaPlayer *ps, const rect &dest);
+
+static bool init_video_planes(MediaPlayer *ps, VideoFmt fmt, int coded_w, int coded_h) {
+    ps->plane_fmt = fmt;
+    ps->render_fn = fmt == VideoFmt::NV12 ? video_render_nv12 : video_render_yuv420p;
+    if (g_ctx.spare_fmt == fmt && g_ctx.spare_y.coded_w == coded_w && g_ctx.spare_y.coded_h == coded_h) {
+        ps->plane_y = g_ctx.spare_y;
+        ps->plane_u = g_ctx.spare_u;
+        ps->plane_v = g_ctx.spare_v;
+        ps->plane_uv = g_ctx.spare_uv;
+        g_ctx.spare_y = g_ctx.spare_u = g_ctx.spare_v = g_ctx.spare_uv = VideoPlane{};
+        g_ctx.spare_fmt = VideoFmt::Unknown;
+        log_message(LOG_OK, MP, "init_video_planes: reusing %s %dx%d", fmt == VideoFmt::NV12 ? "NV12" : "YUV420P", coded_w, coded_h);
+        return true;
+    }
+    // Planes live in MEM1; make room before allocating a different set.
+    free_spare_planes();
+
     const uint32_t cm_r8 = GX2_COMP_MAP(GX2_SQ_SEL_R, GX2_SQ_SEL_0, GX2_SQ_SEL_0, GX2_SQ_SEL_1);
     const uint32_t cm_rg8 = GX2_COMP_MAP(GX2_SQ_SEL_R, GX2_SQ_SEL_G, GX2_SQ_SEL_0, GX2_SQ_SEL_1);
 
-    if (!alloc_plane(S->plane_y, GX2_SURFACE_FORMAT_UNORM_R8, cm_r8, coded_w, coded_h)) return false;
+    if (!alloc_plane(ps->plane_y, GX2_SURFACE_FORMAT_UNORM_R8, cm_r8, coded_w, coded_h)) return false;
 
     if (fmt == VideoFmt::YUV420P) {
-        if (!alloc_plane(S->plane_u, GX2_SURFACE_FORMAT_UNORM_R8, cm_r8, coded_w / 2, coded_h / 2)) return false;
-        if (!alloc_plane(S->plane_v, GX2_SURFACE_FORMAT_UNORM_R8, cm_r8, coded_w / 2, coded_h / 2)) return false;
-        log_message(LOG_OK, MP, "init_video_planes: YUV420P %dx%d (Y-pitch=%u U-pitch=%u)", coded_w, coded_h, S->plane_y.tex[0].surface.pitch, S->plane_u.tex[0].surface.pitch);
+        if (!alloc_plane(ps->plane_u, GX2_SURFACE_FORMAT_UNORM_R8, cm_r8, coded_w / 2, coded_h / 2)) return false;
+        if (!alloc_plane(ps->plane_v, GX2_SURFACE_FORMAT_UNORM_R8, cm_r8, coded_w / 2, coded_h / 2)) return false;
+        log_message(LOG_OK, MP, "init_video_planes: YUV420P %dx%d (Y-pitch=%u U-pitch=%u)", coded_w, coded_h, ps->plane_y.tex[0].surface.pitch, ps->plane_u.tex[0].surface.pitch);
     } else {
-        if (!alloc_plane(S->plane_uv, GX2_SURFACE_FORMAT_UNORM_R8_G8, cm_rg8, coded_w / 2, coded_h / 2)) return false;
-        log_message(LOG_OK, MP, "init_video_planes: NV12 %dx%d (Y-pitch=%u UV-pitch=%u)", coded_w, coded_h, S->plane_y.tex[0].surface.pitch, S->plane_uv.tex[0].surface.pitch);
+        if (!alloc_plane(ps->plane_uv, GX2_SURFACE_FORMAT_UNORM_R8_G8, cm_rg8, coded_w / 2, coded_h / 2)) return false;
+        log_message(LOG_OK, MP, "init_video_planes: NV12 %dx%d (Y-pitch=%u UV-pitch=%u)", coded_w, coded_h, ps->plane_y.tex[0].surface.pitch, ps->plane_uv.tex[0].surface.pitch);
     }
     return true;
 }
 
-static void free_video_planes() {
-    free_plane(S->plane_y);
-    free_plane(S->plane_u);
-    free_plane(S->plane_v);
-    free_plane(S->plane_uv);
+static void free_video_planes(MediaPlayer *ps) {
+    free_plane(ps->plane_y);
+    free_plane(ps->plane_u);
+    free_plane(ps->plane_v);
+    free_plane(ps->plane_uv);
+}
+
+// Keeps the planes and quad of a closing instance for the next open; the
+// most recent set wins.
+static void park_video_output(MediaPlayer *ps) {
+    if (ps->plane_y.valid) {
+        free_spare_planes();
+        g_ctx.spare_fmt = ps->plane_fmt;
+        g_ctx.spare_y = ps->plane_y;
+        g_ctx.spare_u = ps->plane_u;
+        g_ctx.spare_v = ps->plane_v;
+        g_ctx.spare_uv = ps->plane_uv;
+        ps->plane_y = ps->plane_u = ps->plane_v = ps->plane_uv = VideoPlane{};
+    }
+    if (!g_ctx.spare_quad) {
+        g_ctx.spare_quad = ps->quad_vtx;
+        ps->quad_vtx = nullptr;
+    }
+    free(ps->quad_vtx);
+    ps->quad_vtx = nullptr;
 }
 
-static void update_quad(const rect &r) {
+static void update_quad(MediaPlayer *ps, const rect &r) {
     // Skip if nothing changed
-    if (r.x == S->quad_last_rect.x && r.y == S->quad_last_rect.y && r.w == S->quad_last_rect.w && r.h == S->quad_last_rect.h) return;
+    if (r.x == ps->quad_last_rect.x && r.y == ps->quad_last_rect.y && r.w == ps->quad_last_rect.w && r.h == ps->quad_last_rect.h) return;
 
     constexpr uint32_t needed = 4 * sizeof(VideoVertex);
-    if (!S->quad_vtx || S->quad_vtx_size < needed) {
-        free(S->quad_vtx);
-        S->quad_vtx = memalign(GX2_VERTEX_BUFFER_ALIGNMENT, needed);
-        S->quad_vtx_size = needed;
+    if (!ps->quad_vtx) {
+        ps->quad_vtx = g_ctx.spare_quad ? g_ctx.spare_quad : memalign(GX2_VERTEX_BUFFER_ALIGNMENT, needed);
+        g_ctx.spare_quad = nullptr;
+        ps->quad_vtx_size = needed;
     }
 
     float x0 = px_to_ndc_x(r.x), y0 = px_to_ndc_y(r.y);
     float x1 = px_to_ndc_x(r.x + r.w), y1 = px_to_ndc_y(r.y + r.h);
 
-    VideoVertex *v = static_cast<VideoVertex *>(S->quad_vtx);
+    VideoVertex *v = static_cast<VideoVertex *>(ps->quad_vtx);
     v[0] = {x0, y0, 0.0f, 0.0f}; // top-left
     v[1] = {x0, y1, 0.0f, 1.0f}; // bottom-left
     v[2] = {x1, y0, 1.0f, 0.0f}; // top-right
     v[3] = {x1, y1, 1.0f, 1.0f}; // bottom-right
 
-    GX2Invalidate(GX2_INVALIDATE_MODE_CPU_ATTRIBUTE_BUFFER, S->quad_vtx, S->quad_vtx_size);
-    S->quad_last_rect = r;
+    GX2Invalidate(GX2_INVALIDATE_MODE_CPU_ATTRIBUTE_BUFFER, ps->quad_vtx, ps->quad_vtx_size);
+    ps->quad_last_rect = r;
 }
 
-static void video_upload_frame(const AVFrame *f) {
-    const int wi = S->plane_write_idx;
+static void video_upload_frame(MediaPlayer *ps, const AVFrame *f) {
+    const int wi = ps->plane_write_idx;
 
     if (f->format == AV_PIX_FMT_YUV420P) {
         // Y: full resolution, 1 byte/sample
-        upload_plane(S->plane_y, wi, f->data[0], f->linesize[0], f->width, f->height);
+        upload_plane(ps->plane_y, wi, f->data[0], f->linesize[0], f->width, f->height);
         // U: half resolution, 1 byte/sample
-        upload_plane(S->plane_u, wi, f->data[1], f->linesize[1], f->width / 2, f->height / 2);
+        upload_plane(ps->plane_u, wi, f->data[1], f->linesize[1], f->width / 2, f->height / 2);
         // V: half resolution, 1 byte/sample
-        upload_plane(S->plane_v, wi, f->data[2], f->linesize[2], f->width / 2, f->height / 2);
+        upload_plane(ps->plane_v, wi, f->data[2], f->linesize[2], f->width / 2, f->height / 2);
     } else if (f->format == AV_PIX_FMT_NV12) {
         // Y: full resolution, 1 byte/sample
-        upload_plane(S->plane_y, wi, f->data[0], f->linesize[0], f->width, f->height);
+        upload_plane(ps->plane_y, wi, f->data[0], f->linesize[0], f->width, f->height);
         // UV: interleaved, half resolution.
-        upload_plane(S->plane_uv, wi, f->data[1], f->linesize[1], f->width, f->height / 2);
+        upload_plane(ps->plane_uv, wi, f->data[1], f->linesize[1], f->width, f->height / 2);
     } else {
         log_message(LOG_WARNING, MP, "video_upload_frame: unsupported fmt=%d — frame skipped", f->format);
         return;
     }
 
-    S->plane_write_idx ^= 1;
+    ps->plane_write_idx ^= 1;
 }
 
-static void video_render_common(WHBGfxShaderGroup *grp) {
-    if (!grp || !S->quad_vtx) return;
+static void video_render_common(MediaPlayer *ps, WHBGfxShaderGroup *grp) {
+    if (!grp || !ps->quad_vtx) return;
 
     GX2SetColorControl(GX2_LOGIC_OP_COPY, 0xFF, FALSE, TRUE);
     GX2SetBlendControl(GX2_RENDER_TARGET_0, GX2_BLEND_MODE_ONE, GX2_BLEND_MODE_ZERO, GX2_BLEND_COMBINE_MODE_ADD, FALSE, GX2_BLEND_MODE_ONE, GX2_BLEND_MODE_ZERO, GX2_BLEND_COMBINE_MODE_ADD);
@@ -738,40 +1197,40 @@ static void video_render_common(WHBGfxShaderGroup *grp) {
     const float mvp[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
 
     GX2SetVertexUniformReg(0, 16, &mvp[0][0]);
-    GX2SetAttribBuffer(0, S->quad_vtx_size, sizeof(VideoVertex), S->quad_vtx);
+    GX2SetAttribBuffer(0, ps->quad_vtx_size, sizeof(VideoVertex), ps->quad_vtx);
     GX2DrawEx(GX2_PRIMITIVE_MODE_TRIANGLE_STRIP, 4, 0, 1);
 }
 
-static void video_render_yuv420p(const rect & /*dest*/) {
-    const int ri = S->plane_write_idx ^ 1;
+static void video_render_yuv420p(MediaPlayer *ps, const rect & /*dest*/) {
+    const int ri = ps->plane_write_idx ^ 1;
 
-    GX2SetPixelTexture(&S->plane_y.tex[ri], 0);
-    GX2SetPixelSampler(&S->plane_y.smp, 0);
-    GX2SetPixelTexture(&S->plane_u.tex[ri], 1);
-    GX2SetPixelSampler(&S->plane_u.smp, 1);
-    GX2SetPixelTexture(&S->plane_v.tex[ri], 2);
-    GX2SetPixelSampler(&S->plane_v.smp, 2);
+    GX2SetPixelTexture(&ps->plane_y.tex[ri], 0);
+    GX2SetPixelSampler(&ps->plane_y.smp, 0);
+    GX2SetPixelTexture(&ps->plane_u.tex[ri], 1);
+    GX2SetPixelSampler(&ps->plane_u.smp, 1);
+    GX2SetPixelTexture(&ps->plane_v.tex[ri], 2);
+    GX2SetPixelSampler(&ps->plane_v.smp, 2);
 
-    video_render_common(S->shader_yuv420p);
+    video_render_common(ps, g_ctx.shader_yuv420p);
 }
 
-static void video_render_nv12(const rect & /*dest*/) {
-    const int ri = S->plane_write_idx ^ 1;
+static void video_render_nv12(MediaPlayer *ps, const rect & /*dest*/) {
+    const int ri = ps->plane_write_idx ^ 1;
 
-    GX2SetPixelTexture(&S->plane_y.tex[ri], 0);
-    GX2SetPixelSampler(&S->plane_y.smp, 0);
-    GX2SetPixelTexture(&S->plane_uv.tex[ri], 1);
-    GX2SetPixelSampler(&S->plane_uv.smp, 1);
+    GX2SetPixelTexture(&ps->plane_y.tex[ri], 0);
+    GX2SetPixelSampler(&ps->plane_y.smp, 0);
+    GX2SetPixelTexture(&ps->plane_uv.tex[ri], 1);
+    GX2SetPixelSampler(&ps->plane_uv.smp, 1);
 
-    video_render_common(S->shader_nv12);
+    video_render_common(ps, g_ctx.shader_nv12);
 }
 
-static void rebuild_swr() {
-    if (S->swr_ctx) {
-        swr_free(&S->swr_ctx);
-        S->swr_ctx = nullptr;
+static void rebuild_swr(MediaPlayer *ps) {
+    if (ps->swr_ctx) {
+        swr_free(&ps->swr_ctx);
+        ps->swr_ctx = nullptr;
     }
-    AVCodecContext *ac = S->audio_avctx;
+    AVCodecContext *ac = ps->audio_avctx;
     if (!ac) return;
 
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
@@ -784,100 +1243,132 @@ static void rebuild_swr() {
     (void)in_chc;
     int64_t out_ch = av_get_default_channel_layout(AUDIO_OUT_CHANNELS);
 
-    S->swr_ctx = swr_alloc();
-    if (!S->swr_ctx) {
+    ps->swr_ctx = swr_alloc();
+    if (!ps->swr_ctx) {
         log_message(LOG_ERROR, MP, "swr_alloc failed");
         return;
     }
-    av_opt_set_int(S->swr_ctx, "in_channel_layout", in_ch, 0);
-    av_opt_set_int(S->swr_ctx, "out_channel_layout", out_ch, 0);
-    av_opt_set_int(S->swr_ctx, "in_sample_rate", ac->sample_rate, 0);
-    av_opt_set_int(S->swr_ctx, "out_sample_rate", AUDIO_OUT_RATE, 0);
-    av_opt_set_sample_fmt(S->swr_ctx, "in_sample_fmt", ac->sample_fmt, 0);
-    av_opt_set_sample_fmt(S->swr_ctx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-    if (swr_init(S->swr_ctx) < 0) {
+    av_opt_set_int(ps->swr_ctx, "in_channel_layout", in_ch, 0);
+    av_opt_set_int(ps->swr_ctx, "out_channel_layout", out_ch, 0);
+    av_opt_set_int(ps->swr_ctx, "in_sample_rate", ac->sample_rate, 0);
+    av_opt_set_int(ps->swr_ctx, "out_sample_rate", AUDIO_OUT_RATE, 0);
+    av_opt_set_sample_fmt(ps->swr_ctx, "in_sample_fmt", ac->sample_fmt, 0);
+    av_opt_set_sample_fmt(ps->swr_ctx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
+    if (swr_init(ps->swr_ctx) < 0) {
         log_message(LOG_ERROR, MP, "swr_init failed");
-        swr_free(&S->swr_ctx);
-        S->swr_ctx = nullptr;
+        swr_free(&ps->swr_ctx);
+        ps->swr_ctx = nullptr;
     }
 }
 
-static void pump_audio() {
-    if (!S->audio_enabled || !S->audio_dev) return;
-    if (S->paused.load(std::memory_order_relaxed)) return;
-    if (SDL_GetQueuedAudioSize(S->audio_dev) > AUDIO_BUF_MAX_BYTES) return;
-    if (!S->swr_ctx) return;
+static void pump_audio(MediaPlayer *ps) {
+    if (!ps->audio_enabled.load(std::memory_order_acquire)) return;
+    if (ps->paused.load(std::memory_order_relaxed)) return;
+    if (audio_mixer_queued(ps->audio_src) > ps->audio_buf_max) return;
+    if (!ps->swr_ctx) return;
 
-    static std::vector<uint8_t> pcm_buf;
     const int bps = av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
 
-    while (fq_nb_remaining(&S->sampq) > 0) {
-        Frame *af = fq_peek(&S->sampq);
+    while (fq_nb_remaining(&ps->sampq) > 0 && !ps->paused.load(std::memory_order_relaxed)) {
+        Frame *af = fq_peek(&ps->sampq);
         if (!af || !af->frame) break;
-        if (af->serial != S->audioq.serial) {
-            fq_next(&S->sampq);
+        if (af->serial != ps->audioq.serial) {
+            fq_next(&ps->sampq);
             continue;
         }
 
+        // Audio may come up after video already started on the wall clock; drop
+        // what is already in the past instead of pulling the master clock back.
+        if (!ps->audio_clock_primed.load(std::memory_order_relaxed)) {
+            double now = get_master_clock(ps);
+            if (!std::isnan(af->pts) && af->pts + af->duration < now) {
+                fq_next(&ps->sampq);
+                continue;
+            }
+            ps->audio_clock_primed.store(true, std::memory_order_release);
+        }
+
         AVFrame *f = af->frame;
-        int delay = swr_get_delay(S->swr_ctx, S->audio_avctx->sample_rate);
-        int max_out = (int)av_rescale_rnd((int64_t)f->nb_samples + delay, AUDIO_OUT_RATE, S->audio_avctx->sample_rate, AV_ROUND_UP);
+        int delay = swr_get_delay(ps->swr_ctx, ps->audio_avctx->sample_rate);
+        int max_out = (int)av_rescale_rnd((int64_t)f->nb_samples + delay, AUDIO_OUT_RATE, ps->audio_avctx->sample_rate, AV_ROUND_UP);
 
         size_t need = (size_t)max_out * AUDIO_OUT_CHANNELS * bps;
-        if (pcm_buf.size() < need) pcm_buf.resize(need);
+        if (ps->pcm_buf.size() < need) ps->pcm_buf.resize(need);
 
-        uint8_t *out = pcm_buf.data();
-        int n = swr_convert(S->swr_ctx, &out, max_out, (const uint8_t **)f->data, f->nb_samples);
+        uint8_t *out = ps->pcm_buf.data();
+        int n = swr_convert(ps->swr_ctx, &out, max_out, (const uint8_t **)f->data, f->nb_samples);
         if (n < 0) {
-            fq_next(&S->sampq);
+            fq_next(&ps->sampq);
             continue;
         }
         if (n > 0) {
-            SDL_QueueAudio(S->audio_dev, pcm_buf.data(), n * AUDIO_OUT_CHANNELS * bps);
+            audio_mixer_queue(ps->audio_src, (const int16_t *)ps->pcm_buf.data(), n * AUDIO_OUT_CHANNELS * bps);
             if (!std::isnan(af->pts)) {
                 double pts_end = af->pts + (double)n / AUDIO_OUT_RATE;
-                double queued = SDL_GetQueuedAudioSize(S->audio_dev) / (double)(AUDIO_OUT_RATE * AUDIO_OUT_CHANNELS * bps);
-                clock_set(&S->audclk, pts_end - queued, af->serial);
-                clock_sync_to_slave(&S->extclk, &S->audclk);
+                double queued = audio_mixer_queued(ps->audio_src) / (double)(AUDIO_OUT_RATE * AUDIO_OUT_CHANNELS * bps) + audio_mixer_latency();
+                clock_set(&ps->audclk, pts_end - queued, af->serial);
+                clock_sync_to_slave(&ps->extclk, &ps->audclk);
             }
         }
-        fq_next(&S->sampq);
+        fq_next(&ps->sampq);
 
-        if (SDL_GetQueuedAudioSize(S->audio_dev) > AUDIO_BUF_MAX_BYTES) break;
+        if (audio_mixer_queued(ps->audio_src) > ps->audio_buf_max) break;
     }
 }
 
-static bool stream_has_enough_packets(AVStream *st, int id, const PacketQueue &q) { return id < 0 || q.abort || (st->disposition & AV_DISPOSITION_ATTACHED_PIC) || (q.nb_packets > MIN_FRAMES && (!q.dur || av_q2d(st->time_base) * q.dur > 1.0)); }
+static bool stream_has_enough_packets(AVStream *st, int id, const PacketQueue &q, double min_seconds) { return id < 0 || q.abort || (st->disposition & AV_DISPOSITION_ATTACHED_PIC) || (q.nb_packets > MIN_FRAMES && (!q.dur || av_q2d(st->time_base) * q.dur > min_seconds)); }
+
+// How long the pump may sleep: until the mixer source drains to the low
+// watermark, or indefinitely (-1) when only a new frame, play or seek can give
+// it work.
+static int audio_pump_wait_ms(MediaPlayer *ps) {
+    if (ps->paused.load(std::memory_order_relaxed)) return -1;
 
-static void audio_pump_thread() {
+    double queued = audio_mixer_queued(ps->audio_src) / (double)AUDIO_BYTES_PER_SEC;
+    double slack = queued - ps->audio_buf_low;
+    if (slack > 0.0) return (int)(slack * 1000.0);
+
+    ps->sampq.want_push.store(true);
+    if (fq_nb_remaining(&ps->sampq) > 0) {
+        ps->sampq.want_push.store(false);
+        return 0;
+    }
+    return -1;
+}
+
+static void audio_pump_thread(MediaPlayer *ps) {
     log_message(LOG_DEBUG, MP, "Audio pump thread started");
-    PlayerState *ps = S;
     while (ps->running.load(std::memory_order_relaxed)) {
-        if (!ps->paused.load(std::memory_order_relaxed)) pump_audio();
-        std::this_thread::sleep_for(std::chrono::milliseconds(8));
+        int wait_ms;
+        {
+            std::lock_guard<std::mutex> lk(ps->audio_mtx);
+            pump_audio(ps);
+            wait_ms = audio_pump_wait_ms(ps);
+        }
+        if (wait_ms != 0) waker_wait(&ps->pump_waker, wait_ms);
     }
     log_message(LOG_DEBUG, MP, "Audio pump thread exiting");
 }
 
-__attribute__((always_inline)) static inline double get_master_clock() {
-    if (!S) return 0.0;
-    if (S->audio_enabled && S->audio_dev) {
-        double t = clock_get(&S->audclk);
+static double get_master_clock(MediaPlayer *ps) {
+    if (!ps) return 0.0;
+    if (ps->audio_enabled.load(std::memory_order_acquire) && ps->audio_clock_primed.load(std::memory_order_acquire)) {
+        double t = clock_get(&ps->audclk);
         if (!std::isnan(t) && t > 0.0) return t;
     }
-    return S->paused.load(std::memory_order_relaxed) ? S->wall_play_offset : S->wall_play_offset + (wall_now() - S->wall_play_origin);
+    return ps->paused.load(std::memory_order_relaxed) ? ps->wall_play_offset : ps->wall_play_offset + (wall_now() - ps->wall_play_origin);
 }
 
-static double vp_duration(Frame *vp, Frame *nextvp) {
+static double vp_duration(MediaPlayer *ps, Frame *vp, Frame *nextvp) {
     if (vp->serial != nextvp->serial) return 0.0;
     double d = nextvp->pts - vp->pts;
-    return (std::isnan(d) || d <= 0 || d > S->max_frame_dur) ? vp->duration : d;
+    return (std::isnan(d) || d <= 0 || d > ps->max_frame_dur) ? vp->duration : d;
 }
 
-static double compute_target_delay(double delay) {
-    double diff = clock_get(&S->vidclk) - get_master_clock();
+static double compute_target_delay(MediaPlayer *ps, double delay) {
+    double diff = clock_get(&ps->vidclk) - get_master_clock(ps);
     double thr = FFMAX(AV_SYNC_THRESHOLD_MIN, FFMIN(AV_SYNC_THRESHOLD_MAX, delay));
-    if (!std::isnan(diff) && std::fabs(diff) < S->max_frame_dur) {
+    if (!std::isnan(diff) && std::fabs(diff) < ps->max_frame_dur) {
         if (diff <= -thr)
             delay = FFMAX(0.0, delay + diff);
         else if (diff >= thr && delay > AV_SYNC_FRAMEDUP_THR)
@@ -888,10 +1379,43 @@ static double compute_target_delay(double delay) {
     return delay;
 }
 
-static void video_decode_thread() {
+static VideoFmt frame_video_fmt(int format) {
+    if (format == AV_PIX_FMT_YUV420P) return VideoFmt::YUV420P;
+    if (format == AV_PIX_FMT_NV12) return VideoFmt::NV12;
+    return VideoFmt::Unknown;
+}
+
+static AVCodecContext *open_video_decoder(MediaPlayer *ps, AVStream *st, const DecoderCapability *cap);
+
+// Moves the video stream to the plan's fallback decoder once the current one
+// keeps failing. Decoding resumes at the next keyframe; there is no switching
+// back.
+static bool switch_video_decoder(MediaPlayer *ps) {
+    const DecoderCapability *cap = ps->decoder_plan.fallback;
+    if (!cap) {
+        log_message(LOG_WARNING, MP, "Video decoder %s failing, no fallback", decoder_name(ps->decoder_plan.primary));
+        return false;
+    }
+    ps->decoder_plan.fallback = nullptr;
+
+    AVCodecContext *avctx = open_video_decoder(ps, ps->fmt_ctx->streams[ps->video_idx], cap);
+    if (!avctx) return false;
+    log_message(LOG_WARNING, MP, "Video decoder %s failing, switching to %s", decoder_name(ps->decoder_plan.primary), decoder_name(cap));
+
+    AVCodecContext *old = ps->viddec.avctx;
+    ps->viddec.avctx = avctx;
+    ps->video_avctx.store(avctx, std::memory_order_release);
+    avcodec_free_context(&old);
+    ps->decoder_plan.primary = cap;
+    ps->hw_decoder = cap->kind == DecoderKind::Hardware;
+    ps->viddec.watch = DecoderWatch{};
+    ps->viddec.wait_keyframe = true;
+    return true;
+}
+
+static void video_decode_thread(MediaPlayer *ps) {
     log_message(LOG_DEBUG, MP, "Video decode thread started");
 
-    PlayerState *ps = S;
     AVRational tb = ps->video_tb;
     AVRational fr = av_guess_frame_rate(ps->fmt_ctx, ps->fmt_ctx->streams[ps->video_idx], nullptr);
     AVFrame *raw = av_frame_alloc();
@@ -902,6 +1426,7 @@ static void video_decode_thread() {
 
     int total = 0, dropped = 0;
     VideoFmt cached_fmt = VideoFmt::Unknown;
+    bool warned_fmt = false;
 
     for (;;) {
         int got = decoder_decode_frame(&ps->viddec, raw);
@@ -913,33 +1438,27 @@ static void video_decode_thread() {
             log_message(LOG_DEBUG, MP, "Video decode EOF (dec=%d drp=%d)", total, dropped);
             break;
         }
-
-        if (cached_fmt == VideoFmt::Unknown) {
-            AVPixelFormat fmt = (AVPixelFormat)raw->format;
-            if (fmt == AV_PIX_FMT_YUV420P) {
-                cached_fmt = VideoFmt::YUV420P;
-                ps->video_fmt.store(VideoFmt::YUV420P, std::memory_order_release);
-                ps->render_fn = video_render_yuv420p;
-                log_message(LOG_OK, MP, "Video fmt: YUV420P (SW decoder)");
-            } else if (fmt == AV_PIX_FMT_NV12) {
-                cached_fmt = VideoFmt::NV12;
-                ps->video_fmt.store(VideoFmt::NV12, std::memory_order_release);
-                ps->render_fn = video_render_nv12;
-                log_message(LOG_OK, MP, "Video fmt: NV12 (HW decoder)");
-            } else {
-                log_message(LOG_ERROR, MP, "Video fmt %d unsupported — only YUV420P and NV12 are handled", (int)fmt);
-                av_frame_unref(raw);
-                continue;
-            }
+        if (got == DECODE_FAILING) {
+            if (!switch_video_decoder(ps)) ps->viddec.watch = DecoderWatch{};
+            continue;
         }
 
-        AVPixelFormat expected_pix = (cached_fmt == VideoFmt::YUV420P) ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_NV12;
-        if (raw->format != expected_pix) {
-            log_message(LOG_WARNING, MP, "Frame fmt %d doesn't match active pipeline %d — skipping", raw->format, (int)cached_fmt);
+        // Formats can change mid-stream after a decoder switch; the display
+        // path re-creates the planes when they do.
+        VideoFmt fmt = frame_video_fmt(raw->format);
+        decoder_watch_frame(&ps->viddec.watch, fmt != VideoFmt::Unknown);
+        if (fmt == VideoFmt::Unknown) {
+            if (!warned_fmt) log_message(LOG_ERROR, MP, "Video fmt %d unsupported — only YUV420P and NV12 are handled", raw->format);
+            warned_fmt = true;
             av_frame_unref(raw);
             dropped++;
             continue;
         }
+        if (fmt != cached_fmt) {
+            cached_fmt = fmt;
+            ps->video_fmt.store(fmt, std::memory_order_release);
+            log_message(LOG_OK, MP, "Video fmt: %s", fmt == VideoFmt::NV12 ? "NV12" : "YUV420P");
+        }
 
         double pts = (raw->pts == AV_NOPTS_VALUE) ? NAN : raw->pts * av_q2d(tb);
         double duration = (fr.num && fr.den) ? av_q2d(AVRational{fr.den, fr.num}) : 0.0;
@@ -966,9 +1485,8 @@ static void video_decode_thread() {
     av_frame_free(&raw);
 }
 
-static void audio_decode_thread() {
+static void audio_decode_thread(MediaPlayer *ps) {
     log_message(LOG_DEBUG, MP, "Audio decode thread started");
-    PlayerState *ps = S;
     AVFrame *frame = av_frame_alloc();
     if (!frame) {
         log_message(LOG_ERROR, MP, "Audio decode: av_frame_alloc failed");
@@ -1002,222 +1520,793 @@ static void audio_decode_thread() {
     log_message(LOG_DEBUG, MP, "Audio decode thread exiting");
 }
 
-static void read_thread() {
+static void post_cmd_to(Waker *w, std::deque<PlayerCmd> *q, const PlayerCmd &c) {
+    {
+        std::lock_guard<std::mutex> lk(w->mtx);
+        q->push_back(c);
+        w->pending = true;
+    }
+    w->cv.notify_one();
+}
+
+// With a separate audio demuxer both readers see every command: each seeks
+// its own cursor, and play wakes both.
+static void player_post_cmd(MediaPlayer *ps, PlayerCmdType type, int64_t pos = 0, int stream_idx = -1) {
+    PlayerCmd c{type, pos, stream_idx, OSGetSystemTime()};
+    post_cmd_to(&ps->read_waker, &ps->cmds, c);
+    if (ps->audio_fmt_ctx) post_cmd_to(&ps->audio_read_waker, &ps->audio_cmds, c);
+}
+
+// Audio stream read_thread demuxes; -1 when the audio demuxer owns it.
+static int read_audio_idx(MediaPlayer *ps) { return ps->audio_fmt_ctx ? -1 : ps->audio_idx.load(); }
+
+// Drains the command queue. Only the last seek in a batch is executed, since
+// earlier ones would be flushed straight away.
+static void read_thread_handle_cmds(MediaPlayer *ps) {
+    std::deque<PlayerCmd> cmds;
+    {
+        std::lock_guard<std::mutex> lk(ps->read_waker.mtx);
+        cmds.swap(ps->cmds);
+    }
+    if (cmds.empty()) return;
+
+    bool seek = false;
+    int64_t pos = 0;
+    uint64_t now = OSGetSystemTime();
+    for (const PlayerCmd &c : cmds) {
+        uint64_t us = OSTicksToMicroseconds(now - c.issued);
+        ps->cmds_done++;
+        ps->cmd_latency_sum_us += us;
+        if (us > ps->cmd_latency_max_us) ps->cmd_latency_max_us = us;
+
+        if (c.type == PlayerCmdType::SwitchAudio && !ps->audio_fmt_ctx) {
+            ps->audio_idx = c.stream_idx;
+            ps->fmt_ctx->streams[c.stream_idx]->discard = AVDISCARD_DEFAULT; // adaptive streams discard the others
+        }
+        if (c.type == PlayerCmdType::Seek || c.type == PlayerCmdType::SwitchAudio) {
+            seek = true;
+            pos = c.pos;
+        }
+    }
+    if (!seek) return;
+
+    // Land on the keyframe at or before the target so the first decoded
+    // frame is complete and can be shown as the preview.
+    if (av_seek_frame(ps->fmt_ctx, -1, pos, AVSEEK_FLAG_BACKWARD) >= 0) avformat_flush(ps->fmt_ctx);
+    if (ps->video_idx >= 0) {
+        pq_flush_locked(&ps->videoq);
+        pq_start(&ps->videoq);
+    }
+    if (read_audio_idx(ps) >= 0) {
+        pq_flush_locked(&ps->audioq);
+        pq_start(&ps->audioq);
+    }
+    if (ps->sub_tid.joinable()) {
+        pq_flush_locked(&ps->subq);
+        pq_start(&ps->subq);
+    }
+    ps->eof = false;
+    ps->force_refresh = true;
+}
+
+static int64_t low_watermark_dur(MediaPlayer *ps, int idx) {
+    double tb = av_q2d(ps->fmt_ctx->streams[idx]->time_base);
+    return tb > 0.0 ? (int64_t)(ps->queue_seconds * PKTQ_LOW_FRACTION / tb) : 0;
+}
+
+// Blocks until either packet queue drains to its low watermark or a command
+// arrives. Returns immediately if a queue is already low.
+static void read_thread_wait_for_space(MediaPlayer *ps) {
+    bool armed_v = ps->video_idx < 0 || pq_arm_low(&ps->videoq, &ps->read_waker, low_watermark_dur(ps, ps->video_idx));
+    int aidx = read_audio_idx(ps);
+    bool armed_a = aidx < 0 || pq_arm_low(&ps->audioq, &ps->read_waker, low_watermark_dur(ps, aidx));
+    if (armed_v && armed_a) waker_wait(&ps->read_waker, -1);
+    if (ps->video_idx >= 0) pq_disarm_low(&ps->videoq);
+    if (aidx >= 0) pq_disarm_low(&ps->audioq);
+}
+
+static void abr_set_discard(MediaPlayer *ps, int variant, AVDiscard discard) {
+    const AbrLadderEntry &e = ps->abr_ladder[variant];
+    ps->fmt_ctx->streams[e.video_idx]->discard = discard;
+    if (e.audio_idx >= 0) ps->fmt_ctx->streams[e.audio_idx]->discard = discard;
+}
+
+// Enables the variant the controller asked for. Its packets are ignored until
+// a keyframe arrives; the demuxer fetches it from the next segment boundary.
+static void read_thread_abr(MediaPlayer *ps) {
+    int target = ps->abr_target.load(std::memory_order_relaxed);
+    if (target < 0 || target == ps->abr_pending || (target == ps->abr_active && ps->abr_pending < 0)) return;
+
+    if (ps->abr_pending >= 0) abr_set_discard(ps, ps->abr_pending, AVDISCARD_ALL);
+    abr_set_discard(ps, ps->abr_active, AVDISCARD_DEFAULT);
+    if (target == ps->abr_active) {
+        ps->abr_pending = -1;
+        return;
+    }
+    ps->abr_pending = target;
+    abr_set_discard(ps, target, AVDISCARD_DEFAULT);
+    log_message(LOG_DEBUG, MP, "ABR: fetching variant %d (%lld bit/s)", target, (long long)ps->abr.variants[target].bitrate);
+}
+
+// First keyframe of the pending variant: route its streams to the decoders
+// and stop fetching the old one. All variants share codec and time base, so
+// the decoders are not flushed.
+static void abr_commit(MediaPlayer *ps) {
+    const AbrLadderEntry &from = ps->abr_ladder[ps->abr_active];
+    const AbrLadderEntry &to = ps->abr_ladder[ps->abr_pending];
+
+    ps->video_idx = to.video_idx;
+    if (to.audio_idx >= 0) ps->audio_idx = to.audio_idx;
+    ps->fmt_ctx->streams[from.video_idx]->discard = AVDISCARD_ALL;
+    if (from.audio_idx >= 0 && from.audio_idx != to.audio_idx) ps->fmt_ctx->streams[from.audio_idx]->discard = AVDISCARD_ALL;
+
+    log_message(LOG_OK, MP, "ABR: variant %d -> %d (%dx%d, %lld bit/s)", ps->abr_active, ps->abr_pending, ps->abr.variants[ps->abr_pending].width, ps->abr.variants[ps->abr_pending].height, (long long)ps->abr.variants[ps->abr_pending].bitrate);
+    ps->abr_active = ps->abr_pending;
+    ps->abr_pending = -1;
+}
+
+static SubtitleSource *subtitle_source_for(MediaPlayer *ps, int stream_index) {
+    for (SubtitleSource &s : ps->subtitles)
+        if (s.stream_index == stream_index) return &s;
+    return nullptr;
+}
+
+// Text subtitles are a few bytes per cue, so they are decoded right here
+// instead of going through a queue and a thread of their own.
+static void subtitle_packet(MediaPlayer *ps, AVPacket *pkt) {
+    SubtitleSource *src = subtitle_source_for(ps, pkt->stream_index);
+    if (!src || src->bitmap || pkt->pts == AV_NOPTS_VALUE) return;
+
+    AVSubtitle sub;
+    int got = 0;
+    if (avcodec_decode_subtitle2(src->avctx, &sub, &got, pkt) < 0 || !got) return;
+
+    double tb = av_q2d(ps->fmt_ctx->streams[pkt->stream_index]->time_base);
+    double pts = pkt->pts * tb;
+    SubtitleCue cue;
+    cue.start = pts + sub.start_display_time / 1000.0;
+    if (pkt->duration > 0)
+        cue.end = pts + pkt->duration * tb;
+    else if (sub.end_display_time > sub.start_display_time && sub.end_display_time != UINT32_MAX)
+        cue.end = pts + sub.end_display_time / 1000.0;
+    else
+        cue.end = cue.start + SUBTITLE_DEFAULT_DURATION;
+    for (unsigned i = 0; i < sub.num_rects; ++i) {
+        const AVSubtitleRect *r = sub.rects[i];
+        std::string text = r->type == SUBTITLE_ASS && r->ass ? subtitle_ass_event_text(r->ass) : r->type == SUBTITLE_TEXT && r->text ? std::string(r->text) : std::string();
+        if (text.empty()) continue;
+        if (!cue.text.empty()) cue.text += '\n';
+        cue.text += text;
+    }
+    avsubtitle_free(&sub);
+    if (cue.text.empty()) return;
+
+    std::lock_guard<std::mutex> lk(ps->sub_mtx);
+    if (subtitle_track_add(&src->track, std::move(cue))) ps->sub_version.fetch_add(1, std::memory_order_release);
+}
+
+// All bitmap regions of an event in one image. The palette is converted once
+// per region and the indices looked up, so the UI thread only uploads.
+static std::shared_ptr<SubtitleBitmap> subtitle_bitmap_from(const AVSubtitle &sub, int canvas_w, int canvas_h) {
+    int x0 = INT32_MAX, y0 = INT32_MAX, x1 = 0, y1 = 0;
+    for (unsigned i = 0; i < sub.num_rects; ++i) {
+        const AVSubtitleRect *r = sub.rects[i];
+        if (r->type != SUBTITLE_BITMAP || r->w <= 0 || r->h <= 0) continue;
+        x0 = std::min(x0, r->x);
+        y0 = std::min(y0, r->y);
+        x1 = std::max(x1, r->x + r->w);
+        y1 = std::max(y1, r->y + r->h);
+    }
+    if (x0 >= x1 || y0 >= y1) return nullptr;
+
+    auto bmp = std::make_shared<SubtitleBitmap>();
+    bmp->canvas_w = std::max(canvas_w, x1);
+    bmp->canvas_h = std::max(canvas_h, y1);
+    bmp->x = x0;
+    bmp->y = y0;
+    bmp->w = x1 - x0;
+    bmp->h = y1 - y0;
+    bmp->rgba.assign((size_t)bmp->w * bmp->h, 0);
+    for (unsigned i = 0; i < sub.num_rects; ++i) {
+        const AVSubtitleRect *r = sub.rects[i];
+        if (r->type != SUBTITLE_BITMAP || r->w <= 0 || r->h <= 0) continue;
+        // The palette is AV_PIX_FMT_RGB32: 0xAARRGGBB in native order.
+        uint32_t pal[256] = {};
+        const uint32_t *src_pal = (const uint32_t *)r->data[1];
+        for (int k = 0; k < std::min(r->nb_colors, 256); ++k) {
+            uint32_t c = src_pal[k];
+            pal[k] = (c & 0xff00ff00) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+        }
+        for (int y = 0; y < r->h; ++y) {
+            const uint8_t *idx = r->data[0] + (size_t)y * r->linesize[0];
+            uint32_t *dst = bmp->rgba.data() + (size_t)(r->y - y0 + y) * bmp->w + (r->x - x0);
+            for (int x = 0; x < r->w; ++x)
+                dst[x] = pal[idx[x]];
+        }
+    }
+    return bmp;
+}
+
+static void clear_subtitle_bitmaps(MediaPlayer *ps) {
+    std::lock_guard<std::mutex> lk(ps->sub_mtx);
+    ps->sub_bitmaps.clear();
+    ps->sub_bitmap_bytes = 0;
+    ps->sub_version.fetch_add(1, std::memory_order_release);
+}
+
+// Decodes the selected bitmap stream. Events without an end (PGS) last until
+// the next one starts; an event without regions only ends the one before.
+// When the queued images reach the budget the thread waits for the UI to
+// retire some, and subq takes up the slack.
+static void subtitle_decode_thread(MediaPlayer *ps) {
+    log_message(LOG_DEBUG, MP, "Subtitle thread started");
+    AVPacket *pkt = av_packet_alloc();
+    int serial = -1;
+    while (pkt && pq_get(&ps->subq, pkt, true, &serial) >= 0) {
+        if (pkt->data == g_flush_pkt->data) {
+            for (SubtitleSource &s : ps->subtitles)
+                if (s.bitmap) avcodec_flush_buffers(s.avctx);
+            clear_subtitle_bitmaps(ps);
+            continue;
+        }
+        SubtitleSource *src = subtitle_source_for(ps, pkt->stream_index);
+        AVSubtitle sub;
+        int got = 0;
+        if (!src || !src->bitmap || pkt->pts == AV_NOPTS_VALUE || avcodec_decode_subtitle2(src->avctx, &sub, &got, pkt) < 0 || !got) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        double base = sub.pts != AV_NOPTS_VALUE ? sub.pts / (double)AV_TIME_BASE : pkt->pts * av_q2d(ps->fmt_ctx->streams[pkt->stream_index]->time_base);
+        double start = base + sub.start_display_time / 1000.0;
+        bool has_end = sub.end_display_time > sub.start_display_time && sub.end_display_time != UINT32_MAX;
+        double end = has_end ? base + sub.end_display_time / 1000.0 : std::numeric_limits<double>::infinity();
+        std::shared_ptr<SubtitleBitmap> bmp = subtitle_bitmap_from(sub, src->avctx->width > 0 ? src->avctx->width : ps->out_w, src->avctx->height > 0 ? src->avctx->height : ps->out_h);
+        avsubtitle_free(&sub);
+        av_packet_unref(pkt);
+        if (bmp) {
+            bmp->start = start;
+            bmp->end = end;
+        }
+
+        std::unique_lock<std::mutex> lk(ps->sub_mtx);
+        for (auto &prev : ps->sub_bitmaps)
+            if (prev->end > start && prev->start <= start) prev->end = start;
+        if (bmp) {
+            while (ps->sub_bitmap_bytes + bmp->bytes() > SUBTITLE_BITMAP_BUDGET && !ps->sub_bitmaps.empty() && !ps->subq.abort && ps->subq.serial == serial) {
+                lk.unlock();
+                waker_wait(&ps->sub_waker, SUBTITLE_BITMAP_WAIT_MS);
+                lk.lock();
+            }
+            if (ps->subq.abort || ps->subq.serial != serial) continue;
+            ps->sub_bitmap_bytes += bmp->bytes();
+            ps->sub_bitmaps.push_back(std::move(bmp));
+        }
+        ps->sub_version.fetch_add(1, std::memory_order_release);
+    }
+    av_packet_free(&pkt);
+    log_message(LOG_DEBUG, MP, "Subtitle thread exiting");
+}
+
+static void read_thread(MediaPlayer *ps) {
     log_message(LOG_DEBUG, MP, "Read thread started");
-    PlayerState *ps = S;
     AVPacket *pkt = av_packet_alloc();
     int pkts_read = 0;
+    int loop_mark = 0; // pkts_read at the last loop restart
 
     for (;;) {
+        read_thread_handle_cmds(ps);
         if (!ps->running.load(std::memory_order_relaxed)) break;
 
-        if (ps->paused.load(std::memory_order_relaxed)) {
-            std::unique_lock<std::mutex> lk(ps->read_sleep_mtx);
-            ps->read_sleep_cv.wait_for(lk, std::chrono::milliseconds(50), [ps] { return !ps->paused.load(std::memory_order_relaxed) || !ps->running.load(); });
+        if (ps->paused.load(std::memory_order_relaxed) && !ps->scrub_read.load(std::memory_order_relaxed)) {
+            waker_wait(&ps->read_waker, -1);
             continue;
         }
 
-        {
-            std::unique_lock<std::mutex> lk(ps->seek_mtx);
-            if (ps->seek_req) {
-                int64_t pos = ps->seek_pos;
-                ps->seek_req = false;
-                lk.unlock();
-                if (av_seek_frame(ps->fmt_ctx, -1, pos, AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY) >= 0) avformat_flush(ps->fmt_ctx);
-                if (ps->video_idx >= 0) {
-                    pq_flush_locked(&ps->videoq);
-                    pq_start(&ps->videoq);
-                }
-                if (ps->audio_idx >= 0) {
-                    pq_flush_locked(&ps->audioq);
-                    pq_start(&ps->audioq);
-                }
-                ps->eof = false;
-                ps->force_refresh = true;
-                ps->seek_cv.notify_all();
-            }
-        }
-
-        bool ev = (ps->video_idx < 0) || stream_has_enough_packets(ps->fmt_ctx->streams[ps->video_idx], ps->video_idx, ps->videoq);
-        bool ea = (ps->audio_idx < 0) || stream_has_enough_packets(ps->fmt_ctx->streams[ps->audio_idx], ps->audio_idx, ps->audioq);
+        bool ev = (ps->video_idx < 0) || stream_has_enough_packets(ps->fmt_ctx->streams[ps->video_idx], ps->video_idx, ps->videoq, ps->queue_seconds);
+        int aidx = read_audio_idx(ps);
+        bool ea = (aidx < 0) || stream_has_enough_packets(ps->fmt_ctx->streams[aidx], aidx, ps->audioq, ps->queue_seconds);
         if (ev && ea) {
-            std::unique_lock<std::mutex> lk(ps->read_sleep_mtx);
-            ps->read_sleep_cv.wait_for(lk, std::chrono::milliseconds(10));
+            read_thread_wait_for_space(ps);
             continue;
         }
 
+        read_thread_abr(ps);
+
+        uint64_t t0 = OSGetSystemTime();
         int ret = av_read_frame(ps->fmt_ctx, pkt);
-        if (ret == AVERROR_EOF || avio_feof(ps->fmt_ctx->pb)) {
-            if (!ps->eof) {
-                if (ps->video_idx >= 0) {
-                    AVPacket *ep = av_packet_alloc();
-                    if (ep) pq_put(&ps->videoq, ep);
+        ps->net_ticks += OSGetSystemTime() - t0;
+        if (ret < 0) {
+            // The file may end while the demuxer still holds packets it read
+            // ahead; those come out first, so only AVERROR_EOF itself parks.
+            if (ret == AVERROR_EOF || avio_feof(ps->fmt_ctx->pb)) {
+                // Looping restarts the demuxer without a flush, so the decoders
+                // run straight through. An empty pass means the seek does not work.
+                if (ps->opts.loop && pkts_read > loop_mark && av_seek_frame(ps->fmt_ctx, -1, 0, AVSEEK_FLAG_BACKWARD) >= 0) {
+                    loop_mark = pkts_read;
+                    continue;
                 }
-                if (ps->audio_idx >= 0) {
-                    AVPacket *ep = av_packet_alloc();
-                    if (ep) pq_put(&ps->audioq, ep);
+                if (!ps->eof) {
+                    if (ps->video_idx >= 0) {
+                        AVPacket *ep = av_packet_alloc();
+                        if (ep) pq_put(&ps->videoq, ep);
+                    }
+                    if (aidx >= 0) {
+                        AVPacket *ep = av_packet_alloc();
+                        if (ep) pq_put(&ps->audioq, ep);
+                    }
+                    ps->eof = true;
                 }
-                ps->eof = true;
+                // Nothing more to read until a seek or track change.
+                if (ret == AVERROR_EOF) waker_wait(&ps->read_waker, -1);
+                continue;
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(20));
-            continue;
-        }
-        if (ret < 0) {
             log_message(LOG_ERROR, MP, "av_read_frame: %d", ret);
             break;
         }
 
         ps->eof = false;
         pkts_read++;
-        if (pkt->stream_index == ps->video_idx)
+        ps->net_bytes += pkt->size;
+        if (ps->abr_pending >= 0 && pkt->stream_index == ps->abr_ladder[ps->abr_pending].video_idx && (pkt->flags & AV_PKT_FLAG_KEY)) abr_commit(ps);
+
+        if (pkt->stream_index == ps->video_idx) {
             pq_put(&ps->videoq, pkt);
-        else if (pkt->stream_index == ps->audio_idx)
+        } else if (pkt->stream_index == aidx) {
             pq_put(&ps->audioq, pkt);
-        else
+        } else if (pkt->stream_index == ps->sub_bitmap_stream.load(std::memory_order_relaxed)) {
+            pq_put(&ps->subq, pkt);
+        } else {
+            subtitle_packet(ps, pkt);
             av_packet_unref(pkt);
+        }
     }
     log_message(LOG_DEBUG, MP, "Read thread exiting (%d packets)", pkts_read);
     av_packet_free(&pkt);
 }
 
-static bool init_video_stream() {
-    S->video_idx = av_find_best_stream(S->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-    if (S->video_idx < 0) {
-        log_message(LOG_WARNING, MP, "No video stream");
-        return false;
+static void audio_read_thread_handle_cmds(MediaPlayer *ps, bool *eof) {
+    std::deque<PlayerCmd> cmds;
+    {
+        std::lock_guard<std::mutex> lk(ps->audio_read_waker.mtx);
+        cmds.swap(ps->audio_cmds);
+    }
+
+    bool seek = false;
+    int64_t pos = 0;
+    for (const PlayerCmd &c : cmds) {
+        if (c.type == PlayerCmdType::SwitchAudio) {
+            ps->audio_fmt_ctx->streams[ps->audio_idx]->discard = AVDISCARD_ALL;
+            ps->audio_idx = c.stream_idx;
+            ps->audio_fmt_ctx->streams[ps->audio_idx]->discard = AVDISCARD_DEFAULT;
+        }
+        if (c.type == PlayerCmdType::Seek || c.type == PlayerCmdType::SwitchAudio) {
+            seek = true;
+            pos = c.pos;
+        }
     }
+    if (!seek) return;
 
-    AVStream *st = S->fmt_ctx->streams[S->video_idx];
-    S->video_tb = st->time_base;
-    S->out_w = st->codecpar->width;
-    S->out_h = st->codecpar->height;
+    AVStream *st = ps->audio_fmt_ctx->streams[ps->audio_idx];
+    if (av_seek_frame(ps->audio_fmt_ctx, ps->audio_idx, av_rescale_q(pos, AV_TIME_BASE_Q, st->time_base), AVSEEK_FLAG_BACKWARD) >= 0) avformat_flush(ps->audio_fmt_ctx);
+    pq_flush_locked(&ps->audioq);
+    pq_start(&ps->audioq);
+    *eof = false;
+}
 
-    const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+// Second cursor for badly interleaved files. It follows only audioq's fill
+// level, so a long video run in the file never stalls audio and vice versa.
+static void audio_read_thread(MediaPlayer *ps) {
+    log_message(LOG_DEBUG, MP, "Audio read thread started");
+    AVPacket *pkt = av_packet_alloc();
+    int pkts_read = 0;
+    bool eof = false;
+
+    for (;;) {
+        audio_read_thread_handle_cmds(ps, &eof);
+        if (!ps->running.load(std::memory_order_relaxed)) break;
+
+        // Scrub previews are video only.
+        if (ps->paused.load(std::memory_order_relaxed)) {
+            waker_wait(&ps->audio_read_waker, -1);
+            continue;
+        }
+
+        AVStream *st = ps->audio_fmt_ctx->streams[ps->audio_idx];
+        if (eof || stream_has_enough_packets(st, ps->audio_idx, ps->audioq, ps->queue_seconds)) {
+            if (eof || pq_arm_low(&ps->audioq, &ps->audio_read_waker, low_watermark_dur(ps, ps->audio_idx))) waker_wait(&ps->audio_read_waker, -1);
+            pq_disarm_low(&ps->audioq);
+            continue;
+        }
+
+        uint64_t t0 = OSGetSystemTime();
+        int ret = av_read_frame(ps->audio_fmt_ctx, pkt);
+        ps->net_ticks += OSGetSystemTime() - t0;
+        if (ret < 0) {
+            if (ret == AVERROR_EOF || avio_feof(ps->audio_fmt_ctx->pb)) {
+                AVPacket *ep = av_packet_alloc();
+                if (ep) pq_put(&ps->audioq, ep);
+                eof = true;
+                continue;
+            }
+            log_message(LOG_ERROR, MP, "av_read_frame (audio): %d", ret);
+            break;
+        }
+
+        pkts_read++;
+        ps->net_bytes += pkt->size;
+        if (pkt->stream_index == ps->audio_idx)
+            pq_put(&ps->audioq, pkt);
+        else
+            av_packet_unref(pkt);
+    }
+    log_message(LOG_DEBUG, MP, "Audio read thread exiting (%d packets)", pkts_read);
+    av_packet_free(&pkt);
+}
+
+// One demuxer over a badly interleaved file reads ahead through a whole run of
+// one stream to find the other, or seeks back and forth between them and drops
+// its buffer every time. A second context on the same file gives audio its own
+// file position and buffer instead. Local files only: over the network it
+// would cost a second connection.
+static void open_audio_demuxer(MediaPlayer *ps, const std::string &path) {
+    double skew = media_layout_interleave_skew(faststart_index_points(ps->fmt_ctx->streams[ps->video_idx], LAYOUT_INDEX_POINTS), faststart_index_points(ps->fmt_ctx->streams[ps->audio_idx], LAYOUT_INDEX_POINTS));
+    if (skew < DUAL_DEMUX_SKEW_SECONDS) return;
+
+    AVFormatContext *ctx = nullptr;
+    int err = avformat_open_input(&ctx, path.c_str(), ps->fmt_ctx->iformat, nullptr);
+    if (err < 0) {
+        log_message(LOG_WARNING, MP, "Audio demuxer: avformat_open_input: %d", err);
+        return;
+    }
+    if (ctx->nb_streams != ps->fmt_ctx->nb_streams) {
+        log_message(LOG_WARNING, MP, "Audio demuxer: stream layout differs, using one demuxer");
+        avformat_close_input(&ctx);
+        return;
+    }
+    ctx->flags |= AVFMT_FLAG_NOBUFFER;
+    for (unsigned i = 0; i < ctx->nb_streams; ++i) {
+        ctx->streams[i]->discard = (int)i == ps->audio_idx ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        if (ps->fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) ps->fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+    }
+    ps->audio_fmt_ctx = ctx;
+    log_message(LOG_OK, MP, "Interleave skew %.1f s: audio gets its own demuxer", skew);
+}
+
+static int64_t variant_bitrate(AVStream *st) {
+    AVDictionaryEntry *e = av_dict_get(st->metadata, "variant_bitrate", nullptr, 0);
+    if (e) return strtoll(e->value, nullptr, 10);
+    return st->codecpar->bit_rate;
+}
+
+// The audio stream carried in the same HLS program as video stream idx.
+static int variant_audio_stream(MediaPlayer *ps, int idx) {
+    for (unsigned p = 0; p < ps->fmt_ctx->nb_programs; ++p) {
+        AVProgram *prog = ps->fmt_ctx->programs[p];
+        bool has_video = false;
+        int audio = -1;
+        for (unsigned i = 0; i < prog->nb_stream_indexes; ++i) {
+            int s = (int)prog->stream_index[i];
+            if (s == idx) has_video = true;
+            if (audio < 0 && ps->fmt_ctx->streams[s]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) audio = s;
+        }
+        if (has_video) return audio;
+    }
+    return -1;
+}
 
-    if (st->codecpar->codec_id == AV_CODEC_ID_H264) {
-        const AVCodec *hw = avcodec_find_decoder_by_name("h264_wiiu");
-        if (hw) {
-            codec = hw;
-            S->hw_decoder = true;
-            log_message(LOG_OK, MP, "h264_wiiu HW decoder (%dx%d H.264)", S->out_w, S->out_h);
+// Builds the variant ladder of an HLS/DASH stream (see abr_build_ladder) and
+// starts at the variant the last session's throughput allows.
+static void init_abr(MediaPlayer *ps) {
+    const char *fmt = ps->fmt_ctx->iformat->name;
+    if (!strstr(fmt, "hls") && !strstr(fmt, "dash")) return;
+
+    int best = av_find_best_stream(ps->fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (best < 0) return;
+
+    std::vector<AbrCandidate> streams;
+    int ref = -1;
+    for (unsigned i = 0; i < ps->fmt_ctx->nb_streams; ++i) {
+        AVStream *st = ps->fmt_ctx->streams[i];
+        if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) continue;
+        if ((int)i == best) ref = (int)streams.size();
+
+        AbrCandidate c;
+        c.video_idx = (int)i;
+        c.codec_id = st->codecpar->codec_id;
+        c.time_base_num = st->time_base.num;
+        c.time_base_den = st->time_base.den;
+        c.attached_pic = st->disposition & AV_DISPOSITION_ATTACHED_PIC;
+        c.variant.bitrate = variant_bitrate(st);
+        c.variant.width = st->codecpar->width;
+        c.variant.height = st->codecpar->height;
+        c.audio_idx = variant_audio_stream(ps, (int)i);
+        if (c.audio_idx >= 0) {
+            AVCodecParameters *a = ps->fmt_ctx->streams[c.audio_idx]->codecpar;
+            c.audio_codec_id = a->codec_id;
+            c.audio_sample_rate = a->sample_rate;
+            c.audio_channels = a->ch_layout.nb_channels;
+        }
+        streams.push_back(c);
+    }
+
+    std::vector<AbrVariant> variants;
+    double budget = g_abr_last_throughput > 0.0 ? g_abr_last_throughput * 0.7 : ABR_START_BITRATE;
+    int start = abr_build_ladder(streams, ref, budget, &variants, &ps->abr_ladder);
+    if (start < 0) return;
+    abr_init(&ps->abr, variants, start);
+    ps->abr_active = start;
+    ps->abr_target.store(start);
+
+    // Every other video stream, in the ladder or not, stops being fetched,
+    // and so does every other audio stream when the variants carry their own.
+    const AbrLadderEntry &active = ps->abr_ladder[start];
+    for (unsigned i = 0; i < ps->fmt_ctx->nb_streams; ++i) {
+        AVStream *st = ps->fmt_ctx->streams[i];
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && (int)i != active.video_idx) st->discard = AVDISCARD_ALL;
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && active.audio_idx >= 0 && (int)i != active.audio_idx) st->discard = AVDISCARD_ALL;
+    }
+
+    AVRational fr = av_guess_frame_rate(ps->fmt_ctx, ps->fmt_ctx->streams[ps->abr_ladder[start].video_idx], nullptr);
+    ps->abr_frame_dur = fr.num && fr.den ? av_q2d(AVRational{fr.den, fr.num}) : 1.0 / 30.0;
+    ps->abr_last_tick = wall_now();
+    log_message(LOG_OK, MP, "ABR: %d variants, starting at %d (%lld bit/s)", (int)variants.size(), start, (long long)variants[start].bitrate);
+}
+
+// Deep enough for PICTQ_SECONDS at the stream's frame rate plus decoder
+// latency, but never more than the video memory left beside the decoder's
+// references. Adaptive streams are sized for their largest variant.
+static int video_queue_depth(MediaPlayer *ps, AVStream *st, AVCodecContext *avctx) {
+    int w = ps->out_w, h = ps->out_h;
+    for (const AbrVariant &v : ps->abr.variants) {
+        if ((int64_t)v.width * v.height > (int64_t)w * h) {
+            w = v.width;
+            h = v.height;
         }
     }
+    size_t frame_bytes = (size_t)FFALIGN(w, 64) * FFALIGN(h, 16) * 3 / 2;
+
+    AVRational fr = av_guess_frame_rate(ps->fmt_ctx, st, nullptr);
+    double fps = fr.num && fr.den ? av_q2d(fr) : 30.0;
+    int latency = ps->hw_decoder ? PICTQ_HW_LATENCY : (avctx->thread_type & FF_THREAD_FRAME) ? avctx->thread_count - 1 : 0;
+    int depth = (int)std::ceil(fps * PICTQ_SECONDS) + latency + 1; // +1: the frame on screen
 
+    size_t avail = PICTQ_HEAP_BUDGET;
+    if (player_arena_ready()) {
+        ArenaStats as;
+        player_arena_get_stats(&as);
+        avail = as.budget[ARENA_VIDEO_FRAMES] > as.budget_used[ARENA_VIDEO_FRAMES] ? as.budget[ARENA_VIDEO_FRAMES] - as.budget_used[ARENA_VIDEO_FRAMES] : 0;
+        avail = std::min(avail, as.capacity - as.used);
+    }
+    size_t refs = PICTQ_DECODER_REFS * frame_bytes;
+    int fit = frame_bytes && avail > refs ? (int)((avail - refs) / frame_bytes) : 0;
+
+    int chosen = std::clamp(std::min(depth, fit), PICTQ_MIN_DEPTH, VIDEO_FRAME_QUEUE_SIZE);
+    log_message(LOG_OK, MP, "Picture queue: %d frames (%.1f MiB at %dx%d, %.2f fps, latency %d, room for %d)", chosen, chosen * frame_bytes / (1024.0 * 1024.0), w, h, fps, latency, fit);
+    return chosen;
+}
+
+// What the capability table needs to know about a video stream.
+static VideoStreamDesc describe_video_stream(MediaPlayer *ps, AVStream *st) {
+    const AVCodecParameters *par = st->codecpar;
+    VideoStreamDesc v;
+    v.codec = avcodec_get_name(par->codec_id);
+    v.profile = par->profile;
+    v.level = par->level;
+    v.width = par->width;
+    v.height = par->height;
+    AVRational fr = av_guess_frame_rate(ps->fmt_ctx, st, nullptr);
+    v.fps = fr.num && fr.den ? av_q2d(fr) : 0.0;
+    v.bitrate = par->bit_rate > 0 ? par->bit_rate : ps->fmt_ctx->bit_rate;
+    const AVPixFmtDescriptor *pd = av_pix_fmt_desc_get((AVPixelFormat)par->format);
+    if (pd) {
+        v.bit_depth = pd->comp[0].depth;
+        v.chroma_420 = pd->log2_chroma_w == 1 && pd->log2_chroma_h == 1;
+    } else if (par->bits_per_raw_sample > 0) {
+        v.bit_depth = par->bits_per_raw_sample;
+    }
+    v.interlaced = par->field_order != AV_FIELD_UNKNOWN && par->field_order != AV_FIELD_PROGRESSIVE;
+    v.has_default_decoder = avcodec_find_decoder(par->codec_id) != nullptr;
+    return v;
+}
+
+static AVCodecContext *open_video_decoder(MediaPlayer *ps, AVStream *st, const DecoderCapability *cap) {
+    const AVCodec *codec = cap->decoder ? avcodec_find_decoder_by_name(cap->decoder) : avcodec_find_decoder(st->codecpar->codec_id);
     if (!codec) {
-        log_message(LOG_ERROR, MP, "No decoder for video codec %d", st->codecpar->codec_id);
-        return false;
+        log_message(LOG_ERROR, MP, "No decoder '%s'", decoder_name(cap));
+        return nullptr;
     }
 
     AVCodecContext *avctx = avcodec_alloc_context3(codec);
     if (!avctx || avcodec_parameters_to_context(avctx, st->codecpar) < 0) {
         log_message(LOG_ERROR, MP, "Video codec context setup failed");
         avcodec_free_context(&avctx);
-        return false;
+        return nullptr;
     }
     avctx->pkt_timebase = st->time_base;
-    if (!S->hw_decoder) {
+    if (cap->kind == DecoderKind::Software) {
         avctx->thread_count = 2;
         avctx->thread_type = FF_THREAD_SLICE;
         avctx->flags2 |= AV_CODEC_FLAG2_FAST;
         avctx->skip_loop_filter = AVDISCARD_NONREF;
+        if ((codec->capabilities & AV_CODEC_CAP_DR1) && player_arena_ready()) {
+            avctx->opaque = &ps->frame_pool;
+            avctx->get_buffer2 = arena_get_buffer2;
+        }
     }
     if (avcodec_open2(avctx, codec, nullptr) < 0) {
         log_message(LOG_ERROR, MP, "avcodec_open2 failed for '%s'", codec->name);
         avcodec_free_context(&avctx);
+        return nullptr;
+    }
+    return avctx;
+}
+
+static bool init_video_stream(MediaPlayer *ps) {
+    int wanted = ps->abr_active >= 0 ? ps->abr_ladder[ps->abr_active].video_idx : -1;
+    ps->video_idx = av_find_best_stream(ps->fmt_ctx, AVMEDIA_TYPE_VIDEO, wanted, -1, nullptr, 0);
+    if (ps->video_idx < 0) {
+        log_message(LOG_WARNING, MP, "No video stream");
         return false;
     }
-    S->video_avctx = avctx;
 
-    log_message(LOG_OK, MP, "Video: stream=%d codec=%s %dx%d tb=%d/%d", S->video_idx, codec->name, S->out_w, S->out_h, st->time_base.num, st->time_base.den);
+    AVStream *st = ps->fmt_ctx->streams[ps->video_idx];
 
-    S->shader_yuv420p = load_shader(yuv420p_shader, "yuv420p");
-    S->shader_nv12 = load_shader(nv12_shader, "nv12");
-    if (!S->shader_yuv420p || !S->shader_nv12) {
-        log_message(LOG_ERROR, MP, "Shader load failed");
+    // Embedded cover art is a single still; keep the bytes for the UI instead of
+    // running the whole video pipeline for it.
+    if (st->disposition & AV_DISPOSITION_ATTACHED_PIC) {
+        if (st->attached_pic.data && st->attached_pic.size > 0) ps->cover_art.assign(st->attached_pic.data, st->attached_pic.data + st->attached_pic.size);
+        log_message(LOG_OK, MP, "Cover art: stream=%d %d bytes", ps->video_idx.load(), (int)ps->cover_art.size());
+        st->discard = AVDISCARD_ALL;
+        ps->video_idx = -1;
         return false;
     }
 
-    VideoFmt expected_fmt = S->hw_decoder ? VideoFmt::NV12 : VideoFmt::YUV420P;
-    if (!init_video_planes(expected_fmt, S->out_w, S->out_h)) {
-        log_message(LOG_ERROR, MP, "init_video_planes failed");
+    ps->video_tb = st->time_base;
+    ps->out_w = st->codecpar->width;
+    ps->out_h = st->codecpar->height;
+
+    VideoStreamDesc desc = describe_video_stream(ps, st);
+    ps->decoder_plan = decoder_plan(desc, g_sw_pixels_per_sec.load(), [](const char *name) { return avcodec_find_decoder_by_name(name) != nullptr; });
+    const DecoderPlan &plan = ps->decoder_plan;
+    if (!plan.primary) {
+        // Nothing here renders it; play the rest rather than fail the open.
+        if (desc.has_default_decoder)
+            log_message(LOG_WARNING, MP, "Video %s %dx%d not playable (%s), continuing without video", desc.codec.c_str(), desc.width, desc.height, plan.reason.c_str());
+        else
+            log_message(LOG_WARNING, MP, "No decoder for video codec %s, continuing without video", desc.codec.c_str());
+        st->discard = AVDISCARD_ALL;
+        ps->video_idx = -1;
         return false;
     }
+    log_message(LOG_OK, MP, "Decoder plan: %s, fallback %s%s%s", decoder_name(plan.primary), decoder_name(plan.fallback), plan.realtime ? "" : ", not real time: ", plan.reason.c_str());
 
-    S->dest_rect = display_calculate_aspect_fit(S->out_w, S->out_h);
-    S->quad_last_rect = {-1, -1, -1, -1};
-    update_quad(S->dest_rect);
-    S->dest_rect_init = true;
+    const DecoderCapability *cap = plan.primary;
+    AVCodecContext *avctx = open_video_decoder(ps, st, cap);
+    if (!avctx && plan.fallback) {
+        cap = plan.fallback;
+        ps->decoder_plan.fallback = nullptr;
+        avctx = open_video_decoder(ps, st, cap);
+    }
+    if (!avctx) return false;
+    ps->hw_decoder = cap->kind == DecoderKind::Hardware;
+    ps->video_avctx.store(avctx, std::memory_order_release);
 
-    if (fq_init(&S->pictq, &S->videoq, VIDEO_FRAME_QUEUE_SIZE, 1) < 0) return false;
-    if (decoder_init(&S->viddec, avctx, &S->videoq) < 0) return false;
+    log_message(LOG_OK, MP, "Video: stream=%d codec=%s %dx%d tb=%d/%d", ps->video_idx.load(), avctx->codec->name, ps->out_w, ps->out_h, st->time_base.num, st->time_base.den);
 
-    S->cur_frame_info = new frame_info{};
-    S->cur_frame_info->width = S->out_w;
-    S->cur_frame_info->height = S->out_h;
+    ps->pictq_depth = video_queue_depth(ps, st, avctx);
+    if (fq_init(&ps->pictq, &ps->videoq, ps->pictq_depth, 1) < 0) return false;
+    if (decoder_init(&ps->viddec, avctx, &ps->videoq) < 0) return false;
     return true;
 }
 
-static bool init_audio_stream() {
-    S->audio_idx = av_find_best_stream(S->fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
-    if (S->audio_idx < 0) {
-        log_message(LOG_WARNING, MP, "No audio stream (continuing without audio)");
-        return true;
+// GX2 resources for presenting video. Runs on the UI thread while the decode
+// thread is already working on the first keyframe.
+static bool init_video_output(MediaPlayer *ps) {
+    profiler prof;
+    if (!g_ctx.shader_yuv420p || !g_ctx.shader_nv12) {
+        profiler_begin(&prof, "video shaders");
+        if (!g_ctx.shader_yuv420p) g_ctx.shader_yuv420p = load_shader(yuv420p_shader, "yuv420p");
+        if (!g_ctx.shader_nv12) g_ctx.shader_nv12 = load_shader(nv12_shader, "nv12");
+        if (!g_ctx.shader_yuv420p || !g_ctx.shader_nv12) {
+            log_message(LOG_ERROR, MP, "Shader load failed");
+            return false;
+        }
+        profiler_end(&prof);
+    }
+
+    profiler_begin(&prof, "video planes");
+    VideoFmt expected_fmt = ps->hw_decoder ? VideoFmt::NV12 : VideoFmt::YUV420P;
+    if (!init_video_planes(ps, expected_fmt, ps->out_w, ps->out_h)) {
+        log_message(LOG_ERROR, MP, "init_video_planes failed");
+        return false;
     }
+    profiler_end(&prof);
 
-    AVStream *st = S->fmt_ctx->streams[S->audio_idx];
+    ps->dest_rect = display_calculate_aspect_fit(ps->out_w, ps->out_h);
+    ps->quad_last_rect = {-1, -1, -1, -1};
+    update_quad(ps, ps->dest_rect);
+    ps->dest_rect_init = true;
+
+    ps->cur_frame_info = new frame_info{};
+    ps->cur_frame_info->width = ps->out_w;
+    ps->cur_frame_info->height = ps->out_h;
+    return true;
+}
+
+// Undoes a partial init_audio_stream. The mixer source stays for player_close.
+static void free_audio_setup(MediaPlayer *ps) {
+    std::lock_guard<std::mutex> lk(ps->audio_mtx);
+    if (ps->swr_ctx) swr_free(&ps->swr_ctx);
+    avcodec_free_context(&ps->audio_avctx);
+    fq_destroy(&ps->sampq);
+    ps->sampq.max_size = 0;
+    decoder_free_pkt(&ps->auddec);
+    ps->auddec.avctx = nullptr;
+}
+
+static bool init_audio_stream(MediaPlayer *ps) {
+    AVStream *st = ps->fmt_ctx->streams[ps->audio_idx];
     const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
     if (!codec) {
         log_message(LOG_ERROR, MP, "No audio decoder");
         return false;
     }
 
+    profiler prof;
+    profiler_begin(&prof, "audio codec");
     AVCodecContext *avctx = avcodec_alloc_context3(codec);
     if (!avctx || avcodec_parameters_to_context(avctx, st->codecpar) < 0 || (avctx->pkt_timebase = st->time_base, false) || avcodec_open2(avctx, codec, nullptr) < 0) {
         log_message(LOG_ERROR, MP, "Audio codec setup failed");
         avcodec_free_context(&avctx);
         return false;
     }
-    S->audio_avctx = avctx;
+    ps->audio_avctx = avctx;
+    profiler_end(&prof);
 
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
     int nch = avctx->ch_layout.nb_channels;
 #else
     int nch = avctx->channels;
 #endif
-    log_message(LOG_OK, MP, "Audio: stream=%d codec=%s %dHz %dch", S->audio_idx, codec->name, avctx->sample_rate, nch);
-
-    if (!SDL_WasInit(SDL_INIT_AUDIO)) SDL_InitSubSystem(SDL_INIT_AUDIO);
-    SDL_AudioSpec want{};
-    want.freq = AUDIO_OUT_RATE;
-    want.format = AUDIO_S16SYS;
-    want.channels = AUDIO_OUT_CHANNELS;
-    want.samples = 4096;
-    S->audio_dev = SDL_OpenAudioDevice(nullptr, 0, &want, &S->audio_spec, 0);
-    if (!S->audio_dev) {
-        log_message(LOG_ERROR, MP, "SDL_OpenAudioDevice: %s", SDL_GetError());
-        avcodec_free_context(&avctx);
+    log_message(LOG_OK, MP, "Audio: stream=%d codec=%s %dHz %dch", ps->audio_idx.load(), codec->name, avctx->sample_rate, nch);
+
+    // The source starts paused; cleanup releases it even if setup fails below.
+    MixerSource src = audio_mixer_add_source(ps->audio_buf_max + AUDIO_SOURCE_SLACK);
+    if (!src) {
+        log_message(LOG_ERROR, MP, "No mixer source");
+        avcodec_free_context(&ps->audio_avctx);
         return false;
     }
-    rebuild_swr();
-    if (!S->swr_ctx) {
-        avcodec_free_context(&avctx);
+    {
+        std::lock_guard<std::mutex> lk(ps->audio_mtx);
+        ps->audio_src = src;
+    }
+
+    profiler_begin(&prof, "audio resampler");
+    rebuild_swr(ps);
+    if (!ps->swr_ctx) {
+        free_audio_setup(ps);
         return false;
     }
-    if (fq_init(&S->sampq, &S->audioq, AUDIO_FRAME_QUEUE_SIZE, 1) < 0) return false;
-    if (decoder_init(&S->auddec, avctx, &S->audioq) < 0) return false;
+    profiler_end(&prof);
 
-    S->cur_audio_track = S->audio_idx;
-    S->audio_enabled = true;
-    SDL_PauseAudioDevice(S->audio_dev, 1);
+    if (fq_init(&ps->sampq, &ps->audioq, ps->audio_only ? AUDIO_ONLY_FRAME_QUEUE_SIZE : AUDIO_FRAME_QUEUE_SIZE, 1) < 0 || decoder_init(&ps->auddec, avctx, &ps->audioq) < 0) {
+        log_message(LOG_ERROR, MP, "Audio queue setup failed");
+        free_audio_setup(ps);
+        return false;
+    }
+
+    ps->cur_audio_track = ps->audio_idx;
 
     {
-        std::lock_guard<std::mutex> lk(S->audio_tracks_mtx);
-        S->audio_tracks.clear();
-        for (unsigned i = 0; i < S->fmt_ctx->nb_streams; ++i) {
-            AVStream *s = S->fmt_ctx->streams[i];
+        std::lock_guard<std::mutex> lk(ps->audio_tracks_mtx);
+        ps->audio_tracks.clear();
+        for (unsigned i = 0; i < ps->fmt_ctx->nb_streams; ++i) {
+            AVStream *s = ps->fmt_ctx->streams[i];
             if (s->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) continue;
             AVDictionaryEntry *lang = av_dict_get(s->metadata, "language", nullptr, 0);
-            S->audio_tracks.push_back({(int)i, avcodec_get_name(s->codecpar->codec_id),
+            ps->audio_tracks.push_back({(int)i, avcodec_get_name(s->codecpar->codec_id),
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
                                        s->codecpar->ch_layout.nb_channels,
 #else
@@ -1225,252 +2314,654 @@ static bool init_audio_stream() {
 #endif
                                        s->codecpar->sample_rate, lang ? lang->value : "und"});
         }
-        media_info_get()->total_audio_track_count = (int)S->audio_tracks.size();
     }
-    log_message(LOG_OK, MP, "%d audio track(s)", (int)S->audio_tracks.size());
+    log_message(LOG_OK, MP, "%d audio track(s)", (int)ps->audio_tracks.size());
+
+    // Enable audio last; play/seek may have run in the meantime and left the
+    // desired pause state in ps->playing.
+    std::lock_guard<std::mutex> lk(ps->audio_mtx);
+    ps->audio_enabled.store(true, std::memory_order_release);
+    audio_mixer_pause(ps->audio_src, !ps->playing.load());
     return true;
 }
 
-int media_player_init(const char *path_) {
-    std::string path = "file:" + std::string(path_);
-    log_message(LOG_DEBUG, MP, "media_player_init: %s", path);
-    if (S) {
-        log_message(LOG_WARNING, MP, "Re-init: cleaning up");
-        media_player_cleanup();
+static void audio_setup_thread(MediaPlayer *ps) {
+    if (!init_audio_stream(ps)) {
+        log_message(LOG_WARNING, MP, "Audio setup failed, continuing without audio");
+        pq_abort(&ps->audioq);
+    } else if (ps->running.load()) {
+        ps->sampq.push_waker = &ps->pump_waker;
+        ps->audio_tid = std::thread(audio_decode_thread, ps);
+        ps->audio_pump_tid = std::thread(audio_pump_thread, ps);
+    }
+    // player_update picks the results up on the UI thread.
+    ps->audio_setup_done.store(true, std::memory_order_release);
+}
+
+static int http_avio_read(void *opaque, uint8_t *buf, int size) {
+    int n = http_source_read((HttpSource *)opaque, buf, size);
+    if (n == 0) return AVERROR_EOF;
+    return n < 0 ? AVERROR(EIO) : n;
+}
+
+static int64_t http_avio_seek(void *opaque, int64_t offset, int whence) {
+    HttpSource *src = (HttpSource *)opaque;
+    if (whence & AVSEEK_SIZE) return http_source_size(src);
+    int64_t pos = http_source_seek(src, offset, whence & ~AVSEEK_FORCE);
+    return pos < 0 ? AVERROR(EIO) : pos;
+}
+
+// Network media goes through our range/read-ahead source instead of FFmpeg's
+// http protocol; servers without range support fall back to the latter.
+static bool open_http_source(MediaPlayer *ps, const char *url) {
+    ps->http_src = http_source_open(url);
+    if (!ps->http_src) return false;
+
+    uint8_t *buf = (uint8_t *)av_malloc(HTTP_AVIO_BUFFER_SIZE);
+    ps->http_avio = buf ? avio_alloc_context(buf, HTTP_AVIO_BUFFER_SIZE, 0, ps->http_src, http_avio_read, nullptr, http_avio_seek) : nullptr;
+    if (!ps->http_avio) {
+        av_free(buf);
+        http_source_close(ps->http_src);
+        ps->http_src = nullptr;
+        return false;
+    }
+    ps->fmt_ctx->pb = ps->http_avio;
+    ps->fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return true;
+}
+
+static void close_http_source(MediaPlayer *ps) {
+    if (ps->http_avio) {
+        av_freep(&ps->http_avio->buffer);
+        avio_context_free(&ps->http_avio);
+    }
+    if (ps->http_src) {
+        http_source_close(ps->http_src);
+        ps->http_src = nullptr;
+    }
+}
+
+static bool is_network_url(const char *path) { return !strncmp(path, "http://", 7) || !strncmp(path, "https://", 8); }
+
+// Playlists are small and fetched whole; FFmpeg's HLS/DASH demuxers open the
+// segments themselves.
+static bool is_playlist_url(const char *path) { return strstr(path, ".m3u8") || strstr(path, ".mpd"); }
+
+// Whole segments go through HttpSource like direct-play files, which gives
+// them read-ahead and the disk cache. Playlist reloads and byte-range
+// segments stay on FFmpeg's http protocol.
+static int segment_io_open(AVFormatContext *s, AVIOContext **pb, const char *url, int flags, AVDictionary **options) {
+    MediaPlayer *ps = (MediaPlayer *)s->opaque;
+    bool ranged = options && (av_dict_get(*options, "offset", nullptr, 0) || av_dict_get(*options, "end_offset", nullptr, 0));
+    if ((flags & AVIO_FLAG_READ) && !(flags & AVIO_FLAG_WRITE) && is_network_url(url) && !is_playlist_url(url) && !ranged) {
+        HttpSource *src = http_source_open(url);
+        uint8_t *buf = src ? (uint8_t *)av_malloc(HTTP_AVIO_BUFFER_SIZE) : nullptr;
+        AVIOContext *avio = buf ? avio_alloc_context(buf, HTTP_AVIO_BUFFER_SIZE, 0, src, http_avio_read, nullptr, http_avio_seek) : nullptr;
+        if (avio) {
+            std::lock_guard<std::mutex> lk(ps->segment_mtx);
+            ps->segment_srcs.push_back(src);
+            *pb = avio;
+            return 0;
+        }
+        av_free(buf);
+        if (src) http_source_close(src);
     }
+    return ps->default_io_open(s, pb, url, flags, options);
+}
+
+static int segment_io_close(AVFormatContext *s, AVIOContext *pb) {
+    MediaPlayer *ps = (MediaPlayer *)s->opaque;
+    if (!pb || pb->read_packet != http_avio_read) return ps->default_io_close2(s, pb);
+
+    HttpSource *src = (HttpSource *)pb->opaque;
+    {
+        std::lock_guard<std::mutex> lk(ps->segment_mtx);
+        ps->segment_srcs.erase(std::remove(ps->segment_srcs.begin(), ps->segment_srcs.end(), src), ps->segment_srcs.end());
+    }
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+    http_source_close(src);
+    return 0;
+}
 
-    g_pkt_pool.init();
+static void hook_segment_io(MediaPlayer *ps) {
+    ps->default_io_open = ps->fmt_ctx->io_open;
+    ps->default_io_close2 = ps->fmt_ctx->io_close2;
+    ps->fmt_ctx->io_open = segment_io_open;
+    ps->fmt_ctx->io_close2 = segment_io_close;
+}
+
+// Open instances of each kind, see PLAYER_MAX_*. UI thread only.
+static int g_full_players = 0;
+static int g_audio_players = 0;
+static MediaPlayer *g_main = nullptr;
+
+// Internal text and bitmap streams, then sidecar files named like the media
+// (movie.mkv: movie.srt, movie.vtt, movie.ass, movie.ssa). A forced track is
+// shown from the start; everything else waits for the user.
+static void init_subtitles(MediaPlayer *ps, const char *path, bool network) {
+    for (unsigned i = 0; i < ps->fmt_ctx->nb_streams; ++i) {
+        AVStream *st = ps->fmt_ctx->streams[i];
+        const AVCodecDescriptor *desc = avcodec_descriptor_get(st->codecpar->codec_id);
+        if (st->codecpar->codec_type != AVMEDIA_TYPE_SUBTITLE || !desc || !(desc->props & (AV_CODEC_PROP_TEXT_SUB | AV_CODEC_PROP_BITMAP_SUB))) continue;
+        const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+        AVCodecContext *avctx = codec ? avcodec_alloc_context3(codec) : nullptr;
+        if (!avctx || avcodec_parameters_to_context(avctx, st->codecpar) < 0 || avcodec_open2(avctx, codec, nullptr) < 0) {
+            log_message(LOG_WARNING, MP, "Subtitle stream %u (%s) has no decoder", i, avcodec_get_name(st->codecpar->codec_id));
+            avcodec_free_context(&avctx);
+            continue;
+        }
+        avctx->pkt_timebase = st->time_base;
+
+        SubtitleSource src;
+        src.stream_index = (int)i;
+        src.avctx = avctx;
+        src.bitmap = desc->props & AV_CODEC_PROP_BITMAP_SUB;
+        AVDictionaryEntry *lang = av_dict_get(st->metadata, "language", nullptr, 0);
+        src.label = std::string(lang ? lang->value : "und") + " (" + avcodec_get_name(st->codecpar->codec_id) + ")";
+        if ((st->disposition & AV_DISPOSITION_FORCED) && ps->sub_selected < 0) ps->sub_selected = (int)ps->subtitles.size();
+        ps->subtitles.push_back(std::move(src));
+    }
+
+    if (!network) {
+        // Sidecar times count from zero; the streams may not.
+        double offset = ps->fmt_ctx->start_time != AV_NOPTS_VALUE ? ps->fmt_ctx->start_time / (double)AV_TIME_BASE : 0.0;
+        std::string base = path;
+        size_t dot = base.find_last_of('.');
+        if (dot != std::string::npos && dot > base.find_last_of('/') + 1) base.erase(dot);
+        for (const char *ext : {"srt", "vtt", "ass", "ssa"}) {
+            std::vector<uint8_t> data;
+            std::vector<SubtitleCue> cues;
+            if (!byte_stream_read_file((base + "." + ext).c_str(), data, SUBTITLE_MAX_FILE)) continue;
+            if (!subtitle_parse(subtitle_format_for_extension(ext), (const char *)data.data(), data.size(), &cues)) {
+                log_message(LOG_WARNING, MP, "Subtitle file %s.%s has no cues", base.c_str(), ext);
+                continue;
+            }
+            for (SubtitleCue &c : cues) {
+                c.start += offset;
+                c.end += offset;
+            }
+            SubtitleSource src;
+            src.label = ext;
+            subtitle_track_assign(&src.track, std::move(cues));
+            ps->subtitles.push_back(std::move(src));
+        }
+    }
+
+    if (!ps->subtitles.empty()) log_message(LOG_OK, MP, "%d subtitle track(s), showing %d", (int)ps->subtitles.size(), ps->sub_selected);
+    if (ps->sub_selected >= 0 && ps->subtitles[ps->sub_selected].bitmap) ps->sub_bitmap_stream = ps->subtitles[ps->sub_selected].stream_index;
+    for (const SubtitleSource &src : ps->subtitles) {
+        if (!src.bitmap) continue;
+        pq_init(&ps->subq);
+        pq_start(&ps->subq);
+        ps->sub_tid = std::thread(subtitle_decode_thread, ps);
+        break;
+    }
+    if (ps->main) {
+        media_info_get()->total_caption_count = (int)ps->subtitles.size();
+        media_info_get()->current_caption_id = ps->sub_selected + 1;
+    }
+}
+
+static int *instance_count(const MediaPlayerOptions &opts) { return opts.audio_only ? &g_audio_players : &g_full_players; }
+
+static void release_instance(MediaPlayer *ps) {
+    --*instance_count(ps->opts);
+    faststart_release(ps->source);
+    delete ps;
+}
+
+static MediaPlayer *open_instance(const char *path_, const MediaPlayerOptions &opts, bool main) {
+    bool network = is_network_url(path_);
+    std::string path = network ? std::string(path_) : "file:" + std::string(path_);
+    log_message(LOG_DEBUG, MP, "player_open: %s%s%s", (network ? http_url_for_log(path) : path).c_str(), opts.audio_only ? " [audio]" : "", opts.loop ? " [loop]" : "");
+
+    int *count = instance_count(opts);
+    if (*count >= (opts.audio_only ? PLAYER_MAX_AUDIO_ONLY : PLAYER_MAX_FULL)) {
+        log_message(LOG_WARNING, MP, "No free %s player instance", opts.audio_only ? "audio-only" : "full");
+        return nullptr;
+    }
 
     if (!g_flush_pkt) {
         g_flush_pkt = av_packet_alloc();
         if (!g_flush_pkt) {
             log_message(LOG_ERROR, MP, "flush sentinel alloc failed");
-            return -1;
+            return nullptr;
         }
         static uint8_t sentinel = 0;
         g_flush_pkt->data = &sentinel;
         g_flush_pkt->size = 0;
     }
 
-    S = new PlayerState{};
-    avformat_network_init();
-
-    S->fmt_ctx = avformat_alloc_context();
-    if (!S->fmt_ctx) {
-        delete S;
-        S = nullptr;
-        return -1;
+    MediaPlayer *ps = new MediaPlayer{};
+    ps->opts = opts;
+    ps->main = main;
+    ps->source = path_;
+    ++*count;
+    // The remuxer keeps off the card, and off files a player may have open.
+    faststart_hold(ps->source);
+    profiler_begin(&ps->startup_prof, "first frame");
+    if (!g_ctx.network) {
+        avformat_network_init();
+        g_ctx.network = true;
+    }
+
+    // The browser may have opened and probed a local file while the cursor
+    // rested on it.
+    AVFormatContext *preopened = network ? nullptr : preopen_take_media(path_);
+    ps->fmt_ctx = preopened ? preopened : avformat_alloc_context();
+    if (!ps->fmt_ctx) {
+        release_instance(ps);
+        return nullptr;
     }
+    ps->fmt_ctx->opaque = ps;
 
-    {
-        int err = avformat_open_input(&S->fmt_ctx, path.c_str(), nullptr, nullptr);
+    // A matching stream-info cache entry lets us skip both the format probe and
+    // avformat_find_stream_info, which together read megabytes on slow media.
+    StreamCacheKey cache_key;
+    StreamCacheEntry cache_entry;
+    bool have_cache_key = !preopened && stream_cache_make_key(path_, &cache_key);
+    bool cache_hit = have_cache_key && stream_cache_load(cache_key, &cache_entry);
+
+    profiler open_prof;
+    profiler_begin(&open_prof, "open+probe");
+
+    if (network && is_playlist_url(path_)) hook_segment_io(ps);
+    else if (network && !open_http_source(ps, path_)) log_message(LOG_WARNING, MP, "Falling back to FFmpeg http protocol");
+
+    bool probed_from_cache = false;
+    if (!preopened) {
+        auto iformat = cache_hit ? av_find_input_format(cache_entry.format_name.substr(0, cache_entry.format_name.find(',')).c_str()) : nullptr;
+        int err = avformat_open_input(&ps->fmt_ctx, path.c_str(), iformat, nullptr);
         if (err < 0) {
             char buf[256]{};
             av_strerror(err, buf, sizeof(buf));
             log_message(LOG_ERROR, MP, "avformat_open_input: [%d] %s", err, buf);
-            avformat_free_context(S->fmt_ctx);
-            S->fmt_ctx = nullptr;
-            delete S;
-            S = nullptr;
-            return -1;
+            avformat_free_context(ps->fmt_ctx);
+            ps->fmt_ctx = nullptr;
+            close_http_source(ps);
+            release_instance(ps);
+            return nullptr;
+        }
+        ps->fmt_ctx->flags |= AVFMT_FLAG_NOBUFFER;
+        ps->fmt_ctx->probesize = PLAYER_PROBE_SIZE;
+        ps->fmt_ctx->max_analyze_duration = PLAYER_ANALYZE_DURATION;
+
+        probed_from_cache = cache_hit && stream_cache_apply(ps->fmt_ctx, cache_entry);
+        if (!probed_from_cache) {
+            if (avformat_find_stream_info(ps->fmt_ctx, nullptr) < 0) {
+                log_message(LOG_ERROR, MP, "avformat_find_stream_info failed");
+                if (cache_hit) stream_cache_invalidate(cache_key);
+                avformat_close_input(&ps->fmt_ctx);
+                close_http_source(ps);
+                release_instance(ps);
+                return nullptr;
+            }
+            if (have_cache_key) {
+                StreamCacheEntry fresh;
+                stream_cache_capture(ps->fmt_ctx, cache_key, &fresh);
+                stream_cache_save(fresh);
+            }
         }
     }
-    S->fmt_ctx->flags |= AVFMT_FLAG_NOBUFFER;
-    S->fmt_ctx->probesize = 32 * 1024;
-    S->fmt_ctx->max_analyze_duration = AV_TIME_BASE / 2;
+    profiler_end(&open_prof);
+    log_message(LOG_OK, MP, "Stream info %s", preopened ? "pre-opened" : probed_from_cache ? "restored from cache" : "probed");
+    log_message(LOG_OK, MP, "Container: fmt=%s streams=%u dur=%.2f s", ps->fmt_ctx->iformat->name, ps->fmt_ctx->nb_streams, ps->fmt_ctx->duration / (double)AV_TIME_BASE);
+    if (!network && strstr(ps->fmt_ctx->iformat->name, "mp4")) faststart_consider(path_);
+
+    ps->max_frame_dur = (ps->fmt_ctx->iformat->flags & AVFMT_TS_DISCONT) ? 10.0 : 3600.0;
+    pq_init(&ps->videoq);
+    pq_init(&ps->audioq);
+
+    // Start-up is a small dependency graph: everything hangs off the probe, the
+    // read/decode threads only need the video codec, and shader/plane setup on
+    // this thread overlaps decoding of the first keyframe while the audio codec,
+    // mixer source and resampler come up on their own thread.
+    bool has_v = false;
+    if (!opts.audio_only) {
+        profiler prof;
+        profiler_begin(&prof, "video codec");
+        init_abr(ps);
+        has_v = init_video_stream(ps);
+        profiler_end(&prof);
+    }
+
+    int wanted_audio = ps->abr_active >= 0 ? ps->abr_ladder[ps->abr_active].audio_idx : -1;
+    ps->audio_idx = av_find_best_stream(ps->fmt_ctx, AVMEDIA_TYPE_AUDIO, wanted_audio, -1, nullptr, 0);
+    bool has_a = ps->audio_idx >= 0;
+    if (!has_a) log_message(LOG_WARNING, MP, "No audio stream (continuing without audio)");
 
-    if (avformat_find_stream_info(S->fmt_ctx, nullptr) < 0) {
-        log_message(LOG_ERROR, MP, "avformat_find_stream_info failed");
-        avformat_close_input(&S->fmt_ctx);
-        delete S;
-        S = nullptr;
-        return -1;
+    if (!has_v && !has_a) {
+        player_close(ps);
+        return nullptr;
     }
-    log_message(LOG_OK, MP, "Container: fmt=%s streams=%u dur=%.2f s", S->fmt_ctx->iformat->name, S->fmt_ctx->nb_streams, S->fmt_ctx->duration / (double)AV_TIME_BASE);
 
-    S->max_frame_dur = (S->fmt_ctx->iformat->flags & AVFMT_TS_DISCONT) ? 10.0 : 3600.0;
-    pq_init(&S->videoq);
-    pq_init(&S->audioq);
+    if (!has_v) {
+        // Audio-only instances never fetch the other streams.
+        if (opts.audio_only)
+            for (unsigned i = 0; i < ps->fmt_ctx->nb_streams; ++i)
+                if ((int)i != ps->audio_idx) ps->fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        ps->audio_only = true;
+        ps->audio_buf_max = AUDIO_ONLY_BUF_MAX_BYTES;
+        ps->queue_seconds = AUDIO_ONLY_QUEUE_SECONDS;
+        ps->audio_buf_low = AUDIO_ONLY_BUF_LOW_SECONDS;
+        log_message(LOG_OK, MP, "Audio-only mode");
+    }
+
+    if (has_v) pq_start(&ps->videoq);
+    if (has_a) pq_start(&ps->audioq);
+    if (has_v && has_a && !network && ps->abr_ladder.empty()) open_audio_demuxer(ps, path);
+    if (has_v) init_subtitles(ps, path_, network);
+
+    clock_init(&ps->audclk, &ps->audioq.serial);
+    clock_init(&ps->vidclk, &ps->videoq.serial);
+    clock_init(&ps->extclk, nullptr);
+
+    ps->frame_timer = ps->wall_play_origin = wall_now();
+    ps->wall_play_offset = 0.0;
+    ps->running.store(true);
+    ps->paused.store(true);
+    ps->playing.store(false);
+
+    ps->read_tid = std::thread(read_thread, ps);
+    if (ps->audio_fmt_ctx) ps->audio_read_tid = std::thread(audio_read_thread, ps);
+    if (has_v) ps->video_tid = std::thread(video_decode_thread, ps);
+    if (has_a) ps->audio_setup_tid = std::thread(audio_setup_thread, ps);
+
+    if (has_v && !init_video_output(ps)) {
+        player_close(ps);
+        return nullptr;
+    }
 
-    bool has_v = init_video_stream();
-    bool has_a = init_audio_stream();
-    if (!has_v && !has_a) {
-        media_player_cleanup();
-        return -1;
+    log_message(LOG_OK, MP, "player_open complete");
+    return ps;
+}
+
+MediaPlayer *player_open(const char *path, const MediaPlayerOptions &opts) { return open_instance(path, opts, false); }
+
+void player_play(MediaPlayer *ps, bool play) {
+    if (!ps) return;
+    if (ps->scrubbing) {
+        // Applied when the scrub settles.
+        ps->scrub_resume = play;
+        if (ps->main) media_info_get()->playback_status = play;
+        return;
+    }
+    if (play && ps->paused.load()) {
+        ps->frame_timer += wall_now() - ps->vidclk.last_upd;
+        ps->vidclk.paused = false;
+        ps->wall_play_origin = wall_now();
+        clock_set(&ps->vidclk, clock_get(&ps->vidclk), ps->vidclk.serial);
+    } else if (!play && !ps->paused.load()) {
+        ps->wall_play_offset = get_master_clock(ps);
+    }
+    clock_set(&ps->extclk, clock_get(&ps->extclk), ps->extclk.serial);
+    ps->audclk.paused = ps->vidclk.paused = ps->extclk.paused = !play;
+    ps->paused.store(!play);
+    ps->playing.store(play);
+    if (ps->main) media_info_get()->playback_status = play;
+    {
+        std::lock_guard<std::mutex> lk(ps->audio_mtx);
+        if (ps->audio_src) audio_mixer_pause(ps->audio_src, !play);
     }
 
-    if (has_v) pq_start(&S->videoq);
-    if (has_a) pq_start(&S->audioq);
+    player_post_cmd(ps, play ? PlayerCmdType::Play : PlayerCmdType::Pause);
+    waker_signal(&ps->pump_waker);
+    log_message(LOG_DEBUG, MP, "player_play(ps, %s) clock=%.3f s", play ? "true" : "false", get_master_clock(ps));
+}
 
-    clock_init(&S->audclk, &S->audioq.serial);
-    clock_init(&S->vidclk, &S->videoq.serial);
-    clock_init(&S->extclk, nullptr);
+// Requests only move the target and the clocks, so the HUD and the next
+// relative seek see it at once; scrub_tick() decides when the demuxer seeks.
+void player_seek(MediaPlayer *ps, double seconds) {
+    if (!ps || !ps->fmt_ctx) return;
+    double total = player_get_total_time(ps);
+    if (total > 0.0) seconds = std::min(seconds, total - 1.0);
+    seconds = std::max(seconds, 0.0);
+
+    if (!ps->scrubbing) {
+        ps->scrub_resume = ps->playing.load();
+        if (ps->scrub_resume) player_play(ps, false);
+        ps->scrubbing = true;
+        ps->scrub_read.store(true);
+    }
+    ps->scrub_target = seconds;
+    ps->scrub_input_time = wall_now();
+
+    ps->wall_play_offset = seconds;
+    ps->wall_play_origin = wall_now();
+    clock_set(&ps->audclk, seconds, ps->audioq.serial);
+    clock_set(&ps->vidclk, seconds, ps->videoq.serial);
+    clock_set(&ps->extclk, seconds, ps->extclk.serial);
+}
 
-    S->frame_timer = S->wall_play_origin = wall_now();
-    S->wall_play_offset = 0.0;
-    S->running.store(true);
-    S->paused.store(true);
-    S->playing.store(false);
+static void scrub_issue(MediaPlayer *ps, double seconds) {
+    {
+        std::lock_guard<std::mutex> alk(ps->audio_mtx);
+        if (ps->audio_src) audio_mixer_clear(ps->audio_src);
+    }
+    ps->scrub_issued = seconds;
+    ps->scrub_issue_time = wall_now();
+    ps->scrub_issue_serial = ps->videoq.serial;
+    ps->frame_timer = wall_now();
+    player_post_cmd(ps, PlayerCmdType::Seek, (int64_t)(seconds * AV_TIME_BASE));
+}
 
-    S->read_tid = std::thread(read_thread);
-    if (has_v) S->video_tid = std::thread(video_decode_thread);
-    if (has_a) S->audio_tid = std::thread(audio_decode_thread);
-    if (has_a) S->audio_pump_tid = std::thread(audio_pump_thread);
+static void scrub_tick(MediaPlayer *ps) {
+    if (!ps->scrubbing) return;
+    double now = wall_now();
+    bool settled = now - ps->scrub_input_time >= SCRUB_SETTLE_SECONDS;
 
-    media_info_get()->playback_status = false;
-    if (has_v && S->video_idx >= 0) {
-        AVStream *vs = S->fmt_ctx->streams[S->video_idx];
-        double dur = vs->duration != AV_NOPTS_VALUE ? vs->duration * av_q2d(vs->time_base) : 0.0;
-        media_info_get()->total_playback_time = dur;
-    }
-    if (has_a && S->audio_idx >= 0) {
-        AVStream *as = S->fmt_ctx->streams[S->audio_idx];
-        int64_t dur = as->duration != AV_NOPTS_VALUE ? (int64_t)(as->duration * av_q2d(as->time_base)) : 0;
-        media_info_get()->total_playback_time = dur;
+    if (ps->scrub_target != ps->scrub_issued) {
+        // Without video there is nothing to preview; seek once input settles.
+        bool preview_up = ps->scrub_shown_serial != ps->scrub_issue_serial && ps->scrub_shown_serial == ps->videoq.serial;
+        bool ready = ps->video_idx >= 0 ? std::isnan(ps->scrub_issued) || preview_up || now - ps->scrub_issue_time >= SCRUB_PREVIEW_TIMEOUT : settled;
+        if (ready) scrub_issue(ps, ps->scrub_target);
+        return;
     }
-    log_message(LOG_OK, MP, "media_player_init complete");
-    return 0;
+    if (!settled) return;
+
+    ps->scrubbing = false;
+    ps->scrub_issued = NAN;
+    ps->scrub_read.store(false);
+    ps->wall_play_offset = ps->scrub_target;
+    ps->wall_play_origin = now;
+    if (ps->scrub_resume) player_play(ps, true);
+}
+
+static AbrCounters abr_counters(MediaPlayer *ps) {
+    AbrCounters c;
+    c.net_bytes = ps->net_bytes.load(std::memory_order_relaxed);
+    c.net_ticks = ps->net_ticks.load(std::memory_order_relaxed);
+    c.busy_ticks = ps->viddec.busy_ticks.load(std::memory_order_relaxed);
+    c.decoded = ps->viddec.frames.load(std::memory_order_relaxed);
+    c.shown = ps->frames_decoded;
+    c.dropped = ps->frames_dropped;
+    c.lateness = ps->lateness_sum;
+    return c;
 }
 
-void media_player_play(bool play) {
-    if (!S) return;
-    if (play && S->paused.load()) {
-        S->frame_timer += wall_now() - S->vidclk.last_upd;
-        S->vidclk.paused = false;
-        S->wall_play_origin = wall_now();
-        clock_set(&S->vidclk, clock_get(&S->vidclk), S->vidclk.serial);
-    } else if (!play && !S->paused.load()) {
-        S->wall_play_offset = get_master_clock();
-    }
-    clock_set(&S->extclk, clock_get(&S->extclk), S->extclk.serial);
-    S->audclk.paused = S->vidclk.paused = S->extclk.paused = !play;
-    S->paused.store(!play);
-    S->playing.store(play);
-    media_info_get()->playback_status = play;
-    if (S->audio_dev) SDL_PauseAudioDevice(S->audio_dev, play ? 0 : 1);
-
-    if (play) S->read_sleep_cv.notify_all();
-    log_message(LOG_DEBUG, MP, "media_player_play(%s) clock=%.3f s", play ? "true" : "false", get_master_clock());
-}
-
-void media_player_seek(double seconds) {
-    if (!S || !S->fmt_ctx) return;
-    bool was_playing = S->playing.load();
-    if (was_playing) media_player_play(false);
-    S->wall_play_offset = seconds;
-    S->wall_play_origin = wall_now();
+// Feeds the last second of network and decoder statistics to the variant
+// controller and hands its choice to the read thread.
+static void abr_tick(MediaPlayer *ps) {
+    if (ps->abr_ladder.empty()) return;
+    double now = wall_now();
+    if (now - ps->abr_last_tick < ABR_TICK_SECONDS) return;
+
+    AbrCounters c = abr_counters(ps);
+    const AbrCounters &p = ps->abr_last;
+    AbrSample s;
+    s.seconds = now - ps->abr_last_tick;
+    s.net_bytes = c.net_bytes - p.net_bytes;
+    s.net_seconds = (double)(c.net_ticks - p.net_ticks) / (double)OSTimerClockSpeed;
+    s.frames_decoded = c.decoded - p.decoded;
+    s.decode_seconds = (double)(c.busy_ticks - p.busy_ticks) / (double)OSTimerClockSpeed;
+    s.frames_shown = c.shown - p.shown;
+    s.frames_dropped = c.dropped - p.dropped;
+    s.lateness_seconds = c.lateness - p.lateness;
+    s.frame_duration = ps->abr_frame_dur;
     {
-        std::lock_guard<std::mutex> lk(S->seek_mtx);
-        S->seek_pos = (int64_t)(seconds * AV_TIME_BASE);
-        S->seek_req = true;
-        if (S->audio_dev) SDL_ClearQueuedAudio(S->audio_dev);
-        clock_set(&S->audclk, seconds, S->audioq.serial);
-        clock_set(&S->vidclk, seconds, S->videoq.serial);
-        clock_set(&S->extclk, seconds, S->extclk.serial);
-        S->frame_timer = wall_now();
+        std::lock_guard<std::mutex> lk(ps->videoq.mtx);
+        s.buffer_seconds = ps->videoq.dur * av_q2d(ps->video_tb);
+    }
+    ps->abr_last = c;
+    ps->abr_last_tick = now;
+
+    int prev = ps->abr.current;
+    int want = abr_update(&ps->abr, s);
+    if (want != prev) {
+        log_message(LOG_DEBUG, MP, "ABR: want %d (tput %.0f kbit/s, load %.2f, drops %d)", want, abr_throughput(&ps->abr) / 1000.0, ps->abr.decode_load, s.frames_dropped);
+        ps->abr_target.store(want, std::memory_order_relaxed);
+        waker_signal(&ps->read_waker);
     }
-    S->seek_cv.notify_all();
-    S->read_sleep_cv.notify_all();
-    if (was_playing) media_player_play(true);
 }
 
-void media_player_update() {
-    if (!S) return;
+// Variants differ in resolution and a decoder switch changes the format;
+// textures follow the decoded frames.
+static void resize_video_planes(MediaPlayer *ps, VideoFmt fmt, int w, int h) {
+    GX2DrawDone();
+    free_video_planes(ps);
+    if (!init_video_planes(ps, fmt, w, h)) {
+        log_message(LOG_ERROR, MP, "init_video_planes failed for %dx%d", w, h);
+        return;
+    }
+    ps->out_w = w;
+    ps->out_h = h;
+    if (ps->cur_frame_info) {
+        ps->cur_frame_info->width = w;
+        ps->cur_frame_info->height = h;
+    }
+}
+
+void player_update(MediaPlayer *ps) {
+    if (!ps) return;
 
-    media_info_get()->current_playback_time = get_master_clock();
-    if (!S->video_avctx) return;
+    // Setup has finished, so the join does not block; media_info is only
+    // written from this thread.
+    if (ps->audio_setup_done.load(std::memory_order_acquire) && ps->audio_setup_tid.joinable()) {
+        ps->audio_setup_tid.join();
+        if (ps->main) media_info_get()->total_audio_track_count = (int)player_get_audio_tracks(ps).size();
+    }
+
+    if (ps->main) {
+        media_info_get()->current_playback_time = get_master_clock(ps);
+        // Background downloads back off while anything is actually playing.
+        download_queue_set_throttled(ps->playing.load(std::memory_order_relaxed));
+    }
 
-    if (S->playing.load(std::memory_order_relaxed)) {
+    if (ps->playing.load(std::memory_order_relaxed)) {
         double now = wall_now();
-        if (now - S->last_log_time >= 5.0) {
-            log_message(LOG_DEBUG, MP, "clock=%.2f vq=%d aq=%d pictq=%d sampq=%d dec=%d drp=%d fmt=%d", get_master_clock(), S->videoq.nb_packets, S->audioq.nb_packets, fq_nb_remaining(&S->pictq), fq_nb_remaining(&S->sampq), S->frames_decoded, S->frames_dropped, (int)S->video_fmt.load());
-            S->last_log_time = now;
+        if (now - ps->last_log_time >= 5.0) {
+            log_message(LOG_DEBUG, MP, "clock=%.2f vq=%d aq=%d pictq=%d/%d sampq=%d dec=%d drp=%d fmt=%d wake r=%u p=%u cmd=%u lat avg=%llu max=%llu us", get_master_clock(ps), ps->videoq.nb_packets, ps->audioq.nb_packets, fq_nb_remaining(&ps->pictq), ps->pictq_depth, fq_nb_remaining(&ps->sampq), ps->frames_decoded, ps->frames_dropped, (int)ps->video_fmt.load(), ps->read_waker.wakeups, ps->pump_waker.wakeups, ps->cmds_done, ps->cmds_done ? ps->cmd_latency_sum_us / ps->cmds_done : 0ULL, ps->cmd_latency_max_us);
+            ps->last_log_time = now;
         }
+        abr_tick(ps);
     }
+    scrub_tick(ps);
+    if (!ps->video_avctx.load(std::memory_order_acquire)) return;
 
-    if (S->video_fmt.load(std::memory_order_acquire) == VideoFmt::Unknown) return;
+    if (ps->video_fmt.load(std::memory_order_acquire) == VideoFmt::Unknown) return;
 
 retry:
-    if (fq_nb_remaining(&S->pictq) > 0) {
-        Frame *lastvp = fq_peek_last(&S->pictq);
-        Frame *vp = fq_peek(&S->pictq);
+    if (fq_nb_remaining(&ps->pictq) > 0) {
+        Frame *lastvp = fq_peek_last(&ps->pictq);
+        Frame *vp = fq_peek(&ps->pictq);
 
-        if (vp->serial != S->videoq.serial) {
-            fq_next(&S->pictq);
+        if (vp->serial != ps->videoq.serial) {
+            fq_next(&ps->pictq);
             goto retry;
         }
-        if (lastvp->serial != vp->serial) S->frame_timer = wall_now();
-        if (!S->playing.load(std::memory_order_relaxed)) goto display;
+        if (lastvp->serial != vp->serial) ps->frame_timer = wall_now();
+        if (!ps->playing.load(std::memory_order_relaxed)) {
+            // The first frame after each scrub seek goes up straight away.
+            if (ps->scrubbing && vp->serial != ps->scrub_shown_serial) {
+                ps->scrub_shown_serial = vp->serial;
+                fq_next(&ps->pictq);
+                ps->force_refresh = true;
+            }
+            goto display;
+        }
 
-        double delay = compute_target_delay(vp_duration(lastvp, vp));
+        double delay = compute_target_delay(ps, vp_duration(ps, lastvp, vp));
         double now = wall_now();
-        if (now < S->frame_timer + delay) goto display;
+        if (now < ps->frame_timer + delay) goto display;
 
-        S->frame_timer += delay;
-        if (delay > 0 && now - S->frame_timer > AV_SYNC_THRESHOLD_MAX) S->frame_timer = now;
+        ps->frame_timer += delay;
+        if (now > ps->frame_timer) ps->lateness_sum += now - ps->frame_timer;
+        if (delay > 0 && now - ps->frame_timer > AV_SYNC_THRESHOLD_MAX) ps->frame_timer = now;
 
         {
-            std::lock_guard<std::mutex> lk(S->pictq.mtx);
+            std::lock_guard<std::mutex> lk(ps->pictq.mtx);
             if (!std::isnan(vp->pts)) {
-                clock_set(&S->vidclk, vp->pts, vp->serial);
-                clock_sync_to_slave(&S->extclk, &S->vidclk);
+                clock_set(&ps->vidclk, vp->pts, vp->serial);
+                clock_sync_to_slave(&ps->extclk, &ps->vidclk);
             }
         }
 
-        if (fq_nb_remaining(&S->pictq) > 1) {
-            Frame *nextvp = fq_peek_next(&S->pictq);
-            if (now > S->frame_timer + vp_duration(vp, nextvp)) {
-                S->frames_dropped++;
-                fq_next(&S->pictq);
-                S->force_refresh = false;
+        if (fq_nb_remaining(&ps->pictq) > 1) {
+            Frame *nextvp = fq_peek_next(&ps->pictq);
+            if (now > ps->frame_timer + vp_duration(ps, vp, nextvp)) {
+                ps->frames_dropped++;
+                fq_next(&ps->pictq);
+                ps->force_refresh = false;
                 goto retry;
             }
         }
-        fq_next(&S->pictq);
-        S->force_refresh = true;
-        S->frames_decoded++;
+        fq_next(&ps->pictq);
+        ps->force_refresh = true;
+        ps->frames_decoded++;
     }
 
 display:
-    if (!S->force_refresh) return;
-    S->force_refresh = false;
-    if (S->pictq.rindex_shown == 0) return;
+    if (!ps->force_refresh) return;
+    ps->force_refresh = false;
+    if (ps->pictq.rindex_shown == 0) return;
 
-    Frame *vp = fq_peek_last(&S->pictq);
+    Frame *vp = fq_peek_last(&ps->pictq);
     if (!vp || !vp->frame || !vp->frame->data[0]) return;
 
     if (!vp->uploaded) {
-        video_upload_frame(vp->frame);
+        VideoFmt fmt = frame_video_fmt(vp->frame->format);
+        if (fmt != ps->plane_fmt || vp->frame->width != ps->plane_y.coded_w || vp->frame->height != ps->plane_y.coded_h) resize_video_planes(ps, fmt, vp->frame->width, vp->frame->height);
+        video_upload_frame(ps, vp->frame);
         vp->uploaded = true;
     }
 
     rect dest = display_calculate_aspect_fit(vp->width, vp->height);
-    update_quad(dest);
+    update_quad(ps, dest);
+
+    if (ps->render_fn) ps->render_fn(ps, dest);
 
-    if (S->render_fn) S->render_fn(dest);
+    if (!ps->first_frame_shown) {
+        ps->first_frame_shown = true;
+        profiler_end(&ps->startup_prof);
+    }
 }
 
-bool media_player_switch_audio_track(int new_idx) {
-    if (!S || !S->audio_enabled) return false;
-    if (new_idx < 0 || new_idx >= (int)S->fmt_ctx->nb_streams) return false;
-    if (S->fmt_ctx->streams[new_idx]->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) return false;
-    if (new_idx == S->audio_idx) return true;
+bool player_switch_audio_track(MediaPlayer *ps, int new_idx) {
+    if (!ps) return false;
+    // Refused while setup is still running; the press is simply ignored.
+    if (!ps->audio_setup_done.load(std::memory_order_acquire) || !ps->audio_enabled.load()) return false;
+    if (new_idx < 0 || new_idx >= (int)ps->fmt_ctx->nb_streams) return false;
+    if (ps->fmt_ctx->streams[new_idx]->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) return false;
+    if (new_idx == ps->audio_idx) return true;
 
-    double t = get_master_clock();
-    bool was_playing = S->playing.load();
-    media_player_play(false);
+    double t = get_master_clock(ps);
+    bool was_playing = ps->playing.load();
+    player_play(ps, false);
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    if (S->audio_dev) {
-        SDL_PauseAudioDevice(S->audio_dev, 1);
-        SDL_ClearQueuedAudio(S->audio_dev);
+    // Pump holds audio_mtx while it converts, so once this is taken it has
+    // stopped touching swr_ctx and the device.
+    std::unique_lock<std::mutex> alk(ps->audio_mtx);
+    if (ps->audio_src) {
+        audio_mixer_pause(ps->audio_src, true);
+        audio_mixer_clear(ps->audio_src);
     }
 
-    decoder_abort(&S->auddec, &S->sampq);
-    if (S->audio_tid.joinable()) S->audio_tid.join();
-    decoder_free_pkt(&S->auddec);
+    decoder_abort(&ps->auddec, &ps->sampq);
+    if (ps->audio_tid.joinable()) ps->audio_tid.join();
+    decoder_free_pkt(&ps->auddec);
 
-    AVStream *st = S->fmt_ctx->streams[new_idx];
+    AVStream *st = ps->fmt_ctx->streams[new_idx];
     const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
     if (!codec) return false;
 
@@ -1480,114 +2971,297 @@ bool media_player_switch_audio_track(int new_idx) {
         return false;
     }
     avctx->pkt_timebase = st->time_base;
-    avcodec_free_context(&S->audio_avctx);
-    S->audio_avctx = avctx;
+    avcodec_free_context(&ps->audio_avctx);
+    ps->audio_avctx = avctx;
 
-    rebuild_swr();
-    if (!S->swr_ctx) {
-        avcodec_free_context(&S->audio_avctx);
+    rebuild_swr(ps);
+    if (!ps->swr_ctx) {
+        avcodec_free_context(&ps->audio_avctx);
         return false;
     }
 
-    S->audio_idx = S->cur_audio_track = new_idx;
-    pq_flush_locked(&S->audioq);
-    pq_start(&S->audioq);
-    fq_destroy(&S->sampq);
-    fq_init(&S->sampq, &S->audioq, AUDIO_FRAME_QUEUE_SIZE, 1);
-    decoder_init(&S->auddec, avctx, &S->audioq);
-    {
-        std::lock_guard<std::mutex> lk(S->seek_mtx);
-        S->seek_pos = (int64_t)(t * AV_TIME_BASE);
-        S->seek_req = true;
-    }
-    S->seek_cv.notify_all();
-    S->read_sleep_cv.notify_all();
-    S->audio_tid = std::thread(audio_decode_thread);
-    if (was_playing) {
-        if (S->audio_dev) SDL_PauseAudioDevice(S->audio_dev, 0);
-        media_player_play(true);
+    // The read thread switches audio_idx itself when it picks up the command,
+    // so packets of the old stream are never routed to the new decoder.
+    ps->cur_audio_track = new_idx;
+    pq_flush_locked(&ps->audioq);
+    pq_start(&ps->audioq);
+    fq_destroy(&ps->sampq);
+    fq_init(&ps->sampq, &ps->audioq, ps->audio_only ? AUDIO_ONLY_FRAME_QUEUE_SIZE : AUDIO_FRAME_QUEUE_SIZE, 1);
+    decoder_init(&ps->auddec, avctx, &ps->audioq);
+    player_post_cmd(ps, PlayerCmdType::SwitchAudio, (int64_t)(t * AV_TIME_BASE), new_idx);
+    ps->audio_tid = std::thread(audio_decode_thread, ps);
+    alk.unlock();
+    if (was_playing) player_play(ps, true);
+    return true;
+}
+
+std::vector<AudioTrackInfo> player_get_audio_tracks(MediaPlayer *ps) {
+    if (!ps) return {};
+    std::lock_guard<std::mutex> lk(ps->audio_tracks_mtx);
+    return ps->audio_tracks;
+}
+
+double player_get_current_time(MediaPlayer *ps) { return ps ? get_master_clock(ps) : 0.0; }
+bool player_is_playing(MediaPlayer *ps) { return ps && ps->playing.load(); }
+int player_get_current_audio_track(MediaPlayer *ps) { return ps ? ps->cur_audio_track : -1; }
+bool player_is_audio_only(MediaPlayer *ps) { return ps && ps->audio_only; }
+
+bool player_get_cover_art(MediaPlayer *ps, const uint8_t **data, size_t *size) {
+    if (!ps || ps->cover_art.empty()) return false;
+    *data = ps->cover_art.data();
+    *size = ps->cover_art.size();
+    return true;
+}
+
+std::vector<SubtitleTrackInfo> player_get_subtitle_tracks(MediaPlayer *ps) {
+    std::vector<SubtitleTrackInfo> tracks;
+    if (!ps) return tracks;
+    for (const SubtitleSource &src : ps->subtitles)
+        tracks.push_back({src.label, src.stream_index < 0});
+    return tracks;
+}
+
+bool player_select_subtitle(MediaPlayer *ps, int track) {
+    if (!ps || track < -1 || track >= (int)ps->subtitles.size()) return false;
+    ps->sub_selected = track;
+    ps->sub_cursor = SubtitleCursor{};
+    ps->sub_dirty = true;
+    if (ps->main) media_info_get()->current_caption_id = track + 1;
+    log_message(LOG_OK, MP, "Subtitles: %s", track >= 0 ? ps->subtitles[track].label.c_str() : "off");
+
+    int bitmap_stream = track >= 0 && ps->subtitles[track].bitmap ? ps->subtitles[track].stream_index : -1;
+    if (ps->sub_bitmap_stream.exchange(bitmap_stream) != bitmap_stream) {
+        clear_subtitle_bitmaps(ps);
+        // The event on screen now may have started long ago; read from here
+        // again so it is not missed.
+        if (bitmap_stream >= 0) player_seek(ps, get_master_clock(ps));
     }
     return true;
 }
 
-std::vector<AudioTrackInfo> media_player_get_audio_tracks() {
-    if (!S) return {};
-    std::lock_guard<std::mutex> lk(S->audio_tracks_mtx);
-    return S->audio_tracks;
+int player_get_current_subtitle(MediaPlayer *ps) { return ps ? ps->sub_selected : -1; }
+
+bool player_get_subtitles(MediaPlayer *ps, const std::vector<SubtitleCue> **cues) {
+    static const std::vector<SubtitleCue> none;
+    *cues = ps ? &ps->sub_cursor.active : &none;
+    if (!ps) return false;
+    bool changed = ps->sub_dirty;
+    ps->sub_dirty = false;
+    if (ps->sub_selected < 0) return changed;
+
+    // The common case: same track version, still inside the cursor window.
+    double t = get_master_clock(ps);
+    uint32_t version = ps->sub_version.load(std::memory_order_acquire);
+    if (std::isnan(t) || subtitle_cursor_valid(ps->sub_cursor, version, t)) return changed;
+
+    std::lock_guard<std::mutex> lk(ps->sub_mtx);
+    return subtitle_cursor_refresh(&ps->sub_cursor, ps->subtitles[ps->sub_selected].track, version, t) || changed;
 }
 
-double media_player_get_current_time() { return S ? get_master_clock() : 0.0; }
-bool media_player_is_playing() { return S && S->playing.load(); }
-int media_player_get_current_audio_track() { return S ? S->cur_audio_track : -1; }
+bool player_get_subtitle_bitmap(MediaPlayer *ps, const SubtitleBitmap **bmp, rect *video) {
+    *bmp = nullptr;
+    if (!ps) return false;
+    *video = ps->dest_rect;
+    if (ps->sub_bitmap_stream.load(std::memory_order_relaxed) < 0) {
+        if (!ps->sub_bitmap_shown) return false;
+        ps->sub_bitmap_shown.reset();
+        return true;
+    }
+
+    // Bitmap events are timed against the picture, not the audio.
+    double t = clock_get(&ps->vidclk);
+    if (std::isnan(t)) t = get_master_clock(ps);
+    uint32_t version = ps->sub_version.load(std::memory_order_acquire);
+    bool changed = false;
+    if (!std::isnan(t) && (version != ps->sub_bitmap_version || t < ps->sub_bitmap_from || t >= ps->sub_bitmap_until)) {
+        std::lock_guard<std::mutex> lk(ps->sub_mtx);
+        size_t queued = ps->sub_bitmaps.size();
+        while (!ps->sub_bitmaps.empty() && ps->sub_bitmaps.front()->end <= t) {
+            ps->sub_bitmap_bytes -= ps->sub_bitmaps.front()->bytes();
+            ps->sub_bitmaps.pop_front();
+        }
+        if (ps->sub_bitmaps.size() != queued) waker_signal(&ps->sub_waker);
+
+        std::shared_ptr<SubtitleBitmap> cur;
+        double until = std::numeric_limits<double>::infinity();
+        for (const auto &b : ps->sub_bitmaps) {
+            if (b->start > t) {
+                until = std::min(until, b->start);
+            } else if (t < b->end) {
+                cur = b;
+                until = std::min(until, b->end);
+            }
+        }
+        ps->sub_bitmap_version = version;
+        ps->sub_bitmap_from = t;
+        ps->sub_bitmap_until = until;
+        changed = cur != ps->sub_bitmap_shown;
+        ps->sub_bitmap_shown = std::move(cur);
+    }
+    *bmp = ps->sub_bitmap_shown.get();
+    return changed;
+}
 
-double media_player_get_total_time() {
-    if (!S || !S->fmt_ctx) return 0.0;
-    auto dur = [](int i) {
-        AVStream *s = S->fmt_ctx->streams[i];
+double player_get_total_time(MediaPlayer *ps) {
+    if (!ps || !ps->fmt_ctx) return 0.0;
+    auto dur = [ps](int i) {
+        AVStream *s = ps->fmt_ctx->streams[i];
         return s->duration != AV_NOPTS_VALUE ? s->duration * av_q2d(s->time_base) : -1.0;
     };
-    if (S->video_idx >= 0) {
-        double d = dur(S->video_idx);
+    if (ps->video_idx >= 0) {
+        double d = dur(ps->video_idx);
         if (d >= 0) return d;
     }
-    if (S->audio_idx >= 0) {
-        double d = dur(S->audio_idx);
+    if (ps->audio_idx >= 0) {
+        double d = dur(ps->audio_idx);
         if (d >= 0) return d;
     }
-    return S->fmt_ctx->duration != AV_NOPTS_VALUE ? S->fmt_ctx->duration / (double)AV_TIME_BASE : 0.0;
+    return ps->fmt_ctx->duration != AV_NOPTS_VALUE ? ps->fmt_ctx->duration / (double)AV_TIME_BASE : 0.0;
 }
 
-void media_player_cleanup() {
-    if (!S) return;
-    log_message(LOG_DEBUG, MP, "cleanup: dec=%d drp=%d clock=%.2f s", S->frames_decoded, S->frames_dropped, get_master_clock());
-
-    S->running.store(false);
-    S->playing.store(false);
-    S->paused.store(true);
-    pq_abort(&S->videoq);
-    fq_signal(&S->pictq);
-    pq_abort(&S->audioq);
-    fq_signal(&S->sampq);
+static void record_decode_rate(MediaPlayer *ps) {
+    // Adaptive streams change resolution on the way, so the pixel count of
+    // the frames is not known.
+    int frames = ps->viddec.frames.load();
+    uint64_t busy = ps->viddec.busy_ticks.load();
+    if (ps->video_idx < 0 || ps->hw_decoder || !ps->abr_ladder.empty() || frames < DECODE_RATE_MIN_FRAMES || !busy) return;
+
+    double secs = (double)busy / (double)OSTimerClockSpeed;
+    double rate = (double)ps->out_w * ps->out_h * frames / secs;
+    double prev = g_sw_pixels_per_sec.load();
+    g_sw_pixels_per_sec.store(prev > 0.0 ? prev + DECODE_RATE_ALPHA * (rate - prev) : rate);
+    log_message(LOG_DEBUG, MP, "SW decode: %d frames %dx%d in %.2f s busy, %.1f Mpx/s", frames, ps->out_w, ps->out_h, secs, rate / 1e6);
+}
+
+DecodeCaps media_player_get_decode_caps() {
+    DecodeCaps caps;
+    caps.hw_h264 = avcodec_find_decoder_by_name("h264_wiiu") != nullptr;
+    caps.sw_pixels_per_sec = g_sw_pixels_per_sec.load();
+    caps.audio_rate = AUDIO_OUT_RATE;
+    caps.audio_channels = AUDIO_OUT_CHANNELS;
+    return caps;
+}
+
+void player_close(MediaPlayer *ps) {
+    if (!ps) return;
+    if (ps->main) download_queue_set_throttled(false);
+    log_message(LOG_DEBUG, MP, "cleanup: dec=%d drp=%d pictq=%d clock=%.2f s", ps->frames_decoded, ps->frames_dropped, ps->pictq_depth, get_master_clock(ps));
+    log_message(LOG_DEBUG, MP, "cleanup: wakeups read=%u pump=%u, %u cmds, latency avg=%llu max=%llu us", ps->read_waker.wakeups, ps->pump_waker.wakeups, ps->cmds_done, ps->cmds_done ? ps->cmd_latency_sum_us / ps->cmds_done : 0ULL, ps->cmd_latency_max_us);
+
+    ps->running.store(false);
+    ps->playing.store(false);
+    ps->paused.store(true);
+    pq_abort(&ps->videoq);
+    fq_signal(&ps->pictq);
+    pq_abort(&ps->audioq);
+    fq_signal(&ps->sampq);
+    waker_signal(&ps->read_waker);
+    waker_signal(&ps->audio_read_waker);
+    waker_signal(&ps->pump_waker);
+    pq_abort(&ps->subq);
+    waker_signal(&ps->sub_waker);
+    if (ps->http_src) http_source_abort(ps->http_src);
     {
-        std::lock_guard<std::mutex> lk(S->seek_mtx);
-        S->seek_req = false;
-    }
-    S->seek_cv.notify_all();
-    S->read_sleep_cv.notify_all();
-
-    if (S->read_tid.joinable()) S->read_tid.join();
-    if (S->video_tid.joinable()) S->video_tid.join();
-    if (S->audio_tid.joinable()) S->audio_tid.join();
-    if (S->audio_pump_tid.joinable()) S->audio_pump_tid.join();
-
-    fq_destroy(&S->pictq);
-    fq_destroy(&S->sampq);
-    pq_destroy(&S->videoq);
-    pq_destroy(&S->audioq);
-    decoder_free_pkt(&S->viddec);
-    decoder_free_pkt(&S->auddec);
-    avcodec_free_context(&S->video_avctx);
-    avcodec_free_context(&S->audio_avctx);
-
-    if (S->audio_dev) {
-        SDL_PauseAudioDevice(S->audio_dev, 1);
-        SDL_ClearQueuedAudio(S->audio_dev);
-        SDL_CloseAudioDevice(S->audio_dev);
-    }
-    if (S->swr_ctx) swr_free(&S->swr_ctx);
-
-    free_video_planes();
-    free_shader(S->shader_yuv420p);
-    free_shader(S->shader_nv12);
-    free(S->quad_vtx);
-    S->quad_vtx = nullptr;
-
-    if (S->cur_frame_info) delete S->cur_frame_info;
-    if (S->fmt_ctx) avformat_close_input(&S->fmt_ctx);
-    if (SDL_WasInit(SDL_INIT_AUDIO)) SDL_QuitSubSystem(SDL_INIT_AUDIO);
-    avformat_network_deinit();
-
-    delete S;
-    S = nullptr;
-    log_message(LOG_OK, MP, "media_player_cleanup complete");
+        std::lock_guard<std::mutex> lk(ps->segment_mtx);
+        for (HttpSource *src : ps->segment_srcs) http_source_abort(src);
+    }
+
+    if (ps->audio_setup_tid.joinable()) ps->audio_setup_tid.join();
+    if (ps->read_tid.joinable()) ps->read_tid.join();
+    if (ps->audio_read_tid.joinable()) ps->audio_read_tid.join();
+    if (ps->video_tid.joinable()) ps->video_tid.join();
+    if (ps->audio_tid.joinable()) ps->audio_tid.join();
+    if (ps->audio_pump_tid.joinable()) ps->audio_pump_tid.join();
+    if (ps->sub_tid.joinable()) ps->sub_tid.join();
+
+    record_decode_rate(ps);
+    if (!ps->abr_ladder.empty() && abr_throughput(&ps->abr) > 0.0) g_abr_last_throughput = abr_throughput(&ps->abr);
+
+    fq_destroy(&ps->pictq);
+    fq_destroy(&ps->sampq);
+    pq_destroy(&ps->videoq);
+    pq_destroy(&ps->audioq);
+    pq_destroy(&ps->subq);
+    decoder_free_pkt(&ps->viddec);
+    decoder_free_pkt(&ps->auddec);
+    AVCodecContext *video_avctx = ps->video_avctx.exchange(nullptr);
+    avcodec_free_context(&video_avctx);
+    arena_frame_pool_free(&ps->frame_pool);
+    avcodec_free_context(&ps->audio_avctx);
+    for (SubtitleSource &src : ps->subtitles)
+        avcodec_free_context(&src.avctx);
+
+    // What is already queued plays out under a short fade, so leaving playback
+    // or handing over to another source does not click.
+    if (ps->audio_src) audio_mixer_release(ps->audio_src, AUDIO_CLOSE_FADE_SECONDS);
+    if (ps->swr_ctx) swr_free(&ps->swr_ctx);
+
+    park_video_output(ps);
+
+    if (ps->cur_frame_info) delete ps->cur_frame_info;
+    if (ps->fmt_ctx) avformat_close_input(&ps->fmt_ctx);
+    if (ps->audio_fmt_ctx) avformat_close_input(&ps->audio_fmt_ctx);
+    close_http_source(ps);
+
+    release_instance(ps);
+    player_arena_log_stats();
+    log_message(LOG_OK, MP, "player_close complete");
+}
+
+// The main player behind the playback scene.
+int media_player_init(const char *path) {
+    if (g_main) {
+        log_message(LOG_WARNING, MP, "Re-init: cleaning up");
+        media_player_cleanup();
+    }
+    player_arena_reset_high_water();
+
+    g_main = open_instance(path, MediaPlayerOptions{}, true);
+    if (!g_main) return -1;
+
+    media_info_get()->playback_status = false;
+    if (g_main->video_idx >= 0) {
+        AVStream *vs = g_main->fmt_ctx->streams[g_main->video_idx];
+        double dur = vs->duration != AV_NOPTS_VALUE ? vs->duration * av_q2d(vs->time_base) : 0.0;
+        media_info_get()->total_playback_time = dur;
+    }
+    if (g_main->audio_idx >= 0) {
+        AVStream *as = g_main->fmt_ctx->streams[g_main->audio_idx];
+        int64_t dur = as->duration != AV_NOPTS_VALUE ? (int64_t)(as->duration * av_q2d(as->time_base)) : 0;
+        media_info_get()->total_playback_time = dur;
+    }
+    log_message(LOG_OK, MP, "media_player_init complete");
+    return 0;
+}
+
+void media_player_cleanup() {
+    player_close(g_main);
+    g_main = nullptr;
+}
+
+void media_player_play(bool play) { player_play(g_main, play); }
+void media_player_seek(double seconds) { player_seek(g_main, seconds); }
+bool media_player_is_playing() { return player_is_playing(g_main); }
+void media_player_update() { player_update(g_main); }
+std::vector<AudioTrackInfo> media_player_get_audio_tracks() { return player_get_audio_tracks(g_main); }
+bool media_player_switch_audio_track(int new_stream_index) { return player_switch_audio_track(g_main, new_stream_index); }
+int media_player_get_current_audio_track() { return player_get_current_audio_track(g_main); }
+double media_player_get_current_time() { return player_get_current_time(g_main); }
+double media_player_get_total_time() { return player_get_total_time(g_main); }
+bool media_player_is_audio_only() { return player_is_audio_only(g_main); }
+bool media_player_get_cover_art(const uint8_t **data, size_t *size) { return player_get_cover_art(g_main, data, size); }
+std::vector<SubtitleTrackInfo> media_player_get_subtitle_tracks() { return player_get_subtitle_tracks(g_main); }
+bool media_player_select_subtitle(int track) { return player_select_subtitle(g_main, track); }
+int media_player_get_current_subtitle() { return player_get_current_subtitle(g_main); }
+bool media_player_get_subtitles(const std::vector<SubtitleCue> **cues) { return player_get_subtitles(g_main, cues); }
+bool media_player_get_subtitle_bitmap(const SubtitleBitmap **bmp, rect *video) { return player_get_subtitle_bitmap(g_main, bmp, video); }
+
+void player_context_shutdown() {
+    free_spare_planes();
+    free(g_ctx.spare_quad);
+    g_ctx.spare_quad = nullptr;
+    free_shader(g_ctx.shader_yuv420p);
+    free_shader(g_ctx.shader_nv12);
+    if (g_ctx.network) avformat_network_deinit();
+    g_ctx.network = false;
 }
@@ -1,6 +1,11 @@
 #ifndef MEDIA_PLAYER_HPP
 #define MEDIA_PLAYER_HPP
 
+#include "player/subtitles.hpp"
+#include "utils/display.hpp"
+
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -12,11 +17,73 @@ struct AudioTrackInfo {
     const char *language;
 };
 
+struct SubtitleTrackInfo {
+    std::string label; // language and codec, or the sidecar file's extension
+    bool external;     // a .srt/.vtt/.ass file next to the media
+};
+
+struct DecodeCaps {
+    bool hw_h264;
+    double sw_pixels_per_sec; // measured over past sessions, 0 until then
+    int audio_rate;
+    int audio_channels;
+};
+
 struct frame_info {
     int width;
     int height;
 };
 
+// A playback instance. Each one runs its own read, decode and audio threads
+// and queues; the UI thread opens it, calls player_update() once per frame
+// and closes it.
+struct MediaPlayer;
+
+struct MediaPlayerOptions {
+    bool audio_only = false; // ignore video: no GX2 resources, no video decoder
+    bool loop = false;       // start over at the end instead of stopping
+};
+
+// Instances compete for the decoders, GX2 memory and the arena, so only a few
+// may be open at once; player_open() fails once a kind is used up.
+#define PLAYER_MAX_FULL 1
+#define PLAYER_MAX_AUDIO_ONLY 2
+
+// Probe limits for avformat_find_stream_info on a freshly opened input.
+#define PLAYER_PROBE_SIZE (32 * 1024)
+#define PLAYER_ANALYZE_DURATION (AV_TIME_BASE / 2)
+
+// Returns nullptr on failure. Starts paused.
+MediaPlayer *player_open(const char *path, const MediaPlayerOptions &opts);
+void player_close(MediaPlayer *player);
+void player_play(MediaPlayer *player, bool play);
+void player_seek(MediaPlayer *player, double seconds);
+bool player_is_playing(MediaPlayer *player);
+// Presents due video frames; audio-only instances play without it.
+void player_update(MediaPlayer *player);
+std::vector<AudioTrackInfo> player_get_audio_tracks(MediaPlayer *player);
+bool player_switch_audio_track(MediaPlayer *player, int new_stream_index);
+int player_get_current_audio_track(MediaPlayer *player);
+double player_get_current_time(MediaPlayer *player);
+double player_get_total_time(MediaPlayer *player);
+bool player_is_audio_only(MediaPlayer *player);
+bool player_get_cover_art(MediaPlayer *player, const uint8_t **data, size_t *size);
+std::vector<SubtitleTrackInfo> player_get_subtitle_tracks(MediaPlayer *player);
+// track indexes player_get_subtitle_tracks(); -1 turns subtitles off.
+bool player_select_subtitle(MediaPlayer *player, int track);
+int player_get_current_subtitle(MediaPlayer *player);
+// Cues on screen at the playback position; *cues stays valid until the next
+// call. Returns true when they differ from what the last call returned.
+bool player_get_subtitles(MediaPlayer *player, const std::vector<SubtitleCue> **cues);
+// The bitmap subtitle on screen at the video clock, nullptr when none, and
+// where the video is drawn. Same lifetime and return value as above.
+bool player_get_subtitle_bitmap(MediaPlayer *player, const SubtitleBitmap **bmp, rect *video);
+
+// Shaders, network start-up and the textures of the last closed instance are
+// kept between opens; this frees them at exit.
+void player_context_shutdown();
+
+// The main player, driven by the playback scene and reflected in media_info.
 int media_player_init(const char *path);
 void media_player_cleanup();
 void media_player_play(bool play);
@@ -28,5 +95,13 @@ bool media_player_switch_audio_track(int new_stream_index);
 int media_player_get_current_audio_track();
 double media_player_get_current_time();
 double media_player_get_total_time();
+bool media_player_is_audio_only();
+bool media_player_get_cover_art(const uint8_t **data, size_t *size);
+std::vector<SubtitleTrackInfo> media_player_get_subtitle_tracks();
+bool media_player_select_subtitle(int track);
+int media_player_get_current_subtitle();
+bool media_player_get_subtitles(const std::vector<SubtitleCue> **cues);
+bool media_player_get_subtitle_bitmap(const SubtitleBitmap **bmp, rect *video);
+DecodeCaps media_player_get_decode_caps();
 
 #endif
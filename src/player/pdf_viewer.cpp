@@ -5,6 +5,7 @@ extern "C" {
 #include "logger/logger.hpp"
 #include "main.hpp"
 #include "player/pdf_viewer.hpp"
+#include "player/preopen.hpp"
 #include "utils/display.hpp"
 
 #include <backends/imgui_impl_gx2.h>
@@ -136,8 +137,22 @@ void pdf_viewer_open_file(const char *filepath) {
         fz_drop_document(g_pdf_viewer.ctx, g_pdf_viewer.doc);
         g_pdf_viewer.doc = nullptr;
     }
+    // The browser may have opened the book and drawn its first page already;
+    // its context comes along when the viewer has none of its own yet.
+    PreopenDocument pre;
+    if (!g_pdf_viewer.ctx && preopen_take_document(filepath, &pre)) {
+        g_pdf_viewer.ctx = pre.ctx;
+        g_pdf_viewer.doc = pre.doc;
+        g_pdf_viewer.current_page = 0;
+        g_pdf_viewer.zoom = pre.zoom;
+        g_pdf_viewer.image = create_texture_rgba(pre.rgba.data(), pre.w, pre.h);
+        g_pdf_viewer.texture_dirty = false;
+        g_pdf_viewer.pan_x = (display_get().width - g_pdf_viewer.image.width) / 2;
+        g_pdf_viewer.pan_y = (display_get().height - g_pdf_viewer.image.height) / 2;
+        return;
+    }
     if (!g_pdf_viewer.ctx) {
-        g_pdf_viewer.ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+        g_pdf_viewer.ctx = fz_new_context(nullptr, nullptr, PDF_STORE_BUDGET);
         fz_register_document_handlers(g_pdf_viewer.ctx);
     }
 
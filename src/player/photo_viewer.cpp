@@ -12,6 +12,7 @@
 #define STBI_NO_THREAD_LOCALS
 #define STB_IMAGE_IMPLEMENTATION
 #include "player/photo_viewer.hpp"
+#include "player/preopen.hpp"
 #include "utils/display.hpp"
 
 #include <stb_image.h>
@@ -227,12 +228,17 @@ void photo_viewer_open_picture(const char *filepath) {
     }
 
     int w, h, comp;
-    uint8_t *pixels = stbi_load(filepath, &w, &h, &comp, 4);
+    std::vector<uint8_t> preopened;
+    if (preopen_take_picture(filepath, &preopened, &w, &h)) {
+        static_image = create_texture_rgba(preopened.data(), w, h, false);
+    } else {
+        uint8_t *pixels = stbi_load(filepath, &w, &h, &comp, 4);
 
-    if (!pixels) return;
+        if (!pixels) return;
 
-    static_image = create_texture_rgba(pixels, w, h, false);
-    stbi_image_free(pixels);
+        static_image = create_texture_rgba(pixels, w, h, false);
+        stbi_image_free(pixels);
+    }
 
     rect r = display_calculate_aspect_fit(w, h);
     dst = r;
@@ -240,6 +246,65 @@ void photo_viewer_open_picture(const char *filepath) {
     dst_set = true;
 }
 
+// Integer box filter; cover art only ever needs to shrink to fit the screen.
+static std::vector<uint8_t> downscale_rgba(const uint8_t *src, int w, int h, int factor, int *out_w, int *out_h) {
+    int dw = w / factor, dh = h / factor;
+    std::vector<uint8_t> out((size_t)dw * dh * 4);
+    const uint32_t area = (uint32_t)(factor * factor);
+
+    for (int y = 0; y < dh; ++y) {
+        for (int x = 0; x < dw; ++x) {
+            uint32_t acc[4] = {0, 0, 0, 0};
+            for (int sy = 0; sy < factor; ++sy) {
+                const uint8_t *row = src + ((size_t)(y * factor + sy) * w + (size_t)x * factor) * 4;
+                for (int sx = 0; sx < factor * 4; sx += 4) {
+                    acc[0] += row[sx + 0];
+                    acc[1] += row[sx + 1];
+                    acc[2] += row[sx + 2];
+                    acc[3] += row[sx + 3];
+                }
+            }
+            uint8_t *d = &out[((size_t)y * dw + x) * 4];
+            for (int c = 0; c < 4; ++c)
+                d[c] = (uint8_t)(acc[c] / area);
+        }
+    }
+
+    *out_w = dw;
+    *out_h = dh;
+    return out;
+}
+
+void photo_viewer_open_picture_memory(const uint8_t *data, size_t size, int max_dim) {
+    photo_viewer_cleanup();
+
+    int w, h, comp;
+    uint8_t *pixels = stbi_load_from_memory(data, (int)size, &w, &h, &comp, 4);
+    if (!pixels) {
+        log_message(LOG_WARNING, "Photo Viewer", "Failed to decode %u byte image", (unsigned)size);
+        return;
+    }
+
+    int factor = 1;
+    while (max_dim > 0 && (w / factor > max_dim || h / factor > max_dim))
+        factor++;
+
+    if (factor > 1) {
+        int dw, dh;
+        std::vector<uint8_t> small = downscale_rgba(pixels, w, h, factor, &dw, &dh);
+        static_image = create_texture_rgba(small.data(), dw, dh, false);
+        log_message(LOG_OK, "Photo Viewer", "Image %dx%d downscaled to %dx%d", w, h, dw, dh);
+    } else {
+        static_image = create_texture_rgba(pixels, w, h, false);
+    }
+    stbi_image_free(pixels);
+
+    rect r = display_calculate_aspect_fit(static_image.width, static_image.height);
+    dst = r;
+    scale = dst.w / static_image.width;
+    dst_set = true;
+}
+
 void photo_texture_zoom(float delta_zoom) {
     scale = std::clamp(scale + delta_zoom, MIN_ZOOM_SCALE, MAX_ZOOM_SCALE);
 
@@ -1,8 +1,12 @@
 #ifndef PHOTO_VIEWER_HPP
 #define PHOTO_VIEWER_HPP
 
+#include <cstddef>
+#include <cstdint>
+
 void photo_viewer_init();
 void photo_viewer_open_picture(const char *filepath);
+void photo_viewer_open_picture_memory(const uint8_t *data, size_t size, int max_dim);
 void photo_texture_zoom(float delta_zoom);
 void photo_viewer_pan(int delta_x, int delta_y);
 void photo_viewer_render();
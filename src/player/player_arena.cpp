@@ -0,0 +1,215 @@
+#include "player/player_arena.hpp"
+
+#include "logger/logger.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <mutex>
+
+#define PA "PlayerArena"
+
+#define ARENA_ALIGN 32
+#define ARENA_MIN_SPLIT 256
+
+#define ARENA_ALIGN_UP(x) (((x) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+// Boundary-tagged block; free blocks are additionally linked into a list.
+// prev_size lets a freed block merge with its lower neighbour in O(1).
+struct ArenaBlock {
+    uint32_t size; // including header
+    uint32_t prev_size;
+    uint32_t free;
+    uint32_t budget;
+    ArenaBlock *next_free;
+    ArenaBlock *prev_free;
+};
+
+#define ARENA_HDR ARENA_ALIGN_UP(sizeof(ArenaBlock))
+
+static struct {
+    uint8_t *base = nullptr;
+    size_t capacity = 0;
+    ArenaBlock *free_list = nullptr;
+    std::mutex mtx;
+
+    size_t used = 0;
+    size_t high_water = 0;
+    size_t budget[ARENA_BUDGET_COUNT] = {};
+    size_t budget_used[ARENA_BUDGET_COUNT] = {};
+    size_t budget_high_water[ARENA_BUDGET_COUNT] = {};
+    uint32_t failed[ARENA_BUDGET_COUNT] = {};
+} g_arena;
+
+static const char *budget_names[ARENA_BUDGET_COUNT] = {"video frames", "packets"};
+
+static inline ArenaBlock *block_next(ArenaBlock *b) {
+    uint8_t *p = (uint8_t *)b + b->size;
+    return p < g_arena.base + g_arena.capacity ? (ArenaBlock *)p : nullptr;
+}
+
+static inline ArenaBlock *block_prev(ArenaBlock *b) { return b->prev_size ? (ArenaBlock *)((uint8_t *)b - b->prev_size) : nullptr; }
+
+static void free_list_push(ArenaBlock *b) {
+    b->free = 1;
+    b->prev_free = nullptr;
+    b->next_free = g_arena.free_list;
+    if (g_arena.free_list) g_arena.free_list->prev_free = b;
+    g_arena.free_list = b;
+}
+
+static void free_list_remove(ArenaBlock *b) {
+    if (b->prev_free)
+        b->prev_free->next_free = b->next_free;
+    else
+        g_arena.free_list = b->next_free;
+    if (b->next_free) b->next_free->prev_free = b->prev_free;
+    b->free = 0;
+    b->next_free = b->prev_free = nullptr;
+}
+
+bool player_arena_init(size_t size) {
+    if (g_arena.base) return true;
+
+    size = ARENA_ALIGN_UP(size);
+    uint8_t *base = (uint8_t *)memalign(ARENA_ALIGN, size);
+    if (!base) {
+        log_message(LOG_WARNING, PA, "Could not reserve %u KiB, player uses the heap", (unsigned)(size >> 10));
+        return false;
+    }
+
+    g_arena.base = base;
+    g_arena.capacity = size;
+
+    ArenaBlock *b = (ArenaBlock *)base;
+    b->size = (uint32_t)size;
+    b->prev_size = 0;
+    b->budget = 0;
+    free_list_push(b);
+
+    for (int i = 0; i < ARENA_BUDGET_COUNT; ++i) g_arena.budget[i] = size;
+
+    log_message(LOG_OK, PA, "Reserved %u KiB", (unsigned)(size >> 10));
+    return true;
+}
+
+void player_arena_shutdown() {
+    std::lock_guard<std::mutex> lk(g_arena.mtx);
+    if (!g_arena.base) return;
+    if (g_arena.used) log_message(LOG_WARNING, PA, "Shutdown with %u bytes still allocated", (unsigned)g_arena.used);
+
+    free(g_arena.base);
+    g_arena.base = nullptr;
+    g_arena.capacity = 0;
+    g_arena.free_list = nullptr;
+}
+
+bool player_arena_ready() { return g_arena.base != nullptr; }
+
+void player_arena_set_budget(ArenaBudget budget, size_t bytes) {
+    std::lock_guard<std::mutex> lk(g_arena.mtx);
+    g_arena.budget[budget] = bytes;
+}
+
+void *player_arena_alloc(ArenaBudget budget, size_t size) {
+    if (!g_arena.base || size == 0) return nullptr;
+
+    size_t need = ARENA_HDR + ARENA_ALIGN_UP(size);
+    std::lock_guard<std::mutex> lk(g_arena.mtx);
+
+    if (g_arena.budget_used[budget] + need > g_arena.budget[budget]) {
+        g_arena.failed[budget]++;
+        return nullptr;
+    }
+
+    ArenaBlock *b = g_arena.free_list;
+    while (b && b->size < need) b = b->next_free;
+    if (!b) {
+        g_arena.failed[budget]++;
+        return nullptr;
+    }
+
+    free_list_remove(b);
+
+    if (b->size - need >= ARENA_HDR + ARENA_MIN_SPLIT) {
+        ArenaBlock *rest = (ArenaBlock *)((uint8_t *)b + need);
+        rest->size = b->size - (uint32_t)need;
+        rest->prev_size = (uint32_t)need;
+        rest->budget = 0;
+        b->size = (uint32_t)need;
+
+        ArenaBlock *after = block_next(rest);
+        if (after) after->prev_size = rest->size;
+        free_list_push(rest);
+    }
+
+    b->budget = budget;
+    g_arena.used += b->size;
+    g_arena.budget_used[budget] += b->size;
+    if (g_arena.used > g_arena.high_water) g_arena.high_water = g_arena.used;
+    if (g_arena.budget_used[budget] > g_arena.budget_high_water[budget]) g_arena.budget_high_water[budget] = g_arena.budget_used[budget];
+
+    return (uint8_t *)b + ARENA_HDR;
+}
+
+void player_arena_free(void *ptr) {
+    if (!ptr) return;
+
+    std::lock_guard<std::mutex> lk(g_arena.mtx);
+    ArenaBlock *b = (ArenaBlock *)((uint8_t *)ptr - ARENA_HDR);
+
+    g_arena.used -= b->size;
+    g_arena.budget_used[b->budget] -= b->size;
+
+    ArenaBlock *next = block_next(b);
+    if (next && next->free) {
+        free_list_remove(next);
+        b->size += next->size;
+    }
+
+    ArenaBlock *prev = block_prev(b);
+    if (prev && prev->free) {
+        free_list_remove(prev);
+        prev->size += b->size;
+        b = prev;
+    }
+
+    next = block_next(b);
+    if (next) next->prev_size = b->size;
+    free_list_push(b);
+}
+
+void player_arena_get_stats(ArenaStats *stats) {
+    std::lock_guard<std::mutex> lk(g_arena.mtx);
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = g_arena.capacity;
+    stats->used = g_arena.used;
+    stats->high_water = g_arena.high_water;
+    for (ArenaBlock *b = g_arena.free_list; b; b = b->next_free)
+        if (b->size > stats->largest_free) stats->largest_free = b->size;
+    for (int i = 0; i < ARENA_BUDGET_COUNT; ++i) {
+        stats->budget[i] = g_arena.budget[i];
+        stats->budget_used[i] = g_arena.budget_used[i];
+        stats->budget_high_water[i] = g_arena.budget_high_water[i];
+        stats->failed[i] = g_arena.failed[i];
+    }
+}
+
+void player_arena_reset_high_water() {
+    std::lock_guard<std::mutex> lk(g_arena.mtx);
+    g_arena.high_water = g_arena.used;
+    for (int i = 0; i < ARENA_BUDGET_COUNT; ++i) {
+        g_arena.budget_high_water[i] = g_arena.budget_used[i];
+        g_arena.failed[i] = 0;
+    }
+}
+
+void player_arena_log_stats() {
+    if (!g_arena.base) return;
+
+    ArenaStats st;
+    player_arena_get_stats(&st);
+    log_message(LOG_DEBUG, PA, "used %u KiB, peak %u / %u KiB, largest free %u KiB", (unsigned)(st.used >> 10), (unsigned)(st.high_water >> 10), (unsigned)(st.capacity >> 10), (unsigned)(st.largest_free >> 10));
+    for (int i = 0; i < ARENA_BUDGET_COUNT; ++i)
+        log_message(LOG_DEBUG, PA, "  %-12s used %u KiB, peak %u / %u KiB, %u over budget", budget_names[i], (unsigned)(st.budget_used[i] >> 10), (unsigned)(st.budget_high_water[i] >> 10), (unsigned)(st.budget[i] >> 10), st.failed[i]);
+}
@@ -0,0 +1,41 @@
+#ifndef PLAYER_ARENA_HPP
+#define PLAYER_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Player-owned memory carved out of MEM2 once at start-up, so decoded frames
+// and queued packets never compete with the viewers for the general heap.
+enum ArenaBudget {
+    ARENA_VIDEO_FRAMES,
+    ARENA_PACKETS,
+    ARENA_BUDGET_COUNT
+};
+
+struct ArenaStats {
+    size_t capacity;
+    size_t used;
+    size_t high_water;
+    size_t largest_free;
+    size_t budget[ARENA_BUDGET_COUNT];
+    size_t budget_used[ARENA_BUDGET_COUNT];
+    size_t budget_high_water[ARENA_BUDGET_COUNT];
+    uint32_t failed[ARENA_BUDGET_COUNT];
+};
+
+bool player_arena_init(size_t size);
+void player_arena_shutdown();
+bool player_arena_ready();
+
+void player_arena_set_budget(ArenaBudget budget, size_t bytes);
+
+// Returns nullptr when the budget or the arena is exhausted; callers fall back
+// to the regular heap.
+void *player_arena_alloc(ArenaBudget budget, size_t size);
+void player_arena_free(void *ptr);
+
+void player_arena_get_stats(ArenaStats *stats);
+void player_arena_reset_high_water();
+void player_arena_log_stats();
+
+#endif
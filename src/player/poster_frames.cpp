@@ -0,0 +1,161 @@
+#include "player/poster_frames.hpp"
+
+#include "logger/logger.hpp"
+#include "main.hpp"
+#include "player/faststart.hpp"
+#include "player/frame_thumb.hpp"
+#include "player/poster_store.hpp"
+#include "player/stream_cache.hpp"
+#include "utils/byte_stream.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coreinit/thread.h>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+
+#define PF "Posters"
+
+#define POSTER_DIR CACHE_PATH "posters/"
+
+static std::mutex mtx;
+static std::condition_variable cv;
+static std::thread worker;
+static bool quit = false;
+static std::vector<std::string> wanted;
+static std::string current; // the path the worker is on
+static std::deque<PosterFrame> results;
+static std::atomic<uint32_t> generation{0}; // bumped when current stops being wanted
+
+static int interrupt_cb(void *opaque) { return generation.load(std::memory_order_relaxed) != (uint32_t)(uintptr_t)opaque; }
+
+static void store_save(const StreamCacheKey &key, const PosterFrame &p) {
+    mkdir(CACHE_PATH, 0777);
+    mkdir(POSTER_DIR, 0777);
+    std::string file = poster_store_file_for_key(POSTER_DIR, key);
+    if (!byte_stream_write_file(file.c_str(), poster_serialize(key, p))) log_message(LOG_WARNING, PF, "Failed to write %s", file.c_str());
+}
+
+// An entry prepared on a PC is taken on path and size, then stored again
+// under the real mtime.
+static bool store_load(const StreamCacheKey &key, PosterFrame *out) {
+    std::string file = poster_store_file_for_key(POSTER_DIR, key);
+    std::vector<uint8_t> data;
+    if (!byte_stream_read_file(file.c_str(), data, POSTER_MAX_FILE)) return false;
+
+    StreamCacheKey stored;
+    if (!poster_deserialize(data.data(), data.size(), &stored, out)) {
+        log_message(LOG_WARNING, PF, "Discarding corrupt entry %s", file.c_str());
+        remove(file.c_str());
+        return false;
+    }
+    bool prepared = stored.mtime == STREAM_CACHE_MTIME_ANY;
+    if (stored.path != key.path || stored.size != key.size || (!prepared && stored.mtime != key.mtime)) {
+        out->w = out->h = 0;
+        out->rgba.clear();
+        return false;
+    }
+    if (prepared) store_save(key, *out);
+    return true;
+}
+
+static void extract(const std::string &path, uint32_t gen, PosterFrame *out) {
+    AVFormatContext *fmt = avformat_alloc_context();
+    AVCodecContext *avctx = nullptr;
+    int vidx = -1;
+
+    if (!fmt) return;
+    fmt->interrupt_callback.callback = interrupt_cb;
+    fmt->interrupt_callback.opaque = (void *)(uintptr_t)gen;
+    fmt->probesize = POSTER_PROBE_SIZE;
+    fmt->max_analyze_duration = AV_TIME_BASE;
+    if (avformat_open_input(&fmt, ("file:" + path).c_str(), nullptr, nullptr) < 0) return; // frees fmt
+    if (avformat_find_stream_info(fmt, nullptr) >= 0) avctx = frame_thumb_open_decoder(fmt, POSTER_MAX_W, POSTER_MAX_H, &vidx);
+    if (avctx) poster_pick_frame(fmt, avctx, vidx, interrupt_cb, (void *)(uintptr_t)gen, out);
+    avcodec_free_context(&avctx);
+    avformat_close_input(&fmt);
+}
+
+static void worker_thread() {
+    OSSetThreadPriority(OSGetCurrentThread(), POSTER_THREAD_PRIORITY);
+    for (;;) {
+        PosterFrame poster;
+        uint32_t gen;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [] { return quit || !wanted.empty(); });
+            if (quit) return;
+            current = wanted.front();
+            wanted.erase(wanted.begin());
+            poster.path = current;
+            gen = generation.load();
+        }
+
+        StreamCacheKey key;
+        bool known = stream_cache_make_key(poster.path.c_str(), &key);
+        if (known && !store_load(key, &poster)) {
+            faststart_hold(poster.path);
+            extract(poster.path, gen, &poster);
+            faststart_release(poster.path);
+            if (generation.load() == gen) {
+                store_save(key, poster);
+                log_message(LOG_DEBUG, PF, "%s: %s", poster.path.c_str(), poster.w ? "poster stored" : "no usable frame");
+            }
+        }
+
+        std::lock_guard<std::mutex> lk(mtx);
+        current.clear();
+        if (generation.load() == gen) results.push_back(std::move(poster));
+    }
+}
+
+void poster_frames_want(const std::vector<std::string> &paths) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        wanted.clear();
+        bool current_wanted = false;
+        for (const std::string &p : paths) {
+            if (p == current) {
+                current_wanted = true;
+                continue;
+            }
+            if (std::any_of(results.begin(), results.end(), [&](const PosterFrame &r) { return r.path == p; })) continue;
+            wanted.push_back(p);
+        }
+        if (!current.empty() && !current_wanted) generation++;
+        if (!wanted.empty() && !worker.joinable()) {
+            quit = false;
+            worker = std::thread(worker_thread);
+        }
+    }
+    cv.notify_all();
+}
+
+bool poster_frames_take(PosterFrame *out) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (results.empty()) return false;
+    *out = std::move(results.front());
+    results.pop_front();
+    return true;
+}
+
+void poster_frames_shutdown() {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = true;
+        generation++;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+    wanted.clear();
+    results.clear();
+}
@@ -0,0 +1,43 @@
+#ifndef POSTER_FRAMES_HPP
+#define POSTER_FRAMES_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Poster frames for the file browser's video rows, made on a low-priority
+// worker and kept on the card so a video is decoded for this at most once per
+// version of the file. The worker skips the intro, decodes a handful of
+// keyframes spread over the rest through frame_thumb, drops black and flat
+// ones and keeps the one with the most contrast. Store entries are keyed by
+// path, size and mtime like the stream-info cache; a file without a usable
+// frame gets an empty entry so it is not tried again.
+#define POSTER_MAX_W 160
+#define POSTER_MAX_H 90
+#define POSTER_SKIP_FRACTION 0.1 // of the duration, at most POSTER_SKIP_MAX_SECONDS
+#define POSTER_SKIP_MAX_SECONDS 300.0
+#define POSTER_END_FRACTION 0.8  // candidates come from before this point
+#define POSTER_CANDIDATES 6
+#define POSTER_BLACK_MEAN 40     // mean luma below this is a black frame
+#define POSTER_FLAT_STDDEV 12    // luma deviation below this is a title card or fade
+#define POSTER_GOOD_STDDEV 60    // good enough to stop looking
+#define POSTER_PROBE_SIZE (256 * 1024)
+#define POSTER_THREAD_PRIORITY 30
+
+struct PosterFrame {
+    std::string path;
+    int w = 0; // 0 when the file has no usable frame
+    int h = 0;
+    std::vector<uint32_t> rgba; // ImGui's RGBA32 layout
+};
+
+// The rows on screen still without a poster. Replaces the previous list:
+// paths that left it are not worked on, and one being decoded is abandoned.
+void poster_frames_want(const std::vector<std::string> &paths);
+
+// Pops one finished poster; false when none is waiting.
+bool poster_frames_take(PosterFrame *out);
+
+void poster_frames_shutdown();
+
+#endif
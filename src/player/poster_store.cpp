@@ -0,0 +1,125 @@
+#include "player/poster_store.hpp"
+
+#include "player/frame_thumb.hpp"
+#include "utils/byte_stream.hpp"
+#include "utils/hash.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <cstdio>
+
+#define POSTER_MAGIC 0x31545350u // "PST1"
+#define POSTER_VERSION 1u
+#define POSTER_MAX_PACKETS 4096 // read while looking for one decodable keyframe
+
+static bool is_cancelled(PosterCancelFn cancelled, void *opaque) { return cancelled && cancelled(opaque); }
+
+std::string poster_store_file_for_key(const char *dir, const StreamCacheKey &key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.pst", (unsigned long long)hash_fnv1a64(key.path.data(), key.path.size()));
+    return std::string(dir) + name;
+}
+
+// Pixels are kept as RGB bytes, so the file reads the same on any CPU.
+std::vector<uint8_t> poster_serialize(const StreamCacheKey &key, const PosterFrame &p) {
+    std::vector<uint8_t> rgb(p.rgba.size() * 3);
+    for (size_t i = 0; i < p.rgba.size(); ++i) {
+        rgb[i * 3] = (uint8_t)p.rgba[i];
+        rgb[i * 3 + 1] = (uint8_t)(p.rgba[i] >> 8);
+        rgb[i * 3 + 2] = (uint8_t)(p.rgba[i] >> 16);
+    }
+    ByteWriter w;
+    w.u32(POSTER_MAGIC);
+    w.u32(POSTER_VERSION);
+    w.str(key.path);
+    w.i64(key.size);
+    w.i64(key.mtime);
+    w.i32(p.w);
+    w.i32(p.h);
+    w.bytes(rgb.data(), rgb.size());
+    return w.buf;
+}
+
+bool poster_deserialize(const uint8_t *data, size_t len, StreamCacheKey *key, PosterFrame *out) {
+    ByteReader r(data, len);
+    std::vector<uint8_t> rgb;
+    if (r.u32() != POSTER_MAGIC || r.u32() != POSTER_VERSION) return false;
+    r.str(key->path, 4096);
+    key->size = r.i64();
+    key->mtime = r.i64();
+    int w = r.i32(), h = r.i32();
+    r.bytes(rgb, (size_t)POSTER_MAX_W * POSTER_MAX_H * 3);
+    if (!r.ok || w < 0 || h < 0 || rgb.size() != (size_t)w * h * 3) return false;
+
+    out->w = w;
+    out->h = h;
+    out->rgba.resize((size_t)w * h);
+    for (size_t i = 0; i < out->rgba.size(); ++i)
+        out->rgba[i] = 0xff000000u | ((uint32_t)rgb[i * 3 + 2] << 16) | ((uint32_t)rgb[i * 3 + 1] << 8) | rgb[i * 3];
+    return true;
+}
+
+// The first keyframe from the current position. The decoder is drained
+// right after it, so one with reordering delay hands it out at once.
+static bool decode_keyframe(AVFormatContext *fmt, AVCodecContext *avctx, int vidx, AVPacket *pkt, AVFrame *frame, PosterCancelFn cancelled, void *opaque) {
+    avcodec_flush_buffers(avctx);
+    for (int n = 0; n < POSTER_MAX_PACKETS && !is_cancelled(cancelled, opaque); ++n) {
+        if (av_read_frame(fmt, pkt) < 0) return false;
+        bool key = pkt->stream_index == vidx && (pkt->flags & AV_PKT_FLAG_KEY);
+        int ret = key ? avcodec_send_packet(avctx, pkt) : -1;
+        av_packet_unref(pkt);
+        if (ret < 0) continue;
+        avcodec_send_packet(avctx, nullptr);
+        if (avcodec_receive_frame(avctx, frame) >= 0) return true;
+        avcodec_flush_buffers(avctx);
+    }
+    return false;
+}
+
+// Candidates are spread from past the intro to POSTER_END_FRACTION. A frame
+// that is neither black nor flat beats any that is, then contrast decides.
+void poster_pick_frame(AVFormatContext *fmt, AVCodecContext *avctx, int vidx, PosterCancelFn cancelled, void *opaque, PosterFrame *out) {
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    std::vector<uint32_t> rgba;
+    double dur = fmt->duration > 0 ? fmt->duration / (double)AV_TIME_BASE : 0.0;
+    double base = fmt->start_time != AV_NOPTS_VALUE ? fmt->start_time / (double)AV_TIME_BASE : 0.0;
+    double skip = std::min(dur * POSTER_SKIP_FRACTION, POSTER_SKIP_MAX_SECONDS);
+    int candidates = dur > 0.0 ? POSTER_CANDIDATES : 1;
+    int best = -1, best_mean = 0;
+
+    for (int c = 0; pkt && frame && c < candidates && !is_cancelled(cancelled, opaque); ++c) {
+        if (dur > 0.0) {
+            double t = base + skip + (dur * POSTER_END_FRACTION - skip) * c / candidates;
+            if (av_seek_frame(fmt, -1, (int64_t)(t * AV_TIME_BASE), AVSEEK_FLAG_BACKWARD) < 0) break;
+        }
+        if (!decode_keyframe(fmt, avctx, vidx, pkt, frame, cancelled, opaque)) continue;
+
+        int w, h;
+        ThumbStats st;
+        bool ok = frame_thumb_convert(frame, POSTER_MAX_W, POSTER_MAX_H, &rgba, &w, &h, &st);
+        av_frame_unref(frame);
+        if (!ok) break;
+
+        int score = st.stddev + (st.mean >= POSTER_BLACK_MEAN ? 256 : 0) + (st.stddev >= POSTER_FLAT_STDDEV ? 256 : 0);
+        if (score > best) {
+            best = score;
+            best_mean = st.mean;
+            out->rgba.swap(rgba);
+            out->w = w;
+            out->h = h;
+        }
+        if (st.mean >= POSTER_BLACK_MEAN && st.stddev >= POSTER_GOOD_STDDEV) break;
+    }
+    // An all-black video gets no poster rather than a black one.
+    if (best >= 0 && best_mean < POSTER_BLACK_MEAN) {
+        out->w = out->h = 0;
+        out->rgba.clear();
+    }
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+}
@@ -0,0 +1,36 @@
+#ifndef POSTER_STORE_HPP
+#define POSTER_STORE_HPP
+
+// The on-card format of poster frames and the frame choice behind them. No
+// console headers, so tools/cafemp-prep writes the same entries the browser's
+// worker does. Entries prepared on a PC carry STREAM_CACHE_MTIME_ANY and match
+// on path and size until the console stores the real mtime.
+
+#include "player/poster_frames.hpp"
+#include "player/stream_cache.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define POSTER_MAX_FILE (64 * 1024)
+
+struct AVCodecContext;
+struct AVFormatContext;
+
+// Polled between packets; nonzero abandons the pick. Shaped like
+// AVIOInterruptCB so one callback serves both.
+typedef int (*PosterCancelFn)(void *opaque);
+
+std::string poster_store_file_for_key(const char *dir, const StreamCacheKey &key);
+
+std::vector<uint8_t> poster_serialize(const StreamCacheKey &key, const PosterFrame &p);
+// key receives what the entry was stored under. false when it is corrupt.
+bool poster_deserialize(const uint8_t *data, size_t len, StreamCacheKey *key, PosterFrame *out);
+
+// Decodes candidates from an opened input through its frame_thumb decoder.
+// out keeps w = 0 when no frame is usable. cancelled may be nullptr.
+void poster_pick_frame(AVFormatContext *fmt, AVCodecContext *avctx, int vidx, PosterCancelFn cancelled, void *opaque, PosterFrame *out);
+
+#endif
@@ -0,0 +1,383 @@
+#include "player/preopen.hpp"
+
+#include "logger/logger.hpp"
+#include "main.hpp"
+#include "player/faststart.hpp"
+#include "player/media_player.hpp"
+#include "player/stream_cache.hpp"
+#include "utils/display.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <mupdf/fitz.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <coreinit/thread.h>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stb_image.h>
+#include <strings.h>
+#include <thread>
+
+#define PO "Preopen"
+
+struct Slot {
+    std::string path;
+    char type = 0;
+    AVFormatContext *fmt = nullptr;
+    std::vector<uint8_t> rgba; // picture, R G B A bytes
+    int w = 0;
+    int h = 0;
+    PreopenDocument doc;
+};
+
+static std::mutex mtx;
+static std::condition_variable cv;
+static std::thread worker;
+static bool quit = false;
+static std::string wanted;
+static char wanted_type = 0;
+static std::string current; // the path the worker is on
+static std::deque<Slot> slots;
+static std::atomic<uint32_t> generation{0}; // bumped when current stops being wanted
+static fz_cookie *doc_cookie = nullptr;     // the render in flight, guarded by mtx
+
+static int interrupt_cb(void *opaque) { return generation.load(std::memory_order_relaxed) != (uint32_t)(uintptr_t)opaque; }
+
+// A slot holds its path against the remuxer from the start of its job until
+// it is freed or taken.
+static void free_slot(Slot &s) {
+    if (s.fmt) avformat_close_input(&s.fmt);
+    if (s.doc.ctx) {
+        if (s.doc.doc) fz_drop_document(s.doc.ctx, s.doc.doc);
+        fz_drop_context(s.doc.ctx);
+    }
+    if (!s.path.empty()) faststart_release(s.path);
+    s = Slot{};
+}
+
+// What open_instance does for a local file, up to the first packet read.
+static bool open_media(const std::string &path, uint32_t gen, Slot *out) {
+    StreamCacheKey cache_key;
+    StreamCacheEntry cache_entry;
+    bool have_cache_key = stream_cache_make_key(path.c_str(), &cache_key);
+    bool cache_hit = have_cache_key && stream_cache_load(cache_key, &cache_entry);
+
+    AVFormatContext *fmt = avformat_alloc_context();
+    if (!fmt) return false;
+    fmt->interrupt_callback.callback = interrupt_cb;
+    fmt->interrupt_callback.opaque = (void *)(uintptr_t)gen;
+
+    auto iformat = cache_hit ? av_find_input_format(cache_entry.format_name.substr(0, cache_entry.format_name.find(',')).c_str()) : nullptr;
+    if (avformat_open_input(&fmt, ("file:" + path).c_str(), iformat, nullptr) < 0) return false; // frees fmt
+    fmt->flags |= AVFMT_FLAG_NOBUFFER;
+    fmt->probesize = PLAYER_PROBE_SIZE;
+    fmt->max_analyze_duration = PLAYER_ANALYZE_DURATION;
+
+    if (!(cache_hit && stream_cache_apply(fmt, cache_entry))) {
+        if (avformat_find_stream_info(fmt, nullptr) < 0 || generation.load() != gen) {
+            // An interrupted probe says nothing about the cache entry.
+            if (cache_hit && generation.load() == gen) stream_cache_invalidate(cache_key);
+            avformat_close_input(&fmt);
+            return false;
+        }
+        if (have_cache_key) {
+            StreamCacheEntry fresh;
+            stream_cache_capture(fmt, cache_key, &fresh);
+            stream_cache_save(fresh);
+        }
+    }
+    // The player never sets one; ours would outlive the job. The file
+    // protocol's copy stays until preopen_take_media replaces the pb.
+    fmt->interrupt_callback.callback = nullptr;
+    fmt->interrupt_callback.opaque = nullptr;
+    out->fmt = fmt;
+    return true;
+}
+
+struct PictureReader {
+    FILE *f;
+    uint32_t gen;
+};
+
+// Reads end early once the job is cancelled, so stb_image gives up.
+static int picture_read(void *user, char *data, int size) {
+    PictureReader *r = (PictureReader *)user;
+    if (generation.load(std::memory_order_relaxed) != r->gen) return 0;
+    return (int)fread(data, 1, size, r->f);
+}
+static void picture_skip(void *user, int n) { fseek(((PictureReader *)user)->f, n, SEEK_CUR); }
+static int picture_eof(void *user) {
+    PictureReader *r = (PictureReader *)user;
+    return generation.load(std::memory_order_relaxed) != r->gen || feof(r->f);
+}
+
+static bool decode_picture(const std::string &path, uint32_t gen, Slot *out) {
+    // GIFs go through giflib frame by frame in the viewer.
+    const char *ext = strrchr(path.c_str(), '.');
+    if (ext && strcasecmp(ext, ".gif") == 0) return false;
+
+    PictureReader reader{fopen(path.c_str(), "rb"), gen};
+    if (!reader.f) return false;
+    stbi_io_callbacks io{picture_read, picture_skip, picture_eof};
+    int comp;
+    uint8_t *pixels = stbi_load_from_callbacks(&io, &reader, &out->w, &out->h, &comp, 4);
+    fclose(reader.f);
+    if (!pixels) return false;
+    if (generation.load() == gen) out->rgba.assign(pixels, pixels + (size_t)out->w * out->h * 4);
+    stbi_image_free(pixels);
+    return !out->rgba.empty();
+}
+
+// Opens the book in a context of its own and renders page 0 the way
+// pdf_viewer_fit_to_screen would.
+static bool open_document(const std::string &path, uint32_t gen, Slot *out) {
+    fz_context *ctx = fz_new_context(nullptr, nullptr, PDF_STORE_BUDGET);
+    if (!ctx) return false;
+    fz_register_document_handlers(ctx);
+
+    fz_cookie cookie{};
+    fz_document *doc = nullptr;
+    fz_page *page = nullptr;
+    fz_pixmap *pix = nullptr;
+    fz_device *dev = nullptr;
+    bool ok = false;
+
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (generation.load() != gen) cookie.abort = 1;
+        doc_cookie = &cookie;
+    }
+
+    fz_var(doc);
+    fz_var(page);
+    fz_var(pix);
+    fz_var(dev);
+    fz_try(ctx) {
+        doc = fz_open_document(ctx, path.c_str());
+        page = fz_load_page(ctx, doc, 0);
+        fz_rect bounds = fz_bound_page(ctx, page);
+        int page_width = (int)(bounds.x1 - bounds.x0);
+        float zoom = display_get().height / page_width;
+        int w = (int)((bounds.x1 - bounds.x0) * zoom);
+        int h = (int)((bounds.y1 - bounds.y0) * zoom);
+
+        pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), fz_irect{0, 0, w, h}, nullptr, 0);
+        fz_clear_pixmap_with_value(ctx, pix, 0xFF);
+        dev = fz_new_draw_device(ctx, fz_scale(zoom, zoom), pix);
+        fz_run_page(ctx, page, dev, fz_identity, &cookie);
+        fz_close_device(ctx, dev);
+
+        if (!cookie.abort) {
+            const uint8_t *rgb = fz_pixmap_samples(ctx, pix);
+            out->doc.rgba.resize((size_t)w * h * 4);
+            for (int i = 0; i < w * h; ++i) {
+                out->doc.rgba[i * 4 + 0] = rgb[i * 3 + 0];
+                out->doc.rgba[i * 4 + 1] = rgb[i * 3 + 1];
+                out->doc.rgba[i * 4 + 2] = rgb[i * 3 + 2];
+                out->doc.rgba[i * 4 + 3] = 0xFF;
+            }
+            out->doc.zoom = zoom;
+            out->doc.w = w;
+            out->doc.h = h;
+            ok = true;
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+        fz_drop_pixmap(ctx, pix);
+        fz_drop_page(ctx, page);
+    }
+    fz_catch(ctx) {
+        if (!cookie.abort) log_message(LOG_WARNING, PO, "Failed to open %s", path.c_str());
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        doc_cookie = nullptr;
+    }
+
+    if (!ok) {
+        if (doc) fz_drop_document(ctx, doc);
+        fz_drop_context(ctx);
+        out->doc = PreopenDocument{};
+        return false;
+    }
+    out->doc.ctx = ctx;
+    out->doc.doc = doc;
+    return true;
+}
+
+static void worker_thread() {
+    OSSetThreadPriority(OSGetCurrentThread(), PREOPEN_THREAD_PRIORITY);
+    for (;;) {
+        Slot slot;
+        uint32_t gen;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [] { return quit || !wanted.empty(); });
+            if (quit) return;
+            current.swap(wanted);
+            wanted.clear();
+            slot.path = current;
+            slot.type = wanted_type;
+            gen = generation.load();
+        }
+        faststart_hold(slot.path);
+
+        bool ok = false;
+        switch (slot.type) {
+        case 'V':
+        case 'A': ok = open_media(slot.path, gen, &slot); break;
+        case 'P': ok = decode_picture(slot.path, gen, &slot); break;
+        case 'L': ok = open_document(slot.path, gen, &slot); break;
+        }
+
+        std::vector<Slot> dropped;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            current.clear();
+            if (ok && generation.load() == gen) {
+                log_message(LOG_DEBUG, PO, "%s ready", slot.path.c_str());
+                slots.push_back(std::move(slot));
+                slot = Slot{};
+                while (slots.size() > PREOPEN_SLOTS) {
+                    dropped.push_back(std::move(slots.front()));
+                    slots.pop_front();
+                }
+            }
+        }
+        cv.notify_all();
+
+        // Closing files and dropping contexts happens outside the lock, so a
+        // take never waits on it.
+        free_slot(slot);
+        for (Slot &s : dropped)
+            free_slot(s);
+    }
+}
+
+// Called with mtx held.
+static void cancel_current() {
+    generation++;
+    if (doc_cookie) doc_cookie->abort = 1;
+}
+
+void preopen_start(const std::string &path, char type) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (path == current || path == wanted) return;
+        if (std::any_of(slots.begin(), slots.end(), [&](const Slot &s) { return s.path == path; })) return;
+        if (!current.empty()) cancel_current();
+        wanted = path;
+        wanted_type = type;
+        if (!worker.joinable()) {
+            quit = false;
+            worker = std::thread(worker_thread);
+        }
+    }
+    cv.notify_all();
+}
+
+void preopen_cancel(const std::string &keep) {
+    std::vector<Slot> dropped;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (wanted != keep) wanted.clear();
+        if (!current.empty() && current != keep) cancel_current();
+        for (auto it = slots.begin(); it != slots.end();) {
+            if (it->path == keep) {
+                ++it;
+                continue;
+            }
+            dropped.push_back(std::move(*it));
+            it = slots.erase(it);
+        }
+    }
+    for (Slot &s : dropped)
+        free_slot(s);
+}
+
+// Removes the finished slot for path, waiting for the worker if it is on it.
+static bool take(const std::string &path, Slot *out) {
+    std::unique_lock<std::mutex> lk(mtx);
+    if (wanted == path) wanted.clear();
+    cv.wait(lk, [&] { return current != path; });
+    for (auto it = slots.begin(); it != slots.end(); ++it) {
+        if (it->path != path) continue;
+        *out = std::move(*it);
+        slots.erase(it);
+        return true;
+    }
+    return false;
+}
+
+// The file protocol copied the job's interrupt callback when it opened, and
+// that check fails for good once the generation moves on. The player gets a
+// pb of its own at the same position instead.
+static bool reopen_pb(AVFormatContext *fmt, const std::string &path) {
+    int64_t pos = avio_tell(fmt->pb);
+    AVIOContext *pb = nullptr;
+    if (avio_open2(&pb, ("file:" + path).c_str(), AVIO_FLAG_READ, nullptr, nullptr) < 0) return false;
+    if (avio_seek(pb, pos, SEEK_SET) != pos) {
+        avio_closep(&pb);
+        return false;
+    }
+    avio_closep(&fmt->pb);
+    fmt->pb = pb;
+    return true;
+}
+
+AVFormatContext *preopen_take_media(const std::string &path) {
+    Slot s;
+    if (!take(path, &s)) return nullptr;
+    AVFormatContext *fmt = nullptr;
+    if (s.fmt && s.fmt->pb && reopen_pb(s.fmt, path)) std::swap(fmt, s.fmt);
+    else if (s.fmt) log_message(LOG_WARNING, PO, "Cannot reopen %s, opening it again", path.c_str());
+    free_slot(s);
+    return fmt;
+}
+
+bool preopen_take_picture(const std::string &path, std::vector<uint8_t> *rgba, int *w, int *h) {
+    Slot s;
+    if (!take(path, &s) || s.rgba.empty()) {
+        free_slot(s);
+        return false;
+    }
+    rgba->swap(s.rgba);
+    *w = s.w;
+    *h = s.h;
+    free_slot(s);
+    return true;
+}
+
+bool preopen_take_document(const std::string &path, PreopenDocument *out) {
+    Slot s;
+    if (!take(path, &s) || !s.doc.doc) {
+        free_slot(s);
+        return false;
+    }
+    *out = std::move(s.doc);
+    s.doc = PreopenDocument{};
+    free_slot(s);
+    return true;
+}
+
+void preopen_shutdown() {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = true;
+        cancel_current();
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+    wanted.clear();
+    for (Slot &s : slots)
+        free_slot(s);
+    slots.clear();
+}
@@ -0,0 +1,52 @@
+#ifndef PREOPEN_HPP
+#define PREOPEN_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AVFormatContext;
+struct fz_context;
+struct fz_document;
+
+// Speculative opening of the browser entry the cursor rests on, so pressing A
+// finds the slow part done. One worker does for a local file what its viewer
+// would do first: avformat_open_input and the stream probe (through the
+// stream-info cache) for audio and video, the decode for a picture, and the
+// document plus its first page for a book. Finished work waits in a few
+// slots; the viewer takes it over by path and owns it from then on.
+//
+// Moving focus cancels the job in flight cheaply: avformat and MuPDF are
+// interrupted through their callbacks and the picture decoder's reads end.
+#define PREOPEN_SLOTS 2
+#define PREOPEN_THREAD_PRIORITY 20 // below the UI (16), above the browser's previews
+
+// A book with its first page rendered at the viewer's fit-to-screen zoom.
+// ctx and doc are the viewer's from then on.
+struct PreopenDocument {
+    fz_context *ctx = nullptr;
+    fz_document *doc = nullptr;
+    float zoom = 1.0f;
+    int w = 0;
+    int h = 0;
+    std::vector<uint8_t> rgba; // first page, R G B A bytes
+};
+
+// type is the media_info type: 'V' and 'A' media, 'P' picture, 'L' book.
+// Replaces the job in flight unless it is the same path.
+void preopen_start(const std::string &path, char type);
+
+// Cancels the job in flight and frees the finished work, except for keep,
+// the entry being opened right now.
+void preopen_cancel(const std::string &keep);
+
+// Each hands over the finished work for path, waiting for the worker when it
+// is on that very path, since that beats starting over. false/nullptr when
+// there is nothing for path.
+AVFormatContext *preopen_take_media(const std::string &path);
+bool preopen_take_picture(const std::string &path, std::vector<uint8_t> *rgba, int *w, int *h);
+bool preopen_take_document(const std::string &path, PreopenDocument *out);
+
+void preopen_shutdown();
+
+#endif
@@ -0,0 +1,315 @@
+#include "player/stream_cache.hpp"
+
+#include "logger/logger.hpp"
+#include "main.hpp"
+#include "utils/byte_stream.hpp"
+#include "utils/hash.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#define SC "StreamCache"
+
+#define STREAM_CACHE_DIR CACHE_PATH "streaminfo/"
+#define STREAM_CACHE_MAGIC 0x31434953u // "SIC1"
+#define STREAM_CACHE_VERSION 1u
+#define STREAM_CACHE_MAX_FILE (4 * 1024 * 1024)
+#define STREAM_CACHE_MAX_EXTRADATA (1024 * 1024)
+#define STREAM_CACHE_MAX_STREAMS 64
+
+bool stream_cache_make_key(const char *path, StreamCacheKey *key) {
+    struct stat st;
+    if (!path || stat(path, &st) != 0) return false;
+    if (!S_ISREG(st.st_mode)) return false;
+
+    key->path = path;
+    key->size = (int64_t)st.st_size;
+    key->mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+std::string stream_cache_file_for_key(const char *cache_dir, const StreamCacheKey &key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.sic", (unsigned long long)hash_fnv1a64(key.path.data(), key.path.size()));
+    return std::string(cache_dir) + name;
+}
+
+std::vector<uint8_t> stream_cache_serialize(const StreamCacheEntry &e) {
+    ByteWriter w;
+    w.u32(STREAM_CACHE_MAGIC);
+    w.u32(STREAM_CACHE_VERSION);
+    w.str(e.key.path);
+    w.i64(e.key.size);
+    w.i64(e.key.mtime);
+    w.str(e.format_name);
+    w.i64(e.start_time);
+    w.i64(e.duration);
+    w.i64(e.bit_rate);
+    w.u32((uint32_t)e.streams.size());
+
+    for (const StreamCacheStream &s : e.streams) {
+        w.i32(s.codec_type);
+        w.i32(s.codec_id);
+        w.u32(s.codec_tag);
+        w.i32(s.format);
+        w.i64(s.bit_rate);
+        w.i32(s.profile);
+        w.i32(s.level);
+        w.i32(s.width);
+        w.i32(s.height);
+        w.i32(s.sar_num);
+        w.i32(s.sar_den);
+        w.i32(s.field_order);
+        w.i32(s.color_range);
+        w.i32(s.color_space);
+        w.i32(s.color_primaries);
+        w.i32(s.color_trc);
+        w.i32(s.chroma_location);
+        w.i32(s.sample_rate);
+        w.i32(s.channels);
+        w.u64(s.channel_mask);
+        w.i32(s.frame_size);
+        w.i32(s.block_align);
+        w.i32(s.bits_per_coded_sample);
+        w.i32(s.bits_per_raw_sample);
+        w.i32(s.tb_num);
+        w.i32(s.tb_den);
+        w.i32(s.avg_fr_num);
+        w.i32(s.avg_fr_den);
+        w.i32(s.r_fr_num);
+        w.i32(s.r_fr_den);
+        w.i64(s.start_time);
+        w.i64(s.duration);
+        w.i32(s.disposition);
+        w.bytes(s.extradata.data(), s.extradata.size());
+    }
+    return w.buf;
+}
+
+bool stream_cache_deserialize(const uint8_t *data, size_t len, StreamCacheEntry *e) {
+    ByteReader r(data, len);
+    if (r.u32() != STREAM_CACHE_MAGIC || r.u32() != STREAM_CACHE_VERSION) return false;
+
+    r.str(e->key.path, 4096);
+    e->key.size = r.i64();
+    e->key.mtime = r.i64();
+    r.str(e->format_name, 256);
+    e->start_time = r.i64();
+    e->duration = r.i64();
+    e->bit_rate = r.i64();
+
+    uint32_t n = r.u32();
+    if (!r.ok || n > STREAM_CACHE_MAX_STREAMS) return false;
+
+    e->streams.assign(n, StreamCacheStream{});
+    for (StreamCacheStream &s : e->streams) {
+        s.codec_type = r.i32();
+        s.codec_id = r.i32();
+        s.codec_tag = r.u32();
+        s.format = r.i32();
+        s.bit_rate = r.i64();
+        s.profile = r.i32();
+        s.level = r.i32();
+        s.width = r.i32();
+        s.height = r.i32();
+        s.sar_num = r.i32();
+        s.sar_den = r.i32();
+        s.field_order = r.i32();
+        s.color_range = r.i32();
+        s.color_space = r.i32();
+        s.color_primaries = r.i32();
+        s.color_trc = r.i32();
+        s.chroma_location = r.i32();
+        s.sample_rate = r.i32();
+        s.channels = r.i32();
+        s.channel_mask = r.u64();
+        s.frame_size = r.i32();
+        s.block_align = r.i32();
+        s.bits_per_coded_sample = r.i32();
+        s.bits_per_raw_sample = r.i32();
+        s.tb_num = r.i32();
+        s.tb_den = r.i32();
+        s.avg_fr_num = r.i32();
+        s.avg_fr_den = r.i32();
+        s.r_fr_num = r.i32();
+        s.r_fr_den = r.i32();
+        s.start_time = r.i64();
+        s.duration = r.i64();
+        s.disposition = r.i32();
+        r.bytes(s.extradata, STREAM_CACHE_MAX_EXTRADATA);
+    }
+    return r.ok;
+}
+
+bool stream_cache_load(const StreamCacheKey &key, StreamCacheEntry *entry) {
+    std::string file = stream_cache_file_for_key(STREAM_CACHE_DIR, key);
+
+    std::vector<uint8_t> data;
+    if (!byte_stream_read_file(file.c_str(), data, STREAM_CACHE_MAX_FILE)) return false;
+
+    if (!stream_cache_deserialize(data.data(), data.size(), entry)) {
+        log_message(LOG_WARNING, SC, "Discarding corrupt entry %s", file.c_str());
+        remove(file.c_str());
+        return false;
+    }
+
+    bool prepared = entry->key.mtime == STREAM_CACHE_MTIME_ANY;
+    if (entry->key.path != key.path || entry->key.size != key.size || (!prepared && entry->key.mtime != key.mtime)) {
+        log_message(LOG_DEBUG, SC, "Stale entry for %s", key.path.c_str());
+        return false;
+    }
+    if (prepared) {
+        entry->key.mtime = key.mtime;
+        stream_cache_save(*entry);
+    }
+    return true;
+}
+
+bool stream_cache_save(const StreamCacheEntry &entry) {
+    mkdir(CACHE_PATH, 0777);
+    mkdir(STREAM_CACHE_DIR, 0777);
+
+    std::string file = stream_cache_file_for_key(STREAM_CACHE_DIR, entry.key);
+    if (!byte_stream_write_file(file.c_str(), stream_cache_serialize(entry))) {
+        log_message(LOG_WARNING, SC, "Failed to write %s", file.c_str());
+        return false;
+    }
+    log_message(LOG_DEBUG, SC, "Stored %u stream(s) for %s", (unsigned)entry.streams.size(), entry.key.path.c_str());
+    return true;
+}
+
+void stream_cache_invalidate(const StreamCacheKey &key) { remove(stream_cache_file_for_key(STREAM_CACHE_DIR, key).c_str()); }
+
+void stream_cache_capture(const AVFormatContext *fmt_ctx, const StreamCacheKey &key, StreamCacheEntry *e) {
+    e->key = key;
+    e->format_name = fmt_ctx->iformat ? fmt_ctx->iformat->name : "";
+    e->start_time = fmt_ctx->start_time;
+    e->duration = fmt_ctx->duration;
+    e->bit_rate = fmt_ctx->bit_rate;
+    e->streams.clear();
+
+    for (unsigned i = 0; i < fmt_ctx->nb_streams && i < STREAM_CACHE_MAX_STREAMS; ++i) {
+        const AVStream *st = fmt_ctx->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        StreamCacheStream s;
+
+        s.codec_type = par->codec_type;
+        s.codec_id = par->codec_id;
+        s.codec_tag = par->codec_tag;
+        s.format = par->format;
+        s.bit_rate = par->bit_rate;
+        s.profile = par->profile;
+        s.level = par->level;
+        s.width = par->width;
+        s.height = par->height;
+        s.sar_num = par->sample_aspect_ratio.num;
+        s.sar_den = par->sample_aspect_ratio.den;
+        s.field_order = par->field_order;
+        s.color_range = par->color_range;
+        s.color_space = par->color_space;
+        s.color_primaries = par->color_primaries;
+        s.color_trc = par->color_trc;
+        s.chroma_location = par->chroma_location;
+        s.sample_rate = par->sample_rate;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+        s.channels = par->ch_layout.nb_channels;
+        s.channel_mask = par->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ? par->ch_layout.u.mask : 0;
+#else
+        s.channels = par->channels;
+        s.channel_mask = par->channel_layout;
+#endif
+        s.frame_size = par->frame_size;
+        s.block_align = par->block_align;
+        s.bits_per_coded_sample = par->bits_per_coded_sample;
+        s.bits_per_raw_sample = par->bits_per_raw_sample;
+        s.tb_num = st->time_base.num;
+        s.tb_den = st->time_base.den;
+        s.avg_fr_num = st->avg_frame_rate.num;
+        s.avg_fr_den = st->avg_frame_rate.den;
+        s.r_fr_num = st->r_frame_rate.num;
+        s.r_fr_den = st->r_frame_rate.den;
+        s.start_time = st->start_time;
+        s.duration = st->duration;
+        s.disposition = st->disposition;
+        if (par->extradata && par->extradata_size > 0 && par->extradata_size <= STREAM_CACHE_MAX_EXTRADATA) s.extradata.assign(par->extradata, par->extradata + par->extradata_size);
+
+        e->streams.push_back(std::move(s));
+    }
+}
+
+// Only accepts the entry if the container header produced the same stream layout.
+// Formats that discover streams while reading (MPEG-TS etc.) fail here and get a full probe.
+bool stream_cache_apply(AVFormatContext *fmt_ctx, const StreamCacheEntry &e) {
+    if (fmt_ctx->nb_streams != e.streams.size()) {
+        log_message(LOG_DEBUG, SC, "Layout mismatch: %u streams in header, %u cached", fmt_ctx->nb_streams, (unsigned)e.streams.size());
+        return false;
+    }
+
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; ++i) {
+        const AVCodecParameters *par = fmt_ctx->streams[i]->codecpar;
+        const StreamCacheStream &s = e.streams[i];
+        if (par->codec_type != s.codec_type) return false;
+        if (par->codec_id != AV_CODEC_ID_NONE && par->codec_id != s.codec_id) return false;
+    }
+
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; ++i) {
+        AVStream *st = fmt_ctx->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        const StreamCacheStream &s = e.streams[i];
+
+        par->codec_id = (AVCodecID)s.codec_id;
+        par->codec_tag = s.codec_tag;
+        par->format = s.format;
+        par->bit_rate = s.bit_rate;
+        par->profile = s.profile;
+        par->level = s.level;
+        par->width = s.width;
+        par->height = s.height;
+        par->sample_aspect_ratio = AVRational{s.sar_num, s.sar_den};
+        par->field_order = (AVFieldOrder)s.field_order;
+        par->color_range = (AVColorRange)s.color_range;
+        par->color_space = (AVColorSpace)s.color_space;
+        par->color_primaries = (AVColorPrimaries)s.color_primaries;
+        par->color_trc = (AVColorTransferCharacteristic)s.color_trc;
+        par->chroma_location = (AVChromaLocation)s.chroma_location;
+        par->sample_rate = s.sample_rate;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59, 37, 100)
+        av_channel_layout_uninit(&par->ch_layout);
+        if (s.channel_mask)
+            av_channel_layout_from_mask(&par->ch_layout, s.channel_mask);
+        else if (s.channels > 0)
+            av_channel_layout_default(&par->ch_layout, s.channels);
+#else
+        par->channels = s.channels;
+        par->channel_layout = s.channel_mask;
+#endif
+        par->frame_size = s.frame_size;
+        par->block_align = s.block_align;
+        par->bits_per_coded_sample = s.bits_per_coded_sample;
+        par->bits_per_raw_sample = s.bits_per_raw_sample;
+
+        if (!s.extradata.empty()) {
+            av_freep(&par->extradata);
+            par->extradata = (uint8_t *)av_mallocz(s.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (!par->extradata) return false;
+            memcpy(par->extradata, s.extradata.data(), s.extradata.size());
+            par->extradata_size = (int)s.extradata.size();
+        }
+
+        st->avg_frame_rate = AVRational{s.avg_fr_num, s.avg_fr_den};
+        st->r_frame_rate = AVRational{s.r_fr_num, s.r_fr_den};
+        if (st->start_time == AV_NOPTS_VALUE) st->start_time = s.start_time;
+        if (st->duration == AV_NOPTS_VALUE) st->duration = s.duration;
+    }
+
+    if (fmt_ctx->start_time == AV_NOPTS_VALUE) fmt_ctx->start_time = e.start_time;
+    if (fmt_ctx->duration == AV_NOPTS_VALUE) fmt_ctx->duration = e.duration;
+    if (fmt_ctx->bit_rate <= 0) fmt_ctx->bit_rate = e.bit_rate;
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef STREAM_CACHE_HPP
+#define STREAM_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AVFormatContext;
+
+// A cached probe result is only trusted when path, size and mtime all match.
+// Entries prepared on a PC cannot know the mtime the console will report for
+// the file, so they carry STREAM_CACHE_MTIME_ANY and match on path and size;
+// the first load on the console stores the real mtime.
+#define STREAM_CACHE_MTIME_ANY (-1)
+
+struct StreamCacheKey {
+    std::string path;
+    int64_t size = 0;
+    int64_t mtime = 0;
+};
+
+struct StreamCacheStream {
+    int32_t codec_type = -1;
+    int32_t codec_id = 0;
+    uint32_t codec_tag = 0;
+    int32_t format = -1;
+    int64_t bit_rate = 0;
+    int32_t profile = 0;
+    int32_t level = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t sar_num = 0, sar_den = 1;
+    int32_t field_order = 0;
+    int32_t color_range = 0, color_space = 0, color_primaries = 0, color_trc = 0, chroma_location = 0;
+    int32_t sample_rate = 0;
+    int32_t channels = 0;
+    uint64_t channel_mask = 0;
+    int32_t frame_size = 0;
+    int32_t block_align = 0;
+    int32_t bits_per_coded_sample = 0;
+    int32_t bits_per_raw_sample = 0;
+    int32_t tb_num = 0, tb_den = 1;
+    int32_t avg_fr_num = 0, avg_fr_den = 1;
+    int32_t r_fr_num = 0, r_fr_den = 1;
+    int64_t start_time = 0;
+    int64_t duration = 0;
+    int32_t disposition = 0;
+    std::vector<uint8_t> extradata;
+};
+
+struct StreamCacheEntry {
+    StreamCacheKey key;
+    std::string format_name;
+    int64_t start_time = 0;
+    int64_t duration = 0;
+    int64_t bit_rate = 0;
+    std::vector<StreamCacheStream> streams;
+};
+
+bool stream_cache_make_key(const char *path, StreamCacheKey *key);
+bool stream_cache_load(const StreamCacheKey &key, StreamCacheEntry *entry);
+bool stream_cache_save(const StreamCacheEntry &entry);
+void stream_cache_invalidate(const StreamCacheKey &key);
+
+// Conversion between a probed AVFormatContext and a cache entry.
+void stream_cache_capture(const AVFormatContext *fmt_ctx, const StreamCacheKey &key, StreamCacheEntry *entry);
+bool stream_cache_apply(AVFormatContext *fmt_ctx, const StreamCacheEntry &entry);
+
+// Serialisation, exposed so host-side tools produce byte-identical files.
+std::vector<uint8_t> stream_cache_serialize(const StreamCacheEntry &entry);
+bool stream_cache_deserialize(const uint8_t *data, size_t len, StreamCacheEntry *entry);
+std::string stream_cache_file_for_key(const char *cache_dir, const StreamCacheKey &key);
+
+#endif
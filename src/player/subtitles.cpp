@@ -0,0 +1,322 @@
+#include "player/subtitles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <strings.h>
+
+#define SUBTITLE_SAME_START 0.001 // seconds; cues closer than this are the same cue
+
+SubtitleFormat subtitle_format_for_extension(const char *ext) {
+    if (!strcasecmp(ext, "srt")) return SubtitleFormat::Srt;
+    if (!strcasecmp(ext, "vtt")) return SubtitleFormat::WebVtt;
+    if (!strcasecmp(ext, "ass") || !strcasecmp(ext, "ssa")) return SubtitleFormat::Ass;
+    return SubtitleFormat::Unknown;
+}
+
+static bool valid_utf8(const unsigned char *s, size_t len) {
+    for (size_t i = 0; i < len;) {
+        unsigned char c = s[i];
+        size_t n = c < 0x80 ? 0 : (c & 0xe0) == 0xc0 ? 1 : (c & 0xf0) == 0xe0 ? 2 : (c & 0xf8) == 0xf0 ? 3 : 4;
+        if (n == 4 || i + n >= len) return false;
+        for (size_t k = 1; k <= n; ++k)
+            if ((s[i + k] & 0xc0) != 0x80) return false;
+        i += n + 1;
+    }
+    return true;
+}
+
+static std::string latin1_to_utf8(const char *data, size_t len) {
+    std::string out;
+    out.reserve(len + len / 8);
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)data[i];
+        if (c < 0x80) {
+            out += (char)c;
+        } else {
+            out += (char)(0xc0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3f));
+        }
+    }
+    return out;
+}
+
+static std::vector<std::string> split_lines(const std::string &text) {
+    std::vector<std::string> lines;
+    size_t i = 0;
+    if (text.compare(0, 3, "\xef\xbb\xbf") == 0) i = 3;
+    while (i <= text.size()) {
+        size_t e = text.find_first_of("\r\n", i);
+        if (e == std::string::npos) e = text.size();
+        lines.push_back(text.substr(i, e - i));
+        if (e < text.size() && text[e] == '\r' && e + 1 < text.size() && text[e + 1] == '\n') e++;
+        i = e + 1;
+    }
+    return lines;
+}
+
+// [[h:]m:]s[.,fraction]; advances p past the time.
+static bool parse_time(const char *&p, double *out) {
+    while (*p == ' ' || *p == '\t')
+        p++;
+    double parts[3] = {};
+    int n = 0;
+    for (;;) {
+        if (*p < '0' || *p > '9') return false;
+        char *e;
+        parts[n++] = (double)strtol(p, &e, 10);
+        p = e;
+        if (*p != ':' || n == 3) break;
+        p++;
+    }
+    double t = 0.0;
+    for (int i = 0; i < n; ++i)
+        t = t * 60.0 + parts[i];
+    if (*p == '.' || *p == ',') {
+        double scale = 0.1;
+        for (p++; *p >= '0' && *p <= '9'; p++, scale /= 10.0)
+            t += (*p - '0') * scale;
+    }
+    *out = t;
+    return true;
+}
+
+static void decode_entity(const std::string &s, size_t *i, std::string *out) {
+    static const struct {
+        const char *name;
+        const char *text;
+    } entities[] = {{"&amp;", "&"}, {"&lt;", "<"}, {"&gt;", ">"}, {"&quot;", "\""}, {"&apos;", "'"}, {"&nbsp;", " "}, {"&lrm;", ""}, {"&rlm;", ""}};
+    for (const auto &e : entities) {
+        size_t n = strlen(e.name);
+        if (s.compare(*i, n, e.name) == 0) {
+            *out += e.text;
+            *i += n;
+            return;
+        }
+    }
+    *out += '&';
+    (*i)++;
+}
+
+// Drops leading and trailing blank lines and trailing spaces of each line.
+static std::string tidy_lines(const std::string &s) {
+    std::string out;
+    size_t i = 0;
+    while (i <= s.size()) {
+        size_t e = s.find('\n', i);
+        if (e == std::string::npos) e = s.size();
+        size_t end = e;
+        while (end > i && (s[end - 1] == ' ' || s[end - 1] == '\t'))
+            end--;
+        if (end > i) {
+            if (!out.empty()) out += '\n';
+            out.append(s, i, end - i);
+        }
+        i = e + 1;
+    }
+    return out;
+}
+
+// SRT and WebVTT markup: <i>, <font ...>, <c.class>, <v Speaker>, inline
+// timestamps, entities, and the {\an8} tags some SRT files carry.
+static std::string strip_html(const std::string &s) {
+    std::string out;
+    for (size_t i = 0; i < s.size();) {
+        if (s[i] == '<') {
+            size_t e = s.find('>', i);
+            if (e == std::string::npos) break;
+            i = e + 1;
+        } else if (s[i] == '{' && i + 1 < s.size() && s[i + 1] == '\\') {
+            size_t e = s.find('}', i);
+            if (e == std::string::npos) break;
+            i = e + 1;
+        } else if (s[i] == '&') {
+            decode_entity(s, &i, &out);
+        } else {
+            out += s[i++];
+        }
+    }
+    return tidy_lines(out);
+}
+
+// ASS text: override blocks go, \N and \n break lines, \h is a hard space.
+// Text between {\p1} and {\p0} is a vector drawing, not words.
+static std::string strip_ass(const char *s) {
+    std::string out;
+    bool drawing = false;
+    for (const char *p = s; *p;) {
+        if (*p == '{') {
+            const char *e = strchr(p, '}');
+            if (!e) break;
+            for (const char *q = p; q < e; ++q)
+                if (q[0] == '\\' && q[1] == 'p' && q[2] >= '0' && q[2] <= '9') drawing = q[2] != '0';
+            p = e + 1;
+        } else if (p[0] == '\\' && (p[1] == 'N' || p[1] == 'n')) {
+            if (!drawing) out += '\n';
+            p += 2;
+        } else if (p[0] == '\\' && p[1] == 'h') {
+            if (!drawing) out += ' ';
+            p += 2;
+        } else {
+            if (!drawing) out += *p;
+            p++;
+        }
+    }
+    return tidy_lines(out);
+}
+
+std::string subtitle_ass_event_text(const char *event) {
+    // Text is the ninth field and may itself contain commas.
+    const char *p = event;
+    for (int commas = 0; *p && commas < 8; ++p)
+        if (*p == ',') commas++;
+    return strip_ass(p);
+}
+
+// SRT and WebVTT: a timing line "start --> end [settings]" followed by text
+// up to the next blank line. Blocks without timing (numbers, NOTE, STYLE,
+// the WEBVTT header) are skipped.
+static void parse_timed_blocks(const std::vector<std::string> &lines, std::vector<SubtitleCue> *out) {
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const std::string &l = lines[i];
+        size_t arrow = l.find("-->");
+        if (arrow == std::string::npos) continue;
+
+        SubtitleCue cue;
+        const char *p = l.c_str();
+        const char *q = l.c_str() + arrow + 3;
+        if (!parse_time(p, &cue.start) || !parse_time(q, &cue.end)) continue;
+
+        std::string text;
+        for (i++; i < lines.size() && !lines[i].empty(); ++i) {
+            if (!text.empty()) text += '\n';
+            text += lines[i];
+        }
+        cue.text = strip_html(text);
+        if (!cue.text.empty() && cue.end > cue.start) out->push_back(std::move(cue));
+    }
+}
+
+// ASS/SSA: Dialogue lines of the [Events] section, fields as named by its
+// Format line.
+static void parse_ass(const std::vector<std::string> &lines, std::vector<SubtitleCue> *out) {
+    bool events = false;
+    int start_idx = 1, end_idx = 2, nfields = 10;
+    for (const std::string &l : lines) {
+        if (!l.empty() && l[0] == '[') {
+            events = !strncasecmp(l.c_str(), "[Events]", 8);
+            continue;
+        }
+        if (!events) continue;
+
+        if (!strncasecmp(l.c_str(), "Format:", 7)) {
+            int idx = 0;
+            for (size_t i = 7; i <= l.size(); ++idx) {
+                size_t e = l.find(',', i);
+                if (e == std::string::npos) e = l.size();
+                std::string name = l.substr(i, e - i);
+                name.erase(0, name.find_first_not_of(" \t"));
+                name.erase(name.find_last_not_of(" \t") + 1);
+                if (!strcasecmp(name.c_str(), "Start")) start_idx = idx;
+                if (!strcasecmp(name.c_str(), "End")) end_idx = idx;
+                i = e + 1;
+            }
+            nfields = idx;
+            continue;
+        }
+        if (strncasecmp(l.c_str(), "Dialogue:", 9)) continue;
+
+        // The last field is the text and keeps its commas.
+        std::vector<std::string> f;
+        size_t i = 9;
+        for (; (int)f.size() < nfields - 1; ++i) {
+            size_t e = l.find(',', i);
+            if (e == std::string::npos) break;
+            f.push_back(l.substr(i, e - i));
+            i = e;
+        }
+        if ((int)f.size() != nfields - 1 || start_idx >= nfields - 1 || end_idx >= nfields - 1) continue;
+
+        SubtitleCue cue;
+        const char *ps = f[start_idx].c_str(), *pe = f[end_idx].c_str();
+        if (!parse_time(ps, &cue.start) || !parse_time(pe, &cue.end)) continue;
+        cue.text = strip_ass(l.c_str() + i);
+        if (!cue.text.empty() && cue.end > cue.start) out->push_back(std::move(cue));
+    }
+}
+
+bool subtitle_parse(SubtitleFormat fmt, const char *data, size_t len, std::vector<SubtitleCue> *out) {
+    std::string text = valid_utf8((const unsigned char *)data, len) ? std::string(data, len) : latin1_to_utf8(data, len);
+    std::vector<std::string> lines = split_lines(text);
+    out->clear();
+    switch (fmt) {
+        case SubtitleFormat::Srt:
+        case SubtitleFormat::WebVtt:
+            parse_timed_blocks(lines, out);
+            break;
+        case SubtitleFormat::Ass:
+            parse_ass(lines, out);
+            break;
+        default:
+            return false;
+    }
+    return !out->empty();
+}
+
+static void rebuild_max_end(SubtitleTrack *t, size_t from) {
+    t->max_end.resize(t->cues.size());
+    for (size_t i = from; i < t->cues.size(); ++i)
+        t->max_end[i] = i ? std::max(t->max_end[i - 1], t->cues[i].end) : t->cues[i].end;
+}
+
+static bool start_before(double time, const SubtitleCue &c) { return time < c.start; }
+
+bool subtitle_track_add(SubtitleTrack *t, SubtitleCue cue) {
+    // Internal tracks arrive in order, so this is an append almost always.
+    size_t pos = std::upper_bound(t->cues.begin(), t->cues.end(), cue.start, start_before) - t->cues.begin();
+    for (size_t i = pos; i-- > 0 && t->cues[i].start > cue.start - SUBTITLE_SAME_START;)
+        if (t->cues[i].text == cue.text) return false;
+    t->cues.insert(t->cues.begin() + pos, std::move(cue));
+    rebuild_max_end(t, pos);
+    return true;
+}
+
+void subtitle_track_assign(SubtitleTrack *t, std::vector<SubtitleCue> cues) {
+    std::stable_sort(cues.begin(), cues.end(), [](const SubtitleCue &a, const SubtitleCue &b) { return a.start < b.start; });
+    t->cues = std::move(cues);
+    rebuild_max_end(t, 0);
+}
+
+void subtitle_track_lookup(const SubtitleTrack &t, double time, std::vector<SubtitleCue> *active, double *until) {
+    active->clear();
+    size_t k = std::upper_bound(t.cues.begin(), t.cues.end(), time, start_before) - t.cues.begin();
+    *until = k < t.cues.size() ? t.cues[k].start : std::numeric_limits<double>::infinity();
+    for (size_t i = k; i-- > 0 && t.max_end[i] > time;) {
+        if (t.cues[i].end > time) {
+            active->push_back(t.cues[i]);
+            *until = std::min(*until, t.cues[i].end);
+        }
+    }
+    std::reverse(active->begin(), active->end());
+}
+
+static bool same_cues(const std::vector<SubtitleCue> &a, const std::vector<SubtitleCue> &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a[i].start != b[i].start || a[i].text != b[i].text) return false;
+    return true;
+}
+
+bool subtitle_cursor_refresh(SubtitleCursor *c, const SubtitleTrack &t, uint32_t version, double time) {
+    std::vector<SubtitleCue> active;
+    double until;
+    subtitle_track_lookup(t, time, &active, &until);
+    c->version = version;
+    c->from = time;
+    c->until = until;
+    if (same_cues(active, c->active)) return false;
+    c->active = std::move(active);
+    return true;
+}
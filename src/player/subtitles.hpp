@@ -0,0 +1,79 @@
+#ifndef SUBTITLES_HPP
+#define SUBTITLES_HPP
+
+// Text subtitles: SRT, WebVTT and ASS/SSA parsed into plain-text cues, and a
+// per-track index answering "what is on screen at t". Styling and positioning
+// are dropped; the renderer draws every cue bottom-centred. Bitmap subtitle
+// events arrive as SubtitleBitmap images. No FFmpeg types, so it builds and
+// runs on the host.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SUBTITLE_MAX_FILE (4 * 1024 * 1024)
+#define SUBTITLE_DEFAULT_DURATION 5.0 // cues that arrive without an end
+
+struct SubtitleCue {
+    double start = 0.0;
+    double end = 0.0;
+    std::string text; // UTF-8, lines separated by '\n'
+};
+
+enum class SubtitleFormat { Unknown, Srt, WebVtt, Ass };
+
+SubtitleFormat subtitle_format_for_extension(const char *ext);
+
+// A whole subtitle file; text that is not valid UTF-8 is taken as Latin-1.
+bool subtitle_parse(SubtitleFormat fmt, const char *data, size_t len, std::vector<SubtitleCue> *out);
+
+// The text of an ASS event as FFmpeg's text subtitle decoders hand it out
+// (ReadOrder,Layer,Style,Name,MarginL,MarginR,MarginV,Effect,Text), without
+// override tags.
+std::string subtitle_ass_event_text(const char *event);
+
+// Cues sorted by start. max_end[i] is the latest end among cues[0..i], which
+// bounds the backwards walk in a lookup.
+struct SubtitleTrack {
+    std::vector<SubtitleCue> cues;
+    std::vector<double> max_end;
+};
+
+// Keeps the order; a cue already present (same start and text) is dropped,
+// so packets read again after a seek do not double up.
+bool subtitle_track_add(SubtitleTrack *t, SubtitleCue cue);
+void subtitle_track_assign(SubtitleTrack *t, std::vector<SubtitleCue> cues);
+
+// Cues showing at time, in start order. *until is when that set changes next
+// if no cue is added.
+void subtitle_track_lookup(const SubtitleTrack &t, double time, std::vector<SubtitleCue> *active, double *until);
+
+// A decoded bitmap subtitle event (PGS, VobSub, DVB): all of its regions in
+// one image, placed on the canvas the stream was authored for.
+struct SubtitleBitmap {
+    double start = 0.0;
+    double end = 0.0; // infinity until the next event ends it
+    int canvas_w = 0;
+    int canvas_h = 0;
+    int x = 0, y = 0, w = 0, h = 0;
+    std::vector<uint32_t> rgba; // ImGui's RGBA32 layout, w * h
+
+    size_t bytes() const { return rgba.size() * sizeof(uint32_t) + sizeof(*this); }
+};
+
+// The active set of one track as the UI last saw it. A lookup only happens
+// when the time leaves [from, until) or the track has changed.
+struct SubtitleCursor {
+    uint32_t version = 0;
+    double from = 1.0;
+    double until = 0.0;
+    std::vector<SubtitleCue> active;
+};
+
+inline bool subtitle_cursor_valid(const SubtitleCursor &c, uint32_t version, double time) { return c.version == version && time >= c.from && time < c.until; }
+
+// Returns true when the active set differs from before.
+bool subtitle_cursor_refresh(SubtitleCursor *c, const SubtitleTrack &t, uint32_t version, double time);
+
+#endif
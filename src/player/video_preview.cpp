@@ -0,0 +1,171 @@
+#include "player/video_preview.hpp"
+
+#include "logger/logger.hpp"
+#include "player/faststart.hpp"
+#include "player/frame_thumb.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coreinit/thread.h>
+#include <mutex>
+#include <thread>
+
+#define VP "Preview"
+
+static std::mutex mtx;
+static std::condition_variable cv;
+static std::thread worker;
+static std::string wanted; // empty when stopped
+static bool quit = false;
+static std::atomic<uint32_t> generation{0}; // bumped by every start and stop
+
+// The newest image, guarded by mtx.
+static std::vector<uint32_t> latest;
+static int latest_w = 0;
+static int latest_h = 0;
+static bool latest_new = false;
+
+static int interrupt_cb(void *opaque) { return generation.load(std::memory_order_relaxed) != (uint32_t)(uintptr_t)opaque; }
+
+// false when the preview was replaced or stopped in the meantime.
+static bool hold(uint32_t gen, int ms) {
+    std::unique_lock<std::mutex> lk(mtx);
+    return !cv.wait_for(lk, std::chrono::milliseconds(ms), [gen] { return quit || generation.load() != gen; });
+}
+
+// Loops over the keyframes of the video until the generation moves on.
+static void run_preview(const std::string &path, uint32_t gen) {
+    AVFormatContext *fmt = avformat_alloc_context();
+    AVCodecContext *avctx = nullptr;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    std::vector<uint32_t> rgba;
+    int vidx = -1, w = 0, h = 0, shown = 0;
+    int64_t start = AV_NOPTS_VALUE;
+
+    if (!fmt || !pkt || !frame) goto done;
+    fmt->interrupt_callback.callback = interrupt_cb;
+    fmt->interrupt_callback.opaque = (void *)(uintptr_t)gen;
+    fmt->probesize = PREVIEW_PROBE_SIZE;
+    fmt->max_analyze_duration = AV_TIME_BASE;
+    if (avformat_open_input(&fmt, ("file:" + path).c_str(), nullptr, nullptr) < 0) goto done; // frees fmt
+    if (avformat_find_stream_info(fmt, nullptr) < 0) goto done;
+
+    avctx = frame_thumb_open_decoder(fmt, PREVIEW_MAX_W, PREVIEW_MAX_H, &vidx);
+    if (!avctx) goto done;
+
+    if (fmt->duration > 0) {
+        start = (int64_t)(fmt->duration * PREVIEW_START_FRACTION) + (fmt->start_time != AV_NOPTS_VALUE ? fmt->start_time : 0);
+        av_seek_frame(fmt, -1, start, AVSEEK_FLAG_BACKWARD);
+    }
+
+    while (generation.load() == gen) {
+        int ret = av_read_frame(fmt, pkt);
+        if (ret == AVERROR_EOF) {
+            // Loop; a file that ended before showing anything has nothing to show.
+            if (!shown || av_seek_frame(fmt, -1, start != AV_NOPTS_VALUE ? start : 0, AVSEEK_FLAG_BACKWARD) < 0) break;
+            avcodec_flush_buffers(avctx);
+            continue;
+        }
+        if (ret < 0) break;
+        bool key = pkt->stream_index == vidx && (pkt->flags & AV_PKT_FLAG_KEY);
+        ret = key ? avcodec_send_packet(avctx, pkt) : 0;
+        av_packet_unref(pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN)) continue;
+
+        while (avcodec_receive_frame(avctx, frame) >= 0) {
+            bool ok = frame_thumb_convert(frame, PREVIEW_MAX_W, PREVIEW_MAX_H, &rgba, &w, &h, nullptr);
+            av_frame_unref(frame);
+            if (!ok) {
+                log_message(LOG_DEBUG, VP, "%s: pixel format %d not supported", path.c_str(), avctx->pix_fmt);
+                goto done;
+            }
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                if (generation.load() != gen) goto done;
+                latest.swap(rgba);
+                latest_w = w;
+                latest_h = h;
+                latest_new = true;
+            }
+            shown++;
+            if (!hold(gen, PREVIEW_FRAME_MS)) goto done;
+        }
+    }
+
+done:
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&avctx);
+    if (fmt) avformat_close_input(&fmt);
+}
+
+static void worker_thread() {
+    OSSetThreadPriority(OSGetCurrentThread(), PREVIEW_THREAD_PRIORITY);
+    for (;;) {
+        std::string path;
+        uint32_t gen;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [] { return quit || !wanted.empty(); });
+            if (quit) return;
+            path.swap(wanted);
+            gen = generation.load();
+        }
+        faststart_hold(path);
+        run_preview(path, gen);
+        faststart_release(path);
+    }
+}
+
+void video_preview_start(const std::string &path) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        generation++;
+        wanted = path;
+        latest_new = false;
+        if (!worker.joinable()) {
+            quit = false;
+            worker = std::thread(worker_thread);
+        }
+    }
+    cv.notify_all();
+}
+
+void video_preview_stop() {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        generation++;
+        wanted.clear();
+        latest_new = false;
+    }
+    cv.notify_all();
+}
+
+bool video_preview_take_frame(std::vector<uint32_t> *rgba, int *w, int *h) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (!latest_new) return false;
+    rgba->swap(latest);
+    *w = latest_w;
+    *h = latest_h;
+    latest_new = false;
+    return true;
+}
+
+void video_preview_shutdown() {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quit = true;
+        generation++;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+    latest.clear();
+    latest.shrink_to_fit();
+}
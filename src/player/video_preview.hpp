@@ -0,0 +1,30 @@
+#ifndef VIDEO_PREVIEW_HPP
+#define VIDEO_PREVIEW_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A muted, keyframe-only preview of one local video for the file browser.
+// A single low-priority worker decodes keyframes through frame_thumb and the
+// UI thread only uploads the latest image. Starting another file or stopping
+// never waits for the worker: it notices at its next packet, or inside
+// avformat through the interrupt callback.
+#define PREVIEW_MAX_W 256
+#define PREVIEW_MAX_H 144
+#define PREVIEW_FRAME_MS 500       // how long each keyframe stays up
+#define PREVIEW_START_FRACTION 0.1 // skip the intro and logos
+#define PREVIEW_PROBE_SIZE (256 * 1024)
+#define PREVIEW_THREAD_PRIORITY 30 // 0 is the highest, the UI runs at 16
+
+// Replaces whatever was previewing.
+void video_preview_start(const std::string &path);
+void video_preview_stop();
+
+// Moves the newest image into rgba (w * h, ImGui's RGBA32 layout). Returns
+// false when none arrived since the last call.
+bool video_preview_take_frame(std::vector<uint32_t> *rgba, int *w, int *h);
+
+void video_preview_shutdown();
+
+#endif
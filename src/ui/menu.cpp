@@ -5,6 +5,7 @@
 #include "player/media_player.hpp"
 #include "ui/scene.hpp"
 #include "ui/scenes/scene_file_browser.hpp"
+#include "ui/scenes/scene_jellyfin_browser.hpp"
 #include "ui/scenes/scene_main_menu.hpp"
 #include "ui/scenes/scene_media_player.hpp"
 #include "ui/scenes/scene_pdf_viewer.hpp"
@@ -15,6 +16,8 @@
 #include "utils/font.hpp"
 #include "utils/media_info.hpp"
 
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
 #include <imgui/backends/imgui_impl_gx2.h>
 #include <imgui/backends/imgui_impl_wiiu.h>
 #include <gx2/registers.h>
@@ -23,27 +26,29 @@
 #include <memory>
 #include <whb/gfx.h>
 
+#define UI_IDLE_SLEEP_MS 16
+
 static ImGuiIO *io{};
 const ImVec4 clear_color = ImVec4(0.0f, 0.0f, 0.00f, 1.00f);
 static InputState input{};
 
-static bool ambiance_playing = false;
 static bool background_music_enabled = true;
+static MediaPlayer *ambiance = nullptr;
 
+// Menu music is a looping audio-only instance of its own, so it never touches
+// the main player the playback scenes drive.
 void ui_handle_ambiance(bool new_state) {
-    /*
-    ambiance_playing = new_state;
-
-    if (ambiance_playing && background_music_enabled) {
-        media_player_init(AMBIANCE_PATH);
-        media_player_play(true);
-        ambiance_playing = true;
-    } else if (ambiance_playing && !background_music_enabled) {
-        media_player_play(true);
-        media_player_cleanup();
-        media_player_play(false);
+    bool want = new_state && background_music_enabled;
+    if (want && !ambiance) {
+        MediaPlayerOptions opts;
+        opts.audio_only = true;
+        opts.loop = true;
+        ambiance = player_open(AMBIANCE_PATH, opts);
+        if (ambiance) player_play(ambiance, true);
+    } else if (!want && ambiance) {
+        player_close(ambiance);
+        ambiance = nullptr;
     }
-    */
 }
 
 void ui_init() {
@@ -69,7 +74,8 @@ void ui_init() {
     ImGui_ImplGX2_Init();
 
     ui_scene_register(STATE_MENU, {[]() {}, [](InputState &input) {}, []() { scene_main_menu_render(); }, []() {}});
-    ui_scene_register(STATE_MENU_FILES, {[]() {}, [](InputState &input) { scene_file_browser_input(input); }, []() { scene_file_browser_render(); }, []() {}});
+    ui_scene_register(STATE_MENU_FILES, {[]() {}, [](InputState &input) { scene_file_browser_input(input); }, []() { scene_file_browser_render(); }, []() { scene_file_browser_shutdown(); }});
+    ui_scene_register(STATE_MENU_JELLYFIN, {[]() {}, [](InputState &input) { scene_jellyfin_browser_input(input); }, []() { scene_jellyfin_browser_render(); }, []() { scene_jellyfin_browser_shutdown(); }});
 
     ui_scene_register(STATE_VIEWING_PHOTO, {[]() {
                                                 scene_photo_viewer_init(media_info_get()->path);
@@ -84,8 +90,8 @@ void ui_init() {
                                           [](InputState &input) { scene_pdf_viewer_input(input); }, []() { scene_pdf_viewer_render(); }, []() { ui_handle_ambiance(true); }});
 
     ui_scene_register(STATE_PLAYING_VIDEO, {[]() {
-                                                scene_media_player_init(media_info_get()->path);
                                                 ui_handle_ambiance(false);
+                                                scene_media_player_init(media_info_get()->path);
                                             },
                                             [](InputState &input) { scene_media_player_input(input); }, []() { scene_media_player_render(); },
                                             []() {
@@ -94,14 +100,15 @@ void ui_init() {
                                             }});
 
     ui_scene_register(STATE_PLAYING_AUDIO, {[]() {
-                                                scene_media_player_init(media_info_get()->path);
                                                 ui_handle_ambiance(false);
+                                                scene_media_player_init(media_info_get()->path);
                                             },
                                             [](InputState &input) { scene_media_player_input(input); }, []() { scene_media_player_render(); },
                                             []() {
                                                 scene_media_player_shutdown();
                                                 ui_handle_ambiance(true);
-                                            }});
+                                            },
+                                            []() { return scene_media_player_idle(); }});
 
     ui_scene_set(app_state_get());
     ui_handle_ambiance(true);
@@ -110,6 +117,14 @@ void ui_init() {
 void ui_render() {
     input_poll(input);
 
+    // Nothing visible changed: keep the last frame on screen and skip the whole
+    // ImGui/GX2 pass, only servicing input.
+    if (ui_scene_idle()) {
+        ui_scene_input(input);
+        OSSleepTicks(OSMillisecondsToTicks(UI_IDLE_SLEEP_MS));
+        return;
+    }
+
     GX2ColorBuffer *cb = WHBGfxGetTVColourBuffer();
 
     ImGui_ImplWiiU_NewFrame(cb);
@@ -146,13 +161,6 @@ void ui_render() {
     GX2CopyColorBufferToScanBuffer(WHBGfxGetTVColourBuffer(), GX2_SCAN_TARGET_DRC);
 
     WHBGfxFinishRender();
-
-    /*
-        if ((int)media_player_get_current_time() == (int)media_player_get_total_time() && ambiance_playing && background_music_enabled) {
-            log_message(LOG_DEBUG, "UI", "Restarting ambiance");
-            media_player_seek(-1000);
-        }
-    */
 }
 
 void ui_shutdown() {
@@ -29,6 +29,8 @@ void ui_scene_render() {
     if (current_scene && current_scene->render) current_scene->render();
 }
 
+bool ui_scene_idle() { return current_scene && current_scene->idle && current_scene->idle(); }
+
 void ui_scene_shutdown() {
     if (current_scene && current_scene->shutdown) current_scene->shutdown();
 }
@@ -10,6 +10,7 @@ struct UIScene {
     std::function<void(InputState &input)> input;
     std::function<void()> render;
     std::function<void()> shutdown;
+    std::function<bool()> idle; // optional: true when nothing on screen needs to change
 };
 
 void ui_scene_register(int state, const UIScene &scene);
@@ -17,5 +18,6 @@ void ui_scene_set(int state);
 void ui_scene_input(InputState &input);
 void ui_scene_render();
 void ui_scene_shutdown();
+bool ui_scene_idle();
 
 #endif
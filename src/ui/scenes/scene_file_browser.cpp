@@ -3,6 +3,9 @@
 #include "input/input_actions.hpp"
 #include "logger/logger.hpp"
 #include "main.hpp"
+#include "player/poster_frames.hpp"
+#include "player/preopen.hpp"
+#include "player/video_preview.hpp"
 #include "ui/widgets/widget_button_icon.hpp"
 #include "ui/widgets/widget_sidebar.hpp"
 #include "ui/widgets/widget_tooltip.hpp"
@@ -11,13 +14,20 @@
 #include "utils/font.hpp"
 #include "utils/media_info.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <dirent.h>
+#include <imgui/backends/imgui_impl_gx2.h>
 #include <imgui/imgui.h>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#define PREVIEW_DWELL_SECONDS 0.8  // focus time on a video row before its preview starts
+#define POSTER_TEXTURE_CACHE 32    // poster textures kept, the ones on screen included
+#define PREOPEN_DWELL_SECONDS 0.25 // focus time on a file row before it is opened speculatively
+
 enum file_types { FILE_FOLDER, FILE_AUDIO, FILE_VIDEO, FILE_IMAGE, FILE_BOOK };
 
 static const std::unordered_map<file_types, const char *> file_icons = {
@@ -29,6 +39,19 @@ static const std::unordered_set<std::string> valid_audio_endings = {"mp3", "wav"
 static const std::unordered_set<std::string> valid_image_endings = {"png", "jpg", "gif", "tga", "bmp"};
 static const std::unordered_set<std::string> valid_pdf_endings = {"pdf", "epub", "cbz"};
 
+struct TypeInfo {
+    char media_char;
+    AppState next_state;
+    bool is_visual;
+};
+
+static const std::unordered_map<file_types, TypeInfo> type_info_map = {
+    {FILE_AUDIO, {'A', STATE_PLAYING_AUDIO, false}},
+    {FILE_VIDEO, {'V', STATE_PLAYING_VIDEO, false}},
+    {FILE_IMAGE, {'P', STATE_VIEWING_PHOTO, true}},
+    {FILE_BOOK, {'L', STATE_VIEWING_PDF, true}},
+};
+
 struct file {
     std::string path;
     file_types file_type;
@@ -38,6 +61,26 @@ static std::vector<file> files;
 static std::string media_root;
 static std::string relative_dir;
 
+static std::string preview_path; // the focused video row, relative
+static double preview_since = 0.0;
+static bool preview_running = false;
+static ImTextureData *preview_tex = nullptr;
+static std::vector<uint32_t> preview_px;
+
+static std::string preopen_path; // the focused file row, full path
+static double preopen_since = 0.0;
+static bool preopen_started = false;
+static std::string opening_path; // the file start_file handed to its viewer
+
+struct Poster {
+    ImTextureData *texture = nullptr; // nullptr: the video has no usable frame
+    uint64_t last_used = 0;
+};
+
+static std::unordered_map<std::string, Poster> posters; // by full path
+static std::vector<std::string> posters_wanted;
+static uint64_t frame_no = 0;
+
 static std::string get_extension(const std::string &filename) {
     size_t dot = filename.find_last_of('.');
     if (dot == std::string::npos || dot == filename.size() - 1) return "";
@@ -68,20 +111,131 @@ static std::string parent_relative(const std::string &base) {
     return base.substr(0, slash);
 }
 
-static void start_file(const file &f) {
-    struct TypeInfo {
-        char media_char;
-        AppState next_state;
-        bool is_visual;
-    };
-
-    static const std::unordered_map<file_types, TypeInfo> type_info_map = {
-        {FILE_AUDIO, {'A', STATE_PLAYING_AUDIO, false}},
-        {FILE_VIDEO, {'V', STATE_PLAYING_VIDEO, false}},
-        {FILE_IMAGE, {'P', STATE_VIEWING_PHOTO, true}},
-        {FILE_BOOK, {'L', STATE_VIEWING_PDF, true}},
-    };
+static ImTextureData *create_texture(const std::vector<uint32_t> &rgba, int w, int h) {
+    ImTextureData *tex = IM_NEW(ImTextureData);
+    tex->Create(ImTextureFormat_RGBA32, w, h);
+    memcpy(tex->GetPixels(), rgba.data(), rgba.size() * sizeof(uint32_t));
+    tex->SetStatus(ImTextureStatus_WantCreate);
+    ImGui_ImplGX2_HandleTexture(tex);
+    return tex;
+}
+
+static void destroy_texture(ImTextureData *tex) {
+    if (!tex) return;
+    tex->SetStatus(ImTextureStatus_WantDestroy);
+    ImGui_ImplGX2_HandleTexture(tex);
+    IM_DELETE(tex);
+}
+
+static void stop_preview() {
+    if (preview_running) video_preview_stop();
+    preview_running = false;
+    preview_path.clear();
+    destroy_texture(preview_tex);
+    preview_tex = nullptr;
+}
+
+// A video row that keeps focus for PREVIEW_DWELL_SECONDS gets a muted preview
+// at its right end. Moving on stops it at once; the worker winds down on its
+// own, so nothing here waits for it.
+static void update_preview(const std::string &path, ImVec2 row_min, ImVec2 row_max) {
+    if (path != preview_path) {
+        stop_preview();
+        preview_path = path;
+        preview_since = ImGui::GetTime();
+    }
+    if (preview_path.empty()) return;
+    if (!preview_running && ImGui::GetTime() - preview_since >= PREVIEW_DWELL_SECONDS) {
+        video_preview_start(media_root + join_relative(relative_dir, preview_path));
+        preview_running = true;
+    }
+
+    int w, h;
+    if (video_preview_take_frame(&preview_px, &w, &h)) {
+        if (!preview_tex || preview_tex->Width != w || preview_tex->Height != h) {
+            destroy_texture(preview_tex);
+            preview_tex = create_texture(preview_px, w, h);
+        } else {
+            memcpy(preview_tex->GetPixels(), preview_px.data(), preview_px.size() * sizeof(uint32_t));
+            preview_tex->Updates.resize(0);
+            preview_tex->Updates.push_back({0, 0, (unsigned short)w, (unsigned short)h});
+            preview_tex->SetStatus(ImTextureStatus_WantUpdates);
+            ImGui_ImplGX2_HandleTexture(preview_tex);
+        }
+    }
+    if (!preview_tex) return;
 
+    float ph = row_max.y - row_min.y;
+    float pw = ph * preview_tex->Width / preview_tex->Height;
+    ImGui::GetWindowDrawList()->AddImage(preview_tex->TexID, ImVec2(row_max.x - pw, row_min.y), ImVec2(row_max.x, row_max.y));
+}
+
+// Covers the row's icon square with the poster, cropped to the centre. A
+// video without an entry yet is added to want.
+static void draw_poster(const std::string &path, ImVec2 row_min, float size, std::vector<std::string> *want) {
+    auto it = posters.find(path);
+    if (it == posters.end()) {
+        want->push_back(path);
+        return;
+    }
+    it->second.last_used = frame_no;
+    ImTextureData *tex = it->second.texture;
+    if (!tex) return;
+
+    float crop_u = tex->Width > tex->Height ? 0.5f * (1.0f - (float)tex->Height / tex->Width) : 0.0f;
+    float crop_v = tex->Height > tex->Width ? 0.5f * (1.0f - (float)tex->Width / tex->Height) : 0.0f;
+    ImGui::GetWindowDrawList()->AddImage(tex->TexID, row_min, ImVec2(row_min.x + size, row_min.y + size), ImVec2(crop_u, crop_v), ImVec2(1.0f - crop_u, 1.0f - crop_v));
+}
+
+// Takes in finished posters, drops the least recently drawn textures past
+// POSTER_TEXTURE_CACHE and tells the service which rows still need one.
+static void update_posters(std::vector<std::string> &want) {
+    PosterFrame p;
+    while (poster_frames_take(&p)) {
+        Poster &entry = posters[p.path];
+        destroy_texture(entry.texture);
+        entry.texture = p.w > 0 ? create_texture(p.rgba, p.w, p.h) : nullptr;
+        entry.last_used = frame_no;
+    }
+    want.erase(std::remove_if(want.begin(), want.end(), [](const std::string &path) { return posters.count(path) != 0; }), want.end());
+
+    size_t textures = 0;
+    for (const auto &kv : posters)
+        if (kv.second.texture) textures++;
+    while (textures > POSTER_TEXTURE_CACHE) {
+        auto victim = posters.end();
+        for (auto it = posters.begin(); it != posters.end(); ++it)
+            if (it->second.texture && (victim == posters.end() || it->second.last_used < victim->second.last_used)) victim = it;
+        if (victim->second.last_used == frame_no) break; // everything is on screen
+        destroy_texture(victim->second.texture);
+        posters.erase(victim);
+        textures--;
+    }
+
+    if (want != posters_wanted) {
+        poster_frames_want(want);
+        posters_wanted = want;
+    }
+}
+
+// A file row that keeps focus for PREOPEN_DWELL_SECONDS is opened on the
+// preopen worker, so its viewer finds the container probed, the picture
+// decoded or the first page drawn. Moving on cancels the job; the last
+// couple of results stay around in case focus comes back.
+static void update_preopen(const file &f) {
+    std::string path = f.file_type != FILE_FOLDER ? media_root + join_relative(relative_dir, f.path) : "";
+    if (path != preopen_path) {
+        preopen_path = path;
+        preopen_since = ImGui::GetTime();
+        preopen_started = false;
+    }
+    if (path.empty() || preopen_started || ImGui::GetTime() - preopen_since < PREOPEN_DWELL_SECONDS) return;
+    auto it = type_info_map.find(f.file_type);
+    if (it != type_info_map.end()) preopen_start(preopen_path, it->second.media_char);
+    preopen_started = true;
+}
+
+static void start_file(const file &f) {
     auto it = type_info_map.find(f.file_type);
 
     if (it == type_info_map.end()) {
@@ -90,6 +244,7 @@ static void start_file(const file &f) {
     }
 
     const TypeInfo &info_type = it->second;
+    stop_preview();
 
     auto new_info = std::make_unique<media_info>();
     media_info_set(std::move(new_info));
@@ -113,6 +268,7 @@ static void start_file(const file &f) {
         info->total_caption_count = 1;
     }
 
+    opening_path = info->path;
     app_state_set(info_type.next_state);
 }
 
@@ -127,6 +283,7 @@ static void scan_relative_directory(const std::string &new_relative_dir) {
         return;
     }
 
+    stop_preview();
     files.clear();
     relative_dir = new_relative_dir;
 
@@ -168,6 +325,20 @@ void scene_file_browser_go_up() {
     scan_relative_directory(parent_relative(relative_dir));
 }
 
+void scene_file_browser_shutdown() {
+    stop_preview();
+    // Whatever was made for the file being opened stays for its viewer.
+    preopen_cancel(opening_path);
+    opening_path.clear();
+    preopen_path.clear();
+    preopen_started = false;
+    poster_frames_want({});
+    posters_wanted.clear();
+    for (auto &kv : posters)
+        destroy_texture(kv.second.texture);
+    posters.clear();
+}
+
 void scene_file_browser_input(InputState &input) {
     if (input_pressed(input, BTN_B)) {
         scene_file_browser_go_up();
@@ -188,8 +359,21 @@ void scene_file_browser_render() {
 
         ImGui::BeginChild("FileList", ImVec2(0, 0), true, ImGuiWindowFlags_None);
 
+        frame_no++;
+        std::string focused;
+        ImVec2 focused_min, focused_max;
+        std::vector<std::string> want;
+        file focused_file{"", FILE_FOLDER};
         for (const file &f : files) {
-            if (widget_button_icon(f.path.c_str(), file_icons.at(f.file_type), false, ImVec2(-1, 64))) {
+            bool clicked = widget_button_icon(f.path.c_str(), file_icons.at(f.file_type), false, ImVec2(-1, 64));
+            if (f.file_type == FILE_VIDEO && ImGui::IsItemVisible()) draw_poster(media_root + join_relative(relative_dir, f.path), ImGui::GetItemRectMin(), 64, &want);
+            if (f.file_type == FILE_VIDEO && (ImGui::IsItemFocused() || ImGui::IsItemHovered())) {
+                focused = f.path;
+                focused_min = ImGui::GetItemRectMin();
+                focused_max = ImGui::GetItemRectMax();
+            }
+            if (ImGui::IsItemFocused() || ImGui::IsItemHovered()) focused_file = f;
+            if (clicked) {
                 if (f.file_type == FILE_FOLDER) {
                     if (f.path == "..") {
                         scene_file_browser_go_up();
@@ -201,6 +385,9 @@ void scene_file_browser_render() {
                 }
             }
         }
+        update_preview(focused, focused_min, focused_max);
+        update_preopen(focused_file);
+        update_posters(want);
 
         ImGui::EndChild();
         ImGui::Columns(1);
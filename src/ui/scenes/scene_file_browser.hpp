@@ -6,5 +6,6 @@
 void scene_file_browser_cd(const char *path);
 void scene_file_browser_input(InputState &input);
 void scene_file_browser_render();
+void scene_file_browser_shutdown();
 
 #endif
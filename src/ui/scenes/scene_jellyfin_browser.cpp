@@ -0,0 +1,455 @@
+#include "ui/scenes/scene_jellyfin_browser.hpp"
+
+#include "input/input_actions.hpp"
+#include "logger/logger.hpp"
+#include "main.hpp"
+#include "network/download_queue.hpp"
+#include "network/jellyfin.hpp"
+#include "ui/widgets/widget_sidebar.hpp"
+#include "ui/widgets/widget_tooltip.hpp"
+#include "utils/app_state.hpp"
+#include "utils/display.hpp"
+#include "utils/font.hpp"
+#include "utils/media_info.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <imgui/backends/imgui_impl_gx2.h>
+#include <imgui/imgui.h>
+#include <mutex>
+#include <stb_image.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define JB "Jellyfin Browser"
+
+#define JB_ROW_HEIGHT 96.0f
+#define JB_POSTER_W 64
+#define JB_POSTER_H 96
+#define JB_THUMB_CACHE 96
+#define JB_UPLOADS_PER_FRAME 2
+
+// Everything network-bound runs on one worker thread; the UI thread only
+// consumes finished results, a bounded number of texture uploads per frame.
+enum class JobType { Page, Image, Play };
+
+struct Job {
+    JobType type;
+    int generation;
+    std::string parent_id;
+    int page;
+    JellyfinItem item;
+};
+
+struct Result {
+    JobType type = JobType::Page;
+    int generation = 0;
+    int page = 0;
+    bool ok = false;
+    bool skipped = false; // image no longer on screen, not fetched
+    JellyfinPage items;
+    std::string item_id;
+    std::vector<uint8_t> rgba;
+    int w = 0, h = 0;
+    JellyfinItem play_item;
+    std::string url;
+};
+
+struct Level {
+    std::string parent_id;
+    std::string name;
+    JellyfinPager pager;
+    float scroll_y = 0.0f;
+};
+
+struct Thumb {
+    ImTextureData *texture = nullptr;
+    uint64_t last_used = 0;
+};
+
+static std::vector<Level> levels;
+static int generation = 0;
+static uint64_t frame_no = 0;
+
+static std::unordered_map<std::string, Thumb> thumbs;
+static std::unordered_set<std::string> thumbs_requested;
+static std::unordered_set<std::string> thumbs_failed;
+
+static std::thread worker;
+static std::mutex mtx;
+static std::condition_variable cv;
+static std::deque<Job> jobs;
+static std::deque<Result> results;
+static std::unordered_set<std::string> wanted_images; // rows on screen, guarded by mtx
+static bool worker_quit = false;
+static std::atomic<bool> worker_abort{false}; // cuts short the request in flight at shutdown
+static bool opening = false; // a Play job is negotiating with the server
+static bool download_pressed = false;
+
+static void worker_thread() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [] { return worker_quit || !jobs.empty(); });
+            if (worker_quit) return;
+
+            // The user waiting on playback comes first, then pages: a row
+            // without a name is worse than one without art.
+            auto it = jobs.begin();
+            for (auto j = jobs.begin(); j != jobs.end(); ++j) {
+                if (j->type == JobType::Play) {
+                    it = j;
+                    break;
+                }
+                if (j->type == JobType::Page && it->type == JobType::Image) it = j;
+            }
+            job = std::move(*it);
+            jobs.erase(it);
+
+            if (job.type == JobType::Image && !wanted_images.count(job.item.id)) {
+                Result skip;
+                skip.type = JobType::Image;
+                skip.skipped = true;
+                skip.item_id = job.item.id;
+                results.push_back(std::move(skip));
+                continue;
+            }
+        }
+
+        Result res;
+        res.type = job.type;
+        res.generation = job.generation;
+        res.page = job.page;
+        res.item_id = job.item.id;
+        if (job.type == JobType::Page) {
+            res.ok = jellyfin_fetch_page(job.parent_id, job.page * JELLYFIN_PAGE_SIZE, JELLYFIN_PAGE_SIZE, &res.items, &worker_abort);
+        } else if (job.type == JobType::Play) {
+            res.ok = jellyfin_resolve_stream(job.item, &res.url, &worker_abort);
+            res.play_item = job.item;
+        } else {
+            std::string bytes;
+            if (jellyfin_fetch_image(job.item, JB_POSTER_W, JB_POSTER_H, &bytes, &worker_abort)) {
+                int w, h, comp;
+                uint8_t *px = stbi_load_from_memory((const stbi_uc *)bytes.data(), (int)bytes.size(), &w, &h, &comp, 4);
+                if (px) {
+                    res.rgba.assign(px, px + (size_t)w * h * 4);
+                    res.w = w;
+                    res.h = h;
+                    res.ok = true;
+                    stbi_image_free(px);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lk(mtx);
+        results.push_back(std::move(res));
+    }
+}
+
+static void post_job(Job job) {
+    if (!worker.joinable()) {
+        worker_quit = false;
+        worker_abort = false;
+        worker = std::thread(worker_thread);
+    }
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        jobs.push_back(std::move(job));
+    }
+    cv.notify_one();
+}
+
+static ImTextureData *create_texture_rgba(const uint8_t *rgba, int width, int height) {
+    ImTextureData *tex = IM_NEW(ImTextureData);
+    tex->Create(ImTextureFormat_RGBA32, width, height);
+
+    uint32_t *dst = reinterpret_cast<uint32_t *>(tex->GetPixels());
+    for (int i = 0; i < width * height; ++i) dst[i] = (rgba[i * 4 + 3] << 24) | (rgba[i * 4 + 2] << 16) | (rgba[i * 4 + 1] << 8) | rgba[i * 4 + 0];
+
+    tex->SetStatus(ImTextureStatus_WantCreate);
+    ImGui_ImplGX2_HandleTexture(tex);
+    return tex;
+}
+
+static void destroy_texture(ImTextureData *tex) {
+    if (!tex) return;
+    tex->SetStatus(ImTextureStatus_WantDestroy);
+    ImGui_ImplGX2_HandleTexture(tex);
+    IM_DELETE(tex);
+}
+
+static void evict_thumbs() {
+    while (thumbs.size() > JB_THUMB_CACHE) {
+        auto victim = thumbs.begin();
+        for (auto it = thumbs.begin(); it != thumbs.end(); ++it)
+            if (it->second.last_used < victim->second.last_used) victim = it;
+        if (victim->second.last_used == frame_no) break; // everything is on screen
+        destroy_texture(victim->second.texture);
+        thumbs.erase(victim);
+    }
+}
+
+static void play_url(const JellyfinItem &item, const std::string &url) {
+    auto info = std::make_unique<media_info>();
+    info->type = item.media_type == "Audio" ? 'A' : 'V';
+    info->path = url;
+    info->filename = item.name;
+    info->remote = true;
+    media_info_set(std::move(info));
+
+    app_state_set(item.media_type == "Audio" ? STATE_PLAYING_AUDIO : STATE_PLAYING_VIDEO);
+}
+
+static void consume_results() {
+    std::deque<Result> done;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        int uploads = 0;
+        while (!results.empty()) {
+            if (results.front().type == JobType::Image && results.front().ok && uploads >= JB_UPLOADS_PER_FRAME) break;
+            if (results.front().type == JobType::Image && results.front().ok) uploads++;
+            done.push_back(std::move(results.front()));
+            results.pop_front();
+        }
+    }
+
+    for (Result &r : done) {
+        if (r.type == JobType::Play) {
+            opening = false;
+            if (r.ok) play_url(r.play_item, r.url);
+            continue;
+        }
+        if (r.type == JobType::Image) {
+            thumbs_requested.erase(r.item_id);
+            if (!r.ok && !r.skipped) thumbs_failed.insert(r.item_id);
+            if (r.ok && !thumbs.count(r.item_id)) thumbs[r.item_id] = {create_texture_rgba(r.rgba.data(), r.w, r.h), frame_no};
+            continue;
+        }
+        if (r.generation != generation || levels.empty()) continue;
+
+        jellyfin_pager_store(&levels.back().pager, r.page, r.ok, &r.items);
+    }
+    evict_thumbs();
+}
+
+static void request_page(Level &lvl, int page) {
+    if (!jellyfin_pager_request(&lvl.pager, page)) return;
+    post_job({JobType::Page, generation, lvl.parent_id, page, {}});
+}
+
+static void enter_level(const std::string &parent_id, const std::string &name) {
+    generation++;
+    levels.push_back({parent_id, name});
+    request_page(levels.back(), 0);
+}
+
+static void go_up() {
+    if (levels.size() <= 1) return;
+    generation++;
+    levels.pop_back();
+    // Pages in flight for the old level are dropped, so ask again.
+    jellyfin_pager_forget_requests(&levels.back().pager);
+}
+
+static const JellyfinItem *item_at(Level &lvl, int index) {
+    int missing;
+    const JellyfinItem *item = jellyfin_pager_item(lvl.pager, index, &missing);
+    if (missing >= 0) request_page(lvl, missing);
+    return item;
+}
+
+static void start_item(const JellyfinItem &item) {
+    if (item.is_folder) {
+        enter_level(item.id, item.name);
+        return;
+    }
+    if (item.media_type != "Video" && item.media_type != "Audio") {
+        log_message(LOG_WARNING, JB, "Cannot play '%s' (%s)", item.name.c_str(), item.type.c_str());
+        return;
+    }
+    if (opening) return;
+
+    // Direct play or transcode is negotiated on the worker.
+    opening = true;
+    post_job({JobType::Play, generation, "", 0, item});
+}
+
+void scene_jellyfin_browser_open() {
+    generation++;
+    levels.clear();
+    if (!jellyfin_configured()) {
+        log_message(LOG_WARNING, JB, "No Jellyfin server configured");
+        return;
+    }
+    enter_level("", "Jellyfin");
+}
+
+void scene_jellyfin_browser_input(InputState &input) {
+    if (input_pressed(input, BTN_B)) go_up();
+    if (input_pressed(input, BTN_X)) download_pressed = true;
+}
+
+static void queue_download(const JellyfinItem &item) {
+    if (item.media_type != "Video" && item.media_type != "Audio") return;
+    download_queue_add(jellyfin_download_url(item), jellyfin_download_name(item));
+}
+
+static void download_status() {
+    int queued = 0;
+    const DownloadInfo *active = nullptr;
+    std::vector<DownloadInfo> list = download_queue_list();
+    for (const DownloadInfo &d : list) {
+        if (d.state == DownloadState::Queued) queued++;
+        if (d.state == DownloadState::Active) active = &d;
+    }
+    if (active && active->size > 0) {
+        ImGui::Text("%s Downloading %s: %d%% (%.1f MB/s), %d queued", ICON_DOWNLOAD, active->name.c_str(), (int)(active->done * 100 / active->size), active->bps / (1024.0 * 1024.0), queued);
+    } else if (active) {
+        ImGui::Text("%s Downloading %s, %d queued", ICON_DOWNLOAD, active->name.c_str(), queued);
+    } else if (queued) {
+        ImGui::Text("%s %d downloads waiting", ICON_DOWNLOAD, queued);
+    }
+}
+
+static bool poster_row(const JellyfinItem *item, int index) {
+    ImGui::PushID(index);
+    bool clicked = ImGui::Button("##jf_row", ImVec2(-1, JB_ROW_HEIGHT));
+    ImVec2 p0 = ImGui::GetItemRectMin();
+    ImDrawList *dl = ImGui::GetWindowDrawList();
+
+    ImVec2 poster_min(p0.x, p0.y);
+    ImVec2 poster_max(p0.x + JB_POSTER_W, p0.y + JB_POSTER_H);
+    dl->AddRectFilled(poster_min, poster_max, ImGui::GetColorU32(ImGuiCol_FrameBg));
+
+    const char *label = "...";
+    if (item) {
+        label = item->name.c_str();
+        auto it = thumbs.find(item->id);
+        if (it != thumbs.end()) {
+            it->second.last_used = frame_no;
+            dl->AddImage(it->second.texture->TexID, poster_min, poster_max);
+        } else if (!item->primary_image_tag.empty() && !thumbs_failed.count(item->id)) {
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                wanted_images.insert(item->id);
+            }
+            if (!thumbs_requested.count(item->id)) {
+                thumbs_requested.insert(item->id);
+                post_job({JobType::Image, generation, "", 0, *item});
+            }
+        } else {
+            ImGui::SetWindowFontScale(2.0f);
+            const char *icon = item->is_folder ? ICON_FOLDER : item->media_type == "Audio" ? ICON_AUDIO : ICON_VIDEO;
+            ImVec2 ts = ImGui::CalcTextSize(icon);
+            dl->AddText(ImVec2(p0.x + (JB_POSTER_W - ts.x) * 0.5f, p0.y + (JB_POSTER_H - ts.y) * 0.5f), ImGui::GetColorU32(ImGuiCol_Text), icon);
+            ImGui::SetWindowFontScale(1.0f);
+        }
+    }
+
+    dl->AddText(ImVec2(p0.x + JB_POSTER_W + 12.0f, p0.y + (JB_ROW_HEIGHT - ImGui::GetTextLineHeight()) * 0.5f), ImGui::GetColorU32(ImGuiCol_Text), label);
+    ImGui::PopID();
+    return clicked && item;
+}
+
+void scene_jellyfin_browser_render() {
+    frame_no++;
+    consume_results();
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        wanted_images.clear();
+    }
+
+    ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar;
+
+    if (ImGui::Begin(VERSION_STRING, nullptr, window_flags)) {
+        ImGui::SetWindowPos(ImVec2(0, 0));
+        ImGui::SetWindowSize(ImVec2(display_get().width, display_get().height - TOOLTIP_BAR_HEIGHT));
+
+        ImGui::Columns(2, nullptr, false);
+        ImGui::SetColumnWidth(0, 200.0f);
+        widget_sidebar_render();
+        ImGui::NextColumn();
+
+        ImGui::BeginChild("JellyfinList", ImVec2(0, 0), true, ImGuiWindowFlags_None);
+
+        if (levels.empty()) {
+            ImGui::Text("Set a Jellyfin server URL and API key in the settings.");
+        } else {
+            Level &lvl = levels.back();
+            JellyfinItem clicked;
+            bool has_clicked = false;
+            JellyfinItem focused;
+            bool has_focused = false;
+
+            download_status();
+            if (opening) ImGui::Text("Opening...");
+            int total = lvl.pager.total;
+            if (total < 0) {
+                ImGui::Text("Loading %s...", lvl.name.c_str());
+            } else if (total == 0) {
+                ImGui::Text("%s is empty.", lvl.name.c_str());
+            } else {
+                // Only the rows on screen are laid out, so cost is independent
+                // of the library size.
+                ImGuiListClipper clipper;
+                clipper.Begin(total, JB_ROW_HEIGHT + ImGui::GetStyle().ItemSpacing.y);
+                int visible_end = 0; // End() resets DisplayEnd, so keep our own
+                while (clipper.Step()) {
+                    visible_end = std::max(visible_end, clipper.DisplayEnd);
+                    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+                        const JellyfinItem *item = item_at(lvl, i);
+                        if (poster_row(item, i)) {
+                            clicked = *item;
+                            has_clicked = true;
+                        }
+                        if (item && (ImGui::IsItemFocused() || ImGui::IsItemHovered())) {
+                            focused = *item;
+                            has_focused = true;
+                        }
+                    }
+                }
+                // Keep one page of look-ahead below the visible range.
+                item_at(lvl, std::min(total - 1, visible_end + JELLYFIN_PAGE_SIZE / 2));
+            }
+
+            if (has_clicked) start_item(clicked);
+            if (download_pressed && has_focused) queue_download(focused);
+        }
+
+        ImGui::EndChild();
+        ImGui::Columns(1);
+        ImGui::End();
+    }
+
+    download_pressed = false;
+    widget_tooltip_render();
+}
+
+void scene_jellyfin_browser_shutdown() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            worker_quit = true;
+            jobs.clear();
+        }
+        // The join waits only for the HTTP client to notice the flag, not for
+        // the request to time out.
+        worker_abort = true;
+        cv.notify_all();
+        worker.join();
+    }
+    results.clear();
+    for (auto &t : thumbs) destroy_texture(t.second.texture);
+    thumbs.clear();
+    thumbs_requested.clear();
+    thumbs_failed.clear();
+    opening = false;
+    // Queued work was dropped; let the pages be requested again on return.
+    for (Level &lvl : levels) jellyfin_pager_forget_requests(&lvl.pager);
+}
@@ -0,0 +1,11 @@
+#ifndef UI_JELLYFIN_BROWSER_HPP
+#define UI_JELLYFIN_BROWSER_HPP
+
+#include "input/input_actions.hpp"
+
+void scene_jellyfin_browser_open();
+void scene_jellyfin_browser_input(InputState &input);
+void scene_jellyfin_browser_render();
+void scene_jellyfin_browser_shutdown();
+
+#endif
@@ -5,8 +5,10 @@
 #include "player/media_player.hpp"
 #include "player/photo_viewer.hpp"
 #include "ui/scenes/scene_file_browser.hpp"
+#include "ui/widgets/widget_captions.hpp"
 #include "ui/widgets/widget_player_hud.hpp"
 #include "utils/app_state.hpp"
+#include "utils/display.hpp"
 #include "utils/media_info.hpp"
 
 #include <imgui/imgui.h>
@@ -15,20 +17,62 @@
 
 static bool show_hud = false;
 
+// Audio-only playback redraws only when what the HUD shows has changed.
+// Each change is drawn twice so both scan buffers carry it.
+#define HUD_REDRAW_FRAMES 2
+
+static int64_t last_hud_signature = -1;
+static int hud_redraw_frames = 0;
+
 ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoBackground;
 
 void scene_media_player_init(std::string full_path) {
-    if (media_info_get()->type == 'A') {
-        std::string cover_path = full_path.substr(0, full_path.find_last_of('/') + 1) + "folder.jpg";
+    media_player_init(full_path.c_str());
 
+    if (media_info_get()->type == 'A') {
         photo_viewer_init();
-        photo_viewer_open_picture(cover_path.c_str());
+
+        const uint8_t *cover = nullptr;
+        size_t cover_size = 0;
+        if (media_player_get_cover_art(&cover, &cover_size)) {
+            photo_viewer_open_picture_memory(cover, cover_size, display_get().height);
+        } else if (!media_info_get()->remote) {
+            std::string cover_path = full_path.substr(0, full_path.find_last_of('/') + 1) + "folder.jpg";
+            photo_viewer_open_picture(cover_path.c_str());
+        }
     }
 
-    media_player_init(full_path.c_str());
+    last_hud_signature = -1;
+    hud_redraw_frames = HUD_REDRAW_FRAMES;
     media_player_play(true);
 }
 
+static int64_t hud_signature(const media_info *info) {
+    bool hud_visible = !info->playback_status || show_hud;
+    int64_t sig = hud_visible ? 1 : 0;
+    sig = sig * 2 + (info->playback_status ? 1 : 0);
+    sig = sig * 64 + info->current_audio_track_id;
+    if (hud_visible) sig = sig * 1000000 + info->current_playback_time;
+    return sig;
+}
+
+bool scene_media_player_idle() {
+    if (!media_player_is_audio_only()) return false;
+
+    media_player_update();
+
+    int64_t sig = hud_signature(media_info_get());
+    if (sig != last_hud_signature) {
+        last_hud_signature = sig;
+        hud_redraw_frames = HUD_REDRAW_FRAMES;
+    }
+    if (hud_redraw_frames > 0) {
+        hud_redraw_frames--;
+        return false;
+    }
+    return true;
+}
+
 void scene_media_player_render() {
     media_player_update();
 
@@ -36,6 +80,15 @@ void scene_media_player_render() {
         photo_texture_zoom(0.0f);
         photo_viewer_pan(0, 0);
         photo_viewer_render();
+    } else {
+        const std::vector<SubtitleCue> *cues = nullptr;
+        bool changed = media_player_get_subtitles(&cues);
+        widget_captions_render(*cues, changed);
+
+        const SubtitleBitmap *bmp = nullptr;
+        rect video;
+        changed = media_player_get_subtitle_bitmap(&bmp, &video);
+        widget_captions_render_bitmap(bmp, changed, video);
     }
 
     if (!media_info_get()->playback_status || show_hud) {
@@ -48,12 +101,14 @@ void scene_media_player_input(InputState &input) {
         bool is_playing = media_info_get()->playback_status;
         media_player_play(!is_playing);
     } else if (input_pressed(input, BTN_B)) {
+        widget_captions_clear();
         media_player_cleanup();
-	app_state_set(STATE_MENU_FILES);
-    } else if (input_pressed(input, BTN_LEFT)) {
+        app_state_set(media_info_get()->remote ? STATE_MENU_JELLYFIN : STATE_MENU_FILES);
+    } else if (input_repeated(input, BTN_LEFT)) {
+        // Held directions scrub; the player coalesces the requests.
         double current_time = media_player_get_current_time();
         media_player_seek(current_time - 5.0);
-    } else if (input_pressed(input, BTN_RIGHT)) {
+    } else if (input_repeated(input, BTN_RIGHT)) {
         double current_time = media_player_get_current_time();
         media_player_seek(current_time + 5.0);
     } else if (input_pressed(input, BTN_X)) {
@@ -78,6 +133,11 @@ void scene_media_player_input(InputState &input) {
         if (media_player_switch_audio_track(next_stream_index)) {
             media_info_get()->current_audio_track_id = next_index + 1;
         }
+    } else if (input_pressed(input, BTN_Y)) {
+        // Off, then each track in turn.
+        int count = media_info_get()->total_caption_count;
+        if (count == 0) return;
+        media_player_select_subtitle((media_player_get_current_subtitle() + 2) % (count + 1) - 1);
     } else if (input_touched(input) || input.valid_cursor) {
         show_hud = true;
     } else {
@@ -86,6 +146,7 @@ void scene_media_player_input(InputState &input) {
 }
 
 void scene_media_player_shutdown() {
+    widget_captions_clear();
     photo_viewer_cleanup();
     media_player_cleanup();
 }
@@ -1 +1,295 @@
-#include "widget_captions.hpp"
+#include "ui/widgets/widget_captions.hpp"
+
+#include "logger/logger.hpp"
+#include "utils/display.hpp"
+
+#include <algorithm>
+#include <coreinit/memory.h>
+#include <cstdint>
+#include <cstring>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <harfbuzz/hb-ft.h>
+#include <harfbuzz/hb.h>
+#include <imgui/backends/imgui_impl_gx2.h>
+#include <imgui/imgui.h>
+#include <string>
+
+#define CAP "Captions"
+
+#define CAPTION_CACHE_SIZE 8          // textures kept, the ones on screen included
+#define CAPTION_FONT_DIVISOR 18       // font size in pixels: screen height / this
+#define CAPTION_OUTLINE 3             // black border around the glyphs, pixels
+#define CAPTION_MAX_WIDTH 0.9f        // share of the screen width a line may take
+#define CAPTION_BOTTOM_MARGIN 0.06f   // share of the screen height below the last line
+
+struct CaptionTexture {
+    std::string text;
+    ImTextureData *texture = nullptr;
+    ImTextureID tex_id = 0;
+    int width = 0;
+    int height = 0;
+    uint64_t last_used = 0;
+};
+
+struct Glyph {
+    unsigned index;
+    int x, y; // 26.6, relative to the line origin
+};
+
+struct ShapedLine {
+    std::vector<Glyph> glyphs;
+    int width = 0;
+};
+
+static std::vector<CaptionTexture> cache;
+static std::vector<size_t> shown; // cache slots of the cues on screen, in cue order
+static CaptionTexture bitmap;     // the bitmap subtitle on screen
+static uint64_t use_clock = 0;
+
+static FT_Library ft_lib = nullptr;
+static FT_Face ft_face = nullptr;
+static hb_font_t *hb_font = nullptr;
+static bool font_failed = false;
+
+// The console's standard shared font, the same one the UI uses.
+static bool load_font() {
+    if (hb_font) return true;
+    if (font_failed) return false;
+    font_failed = true;
+
+    void *data = nullptr;
+    uint32_t size = 0;
+    if (!OSGetSharedData(OS_SHAREDDATATYPE_FONT_STANDARD, 0, &data, &size)) {
+        log_message(LOG_ERROR, CAP, "Shared font not available");
+        return false;
+    }
+    if (!ft_lib && FT_Init_FreeType(&ft_lib)) {
+        log_message(LOG_ERROR, CAP, "FT_Init_FreeType failed");
+        return false;
+    }
+    if (FT_New_Memory_Face(ft_lib, (const FT_Byte *)data, (FT_Long)size, 0, &ft_face)) {
+        log_message(LOG_ERROR, CAP, "FT_New_Memory_Face failed");
+        return false;
+    }
+    FT_Set_Pixel_Sizes(ft_face, 0, display_get().height / CAPTION_FONT_DIVISOR);
+    hb_font = hb_ft_font_create_referenced(ft_face);
+    font_failed = false;
+    return true;
+}
+
+// Shapes text[begin, end) into lines no wider than max_width, breaking at
+// spaces. A word wider than a line stays whole.
+static void shape_paragraph(hb_buffer_t *buf, const std::string &text, size_t begin, size_t end, int max_width, std::vector<ShapedLine> *lines) {
+    while (begin < end) {
+        hb_buffer_clear_contents(buf);
+        hb_buffer_add_utf8(buf, text.data(), (int)text.size(), (unsigned)begin, (int)(end - begin));
+        hb_buffer_guess_segment_properties(buf);
+        hb_shape(hb_font, buf, nullptr, 0);
+
+        unsigned n = 0;
+        const hb_glyph_info_t *info = hb_buffer_get_glyph_infos(buf, &n);
+        const hb_glyph_position_t *pos = hb_buffer_get_glyph_positions(buf, &n);
+
+        ShapedLine line;
+        int x = 0;
+        size_t brk = 0, brk_glyphs = 0;
+        int brk_x = 0;
+        unsigned i = 0;
+        for (; i < n; ++i) {
+            if (text[info[i].cluster] == ' ' && info[i].cluster > begin) {
+                brk = info[i].cluster;
+                brk_glyphs = line.glyphs.size();
+                brk_x = x;
+            }
+            if (((x + pos[i].x_advance) >> 6) > max_width && brk) break;
+            line.glyphs.push_back({info[i].codepoint, x + pos[i].x_offset, pos[i].y_offset});
+            x += pos[i].x_advance;
+        }
+        if (i == n) {
+            line.width = x >> 6;
+            lines->push_back(std::move(line));
+            return;
+        }
+        line.glyphs.resize(brk_glyphs);
+        line.width = brk_x >> 6;
+        lines->push_back(std::move(line));
+        begin = brk + 1;
+    }
+}
+
+// Grows the glyph coverage by radius in both directions; the result is the
+// coverage of the outline.
+static std::vector<uint8_t> dilate(const std::vector<uint8_t> &mask, int w, int h, int radius) {
+    std::vector<uint8_t> tmp(mask.size()), out(mask.size());
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x) {
+            uint8_t m = 0;
+            for (int k = std::max(0, x - radius); k <= std::min(w - 1, x + radius); ++k)
+                m = std::max(m, mask[y * w + k]);
+            tmp[y * w + x] = m;
+        }
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x) {
+            uint8_t m = 0;
+            for (int k = std::max(0, y - radius); k <= std::min(h - 1, y + radius); ++k)
+                m = std::max(m, tmp[k * w + x]);
+            out[y * w + x] = m;
+        }
+    return out;
+}
+
+static bool rasterize(const std::string &text, CaptionTexture *out) {
+    if (!load_font()) return false;
+
+    int max_width = (int)(display_get().width * CAPTION_MAX_WIDTH) - 2 * CAPTION_OUTLINE;
+    std::vector<ShapedLine> lines;
+    hb_buffer_t *buf = hb_buffer_create();
+    for (size_t i = 0; i <= text.size();) {
+        size_t e = text.find('\n', i);
+        if (e == std::string::npos) e = text.size();
+        shape_paragraph(buf, text, i, e, max_width, &lines);
+        i = e + 1;
+    }
+    hb_buffer_destroy(buf);
+    if (lines.empty()) return false;
+
+    int text_w = 0;
+    for (const ShapedLine &l : lines)
+        text_w = std::max(text_w, l.width);
+    const int pad = CAPTION_OUTLINE + 1;
+    const int line_h = (int)(ft_face->size->metrics.height >> 6);
+    const int ascent = (int)(ft_face->size->metrics.ascender >> 6);
+    const int w = text_w + 2 * pad;
+    const int h = line_h * (int)lines.size() + 2 * pad;
+
+    std::vector<uint8_t> mask((size_t)w * h, 0);
+    for (size_t li = 0; li < lines.size(); ++li) {
+        int ox = pad + (text_w - lines[li].width) / 2;
+        int baseline = pad + (int)li * line_h + ascent;
+        for (const Glyph &g : lines[li].glyphs) {
+            if (FT_Load_Glyph(ft_face, g.index, FT_LOAD_RENDER)) continue;
+            const FT_GlyphSlot gs = ft_face->glyph;
+            const FT_Bitmap &bm = gs->bitmap;
+            int gx = ox + (g.x >> 6) + gs->bitmap_left;
+            int gy = baseline - (g.y >> 6) - gs->bitmap_top;
+            for (int r = 0; r < (int)bm.rows; ++r) {
+                int y = gy + r;
+                if (y < 0 || y >= h) continue;
+                for (int c = 0; c < (int)bm.width; ++c) {
+                    int x = gx + c;
+                    if (x < 0 || x >= w) continue;
+                    uint8_t &m = mask[(size_t)y * w + x];
+                    m = std::max(m, bm.buffer[r * bm.pitch + c]);
+                }
+            }
+        }
+    }
+    std::vector<uint8_t> outline = dilate(mask, w, h, CAPTION_OUTLINE);
+
+    // White glyphs over their black outline, straight alpha.
+    ImTextureData *tex = IM_NEW(ImTextureData);
+    tex->Create(ImTextureFormat_RGBA32, w, h);
+    uint32_t *px = reinterpret_cast<uint32_t *>(tex->GetPixels());
+    for (size_t i = 0; i < mask.size(); ++i) {
+        uint32_t m = mask[i], o = outline[i];
+        uint32_t a = m + o * (255 - m) / 255;
+        uint32_t c = a ? m * 255 / a : 0;
+        px[i] = (a << 24) | (c << 16) | (c << 8) | c;
+    }
+    tex->SetStatus(ImTextureStatus_WantCreate);
+    ImGui_ImplGX2_HandleTexture(tex);
+
+    out->text = text;
+    out->texture = tex;
+    out->tex_id = tex->TexID;
+    out->width = w;
+    out->height = h;
+    return true;
+}
+
+static void destroy_caption(CaptionTexture &c) {
+    if (c.texture) {
+        c.texture->SetStatus(ImTextureStatus_WantDestroy);
+        ImGui_ImplGX2_HandleTexture(c.texture);
+        IM_DELETE(c.texture);
+    }
+    c = CaptionTexture{};
+}
+
+// Maps the cues to cache slots, rasterizing the ones not cached yet into the
+// least recently shown slot.
+static void refresh(const std::vector<SubtitleCue> &cues) {
+    shown.clear();
+    use_clock++;
+    for (const SubtitleCue &cue : cues) {
+        auto hit = std::find_if(cache.begin(), cache.end(), [&](const CaptionTexture &c) { return c.text == cue.text; });
+        if (hit != cache.end()) {
+            hit->last_used = use_clock;
+            shown.push_back(hit - cache.begin());
+            continue;
+        }
+
+        size_t slot = cache.size();
+        if (cache.size() >= CAPTION_CACHE_SIZE) {
+            auto lru = std::min_element(cache.begin(), cache.end(), [](const CaptionTexture &a, const CaptionTexture &b) { return a.last_used < b.last_used; });
+            if (lru->last_used < use_clock) slot = lru - cache.begin();
+        }
+        CaptionTexture fresh;
+        if (!rasterize(cue.text, &fresh)) continue;
+        fresh.last_used = use_clock;
+        if (slot == cache.size()) {
+            cache.push_back(std::move(fresh));
+        } else {
+            destroy_caption(cache[slot]);
+            cache[slot] = std::move(fresh);
+        }
+        shown.push_back(slot);
+    }
+}
+
+void widget_captions_render(const std::vector<SubtitleCue> &cues, bool changed) {
+    if (changed) refresh(cues);
+    if (shown.empty()) return;
+
+    // Later cues sit lower, the way they read.
+    ImDrawList *draw = ImGui::GetBackgroundDrawList();
+    const scan_mode d = display_get();
+    float y = d.height * (1.0f - CAPTION_BOTTOM_MARGIN);
+    for (auto it = shown.rbegin(); it != shown.rend(); ++it) {
+        const CaptionTexture &c = cache[*it];
+        y -= c.height;
+        float x = (d.width - c.width) * 0.5f;
+        draw->AddImage(c.tex_id, ImVec2(x, y), ImVec2(x + c.width, y + c.height));
+    }
+}
+
+void widget_captions_render_bitmap(const SubtitleBitmap *bmp, bool changed, const rect &video) {
+    if (changed) {
+        destroy_caption(bitmap);
+        if (bmp && bmp->w > 0 && bmp->h > 0) {
+            ImTextureData *tex = IM_NEW(ImTextureData);
+            tex->Create(ImTextureFormat_RGBA32, bmp->w, bmp->h);
+            memcpy(tex->GetPixels(), bmp->rgba.data(), bmp->rgba.size() * sizeof(uint32_t));
+            tex->SetStatus(ImTextureStatus_WantCreate);
+            ImGui_ImplGX2_HandleTexture(tex);
+            bitmap.texture = tex;
+            bitmap.tex_id = tex->TexID;
+            bitmap.width = bmp->w;
+            bitmap.height = bmp->h;
+        }
+    }
+    if (!bmp || !bitmap.texture || bmp->canvas_w <= 0 || bmp->canvas_h <= 0) return;
+
+    float sx = video.w / bmp->canvas_w, sy = video.h / bmp->canvas_h;
+    ImVec2 p0(video.x + bmp->x * sx, video.y + bmp->y * sy);
+    ImGui::GetBackgroundDrawList()->AddImage(bitmap.tex_id, p0, ImVec2(p0.x + bmp->w * sx, p0.y + bmp->h * sy));
+}
+
+void widget_captions_clear() {
+    destroy_caption(bitmap);
+    for (CaptionTexture &c : cache)
+        destroy_caption(c);
+    cache.clear();
+    shown.clear();
+}
@@ -1,4 +1,21 @@
 #ifndef UI_CAPTIONS_H
 #define UI_CAPTIONS_H
 
+#include "player/subtitles.hpp"
+#include "utils/display.hpp"
+
+#include <vector>
+
+// Draws the cues bottom-centred over the video. Each cue is shaped and
+// rasterized once into a texture; changed says the set differs from the last
+// call, and only then is the texture cache consulted.
+void widget_captions_render(const std::vector<SubtitleCue> &cues, bool changed);
+
+// Draws a bitmap subtitle over the video, scaled from its canvas to where the
+// video is drawn. The texture is made when changed says bmp is a new event.
+void widget_captions_render_bitmap(const SubtitleBitmap *bmp, bool changed, const rect &video);
+
+// Drops the cached textures; the font stays loaded.
+void widget_captions_clear();
+
 #endif
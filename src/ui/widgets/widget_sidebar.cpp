@@ -1,7 +1,9 @@
 #include "ui/widgets/widget_sidebar.hpp"
 
 #include "main.hpp"
+#include "network/jellyfin.hpp"
 #include "ui/scenes/scene_file_browser.hpp"
+#include "ui/scenes/scene_jellyfin_browser.hpp"
 #include "ui/widgets/widget_button_icon.hpp"
 #include "utils/usb.hpp"
 #include "utils/app_state.hpp"
@@ -47,7 +49,14 @@ void widget_sidebar_render() {
 	}
     }    
 #endif
-    
+
+    if (jellyfin_configured()) {
+        if (widget_button_icon("Jellyfin", ICON_SERVER, app_state_get() == STATE_MENU_JELLYFIN, size)) {
+            app_state_set(STATE_MENU_JELLYFIN);
+            scene_jellyfin_browser_open();
+        }
+    }
+
     if (widget_button_icon("Settings", ICON_SETTINGS, app_state_get() == STATE_MENU_SETTINGS, size)) {
         app_state_set(STATE_MENU_SETTINGS);
     }
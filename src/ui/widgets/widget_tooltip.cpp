@@ -20,6 +20,9 @@ void widget_tooltip_render() {
             case STATE_MENU_FILES:
                 ImGui::Text("%s Select | %s Open | %s Back", FONT_GLYPH_LEFT_ANALOG_STICK, FONT_GLYPH_A_BUTTON, FONT_GLYPH_B_BUTTON);
                 break;
+            case STATE_MENU_JELLYFIN:
+                ImGui::Text("%s Select | %s Open | %s Download | %s Back", FONT_GLYPH_LEFT_ANALOG_STICK, FONT_GLYPH_A_BUTTON, FONT_GLYPH_X_BUTTON, FONT_GLYPH_B_BUTTON);
+                break;
             case STATE_MENU_SETTINGS:
                 break;
             case STATE_PLAYING_VIDEO:
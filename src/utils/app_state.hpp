@@ -8,7 +8,8 @@ enum AppState {
     STATE_PLAYING_VIDEO,
     STATE_PLAYING_AUDIO,
     STATE_VIEWING_PHOTO,
-    STATE_VIEWING_PDF
+    STATE_VIEWING_PDF,
+    STATE_MENU_JELLYFIN
 };
 
 AppState app_state_get();
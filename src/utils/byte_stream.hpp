@@ -0,0 +1,140 @@
+#ifndef BYTE_STREAM_HPP
+#define BYTE_STREAM_HPP
+
+// Little-endian (de)serialisation for on-disk caches. The files are shared with
+// host-side tools, so the byte order is fixed regardless of the CPU.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct ByteWriter {
+    std::vector<uint8_t> buf;
+
+    void u8(uint8_t v) { buf.push_back(v); }
+
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+            buf.push_back((uint8_t)(v >> (8 * i)));
+    }
+
+    void u64(uint64_t v) {
+        for (int i = 0; i < 8; ++i)
+            buf.push_back((uint8_t)(v >> (8 * i)));
+    }
+
+    void i32(int32_t v) { u32((uint32_t)v); }
+    void i64(int64_t v) { u64((uint64_t)v); }
+
+    void bytes(const void *data, size_t len) {
+        u32((uint32_t)len);
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        buf.insert(buf.end(), p, p + len);
+    }
+
+    void str(const std::string &s) { bytes(s.data(), s.size()); }
+};
+
+struct ByteReader {
+    const uint8_t *p = nullptr;
+    size_t left = 0;
+    bool ok = true;
+
+    ByteReader(const uint8_t *data, size_t len) : p(data), left(len) {}
+
+    bool take(size_t n) {
+        if (!ok || left < n) {
+            ok = false;
+            return false;
+        }
+        return true;
+    }
+
+    uint8_t u8() {
+        if (!take(1)) return 0;
+        left--;
+        return *p++;
+    }
+
+    uint32_t u32() {
+        if (!take(4)) return 0;
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i)
+            v |= (uint32_t)p[i] << (8 * i);
+        p += 4;
+        left -= 4;
+        return v;
+    }
+
+    uint64_t u64() {
+        if (!take(8)) return 0;
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i)
+            v |= (uint64_t)p[i] << (8 * i);
+        p += 8;
+        left -= 8;
+        return v;
+    }
+
+    int32_t i32() { return (int32_t)u32(); }
+    int64_t i64() { return (int64_t)u64(); }
+
+    bool bytes(std::vector<uint8_t> &out, size_t max_len) {
+        uint32_t n = u32();
+        if (!ok || n > max_len || !take(n)) {
+            ok = false;
+            return false;
+        }
+        out.assign(p, p + n);
+        p += n;
+        left -= n;
+        return true;
+    }
+
+    bool str(std::string &out, size_t max_len) {
+        std::vector<uint8_t> tmp;
+        if (!bytes(tmp, max_len)) return false;
+        out.assign(tmp.begin(), tmp.end());
+        return true;
+    }
+};
+
+static inline bool byte_stream_read_file(const char *path, std::vector<uint8_t> &out, size_t max_len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (len <= 0 || (size_t)len > max_len) {
+        fclose(f);
+        return false;
+    }
+
+    out.resize((size_t)len);
+    bool ok = fread(out.data(), 1, out.size(), f) == out.size();
+    fclose(f);
+    return ok;
+}
+
+// Writes to "<path>.tmp" first and renames, so a crash never leaves a torn file behind.
+static inline bool byte_stream_write_file(const char *path, const std::vector<uint8_t> &data) {
+    std::string tmp = std::string(path) + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+    remove(path);
+    return rename(tmp.c_str(), path) == 0;
+}
+
+#endif
@@ -65,6 +65,8 @@ static const float default_font_size = 32;
 #define ICON_SETTINGS "\uf013"
 #define ICON_FOLDER "\uf07b"
 #define ICON_USB "\uf287"
+#define ICON_SERVER "\uf233"
+#define ICON_DOWNLOAD "\uf019"
 
 static const ImWchar nerd_font_ranges[] = {
     0xE0A0, 0xE0A3,                 // Powerline
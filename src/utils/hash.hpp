@@ -0,0 +1,18 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#define HASH_FNV1A64_SEED 0xcbf29ce484222325ull
+
+static inline uint64_t hash_fnv1a64(const void *data, size_t len, uint64_t h = HASH_FNV1A64_SEED) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+#endif
@@ -17,6 +17,7 @@ struct media_info {
     int current_caption_id = 0;
     int total_caption_count = 0;
     bool playback_status = false;
+    bool remote = false;
 };
 
 media_info *media_info_get();
@@ -0,0 +1,76 @@
+#include "utils/media_layout.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define FOURCC(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+static uint32_t be32(const uint8_t *p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+static uint64_t be64(const uint8_t *p) { return ((uint64_t)be32(p) << 32) | be32(p + 4); }
+
+bool media_layout_scan_atoms(LayoutReadFn read, void *opaque, int64_t file_size, std::vector<LayoutAtom> *atoms) {
+    atoms->clear();
+    int64_t off = 0;
+    while (off < file_size) {
+        if (atoms->size() >= LAYOUT_MAX_ATOMS || file_size - off < 8) return false;
+
+        uint8_t hdr[16];
+        if (!read(opaque, off, hdr, 8)) return false;
+        LayoutAtom a;
+        a.type = be32(hdr + 4);
+        a.offset = off;
+        a.size = be32(hdr);
+        int64_t hdr_size = 8;
+        if (a.size == 1) {
+            // 64-bit size follows the type.
+            if (file_size - off < 16 || !read(opaque, off + 8, hdr + 8, 8)) return false;
+            a.size = (int64_t)be64(hdr + 8);
+            hdr_size = 16;
+        } else if (a.size == 0) {
+            a.size = file_size - off; // runs to the end of the file
+        }
+        if (a.size < hdr_size || a.size > file_size - off) return false;
+
+        atoms->push_back(a);
+        off += a.size;
+    }
+    return !atoms->empty() && (*atoms)[0].type == FOURCC('f', 't', 'y', 'p');
+}
+
+double media_layout_interleave_skew(const std::vector<IndexPoint> &video, const std::vector<IndexPoint> &audio) {
+    if (video.size() < 2 || audio.size() < 2) return 0.0;
+
+    double skew = 0.0;
+    size_t j = 0;
+    for (const IndexPoint &v : video) {
+        while (j + 1 < audio.size() && audio[j + 1].pos <= v.pos)
+            ++j;
+        skew = std::max(skew, std::fabs(v.time - audio[j].time));
+    }
+    return skew;
+}
+
+static const LayoutAtom *find_atom(const std::vector<LayoutAtom> &atoms, uint32_t type) {
+    for (const LayoutAtom &a : atoms)
+        if (a.type == type) return &a;
+    return nullptr;
+}
+
+LayoutVerdict media_layout_classify(const std::vector<LayoutAtom> &atoms, double skew) {
+    const LayoutAtom *moov = find_atom(atoms, FOURCC('m', 'o', 'o', 'v'));
+    const LayoutAtom *mdat = find_atom(atoms, FOURCC('m', 'd', 'a', 't'));
+    // Fragmented files carry their index in every fragment already.
+    if (!moov || !mdat || find_atom(atoms, FOURCC('m', 'o', 'o', 'f'))) return LayoutVerdict::Unsupported;
+    if (moov->offset > mdat->offset) return LayoutVerdict::MoovAtEnd;
+    if (skew > LAYOUT_REMUX_SKEW_SECONDS) return LayoutVerdict::Interleave;
+    return LayoutVerdict::Good;
+}
+
+const char *media_layout_verdict_name(LayoutVerdict v) {
+    switch (v) {
+    case LayoutVerdict::Good: return "good";
+    case LayoutVerdict::MoovAtEnd: return "moov at end";
+    case LayoutVerdict::Interleave: return "badly interleaved";
+    default: return "unsupported";
+    }
+}
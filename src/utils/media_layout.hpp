@@ -0,0 +1,46 @@
+#ifndef MEDIA_LAYOUT_HPP
+#define MEDIA_LAYOUT_HPP
+
+// How a file's samples sit on disk, and whether that layout makes playback
+// seek. Plain C++ without FFmpeg or console headers, so the same heuristics
+// build into host-side tools.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define LAYOUT_MAX_ATOMS 256
+#define LAYOUT_INDEX_POINTS 16384      // per stream, enough for 0.5 s steps over two hours
+#define LAYOUT_REMUX_SKEW_SECONDS 1.0  // stricter than playback needs; remuxed files stay well under it
+
+// A top-level ISO BMFF box.
+struct LayoutAtom {
+    uint32_t type = 0; // fourcc, first character in the high byte
+    int64_t offset = 0;
+    int64_t size = 0;
+};
+
+// A sample of a stream's index: where a packet is stored and when it plays.
+struct IndexPoint {
+    int64_t pos = 0;
+    double time = 0.0;
+};
+
+enum class LayoutVerdict { Good, MoovAtEnd, Interleave, Unsupported };
+
+// Reads exactly len bytes at offset.
+typedef bool (*LayoutReadFn)(void *opaque, int64_t offset, uint8_t *buf, size_t len);
+
+// Walks the top-level boxes one header at a time. false when the file is not
+// a complete MP4/MOV: a box runs past the end or the header is malformed.
+bool media_layout_scan_atoms(LayoutReadFn read, void *opaque, int64_t file_size, std::vector<LayoutAtom> *atoms);
+
+// Largest distance in seconds between video and the audio stored at or before
+// it in the file. Both lists are ordered by position.
+double media_layout_interleave_skew(const std::vector<IndexPoint> &video, const std::vector<IndexPoint> &audio);
+
+// skew is from media_layout_interleave_skew, or 0 when the file has no audio.
+LayoutVerdict media_layout_classify(const std::vector<LayoutAtom> &atoms, double skew);
+const char *media_layout_verdict_name(LayoutVerdict v);
+
+#endif
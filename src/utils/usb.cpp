@@ -114,6 +114,24 @@ static int fatfs_to_errno(FRESULT fr) {
     }
 }
 
+// FAT timestamps are local time with 2 s resolution; treated as UTC here, which is
+// fine for cache keys that only need to notice when a file changed.
+static time_t fat_to_unix_time(WORD fdate, WORD ftime) {
+    int y = 1980 + (fdate >> 9);
+    int m = (fdate >> 5) & 0x0F;
+    int d = fdate & 0x1F;
+    if (m < 1 || m > 12 || d < 1) return 0;
+
+    y -= m <= 2;
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = (long)era * 146097 + doe - 719468;
+
+    return (time_t)(days * 86400 + (ftime >> 11) * 3600 + ((ftime >> 5) & 0x3F) * 60 + (ftime & 0x1F) * 2);
+}
+
 static int fatfs_close_r(struct _reent *r, void *fd) {
     FRESULT fr = f_close((FIL *)fd);
     if (fr != FR_OK) {
@@ -224,6 +242,7 @@ static int fatfs_dirnext_r(struct _reent *r, DIR_ITER *ds, char *filename, struc
     if (st) {
         memset(st, 0, sizeof(struct stat));
         st->st_size = (off_t)fno.fsize;
+        st->st_mtime = fat_to_unix_time(fno.fdate, fno.ftime);
         if (fno.fattrib & AM_DIR)
             st->st_mode = S_IFDIR | S_IRWXU | S_IRWXG | S_IRWXO;
         else {
@@ -320,7 +339,7 @@ static ssize_t fatfs_stub_readlink_r(struct _reent *r, const char *p, char *b, s
 
 #define DRIVE_FUNCS(D) \
 [[maybe_unused]] static int      fatfs_open_r_##D    (struct _reent *r, void *fs, const char *path, int flags, int m) { (void)m; char fp[256]; build_fat_path(D, fp, sizeof(fp), path); FRESULT fr = f_open((FIL *)fs, fp, posix_to_fat_flags(flags)); if (fr != FR_OK) { r->_errno = fatfs_to_errno(fr); return -1; } if (flags & O_APPEND) f_lseek((FIL *)fs, f_size((FIL *)fs)); return 0; } \
-[[maybe_unused]] static int      fatfs_stat_r_##D    (struct _reent *r, const char *file, struct stat *st) { char fp[256]; build_fat_path(D, fp, sizeof(fp), file); FILINFO fno; FRESULT fr = f_stat(fp, &fno); if (fr != FR_OK) { r->_errno = fatfs_to_errno(fr); return -1; } memset(st, 0, sizeof(struct stat)); st->st_size = (off_t)fno.fsize; if (fno.fattrib & AM_DIR) st->st_mode = S_IFDIR | S_IRWXU | S_IRWXG | S_IRWXO; else { st->st_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH; if (!(fno.fattrib & AM_RDO)) st->st_mode |= S_IWUSR | S_IWGRP | S_IWOTH; } return 0; } \
+[[maybe_unused]] static int      fatfs_stat_r_##D    (struct _reent *r, const char *file, struct stat *st) { char fp[256]; build_fat_path(D, fp, sizeof(fp), file); FILINFO fno; FRESULT fr = f_stat(fp, &fno); if (fr != FR_OK) { r->_errno = fatfs_to_errno(fr); return -1; } memset(st, 0, sizeof(struct stat)); st->st_size = (off_t)fno.fsize; st->st_mtime = fat_to_unix_time(fno.fdate, fno.ftime); if (fno.fattrib & AM_DIR) st->st_mode = S_IFDIR | S_IRWXU | S_IRWXG | S_IRWXO; else { st->st_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH; if (!(fno.fattrib & AM_RDO)) st->st_mode |= S_IWUSR | S_IWGRP | S_IWOTH; } return 0; } \
 [[maybe_unused]] static int      fatfs_unlink_r_##D  (struct _reent *r, const char *name) { char fp[256]; build_fat_path(D, fp, sizeof(fp), name); FRESULT fr = f_unlink(fp); if (fr != FR_OK) { r->_errno = fatfs_to_errno(fr); return -1; } return 0; } \
 [[maybe_unused]] static int      fatfs_rename_r_##D  (struct _reent *r, const char *oldN, const char *newN) { char fo[256], fn[256]; build_fat_path(D, fo, sizeof(fo), oldN); build_fat_path(D, fn, sizeof(fn), newN); FRESULT fr = f_rename(fo, fn); if (fr != FR_OK) { r->_errno = fatfs_to_errno(fr); return -1; } return 0; } \
 [[maybe_unused]] static int      fatfs_mkdir_r_##D   (struct _reent *r, const char *path, int m) { (void)m; char fp[256]; build_fat_path(D, fp, sizeof(fp), path); FRESULT fr = f_mkdir(fp); if (fr != FR_OK) { r->_errno = fatfs_to_errno(fr); return -1; } return 0; } \
@@ -465,6 +484,30 @@ bool usb_active_drive() {
     return fat_dev_count;
 }
 
+// Creates (or replaces) path on the USB drive as one contiguous run of
+// clusters, so later writes never walk or extend the FAT.
+bool usb_preallocate(const char *path, uint64_t size) {
+    if (active_drive < 0) return false;
+
+    char fat_path[PATH_MAX];
+    build_fat_path(active_drive, fat_path, sizeof(fat_path), path);
+
+    FIL f;
+    FRESULT fr = f_open(&f, fat_path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (fr != FR_OK) {
+        log_message(LOG_ERROR, "USB", "f_open(%s) failed: %d", fat_path, fr);
+        return false;
+    }
+    fr = f_expand(&f, (FSIZE_t)size, 1);
+    f_close(&f);
+    if (fr != FR_OK) {
+        log_message(LOG_ERROR, "USB", "f_expand(%s, %llu) failed: %d", fat_path, (unsigned long long)size, fr);
+        f_unlink(fat_path);
+        return false;
+    }
+    return true;
+}
+
 void usb_mount() {
     if (!mocha_initialized) usb_init();
 
@@ -2,8 +2,11 @@
 #ifndef USB_HPP
 #define USB_HPP
 
+#include <cstdint>
+
 void usb_init();
 bool usb_active_drive();
+bool usb_preallocate(const char *path, uint64_t size);
 void usb_mount();
 void usb_unmount();
 void usb_shutdown();
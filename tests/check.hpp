@@ -0,0 +1,24 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+// Minimal assertions for the host tests: a failed CHECK reports and counts,
+// the test keeps going, and main returns check_result().
+
+#include <cstdio>
+
+static int check_failures = 0;
+
+#define CHECK(cond)                                                                                                                                            \
+    do {                                                                                                                                                       \
+        if (!(cond)) {                                                                                                                                         \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                                                          \
+            check_failures++;                                                                                                                                  \
+        }                                                                                                                                                      \
+    } while (0)
+
+static int check_result() {
+    if (check_failures) fprintf(stderr, "%d check(s) failed\n", check_failures);
+    return check_failures ? 1 : 0;
+}
+
+#endif
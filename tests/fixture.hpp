@@ -0,0 +1,26 @@
+#ifndef FIXTURE_HPP
+#define FIXTURE_HPP
+
+// Recorded server responses kept under tests/fixtures/. FIXTURE_DIR comes
+// from the test CMake project.
+
+#include <cstdio>
+#include <string>
+
+inline std::string load_fixture(const char *name) {
+    std::string path = std::string(FIXTURE_DIR) + name;
+    std::string out;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        fprintf(stderr, "missing fixture %s\n", path.c_str());
+        return out;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.append(buf, n);
+    fclose(f);
+    return out;
+}
+
+#endif
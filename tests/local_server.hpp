@@ -0,0 +1,173 @@
+#ifndef LOCAL_SERVER_HPP
+#define LOCAL_SERVER_HPP
+
+// A scripted HTTP/1.1 server on 127.0.0.1 for the network tests. Each
+// connection gets its own thread, which parses requests and hands them to
+// the handler; the handler writes the whole response itself, so a test can
+// send broken framing, stall or drop the connection at any point.
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <strings.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct ServerRequest {
+    std::string method;
+    std::string path;
+    std::vector<std::string> headers;
+
+    // Value of the named header, empty when absent.
+    std::string header(const char *name) const {
+        size_t len = strlen(name);
+        for (const std::string &h : headers)
+            if (h.size() > len && h[len] == ':' && !strncasecmp(h.c_str(), name, len)) return h.substr(h.find_first_not_of(' ', len + 1));
+        return std::string();
+    }
+};
+
+// Returns false to close the connection after this request.
+typedef std::function<bool(int fd, const ServerRequest &req)> ServerHandler;
+
+class LocalServer {
+  public:
+    std::atomic<int> accepted{0};
+    std::atomic<int> closed{0};
+    std::atomic<int> requests{0};
+
+    explicit LocalServer(ServerHandler handler) : handler_(handler) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, (struct sockaddr *)&addr, &len);
+        port_ = ntohs(addr.sin_port);
+        listen(listen_fd_, 16);
+        accept_thread_ = std::thread(&LocalServer::accept_loop, this);
+    }
+
+    ~LocalServer() {
+        stopping_.store(true);
+        shutdown(listen_fd_, SHUT_RDWR);
+        close(listen_fd_);
+        accept_thread_.join();
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            for (int fd : client_fds_) shutdown(fd, SHUT_RDWR);
+        }
+        for (std::thread &t : client_threads_) t.join();
+        for (int fd : client_fds_) close(fd);
+    }
+
+    std::string url(const std::string &path) const { return "http://127.0.0.1:" + std::to_string(port_) + path; }
+
+    // For handlers that hold a connection open: sleeps up to ms, returning
+    // early when the server is being torn down.
+    void stall(int ms) {
+        auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+        while (!stopping_.load() && std::chrono::steady_clock::now() < until) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // Waits until count reaches n; false after a second without getting there.
+    static bool wait_for(const std::atomic<int> &count, int n) {
+        for (int i = 0; i < 100 && count.load() < n; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return count.load() >= n;
+    }
+
+  private:
+    ServerHandler handler_;
+    int listen_fd_ = -1;
+    int port_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::thread accept_thread_;
+    std::mutex mtx_;
+    std::vector<int> client_fds_;
+    std::vector<std::thread> client_threads_;
+
+    void accept_loop() {
+        for (;;) {
+            int fd = accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) return;
+            if (stopping_.load()) {
+                close(fd);
+                return;
+            }
+            accepted++;
+            std::lock_guard<std::mutex> lk(mtx_);
+            client_fds_.push_back(fd);
+            client_threads_.emplace_back(&LocalServer::serve, this, fd);
+        }
+    }
+
+    void serve(int fd) {
+        std::string pending;
+        ServerRequest req;
+        while (!stopping_.load() && read_request(fd, &pending, &req)) {
+            requests++;
+            if (!handler_(fd, req)) break;
+        }
+        shutdown(fd, SHUT_RDWR);
+        closed++;
+    }
+
+    // Request bodies are not used by the tests and are not read.
+    static bool read_request(int fd, std::string *pending, ServerRequest *req) {
+        size_t end;
+        while ((end = pending->find("\r\n\r\n")) == std::string::npos) {
+            char buf[1024];
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) return false;
+            pending->append(buf, (size_t)n);
+        }
+        std::string head = pending->substr(0, end);
+        pending->erase(0, end + 4);
+
+        *req = ServerRequest();
+        size_t pos = 0;
+        bool first = true;
+        while (pos <= head.size()) {
+            size_t eol = head.find("\r\n", pos);
+            if (eol == std::string::npos) eol = head.size();
+            std::string line = head.substr(pos, eol - pos);
+            pos = eol + 2;
+            if (first) {
+                size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+                req->method = line.substr(0, sp1);
+                req->path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+                first = false;
+            } else if (!line.empty()) {
+                req->headers.push_back(line);
+            }
+        }
+        return true;
+    }
+};
+
+static bool send_str(int fd, const std::string &s) { return send(fd, s.data(), s.size(), MSG_NOSIGNAL) == (ssize_t)s.size(); }
+
+// Parses "Range: bytes=a-b" (b optional); false when there is no Range header.
+static bool parse_range(const ServerRequest &req, int64_t size, int64_t *start, int64_t *end) {
+    std::string range = req.header("Range");
+    long long a = -1, b = -1;
+    if (range.empty() || sscanf(range.c_str(), "bytes=%lld-%lld", &a, &b) < 1) return false;
+    *start = a;
+    *end = b < 0 || b >= size ? size - 1 : b;
+    return true;
+}
+
+#endif
@@ -0,0 +1,11 @@
+// The disk cache needs the console's storage; the host tests run with it
+// disabled, which is what http_source sees before the slab is ready.
+
+#include "network/disk_cache.hpp"
+
+void disk_cache_init() {}
+void disk_cache_shutdown() {}
+uint64_t disk_cache_resource_id(const std::string &, int64_t) { return 0; }
+bool disk_cache_read(uint64_t, int64_t, std::vector<uint8_t> *) { return false; }
+void disk_cache_store(uint64_t, int64_t, const uint8_t *, size_t) {}
+void disk_cache_get_stats(DiskCacheStats *stats) { *stats = DiskCacheStats(); }
@@ -0,0 +1,10 @@
+// No USB drive on the host; downloads fall back to a plain file.
+
+#include "utils/usb.hpp"
+
+void usb_init() {}
+bool usb_active_drive() { return false; }
+bool usb_preallocate(const char *, uint64_t) { return false; }
+void usb_mount() {}
+void usb_unmount() {}
+void usb_shutdown() {}
@@ -0,0 +1,218 @@
+#include "check.hpp"
+#include "player/abr.hpp"
+
+#include <vector>
+
+static std::vector<AbrVariant> ladder() {
+    std::vector<AbrVariant> v(3);
+    v[0] = {1000000, 640, 360};
+    v[1] = {3000000, 1280, 720};
+    v[2] = {6000000, 1920, 1080};
+    return v;
+}
+
+// seconds of playback at throughput bps, with the decoder busy for load of
+// each frame's time.
+static AbrSample sample(double seconds, double bps, double load) {
+    AbrSample s;
+    s.seconds = seconds;
+    s.net_seconds = seconds * 0.5;
+    s.net_bytes = (uint64_t)(bps * s.net_seconds / 8.0);
+    s.frame_duration = 1.0 / 30.0;
+    s.frames_decoded = (int)(seconds * 30.0);
+    s.decode_seconds = load * s.frames_decoded * s.frame_duration;
+    s.frames_shown = s.frames_decoded;
+    s.buffer_seconds = 10.0;
+    return s;
+}
+
+static void test_spread() {
+    std::vector<int> k = abr_spread(30, ABR_MAX_VARIANTS);
+    CHECK((int)k.size() == ABR_MAX_VARIANTS);
+    CHECK(k.front() == 0 && k.back() == 29);
+    for (size_t i = 1; i < k.size(); ++i)
+        CHECK(k[i] > k[i - 1]);
+
+    k = abr_spread(5, ABR_MAX_VARIANTS);
+    CHECK(k.size() == 5 && k[4] == 4);
+    k = abr_spread(5, 1);
+    CHECK(k.size() == 1 && k[0] == 4);
+    CHECK(abr_spread(0, 4).empty());
+}
+
+#define H264 27
+#define HEVC 173
+#define AAC 86018
+#define AC3 86019
+
+// Video stream idx in 1/90000, with AAC stereo at 48 kHz in stream audio.
+static AbrCandidate candidate(int idx, int64_t bitrate, int height, int audio) {
+    AbrCandidate c;
+    c.video_idx = idx;
+    c.codec_id = H264;
+    c.time_base_num = 1;
+    c.time_base_den = 90000;
+    c.variant = {bitrate, height * 16 / 9, height};
+    c.audio_idx = audio;
+    if (audio >= 0) {
+        c.audio_codec_id = AAC;
+        c.audio_sample_rate = 48000;
+        c.audio_channels = 2;
+    }
+    return c;
+}
+
+static void test_ladder_order_and_start() {
+    // Listed in playlist order, not by bitrate; all variants share audio 4.
+    std::vector<AbrCandidate> s = {candidate(0, 3000000, 720, 4), candidate(1, 800000, 360, 4), candidate(2, 6000000, 1080, 4), candidate(3, 1500000, 540, 4)};
+    std::vector<AbrVariant> v;
+    std::vector<AbrLadderEntry> ladder;
+    CHECK(abr_build_ladder(s, 2, 2000000.0, &v, &ladder) == 1);
+    CHECK(v.size() == 4 && ladder.size() == 4);
+    const int order[] = {1, 3, 0, 2};
+    for (int i = 0; i < 4 && i < (int)ladder.size(); ++i) {
+        CHECK(ladder[i].video_idx == order[i] && ladder[i].audio_idx == 4);
+        CHECK(v[i].bitrate == s[order[i]].variant.bitrate);
+    }
+
+    CHECK(abr_build_ladder(s, 2, 100000.0, &v, &ladder) == 0); // nothing fits: lowest
+    CHECK(abr_build_ladder(s, 2, 1e9, &v, &ladder) == 3);
+}
+
+static void test_ladder_drops_incompatible() {
+    std::vector<AbrCandidate> s;
+    s.push_back(candidate(0, 3000000, 720, 10)); // ref
+    s.push_back(candidate(1, 1000000, 360, 11));
+    s.push_back(candidate(2, 2000000, 540, 12));
+    s.back().codec_id = HEVC;
+    s.push_back(candidate(3, 1500000, 480, 13));
+    s.back().time_base_den = 1000;
+    s.push_back(candidate(4, 6000000, 1080, 14));
+    s.back().time_base_num = 2; // 2/180000 is the same time base
+    s.back().time_base_den = 180000;
+    s.push_back(candidate(5, 50000, 720, 10));
+    s.back().attached_pic = true;
+    s.push_back(candidate(6, 4000000, 720, 15));
+    s.back().audio_sample_rate = 44100;
+    s.push_back(candidate(7, 4500000, 720, 16));
+    s.back().audio_codec_id = AC3;
+    s.push_back(candidate(8, 5000000, 1080, 17));
+    s.back().audio_channels = 6;
+    s.push_back(candidate(9, 0, 720, 10)); // no bitrate known
+    s.push_back(candidate(18, 600000, 240, -1)); // video only, keeps the current audio
+
+    std::vector<AbrVariant> v;
+    std::vector<AbrLadderEntry> ladder;
+    CHECK(abr_build_ladder(s, 0, 1e9, &v, &ladder) == 3);
+    CHECK(ladder.size() == 4);
+    if (ladder.size() == 4) {
+        CHECK(ladder[0].video_idx == 18 && ladder[0].audio_idx == -1);
+        CHECK(ladder[1].video_idx == 1 && ladder[1].audio_idx == 11);
+        CHECK(ladder[2].video_idx == 0 && ladder[2].audio_idx == 10);
+        CHECK(ladder[3].video_idx == 4 && ladder[3].audio_idx == 14);
+    }
+
+    // Without audio in the reference program, audio does not matter and the
+    // variants carry none of their own.
+    s[0].audio_idx = -1;
+    CHECK(abr_build_ladder(s, 0, 1e9, &v, &ladder) == 6);
+    CHECK(ladder.size() == 7);
+    for (const AbrLadderEntry &e : ladder)
+        CHECK(e.audio_idx == -1);
+}
+
+static void test_ladder_thinned() {
+    std::vector<AbrCandidate> s;
+    for (int i = 0; i < 30; ++i)
+        s.push_back(candidate(i, 300000 + (int64_t)((i * 7) % 30) * 250000, 720, -1));
+    std::vector<AbrVariant> v;
+    std::vector<AbrLadderEntry> ladder;
+    CHECK(abr_build_ladder(s, 0, 1e9, &v, &ladder) == ABR_MAX_VARIANTS - 1);
+    CHECK(v.size() == ABR_MAX_VARIANTS && ladder.size() == ABR_MAX_VARIANTS);
+    CHECK(v.front().bitrate == 300000 && v.back().bitrate == 300000 + 29 * 250000);
+    for (size_t i = 1; i < v.size(); ++i)
+        CHECK(v[i].bitrate > v[i - 1].bitrate);
+}
+
+static void test_ladder_too_short() {
+    std::vector<AbrCandidate> s = {candidate(0, 3000000, 720, -1), candidate(1, 1000000, 360, -1)};
+    s[1].codec_id = HEVC;
+    std::vector<AbrVariant> v;
+    std::vector<AbrLadderEntry> ladder;
+    CHECK(abr_build_ladder(s, 0, 1e9, &v, &ladder) == -1);
+    CHECK(v.empty() && ladder.empty());
+    CHECK(abr_build_ladder(s, 5, 1e9, &v, &ladder) == -1);
+}
+
+static void test_down_on_throughput() {
+    AbrController abr;
+    abr_init(&abr, ladder(), 2);
+    // 6 Mbit/s does not fit in 90% of 5; 3 fits in 70%.
+    CHECK(abr_update(&abr, sample(2.5, 5000000, 0.3)) == 1);
+    CHECK(abr.switches == 1);
+}
+
+static void test_down_held_off() {
+    AbrController abr;
+    abr_init(&abr, ladder(), 1);
+    AbrSample s = sample(1.0, 20000000, 0.3);
+    s.frames_dropped = 1;
+    // Too soon after the start to switch while the buffer is full...
+    CHECK(abr_update(&abr, s) == 1);
+    // ...but not once it runs dry.
+    s.buffer_seconds = 1.0;
+    CHECK(abr_update(&abr, s) == 0);
+}
+
+static void test_up_after_hold() {
+    AbrController abr;
+    abr_init(&abr, ladder(), 0);
+    int t = 0;
+    while (t < 9) {
+        CHECK(abr_update(&abr, sample(1.0, 20000000, 0.1)) == 0);
+        t++;
+    }
+    CHECK(abr_update(&abr, sample(1.0, 20000000, 0.1)) == 1);
+    // One step at a time, each after its own hold.
+    CHECK(abr_update(&abr, sample(1.0, 20000000, 0.1)) == 1);
+}
+
+static void test_up_blocked_by_decoder() {
+    // 0.3 of the frame time at 360p is 1.2 at 720p: no up-switch however
+    // fast the network is.
+    AbrController abr;
+    abr_init(&abr, ladder(), 0);
+    for (int i = 0; i < 30; ++i)
+        abr_update(&abr, sample(1.0, 20000000, 0.3));
+    CHECK(abr.current == 0);
+}
+
+static void test_penalty() {
+    AbrController abr;
+    abr_init(&abr, ladder(), 1);
+    AbrSample s = sample(3.0, 20000000, 0.3);
+    s.frames_dropped = 2;
+    CHECK(abr_update(&abr, s) == 0);
+
+    // The overloaded variant stays locked for a minute despite a light load.
+    for (int i = 0; i < 50; ++i)
+        abr_update(&abr, sample(1.0, 20000000, 0.1));
+    CHECK(abr.current == 0);
+    for (int i = 0; i < 25; ++i)
+        abr_update(&abr, sample(1.0, 20000000, 0.1));
+    CHECK(abr.current == 1);
+}
+
+int main() {
+    test_spread();
+    test_ladder_order_and_start();
+    test_ladder_drops_incompatible();
+    test_ladder_thinned();
+    test_ladder_too_short();
+    test_down_on_throughput();
+    test_down_held_off();
+    test_up_after_hold();
+    test_up_blocked_by_decoder();
+    test_penalty();
+    return check_result();
+}
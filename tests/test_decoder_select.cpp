@@ -0,0 +1,124 @@
+#include "check.hpp"
+#include "player/decoder_select.hpp"
+
+#include <cstring>
+#include <string>
+
+static bool hw_present(const char *) { return true; }
+static bool hw_absent(const char *decoder) { return strcmp(decoder, "h264_wiiu") != 0; }
+
+static VideoStreamDesc h264(int width, int height, double fps) {
+    VideoStreamDesc v;
+    v.codec = "h264";
+    v.profile = 100;
+    v.level = 41;
+    v.width = width;
+    v.height = height;
+    v.fps = fps;
+    v.bitrate = 8000000;
+    return v;
+}
+
+static bool has(const std::string &s, const char *part) { return s.find(part) != std::string::npos; }
+
+static void test_hw_first() {
+    DecoderPlan p = decoder_plan(h264(1920, 1080, 30.0), 0.0, hw_present);
+    CHECK(p.primary && p.primary->kind == DecoderKind::Hardware);
+    CHECK(p.realtime);
+    CHECK(p.fallback && p.fallback->kind == DecoderKind::Software);
+}
+
+static void test_sw_when_hw_missing() {
+    DecoderPlan p = decoder_plan(h264(640, 360, 30.0), 0.0, hw_absent);
+    CHECK(p.primary && p.primary->kind == DecoderKind::Software);
+    CHECK(p.realtime);
+    CHECK(!p.fallback);
+}
+
+static void test_hw_limits() {
+    // Each of these is beyond h264_wiiu, so the plan falls to software.
+    VideoStreamDesc v = h264(1280, 720, 30.0);
+    v.interlaced = true;
+    DecoderPlan p = decoder_plan(v, 0.0, hw_present);
+    CHECK(p.primary && p.primary->kind == DecoderKind::Software);
+    CHECK(has(p.reason, "interlaced"));
+
+    v = h264(1280, 720, 30.0);
+    v.level = 51;
+    p = decoder_plan(v, 0.0, hw_present);
+    CHECK(p.primary && p.primary->kind == DecoderKind::Software);
+    CHECK(has(p.reason, "level"));
+
+    v = h264(3840, 2160, 30.0);
+    p = decoder_plan(v, 0.0, hw_present);
+    CHECK(p.primary && p.primary->kind == DecoderKind::Software);
+    CHECK(!p.realtime);
+}
+
+static void test_slow_software() {
+    // Nothing keeps up: the slow decoder is still chosen, flagged as such.
+    DecoderPlan p = decoder_plan(h264(1920, 1080, 30.0), 0.0, hw_absent);
+    CHECK(p.primary && p.primary->kind == DecoderKind::Software);
+    CHECK(!p.realtime);
+    CHECK(has(p.reason, "Mpx/s"));
+
+    // A faster measured CPU makes the same stream real-time.
+    VideoStreamDesc v = h264(1280, 720, 30.0);
+    p = decoder_plan(v, 0.0, hw_absent);
+    CHECK(!p.realtime);
+    p = decoder_plan(v, 1280.0 * 720.0 * 30.0 / DECODER_SW_HEADROOM, hw_absent);
+    CHECK(p.realtime);
+}
+
+static void test_no_render_path() {
+    VideoStreamDesc v = h264(1920, 1080, 30.0);
+    v.codec = "hevc";
+    v.profile = 2;
+    v.bit_depth = 10;
+    DecoderPlan p = decoder_plan(v, 0.0, hw_present);
+    CHECK(!p.primary);
+    CHECK(has(p.reason, "10-bit"));
+
+    v = h264(1920, 1080, 30.0);
+    v.profile = 122;
+    v.chroma_420 = false;
+    p = decoder_plan(v, 0.0, hw_present);
+    CHECK(!p.primary);
+    CHECK(has(p.reason, "4:2:0"));
+
+    v = h264(640, 360, 30.0);
+    v.codec = "unknown";
+    v.has_default_decoder = false;
+    p = decoder_plan(v, 0.0, hw_present);
+    CHECK(!p.primary);
+}
+
+static void test_watch() {
+    DecoderWatch w;
+    for (int i = 0; i < DECODER_ERROR_LIMIT - 1; ++i)
+        decoder_watch_error(&w);
+    CHECK(!decoder_watch_failed(w));
+    decoder_watch_frame(&w, true);
+    CHECK(w.errors == 0);
+
+    for (int i = 0; i < DECODER_ERROR_LIMIT; ++i)
+        decoder_watch_frame(&w, false);
+    CHECK(decoder_watch_failed(w));
+
+    DecoderWatch stall;
+    for (int i = 0; i < DECODER_STALL_PACKETS; ++i)
+        decoder_watch_packet(&stall);
+    CHECK(decoder_watch_failed(stall));
+    decoder_watch_frame(&stall, true);
+    CHECK(!decoder_watch_failed(stall));
+}
+
+int main() {
+    test_hw_first();
+    test_sw_when_hw_missing();
+    test_hw_limits();
+    test_slow_software();
+    test_no_render_path();
+    test_watch();
+    return check_result();
+}
@@ -0,0 +1,127 @@
+#include "check.hpp"
+#include "local_server.hpp"
+#include "network/download_queue.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+// Two and a half chunks, so the drop lands inside a chunk and the resume
+// has to start at the last whole one.
+#define FILE_SIZE (3 * DOWNLOAD_CHUNK_SIZE + DOWNLOAD_CHUNK_SIZE / 2)
+#define DROP_AT (2 * DOWNLOAD_CHUNK_SIZE + DOWNLOAD_CHUNK_SIZE / 2)
+#define ETAG "\"5d2a0e9c\""
+
+static std::vector<uint8_t> content() {
+    std::vector<uint8_t> v(FILE_SIZE);
+    uint32_t x = 0x12345678;
+    for (uint8_t &b : v) {
+        x = x * 1664525u + 1013904223u;
+        b = (uint8_t)(x >> 24);
+    }
+    return v;
+}
+
+static int64_t file_size(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (int64_t)st.st_size : -1;
+}
+
+static std::vector<uint8_t> read_file(const std::string &path) {
+    std::vector<uint8_t> out;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) return out;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return out;
+}
+
+static void remove_dir(const std::string &dir) {
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *e = readdir(d))
+            if (e->d_name[0] != '.') remove((dir + e->d_name).c_str());
+        closedir(d);
+    }
+    rmdir(dir.c_str());
+}
+
+struct Seen {
+    std::string range;
+    std::string if_range;
+    int64_t part_size; // size of the .part file when the request came in
+};
+
+static void test_resume_after_drop() {
+    char tmpl[] = "/tmp/cafemp-dq-XXXXXX";
+    CHECK(mkdtemp(tmpl) != nullptr);
+    const std::string dir = std::string(tmpl) + "/";
+    const std::string name = "movie.mkv";
+    const std::vector<uint8_t> data = content();
+
+    std::mutex seen_mtx;
+    std::vector<Seen> seen;
+
+    // The first answer is cut off mid-chunk; later ones honour the range.
+    LocalServer server([&](int fd, const ServerRequest &req) {
+        int64_t start = 0, end = FILE_SIZE - 1;
+        parse_range(req, FILE_SIZE, &start, &end);
+        size_t attempt;
+        {
+            std::lock_guard<std::mutex> lk(seen_mtx);
+            seen.push_back({req.header("Range"), req.header("If-Range"), file_size(dir + name + ".part")});
+            attempt = seen.size();
+        }
+
+        char head[256];
+        snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\nETag: %s\r\nContent-Range: bytes %lld-%lld/%d\r\nContent-Length: %lld\r\n\r\n", ETAG, (long long)start, (long long)end, FILE_SIZE, (long long)(end - start + 1));
+        send_str(fd, head);
+        int64_t stop = attempt == 1 ? DROP_AT : end + 1;
+        send_str(fd, std::string(data.begin() + start, data.begin() + stop));
+        return false;
+    });
+
+    download_queue_init(dir);
+    uint32_t id = download_queue_add(server.url("/Items/1/Download?api_key=secret"), name);
+    CHECK(id != 0);
+
+    // The retry comes after a two second back-off.
+    DownloadInfo info;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+    do {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::vector<DownloadInfo> list = download_queue_list();
+        CHECK(list.size() == 1);
+        if (list.empty()) break;
+        info = list[0];
+    } while (info.state != DownloadState::Done && info.state != DownloadState::Failed && std::chrono::steady_clock::now() < deadline);
+    download_queue_shutdown();
+
+    CHECK(info.state == DownloadState::Done);
+    CHECK(info.size == FILE_SIZE && info.done == FILE_SIZE);
+
+    CHECK(seen.size() == 2);
+    if (seen.size() == 2) {
+        CHECK(seen[0].range == "bytes=0-" && seen[0].if_range.empty());
+        // Only the whole chunks before the drop were kept.
+        CHECK(seen[1].part_size == 2 * DOWNLOAD_CHUNK_SIZE);
+        CHECK(seen[1].range == "bytes=" + std::to_string(2 * DOWNLOAD_CHUNK_SIZE) + "-");
+        CHECK(seen[1].if_range == ETAG);
+    }
+
+    CHECK(file_size(dir + name + ".part") < 0);
+    CHECK(read_file(dir + name) == data);
+    remove_dir(dir);
+}
+
+int main() {
+    test_resume_after_drop();
+    return check_result();
+}
@@ -0,0 +1,188 @@
+#include "check.hpp"
+#include "local_server.hpp"
+#include "network/http_client.hpp"
+#include "network/http_source.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define RESOURCE_SIZE (4 * HTTP_SOURCE_BLOCK_SIZE + 12345)
+
+static std::vector<uint8_t> resource() {
+    std::vector<uint8_t> v(RESOURCE_SIZE);
+    for (size_t i = 0; i < v.size(); ++i) v[i] = (uint8_t)(i * 131 + i / 7);
+    return v;
+}
+
+static double elapsed_s(std::chrono::steady_clock::time_point t0) { return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count(); }
+
+// Serves resource() with range support on a keep-alive connection.
+static bool serve_ranges(int fd, const ServerRequest &req) {
+    static const std::vector<uint8_t> data = resource();
+    int64_t start, end;
+    if (!parse_range(req, data.size(), &start, &end)) {
+        send_str(fd, "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(data.size()) + "\r\n\r\n");
+        return send_str(fd, std::string(data.begin(), data.end()));
+    }
+    char head[256];
+    snprintf(head, sizeof(head), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %lld-%lld/%lld\r\nContent-Length: %lld\r\n\r\n", (long long)start, (long long)end, (long long)data.size(), (long long)(end - start + 1));
+    send_str(fd, head);
+    return send_str(fd, std::string(data.begin() + start, data.begin() + end + 1));
+}
+
+static void test_url_for_log() {
+    CHECK(http_url_for_log("http://srv:8096/Items/1/Download?api_key=secret") == "http://srv:8096/Items/1/Download?...");
+    CHECK(http_url_for_log("http://user:pw@srv/a/b") == "http://srv/a/b");
+    CHECK(http_url_for_log("http://srv/a?x=1&api_key=secret").find("secret") == std::string::npos);
+    CHECK(http_url_for_log("http://srv/plain") == "http://srv/plain");
+}
+
+static void test_chunked() {
+    LocalServer server([](int fd, const ServerRequest &) {
+        send_str(fd, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+        send_str(fd, "7\r\nHello, \r\n");
+        send_str(fd, "8\r\nchunked \r\n5\r\nworld\r\n");
+        return send_str(fd, "0\r\nX-Trailer: 1\r\n\r\n");
+    });
+
+    HttpResponse resp;
+    std::string body;
+    CHECK(http_get(server.url("/chunked"), {}, &resp, &body, 1024));
+    CHECK(resp.status == 200 && resp.chunked);
+    CHECK(body == "Hello, chunked world");
+
+    // The trailer was consumed, so the pooled connection carries the next request.
+    body.clear();
+    CHECK(http_get(server.url("/chunked"), {}, &resp, &body, 8));
+    CHECK(body == "Hello, c");
+    CHECK(server.accepted.load() == 1 && server.requests.load() == 2);
+    http_pool_clear();
+}
+
+static void test_stale_keep_alive() {
+    // Every response claims keep-alive, then the server hangs up.
+    LocalServer server([](int fd, const ServerRequest &req) {
+        std::string body = "answer to " + req.path;
+        send_str(fd, "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+        return false;
+    });
+
+    HttpResponse resp;
+    std::string body;
+    CHECK(http_get(server.url("/first"), {}, &resp, &body, 1024));
+    CHECK(body == "answer to /first");
+    CHECK(LocalServer::wait_for(server.closed, 1));
+
+    // The pooled connection is dead; the request goes out again on a new one.
+    CHECK(http_get(server.url("/second"), {}, &resp, &body, 1024));
+    CHECK(resp.status == 200 && body == "answer to /second");
+    CHECK(server.accepted.load() == 2);
+    http_pool_clear();
+}
+
+static void test_range_source() {
+    const std::vector<uint8_t> data = resource();
+    LocalServer server(serve_ranges);
+
+    HttpSource *src = http_source_open(server.url("/movie.mkv?api_key=secret").c_str());
+    CHECK(src != nullptr);
+    if (!src) return;
+    CHECK(http_source_size(src) == RESOURCE_SIZE);
+
+    // Odd-sized reads cross block boundaries.
+    std::vector<uint8_t> got;
+    uint8_t buf[100003];
+    int n;
+    while ((n = http_source_read(src, buf, sizeof(buf))) > 0) got.insert(got.end(), buf, buf + n);
+    CHECK(n == 0);
+    CHECK(got == data);
+
+    CHECK(http_source_seek(src, 700000, SEEK_SET) == 700000);
+    CHECK(http_source_read(src, buf, 5000) == 5000);
+    CHECK(!memcmp(buf, data.data() + 700000, 5000));
+
+    CHECK(http_source_seek(src, -10, SEEK_END) == RESOURCE_SIZE - 10);
+    CHECK(http_source_read(src, buf, sizeof(buf)) == 10);
+    CHECK(!memcmp(buf, data.data() + RESOURCE_SIZE - 10, 10));
+    CHECK(http_source_read(src, buf, sizeof(buf)) == 0);
+
+    HttpSourceStats stats;
+    http_source_get_stats(src, &stats);
+    CHECK(stats.blocks_fetched >= 5 && stats.retries == 0);
+    http_source_close(src);
+
+    // Workers keep their connections: far fewer than one per block.
+    CHECK(server.accepted.load() <= 1 + HTTP_SOURCE_WORKERS);
+
+    // A server that ignores Range is not used.
+    LocalServer no_ranges([](int fd, const ServerRequest &) {
+        send_str(fd, "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello");
+        return true;
+    });
+    CHECK(http_source_open(no_ranges.url("/file").c_str()) == nullptr);
+}
+
+static void test_stalled_peer() {
+    // Sends part of the body, then goes quiet.
+    LocalServer server([&server](int fd, const ServerRequest &req) {
+        if (req.path == "/head") {
+            server.stall(5000);
+            return false;
+        }
+        send_str(fd, "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n0123456789");
+        server.stall(5000);
+        return false;
+    });
+    HttpUrl url;
+    CHECK(http_parse_url(server.url("/body"), &url));
+
+    auto t0 = std::chrono::steady_clock::now();
+    HttpConnection *c = http_connect(url, 300);
+    HttpResponse resp;
+    CHECK(c && http_send_request(c, "GET", url, {}, &resp));
+    char buf[128];
+    int got = 0, n;
+    while ((n = http_read_body(c, buf, sizeof(buf))) > 0) got += n;
+    CHECK(got == 10 && n == -1);
+    CHECK(!http_reusable(c));
+    CHECK(elapsed_s(t0) < 2.0);
+    http_close(c);
+
+    // No response head at all.
+    HttpUrl head = url;
+    head.path = "/head";
+    t0 = std::chrono::steady_clock::now();
+    c = http_connect(head, 300);
+    CHECK(c && !http_send_request(c, "GET", head, {}, &resp));
+    CHECK(elapsed_s(t0) < 2.0);
+    http_close(c);
+
+    // With a long timeout, raising the abort flag ends the read instead.
+    std::atomic<bool> abort{false};
+    c = http_connect(url, 10000);
+    http_set_abort_flag(c, &abort);
+    CHECK(c && http_send_request(c, "GET", url, {}, &resp));
+    std::thread raiser([&abort] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        abort.store(true);
+    });
+    t0 = std::chrono::steady_clock::now();
+    while ((n = http_read_body(c, buf, sizeof(buf))) > 0) {}
+    CHECK(n == -1);
+    CHECK(elapsed_s(t0) < 2.0);
+    raiser.join();
+    http_close(c);
+}
+
+int main() {
+    test_url_for_log();
+    test_chunked();
+    test_stale_keep_alive();
+    test_range_source();
+    test_stalled_peer();
+    return check_result();
+}
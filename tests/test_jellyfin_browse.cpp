@@ -0,0 +1,160 @@
+#include "check.hpp"
+#include "fixture.hpp"
+#include "network/jellyfin_browse.hpp"
+
+#include <cstring>
+#include <string>
+
+// items_page0.json and items_page2.json are the first and last /Items pages
+// of one 230-entry folder, media_folders.json the library roots.
+#define FOLDER_TOTAL 230
+
+static bool parse_fixture(const char *name, JellyfinPage *page) {
+    std::string json = load_fixture(name);
+    return jellyfin_parse_items(json.data(), json.size(), page);
+}
+
+static void test_parse_roots() {
+    JellyfinPage page;
+    CHECK(parse_fixture("items_media_folders.json", &page));
+    CHECK(page.items.size() == 3 && page.total == 3 && page.start_index == 0);
+    CHECK(page.items[0].name == "Movies" && page.items[0].id == "6b0c63aa71b4984b53227fd2e0326750");
+    CHECK(page.items[0].type == "CollectionFolder" && page.items[0].is_folder);
+    CHECK(!page.items[0].primary_image_tag.empty());
+}
+
+static void test_parse_page() {
+    JellyfinPage page;
+    CHECK(parse_fixture("items_page0.json", &page));
+    CHECK(page.items.size() == JELLYFIN_PAGE_SIZE && page.total == FOLDER_TOTAL && page.start_index == 0);
+
+    const JellyfinItem &folder = page.items[0];
+    CHECK(folder.name == "Extras" && folder.is_folder && folder.type == "Folder");
+    CHECK(folder.primary_image_tag.empty() && folder.container.empty() && folder.run_time_ticks == 0);
+
+    // Only the first container of the server's list is kept.
+    const JellyfinItem &no_art = page.items[3];
+    CHECK(no_art.name == "Arrival" && no_art.container == "mov" && no_art.primary_image_tag.empty());
+    const JellyfinItem &movie = page.items[4];
+    CHECK(movie.id == "af0cc514d41de65406f244f6c9e27a3b" && movie.name == "Blade Runner 2049");
+    CHECK(movie.type == "Movie" && movie.media_type == "Video" && !movie.is_folder);
+    CHECK(movie.container == "mkv" && movie.run_time_ticks == 60123456789LL);
+    CHECK(movie.primary_image_tag == "32564ab174a7e05656979bda7c130887");
+
+    CHECK(parse_fixture("items_page2.json", &page));
+    CHECK(page.items.size() == FOLDER_TOTAL - 2 * JELLYFIN_PAGE_SIZE && page.start_index == 2 * JELLYFIN_PAGE_SIZE);
+    CHECK(page.items[28].media_type == "Audio" && page.items[28].container == "flac");
+}
+
+static void test_parse_errors() {
+    JellyfinPage page;
+    const char *bad[] = {"", "{\"Items\": [", "{\"Items\": null, \"TotalRecordCount\": 0}", "[]"};
+    for (const char *json : bad)
+        CHECK(!jellyfin_parse_items(json, strlen(json), &page));
+
+    // Entries without an Id cannot be opened and are dropped.
+    const char *partial = "{\"Items\": [{\"Name\": \"x\"}, {\"Id\": \"1\", \"Name\": \"y\"}]}";
+    CHECK(jellyfin_parse_items(partial, strlen(partial), &page));
+    CHECK(page.items.size() == 1 && page.items[0].name == "y" && page.total == 1);
+}
+
+static void test_items_path() {
+    CHECK(jellyfin_items_path("", 0, JELLYFIN_PAGE_SIZE) == "/Library/MediaFolders");
+    std::string path = jellyfin_items_path("f137a2dd21bbc1b99aa5c0f6bf02a805", 200, JELLYFIN_PAGE_SIZE);
+    CHECK(path.rfind("/Items?ParentId=f137a2dd21bbc1b99aa5c0f6bf02a805&", 0) == 0);
+    CHECK(path.find("&StartIndex=200&Limit=100&") != std::string::npos);
+    CHECK(path.find("EnableTotalRecordCount=true") != std::string::npos);
+}
+
+static void test_pager() {
+    JellyfinPager pager;
+    int missing;
+    CHECK(pager.total < 0);
+    CHECK(!jellyfin_pager_item(pager, 0, &missing) && missing == 0);
+    CHECK(jellyfin_pager_request(&pager, 0));
+    CHECK(!jellyfin_pager_request(&pager, 0)); // already in flight
+
+    JellyfinPage page;
+    CHECK(parse_fixture("items_page0.json", &page));
+    jellyfin_pager_store(&pager, 0, true, &page);
+    CHECK(pager.total == FOLDER_TOTAL && pager.requested.empty());
+    CHECK(!jellyfin_pager_request(&pager, 0)); // already loaded
+
+    const JellyfinItem *item = jellyfin_pager_item(pager, 99, &missing);
+    CHECK(item && item->name == "Tron Legacy (2004)" && missing == -1);
+    CHECK(!jellyfin_pager_item(pager, 100, &missing) && missing == 1);
+    CHECK(!jellyfin_pager_item(pager, FOLDER_TOTAL - 1, &missing) && missing == 2);
+
+    // Pages arrive out of order; page 1 stays a gap.
+    CHECK(jellyfin_pager_request(&pager, 2));
+    CHECK(jellyfin_pager_request(&pager, 1));
+    CHECK(parse_fixture("items_page2.json", &page));
+    jellyfin_pager_store(&pager, 2, true, &page);
+    item = jellyfin_pager_item(pager, FOLDER_TOTAL - 1, &missing);
+    CHECK(item && item->name == "Ex Machina (2011)" && missing == -1);
+    CHECK(!jellyfin_pager_item(pager, FOLDER_TOTAL, &missing) && missing == -1);
+    CHECK(!jellyfin_pager_item(pager, 150, &missing) && missing == 1);
+    CHECK(!jellyfin_pager_request(&pager, 1));
+
+    // The fetch of page 1 was dropped (e.g. the user went up a level).
+    jellyfin_pager_forget_requests(&pager);
+    CHECK(jellyfin_pager_request(&pager, 1));
+
+    // A failed page keeps the known total and can be asked for again.
+    jellyfin_pager_store(&pager, 1, false, &page);
+    CHECK(pager.total == FOLDER_TOTAL && jellyfin_pager_request(&pager, 1));
+
+    // A failed first page shows an empty folder instead of loading forever.
+    JellyfinPager failed;
+    CHECK(jellyfin_pager_request(&failed, 0));
+    jellyfin_pager_store(&failed, 0, false, &page);
+    CHECK(failed.total == 0);
+}
+
+static void test_cache_record() {
+    JellyfinCachedResponse resp;
+    resp.etag = "\"a3f6c0de\"";
+    resp.last_modified = "Sat, 02 Mar 2024 18:12:03 GMT";
+    resp.body = load_fixture("items_page0.json");
+
+    std::vector<uint8_t> data = jellyfin_cache_encode(resp);
+    JellyfinCachedResponse back;
+    CHECK(jellyfin_cache_decode(data, resp.body.size(), &back));
+    CHECK(back.etag == resp.etag && back.last_modified == resp.last_modified && back.body == resp.body);
+
+    // A body over the limit, a torn file and a foreign file are all misses.
+    CHECK(!jellyfin_cache_decode(data, resp.body.size() - 1, &back));
+    std::vector<uint8_t> torn(data.begin(), data.end() - 10);
+    CHECK(!jellyfin_cache_decode(torn, resp.body.size(), &back));
+    data[0] ^= 0xff;
+    CHECK(!jellyfin_cache_decode(data, resp.body.size(), &back));
+
+    std::vector<std::string> headers = jellyfin_revalidate_headers(resp);
+    CHECK(headers.size() == 2);
+    CHECK(headers[0] == "If-None-Match: \"a3f6c0de\"");
+    CHECK(headers[1] == "If-Modified-Since: Sat, 02 Mar 2024 18:12:03 GMT");
+    resp.etag.clear();
+    CHECK(jellyfin_revalidate_headers(resp).size() == 1);
+}
+
+static void test_cache_use() {
+    CHECK(jellyfin_cache_use(false, true, 200) == JellyfinCacheUse::Fresh);
+    CHECK(jellyfin_cache_use(true, true, 200) == JellyfinCacheUse::Fresh);
+    CHECK(jellyfin_cache_use(true, true, 304) == JellyfinCacheUse::Cached);
+    CHECK(jellyfin_cache_use(true, true, 500) == JellyfinCacheUse::Cached);
+    CHECK(jellyfin_cache_use(true, false, 0) == JellyfinCacheUse::Cached);
+    CHECK(jellyfin_cache_use(false, true, 304) == JellyfinCacheUse::Fail);
+    CHECK(jellyfin_cache_use(false, true, 404) == JellyfinCacheUse::Fail);
+    CHECK(jellyfin_cache_use(false, false, 0) == JellyfinCacheUse::Fail);
+}
+
+int main() {
+    test_parse_roots();
+    test_parse_page();
+    test_parse_errors();
+    test_items_path();
+    test_pager();
+    test_cache_record();
+    test_cache_use();
+    return check_result();
+}
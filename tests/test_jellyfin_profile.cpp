@@ -0,0 +1,272 @@
+#include "check.hpp"
+#include "fixture.hpp"
+#include "network/jellyfin_profile.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <jansson.h>
+#include <string>
+
+static JellyfinDeviceCaps hw_caps() {
+    JellyfinDeviceCaps caps;
+    caps.hw_h264 = true;
+    return caps;
+}
+
+static JellyfinMediaSource h264_source(int width, int height) {
+    JellyfinMediaSource src;
+    src.id = "a";
+    src.container = "mkv";
+    src.bitrate = 8000000;
+    src.supports_direct_play = true;
+    src.supports_transcoding = true;
+    src.transcoding_url = "/videos/a/master.m3u8";
+    src.has_video = true;
+    src.video.codec = "h264";
+    src.video.profile = "High";
+    src.video.pix_fmt = "yuv420p";
+    src.video.width = width;
+    src.video.height = height;
+    src.video.fps = 30.0;
+    src.video.level = 41;
+    src.audio_codec = "aac";
+    src.audio_channels = 2;
+    return src;
+}
+
+static JellyfinPlayDecision decide(const JellyfinDeviceCaps &caps, const JellyfinMediaSource &src) {
+    JellyfinPlaybackInfo info;
+    info.sources.push_back(src);
+    return jellyfin_decide(caps, info);
+}
+
+static bool has(const std::string &s, const char *part) { return s.find(part) != std::string::npos; }
+
+static void test_direct_play() {
+    JellyfinPlayDecision d = decide(hw_caps(), h264_source(1920, 1080));
+    CHECK(d.method == JellyfinPlayMethod::DirectPlay);
+    CHECK(d.source == 0);
+}
+
+static void test_hw_limits_transcode() {
+    // Beyond the HW row and too much for software: the server transcodes.
+    JellyfinMediaSource src = h264_source(1920, 1080);
+    src.video.interlaced = true;
+    JellyfinPlayDecision d = decide(hw_caps(), src);
+    CHECK(d.method == JellyfinPlayMethod::Transcode);
+    CHECK(has(d.reason, "interlaced"));
+
+    src = h264_source(1920, 1080);
+    src.video.profile = "High 4:2:2";
+    src.video.pix_fmt.clear();
+    d = decide(hw_caps(), src);
+    CHECK(d.method == JellyfinPlayMethod::Transcode);
+    CHECK(has(d.reason, "4:2:0"));
+
+    src = h264_source(1920, 1080);
+    src.video.pix_fmt = "yuv444p";
+    d = decide(hw_caps(), src);
+    CHECK(d.method == JellyfinPlayMethod::Transcode);
+
+    src = h264_source(1920, 1080);
+    src.video.level = 51;
+    d = decide(hw_caps(), src);
+    CHECK(d.method == JellyfinPlayMethod::Transcode);
+    CHECK(has(d.reason, "level"));
+}
+
+static void test_software_budget() {
+    // Small interlaced H.264 is within what the software decoder sustains.
+    JellyfinMediaSource src = h264_source(640, 360);
+    src.video.interlaced = true;
+    CHECK(decide(hw_caps(), src).method == JellyfinPlayMethod::DirectPlay);
+
+    JellyfinDeviceCaps caps;
+    src = h264_source(1280, 720);
+    src.video.codec = "mpeg4";
+    src.video.profile.clear();
+    CHECK(decide(caps, src).method == JellyfinPlayMethod::Transcode);
+    caps.sw_pixels_per_sec = 40000000.0;
+    CHECK(decide(caps, src).method == JellyfinPlayMethod::DirectPlay);
+
+    // Without the HW decoder 1080p H.264 is over the software budget.
+    CHECK(decide(caps, h264_source(1920, 1080)).method == JellyfinPlayMethod::Transcode);
+}
+
+static void test_formats() {
+    JellyfinMediaSource src = h264_source(1920, 1080);
+    src.video.codec = "hevc";
+    src.video.profile = "Main 10";
+    src.video.bit_depth = 10;
+    std::string why;
+    CHECK(!jellyfin_source_playable(hw_caps(), src, &why));
+    CHECK(has(why, "10-bit"));
+
+    src = h264_source(1920, 1080);
+    src.video.codec = "av1";
+    CHECK(!jellyfin_source_playable(hw_caps(), src, &why));
+    CHECK(has(why, "av1"));
+
+    src = h264_source(1920, 1080);
+    src.audio_codec = "dts";
+    CHECK(!jellyfin_source_playable(hw_caps(), src, &why));
+    CHECK(has(why, "audio codec"));
+}
+
+static void test_source_choice() {
+    JellyfinPlaybackInfo info;
+    JellyfinMediaSource bad = h264_source(1920, 1080);
+    bad.video.bit_depth = 10;
+    info.sources.push_back(bad);
+    info.sources.push_back(h264_source(1280, 720));
+    JellyfinPlayDecision d = jellyfin_decide(hw_caps(), info);
+    CHECK(d.method == JellyfinPlayMethod::DirectPlay);
+    CHECK(d.source == 1);
+
+    bad.supports_transcoding = false;
+    info.sources.assign(1, bad);
+    d = jellyfin_decide(hw_caps(), info);
+    CHECK(d.method == JellyfinPlayMethod::Unplayable);
+    CHECK(has(d.reason, "10-bit"));
+}
+
+static bool parse_fixture(const char *name, JellyfinPlaybackInfo *info) {
+    std::string json = load_fixture(name);
+    return jellyfin_parse_playback_info(json.data(), json.size(), info);
+}
+
+static void test_parse_direct() {
+    JellyfinPlaybackInfo info;
+    CHECK(parse_fixture("playback_info_direct.json", &info));
+    CHECK(info.play_session_id == "5d2a0e9c1f7b4e3a8c6d0b9e2f1a4c7d");
+    CHECK(info.sources.size() == 1);
+    const JellyfinMediaSource &src = info.sources[0];
+    CHECK(src.id == "a3f6c0de41b2e8a9c7d15f0e2b4a6c81");
+    CHECK(src.container == "mkv");
+    CHECK(src.bitrate == 9960044);
+    CHECK(src.supports_direct_play && src.supports_transcoding);
+    CHECK(has(src.transcoding_url, "master.m3u8"));
+    CHECK(src.has_video);
+    CHECK(src.video.codec == "h264" && src.video.profile == "High" && src.video.pix_fmt == "yuv420p");
+    CHECK(src.video.width == 1920 && src.video.height == 1080 && src.video.level == 41);
+    CHECK(src.video.bit_depth == 8 && !src.video.interlaced);
+    CHECK(std::fabs(src.video.fps - 23.976) < 0.01);
+    // DefaultAudioStreamIndex picks the second audio stream, not the first.
+    CHECK(src.audio_codec == "aac" && src.audio_channels == 2);
+
+    JellyfinPlayDecision d = jellyfin_decide(hw_caps(), info);
+    CHECK(d.method == JellyfinPlayMethod::DirectPlay && d.source == 0);
+}
+
+static void test_parse_transcode_only() {
+    JellyfinPlaybackInfo info;
+    CHECK(parse_fixture("playback_info_transcode_only.json", &info));
+    CHECK(info.sources.size() == 1);
+    const JellyfinMediaSource &src = info.sources[0];
+    CHECK(!src.supports_direct_play && src.supports_transcoding);
+    CHECK(src.video.codec == "hevc" && src.video.profile == "Main 10" && src.video.bit_depth == 10);
+    CHECK(src.video.width == 3840 && src.video.fps == 24.0);
+    CHECK(src.audio_codec == "eac3" && src.audio_channels == 8);
+
+    JellyfinPlayDecision d = jellyfin_decide(hw_caps(), info);
+    CHECK(d.method == JellyfinPlayMethod::Transcode && d.source == 0);
+}
+
+static void test_parse_versions() {
+    JellyfinPlaybackInfo info;
+    CHECK(parse_fixture("playback_info_versions.json", &info));
+    CHECK(info.sources.size() == 2);
+    CHECK(info.sources[0].video.interlaced);
+    CHECK(std::fabs(info.sources[0].video.fps - 29.97) < 0.01); // AverageFrameRate when RealFrameRate is missing
+    CHECK(info.sources[1].video.profile == "Main" && info.sources[1].video.level == 31);
+    CHECK(info.sources[1].transcoding_url.empty());
+    CHECK(info.sources[1].audio_codec == "aac");
+
+    // The interlaced version is beyond the HW decoder and too big for software.
+    JellyfinPlayDecision d = jellyfin_decide(hw_caps(), info);
+    CHECK(d.method == JellyfinPlayMethod::DirectPlay && d.source == 1);
+
+    std::string why;
+    CHECK(!jellyfin_source_playable(hw_caps(), info.sources[0], &why));
+    CHECK(has(why, "interlaced"));
+}
+
+static void test_parse_errors() {
+    JellyfinPlaybackInfo info;
+    CHECK(!parse_fixture("playback_info_error.json", &info));
+    const char bad[] = "{\"MediaSources\": [";
+    CHECK(!jellyfin_parse_playback_info(bad, strlen(bad), &info));
+}
+
+static json_t *find_codec_profile(json_t *profile, const char *type, const char *codec) {
+    size_t i;
+    json_t *p;
+    json_array_foreach(json_object_get(profile, "CodecProfiles"), i, p) {
+        json_t *c = json_object_get(p, "Codec");
+        if (!strcmp(json_string_value(json_object_get(p, "Type")), type) && json_is_string(c) && !strcmp(json_string_value(c), codec)) return p;
+    }
+    return nullptr;
+}
+
+static const char *condition_value(json_t *codec_profile, const char *property) {
+    size_t i;
+    json_t *c;
+    json_array_foreach(json_object_get(codec_profile, "Conditions"), i, c) {
+        if (!strcmp(json_string_value(json_object_get(c, "Property")), property)) return json_string_value(json_object_get(c, "Value"));
+    }
+    return nullptr;
+}
+
+static void test_request_body() {
+    JellyfinDeviceCaps caps = hw_caps();
+    std::string body = jellyfin_build_playback_request(caps, true);
+    json_error_t error;
+    json_t *root = json_loadb(body.data(), body.size(), 0, &error);
+    CHECK(root != nullptr);
+    if (!root) return;
+
+    CHECK(json_is_true(json_object_get(root, "EnableDirectPlay")));
+    CHECK(json_is_true(json_object_get(root, "EnableTranscoding")));
+    CHECK(json_integer_value(json_object_get(root, "MaxStreamingBitrate")) == caps.max_bitrate);
+
+    json_t *profile = json_object_get(root, "DeviceProfile");
+    json_t *transcode = json_array_get(json_object_get(profile, "TranscodingProfiles"), 0);
+    CHECK(!strcmp(json_string_value(json_object_get(transcode, "Protocol")), "hls"));
+    CHECK(!strcmp(json_string_value(json_object_get(transcode, "VideoCodec")), "h264"));
+
+    // The HW row's limits, with 4:2:2 and 4:4:4 profiles and interlacing kept out.
+    json_t *h264 = find_codec_profile(profile, "Video", "h264");
+    CHECK(h264 != nullptr);
+    if (h264) {
+        CHECK(condition_value(h264, "Width") && !strcmp(condition_value(h264, "Width"), "1920"));
+        CHECK(condition_value(h264, "VideoLevel") && !strcmp(condition_value(h264, "VideoLevel"), "42"));
+        const char *profiles = condition_value(h264, "VideoProfile");
+        CHECK(profiles && strstr(profiles, "high") && strstr(profiles, "main") && !strstr(profiles, "4:2:2"));
+        CHECK(condition_value(h264, "IsInterlaced") && !strcmp(condition_value(h264, "IsInterlaced"), "false"));
+    }
+    json_decref(root);
+
+    // Without the HW decoder H.264 only appears in the software profile.
+    caps.hw_h264 = false;
+    body = jellyfin_build_playback_request(caps, false);
+    root = json_loadb(body.data(), body.size(), 0, &error);
+    CHECK(root != nullptr);
+    if (!root) return;
+    CHECK(json_is_false(json_object_get(root, "EnableDirectPlay")));
+    CHECK(!find_codec_profile(json_object_get(root, "DeviceProfile"), "Video", "h264"));
+    json_decref(root);
+}
+
+int main() {
+    test_direct_play();
+    test_hw_limits_transcode();
+    test_software_budget();
+    test_formats();
+    test_source_choice();
+    test_parse_direct();
+    test_parse_transcode_only();
+    test_parse_versions();
+    test_parse_errors();
+    test_request_body();
+    return check_result();
+}
@@ -0,0 +1,132 @@
+#include "check.hpp"
+#include "utils/media_layout.hpp"
+
+#include <cstring>
+#include <vector>
+
+// A file assembled in memory from top-level boxes.
+struct Buffer {
+    std::vector<uint8_t> data;
+
+    void box(const char *type, uint32_t size) {
+        size_t at = data.size();
+        data.resize(at + size);
+        data[at] = (uint8_t)(size >> 24);
+        data[at + 1] = (uint8_t)(size >> 16);
+        data[at + 2] = (uint8_t)(size >> 8);
+        data[at + 3] = (uint8_t)size;
+        memcpy(&data[at + 4], type, 4);
+    }
+
+    // size 1 and the real size after the type.
+    void box64(const char *type, uint64_t size) {
+        size_t at = data.size();
+        data.resize(at + size);
+        data[at + 3] = 1;
+        memcpy(&data[at + 4], type, 4);
+        for (int i = 0; i < 8; ++i)
+            data[at + 8 + i] = (uint8_t)(size >> (56 - 8 * i));
+    }
+};
+
+static bool read_buffer(void *opaque, int64_t offset, uint8_t *buf, size_t len) {
+    const Buffer *b = (const Buffer *)opaque;
+    if (offset < 0 || (size_t)offset + len > b->data.size()) return false;
+    memcpy(buf, &b->data[offset], len);
+    return true;
+}
+
+static bool scan(Buffer &b, std::vector<LayoutAtom> *atoms) { return media_layout_scan_atoms(read_buffer, &b, (int64_t)b.data.size(), atoms); }
+
+static LayoutVerdict classify(Buffer &b, double skew) {
+    std::vector<LayoutAtom> atoms;
+    if (!scan(b, &atoms)) return LayoutVerdict::Unsupported;
+    return media_layout_classify(atoms, skew);
+}
+
+static void test_moov_first() {
+    Buffer b;
+    b.box("ftyp", 24);
+    b.box("moov", 400);
+    b.box("mdat", 4000);
+    std::vector<LayoutAtom> atoms;
+    CHECK(scan(b, &atoms));
+    CHECK(atoms.size() == 3);
+    CHECK(atoms[1].offset == 24 && atoms[1].size == 400);
+    CHECK(atoms[2].offset == 424);
+    CHECK(media_layout_classify(atoms, 0.0) == LayoutVerdict::Good);
+    CHECK(media_layout_classify(atoms, LAYOUT_REMUX_SKEW_SECONDS * 2) == LayoutVerdict::Interleave);
+}
+
+static void test_moov_at_end() {
+    Buffer b;
+    b.box("ftyp", 24);
+    b.box("free", 8);
+    b.box64("mdat", 4000);
+    b.box("moov", 400);
+    std::vector<LayoutAtom> atoms;
+    CHECK(scan(b, &atoms));
+    CHECK(atoms.size() == 4 && atoms[2].size == 4000);
+    CHECK(media_layout_classify(atoms, 0.0) == LayoutVerdict::MoovAtEnd);
+}
+
+static void test_fragmented() {
+    Buffer b;
+    b.box("ftyp", 24);
+    b.box("moov", 400);
+    b.box("moof", 100);
+    b.box("mdat", 2000);
+    b.box("moof", 100);
+    b.box("mdat", 2000);
+    CHECK(classify(b, 0.0) == LayoutVerdict::Unsupported);
+}
+
+static void test_malformed() {
+    // The last box claims more than the file holds.
+    Buffer b;
+    b.box("ftyp", 24);
+    b.box("moov", 400);
+    b.box("mdat", 4000);
+    b.data.resize(b.data.size() - 100);
+    std::vector<LayoutAtom> atoms;
+    CHECK(!scan(b, &atoms));
+
+    // A header cut off after four bytes.
+    Buffer c;
+    c.box("ftyp", 24);
+    c.data.resize(c.data.size() + 4);
+    CHECK(!scan(c, &atoms));
+
+    // Not an ISO BMFF file at all.
+    Buffer d;
+    d.box("RIFF", 64);
+    CHECK(!scan(d, &atoms));
+
+    // A box smaller than its own header.
+    Buffer e;
+    e.box("ftyp", 24);
+    e.box("moov", 16);
+    e.data[27] = 4;
+    CHECK(!scan(e, &atoms));
+}
+
+static void test_skew() {
+    // Audio stored in one block after all the video: the last video sample
+    // sits next to audio from the start.
+    std::vector<IndexPoint> video = {{1000, 0.0}, {2000, 5.0}, {3000, 10.0}};
+    std::vector<IndexPoint> audio = {{500, 0.0}, {4000, 5.0}, {5000, 10.0}};
+    CHECK(media_layout_interleave_skew(video, audio) == 10.0);
+
+    std::vector<IndexPoint> mixed = {{900, 0.0}, {1900, 5.0}, {2900, 10.0}};
+    CHECK(media_layout_interleave_skew(video, mixed) == 0.0);
+    CHECK(media_layout_interleave_skew(video, {}) == 0.0);
+}
+
+int main() {
+    test_moov_first();
+    test_moov_at_end();
+    test_fragmented();
+    test_malformed();
+    test_skew();
+    return check_result();
+}
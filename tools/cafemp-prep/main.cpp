@@ -0,0 +1,248 @@
+// cafemp-prep: works out on a PC what the console would otherwise compute on
+// the first open of every file, and writes it in the formats the app reads.
+//
+//   cafemp-prep [-j jobs] [-f] <media dir> <console prefix> <cache dir>
+//
+// media dir is a folder on the mounted SD card or USB drive, console prefix
+// is how the app names that same folder (video:/, audio:/, usb:/Movies/...),
+// and cache dir is the app's cache folder on the SD card
+// (wiiu/apps/cafemp/cache/). Every file gets its stream-info entry and every
+// video its browser poster frame. Re-runs only touch files that changed.
+//
+// Keyframe index sidecars, seek-bar sprites, photo thumbnails and a library
+// index are not written: the app has no on-disk format for them. Seeking uses
+// the container's own index, the seek bar and photo rows show no thumbnails
+// and the browser lists folders as it enters them.
+
+#include "player/faststart.hpp"
+#include "player/frame_thumb.hpp"
+#include "player/poster_store.hpp"
+#include "player/stream_cache.hpp"
+#include "utils/byte_stream.hpp"
+#include "utils/media_layout.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/log.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define PREP_MAX_CACHE_FILE (4 * 1024 * 1024)
+
+// What the console's file browser lists as audio or video.
+static const char *media_extensions[] = {"mp4", "mov", "avi", "mkv", "mp3", "wav", "ogg", "flac", "aac"};
+// The rows it draws a poster frame for.
+static const char *video_extensions[] = {"mp4", "mov", "avi", "mkv"};
+
+struct Job {
+    fs::path host_path;
+    std::string console_path;
+    bool video = false;
+    LayoutVerdict layout = LayoutVerdict::Unsupported;
+};
+
+enum class Outcome { Written, UpToDate, Failed };
+
+static std::string stream_dir; // cache dir + streaminfo/
+static std::string poster_dir; // cache dir + posters/
+static bool force = false;
+static std::mutex print_mtx;
+
+static std::string lower_extension(const fs::path &p) {
+    std::string ext = p.extension().string();
+    if (!ext.empty()) ext.erase(0, 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+static bool has_extension(const fs::path &p, const char *const *list, size_t n) {
+    std::string ext = lower_extension(p);
+    for (size_t i = 0; i < n; ++i)
+        if (ext == list[i]) return true;
+    return false;
+}
+
+static bool is_media(const fs::path &p) { return has_extension(p, media_extensions, sizeof(media_extensions) / sizeof(media_extensions[0])); }
+static bool is_video(const fs::path &p) { return has_extension(p, video_extensions, sizeof(video_extensions) / sizeof(video_extensions[0])); }
+
+// The cache file is newer than the media and describes it under the same
+// console path and size.
+static bool matches(const Job &job, const std::string &cache_file, const StreamCacheKey &stored) {
+    std::error_code ec;
+    return fs::last_write_time(cache_file, ec) >= fs::last_write_time(job.host_path, ec) && stored.path == job.console_path && stored.size == (int64_t)fs::file_size(job.host_path, ec);
+}
+
+static bool stream_info_up_to_date(const Job &job, const std::string &cache_file) {
+    std::vector<uint8_t> data;
+    StreamCacheEntry e;
+    if (!byte_stream_read_file(cache_file.c_str(), data, PREP_MAX_CACHE_FILE) || !stream_cache_deserialize(data.data(), data.size(), &e)) return false;
+    return matches(job, cache_file, e.key);
+}
+
+static bool poster_up_to_date(const Job &job, const std::string &cache_file) {
+    std::vector<uint8_t> data;
+    StreamCacheKey stored;
+    PosterFrame p;
+    if (!byte_stream_read_file(cache_file.c_str(), data, POSTER_MAX_FILE) || !poster_deserialize(data.data(), data.size(), &stored, &p)) return false;
+    return matches(job, cache_file, stored);
+}
+
+static bool read_at(void *opaque, int64_t offset, uint8_t *buf, size_t len) {
+    FILE *f = (FILE *)opaque;
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0 && fread(buf, 1, len, f) == len;
+}
+
+// Same verdict the console's background remuxer would reach.
+static LayoutVerdict check_layout(const Job &job, AVFormatContext *fmt) {
+    std::string ext = lower_extension(job.host_path);
+    if (ext != "mp4" && ext != "mov") return LayoutVerdict::Unsupported;
+
+    std::vector<LayoutAtom> atoms;
+    FILE *f = fopen(job.host_path.c_str(), "rb");
+    if (!f) return LayoutVerdict::Unsupported;
+    std::error_code ec;
+    bool ok = media_layout_scan_atoms(read_at, f, (int64_t)fs::file_size(job.host_path, ec), &atoms);
+    fclose(f);
+    if (!ok) return LayoutVerdict::Unsupported;
+
+    int vidx = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    int aidx = av_find_best_stream(fmt, AVMEDIA_TYPE_AUDIO, -1, vidx, nullptr, 0);
+    double skew = 0.0;
+    if (vidx >= 0 && aidx >= 0) skew = media_layout_interleave_skew(faststart_index_points(fmt->streams[vidx], LAYOUT_INDEX_POINTS), faststart_index_points(fmt->streams[aidx], LAYOUT_INDEX_POINTS));
+    return media_layout_classify(atoms, skew);
+}
+
+// The frame the console's browser worker would pick. A video without a
+// usable frame gets an empty entry, as it does there.
+static bool write_poster(AVFormatContext *fmt, const StreamCacheKey &key, const std::string &file) {
+    PosterFrame p;
+    int vidx = -1;
+    AVCodecContext *avctx = frame_thumb_open_decoder(fmt, POSTER_MAX_W, POSTER_MAX_H, &vidx);
+    if (avctx) poster_pick_frame(fmt, avctx, vidx, nullptr, nullptr, &p);
+    avcodec_free_context(&avctx);
+    return byte_stream_write_file(file.c_str(), poster_serialize(key, p));
+}
+
+static Outcome prepare(Job &job) {
+    StreamCacheKey key;
+    key.path = job.console_path;
+    std::error_code ec;
+    key.size = (int64_t)fs::file_size(job.host_path, ec);
+    key.mtime = STREAM_CACHE_MTIME_ANY;
+    if (ec) return Outcome::Failed;
+
+    std::string info_file = stream_cache_file_for_key(stream_dir.c_str(), key);
+    std::string poster_file = poster_store_file_for_key(poster_dir.c_str(), key);
+    bool need_info = force || !stream_info_up_to_date(job, info_file);
+    bool need_poster = job.video && (force || !poster_up_to_date(job, poster_file));
+    if (!need_info && !need_poster) return Outcome::UpToDate;
+
+    // A full probe: the host has the time the console's 32 KiB probe does not.
+    AVFormatContext *fmt = nullptr;
+    if (avformat_open_input(&fmt, job.host_path.c_str(), nullptr, nullptr) < 0) return Outcome::Failed;
+    if (avformat_find_stream_info(fmt, nullptr) < 0) {
+        avformat_close_input(&fmt);
+        return Outcome::Failed;
+    }
+
+    bool ok = true;
+    if (need_info) {
+        StreamCacheEntry e;
+        stream_cache_capture(fmt, key, &e);
+        job.layout = check_layout(job, fmt);
+        ok = byte_stream_write_file(info_file.c_str(), stream_cache_serialize(e));
+    }
+    // Last: the poster decoder discards every stream but the video.
+    if (need_poster && !write_poster(fmt, key, poster_file)) ok = false;
+    avformat_close_input(&fmt);
+    return ok ? Outcome::Written : Outcome::Failed;
+}
+
+static void usage() { fprintf(stderr, "usage: cafemp-prep [-j jobs] [-f] <media dir> <console prefix> <cache dir>\n"); }
+
+int main(int argc, char **argv) {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<const char *> args;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            threads = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-f"))
+            force = true;
+        else
+            args.push_back(argv[i]);
+    }
+    if (args.size() != 3) {
+        usage();
+        return 2;
+    }
+
+    fs::path root = args[0];
+    std::string prefix = args[1];
+    std::string cache_dir = args[2];
+    if (!prefix.empty() && prefix.back() != '/') prefix += '/';
+    if (!cache_dir.empty() && cache_dir.back() != '/') cache_dir += '/';
+    stream_dir = cache_dir + "streaminfo/";
+    poster_dir = cache_dir + "posters/";
+
+    std::error_code ec;
+    fs::create_directories(stream_dir, ec);
+    fs::create_directories(poster_dir, ec);
+    if (!fs::is_directory(root, ec) || !fs::is_directory(stream_dir, ec) || !fs::is_directory(poster_dir, ec)) {
+        usage();
+        return 2;
+    }
+
+    std::vector<Job> jobs;
+    for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec); it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec || !it->is_regular_file(ec) || !is_media(it->path())) continue;
+        Job job;
+        job.host_path = it->path();
+        job.console_path = prefix + fs::relative(it->path(), root, ec).generic_string();
+        job.video = is_video(it->path());
+        jobs.push_back(std::move(job));
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) { return a.console_path < b.console_path; });
+
+    av_log_set_level(AV_LOG_ERROR);
+    std::atomic<size_t> next{0};
+    std::atomic<int> written{0}, unchanged{0}, failed{0};
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < std::min<size_t>(threads, jobs.size()); ++t) {
+        pool.emplace_back([&] {
+            for (size_t i; (i = next++) < jobs.size();) {
+                Outcome o = prepare(jobs[i]);
+                std::lock_guard<std::mutex> lk(print_mtx);
+                if (o == Outcome::Written) {
+                    written++;
+                    printf("%s\n", jobs[i].console_path.c_str());
+                } else if (o == Outcome::UpToDate) {
+                    unchanged++;
+                } else {
+                    failed++;
+                    fprintf(stderr, "cannot prepare %s\n", jobs[i].host_path.c_str());
+                }
+            }
+        });
+    }
+    for (std::thread &t : pool)
+        t.join();
+
+    for (const Job &job : jobs)
+        if (job.layout == LayoutVerdict::MoovAtEnd || job.layout == LayoutVerdict::Interleave) printf("%s: %s, the console will remux it\n", job.console_path.c_str(), media_layout_verdict_name(job.layout));
+    printf("%zu files: %d prepared, %d up to date, %d failed\n", jobs.size(), written.load(), unchanged.load(), failed.load());
+    return failed ? 1 : 0;
+}